@@ -0,0 +1,173 @@
+// Inserts addresses into an AvailableList the way trackers, PEX and
+// DHT feed it, comparing the hashed list with the previous one that
+// searched the whole vector for duplicates.
+//
+// Trackers reply with large batches that mostly repeat earlier
+// replies, PEX messages are smaller with many addresses already known,
+// and DHT replies are a handful of mostly new addresses. A fifth of
+// the addresses are IPv6.
+//
+// Usage: bench_available_list [addresses]
+
+#include "config.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "download/available_list.h"
+#include "net/address_list.h"
+#include "torrent/peer/peer_list.h"
+
+typedef std::chrono::steady_clock clock_type;
+
+// The previous implementation, callers sorted and uniqued the lists.
+class linear_available_list : private std::vector<rak::socket_address> {
+public:
+  typedef std::vector<rak::socket_address> base_type;
+
+  using base_type::size;
+
+  void
+  push_back(const rak::socket_address* sa) {
+    if (std::find(begin(), end(), *sa) != end())
+      return;
+
+    base_type::push_back(*sa);
+  }
+
+  void
+  insert(torrent::AddressList* l) {
+    l->sort();
+    l->unique();
+
+    for (const auto& sa : *l)
+      push_back(&sa);
+  }
+};
+
+class hashed_available_list : public torrent::AvailableList {
+public:
+  void
+  insert(torrent::AddressList* l) {
+    for (const auto& sa : *l)
+      push_back(&sa);
+  }
+};
+
+class peer_list_available_list {
+public:
+  size_t size() { return m_peer_list.available_list_size(); }
+
+  void insert(torrent::AddressList* l) { m_peer_list.insert_available(l); }
+
+private:
+  torrent::PeerList m_peer_list;
+};
+
+struct source_type {
+  const char* name;
+  unsigned int batch_size;
+  unsigned int repeat_percent;
+  unsigned int weight;
+};
+
+static const source_type sources[] = {
+  { "tracker", 200, 60, 1 },
+  { "pex",      50, 40, 6 },
+  { "dht",       8, 10, 20 },
+};
+
+static rak::socket_address
+make_address(std::mt19937& rng) {
+  rak::socket_address sa;
+  sa.clear();
+
+  if (rng() % 5 == 0) {
+    in6_addr address;
+    for (auto& part : address.s6_addr32)
+      part = rng();
+
+    sa.sa_inet6()->clear();
+    sa.sa_inet6()->set_address(address);
+    sa.sa_inet6()->set_port(1024 + rng() % 60000);
+  } else {
+    sa.sa_inet()->clear();
+    sa.sa_inet()->set_address_h(rng());
+    sa.sa_inet()->set_port(1024 + rng() % 60000);
+  }
+
+  return sa;
+}
+
+// Builds the batches up front so only the inserts are timed.
+static std::vector<torrent::AddressList>
+make_batches(unsigned int addresses, unsigned int* total) {
+  std::mt19937 rng(1);
+  std::vector<rak::socket_address> seen;
+  std::vector<torrent::AddressList> batches;
+
+  unsigned int weight_total = 0;
+
+  for (const auto& source : sources)
+    weight_total += source.weight;
+
+  *total = 0;
+
+  while (seen.size() < addresses) {
+    unsigned int pick = rng() % weight_total;
+    const source_type* source = sources;
+
+    while (pick >= source->weight)
+      pick -= (source++)->weight;
+
+    batches.emplace_back();
+
+    for (unsigned int i = 0; i != source->batch_size; i++) {
+      if (!seen.empty() && rng() % 100 < source->repeat_percent) {
+        batches.back().push_back(seen[rng() % seen.size()]);
+      } else {
+        seen.push_back(make_address(rng));
+        batches.back().push_back(seen.back());
+      }
+    }
+
+    *total += source->batch_size;
+  }
+
+  return batches;
+}
+
+template <typename List>
+static void
+run(const char* name, std::vector<torrent::AddressList> batches, unsigned int total) {
+  List list;
+  auto start = clock_type::now();
+
+  for (auto& batch : batches)
+    list.insert(&batch);
+
+  double elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+
+  std::printf("%-14s %10.3f ms  %8.1f ns/address  size:%zu\n",
+              name, elapsed * 1e3, elapsed * 1e9 / total, (size_t)list.size());
+}
+
+int
+main(int argc, char** argv) {
+  unsigned int addresses = argc > 1 ? std::atoi(argv[1]) : 100000;
+  unsigned int total;
+
+  std::vector<torrent::AddressList> batches = make_batches(addresses, &total);
+
+  std::printf("unique:%u inserted:%u batches:%zu\n", addresses, total, batches.size());
+
+  run<linear_available_list>("linear", batches, total);
+  run<hashed_available_list>("hashed", batches, total);
+  run<peer_list_available_list>("peer list", batches, total);
+
+  return 0;
+}
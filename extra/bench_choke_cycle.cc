@@ -0,0 +1,171 @@
+// Runs choke_queue::cycle() over many connections spread across
+// choke groups, and compares ranking the group containers with a
+// full sort against the partial selection cycle() now uses.
+//
+// Usage: bench_choke_cycle [peers] [groups] [max unchoked] [group max slots] [cycles]
+
+#include "config.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+#include <netinet/in.h>
+
+#include "globals.h"
+#include "download/download_main.h"
+#include "protocol/peer_connection_base.h"
+#include "torrent/download/choke_group.h"
+#include "torrent/download/choke_queue.h"
+#include "torrent/download/group_entry.h"
+#include "torrent/peer/peer_info.h"
+#include "torrent/poll_select.h"
+#include "torrent/torrent.h"
+
+typedef std::chrono::steady_clock clock_type;
+typedef torrent::choke_queue::container_type container_type;
+
+// A connection without a socket, the choke messages are kept out of
+// the poll by leaving the write side busy.
+class bench_connection : public torrent::PeerConnectionBase {
+public:
+  bench_connection(torrent::DownloadMain* download, torrent::PeerInfo* peer_info, uint32_t rate) {
+    m_download = download;
+    m_peerInfo = peer_info;
+    m_up->set_state(ProtocolWrite::MSG);
+
+    peer_chunks()->download_throttle()->rate()->insert(rate);
+    peer_chunks()->upload_throttle()->rate()->insert(rate / 2);
+  }
+
+  void initialize_custom() override {}
+  void update_interested() override {}
+  bool receive_keepalive() override { return true; }
+
+  void event_read() override {}
+  void event_write() override {}
+};
+
+static void
+run_cycle(unsigned int peers, unsigned int groups, unsigned int max_unchoked, unsigned int group_slots, unsigned int cycles) {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<uint32_t> rate(0, 64 << 20);
+
+  torrent::DownloadMain download;
+  torrent::choke_group choke_group;
+  torrent::choke_queue* queue = choke_group.up_queue();
+
+  download.set_choke_group(&choke_group);
+
+  queue->set_heuristics(torrent::choke_queue::HEURISTICS_UPLOAD_LEECH);
+  queue->set_slot_connection(&torrent::PeerConnectionBase::receive_upload_choke);
+  queue->set_slot_unchoke([](int) {});
+  queue->set_slot_can_unchoke([] { return 0; });
+
+  std::vector<std::unique_ptr<torrent::group_entry>> entries;
+  std::vector<std::unique_ptr<torrent::PeerInfo>> peer_infos;
+  std::vector<std::unique_ptr<bench_connection>> connections;
+
+  for (unsigned int i = 0; i != groups; i++) {
+    entries.emplace_back(new torrent::group_entry);
+    entries.back()->set_max_slots(group_slots);
+    queue->group_container().push_back(entries.back().get());
+  }
+
+  sockaddr_in sa{};
+  sa.sin_family = AF_INET;
+
+  for (unsigned int i = 0; i != peers; i++) {
+    peer_infos.emplace_back(new torrent::PeerInfo(reinterpret_cast<sockaddr*>(&sa)));
+    connections.emplace_back(new bench_connection(&download, peer_infos.back().get(), rate(rng)));
+
+    connections.back()->up_choke()->set_entry(entries[i % groups].get());
+    queue->set_queued(connections.back().get(), connections.back()->up_choke());
+  }
+
+  queue->set_max_unchoked(max_unchoked);
+
+  int changed = 0;
+  auto start = clock_type::now();
+
+  for (unsigned int i = 0; i != cycles; i++)
+    changed += queue->cycle(max_unchoked);
+
+  double elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+
+  std::printf("cycle          %9.3f ms  %9.1f us/cycle  unchoked:%u queued:%u  (changed %i)\n",
+              elapsed * 1e3, elapsed * 1e6 / cycles, queue->size_unchoked(), queue->size_queued(), changed);
+
+  for (auto& connection : connections)
+    queue->disconnected(connection.get(), connection->up_choke());
+}
+
+// The ranking step alone, on containers of random weights the size of
+// each group's queued connections.
+static void
+run_ranking(const char* name, bool partial, unsigned int peers, unsigned int groups, unsigned int group_slots, unsigned int cycles) {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<uint32_t> weight(0, torrent::choke_queue::order_base - 1);
+
+  auto less = [](const torrent::weighted_connection& a, const torrent::weighted_connection& b) { return a.weight < b.weight; };
+
+  std::vector<container_type> containers(groups);
+
+  for (unsigned int i = 0; i != peers; i++)
+    containers[i % groups].emplace_back(nullptr, 0);
+
+  uint64_t sum = 0;
+  double elapsed = 0;
+
+  for (unsigned int i = 0; i != cycles; i++) {
+    for (auto& container : containers)
+      for (auto& value : container)
+        value.weight = weight(rng);
+
+    auto start = clock_type::now();
+
+    for (auto& container : containers) {
+      if (partial) {
+        auto middle = container.end() - std::min<size_t>(group_slots, container.size());
+
+        std::nth_element(container.begin(), middle, container.end(), less);
+        std::sort(middle, container.end(), less);
+      } else {
+        std::sort(container.begin(), container.end(), less);
+      }
+
+      sum += container.back().weight;
+    }
+
+    elapsed += std::chrono::duration<double>(clock_type::now() - start).count();
+  }
+
+  std::printf("%-14s %9.3f ms  %9.1f us/cycle  (sum %llu)\n",
+              name, elapsed * 1e3, elapsed * 1e6 / cycles, (unsigned long long)sum);
+}
+
+int
+main(int argc, char** argv) {
+  unsigned int peers        = argc > 1 ? std::atoi(argv[1]) : 10000;
+  unsigned int groups       = argc > 2 ? std::atoi(argv[2]) : 50;
+  unsigned int max_unchoked = argc > 3 ? std::atoi(argv[3]) : 200;
+  unsigned int group_slots  = argc > 4 ? std::atoi(argv[4]) : 8;
+  unsigned int cycles       = argc > 5 ? std::atoi(argv[5]) : 200;
+
+  std::printf("peers:%u groups:%u max_unchoked:%u group_max_slots:%u cycles:%u\n",
+              peers, groups, max_unchoked, group_slots, cycles);
+
+  torrent::Poll::slot_create_poll() = [] { return torrent::PollSelect::create(256); };
+  torrent::initialize();
+
+  run_cycle(peers, groups, max_unchoked, group_slots, cycles);
+
+  run_ranking("full sort", false, peers, groups, group_slots, cycles);
+  run_ranking("partial", true, peers, groups, group_slots, cycles);
+
+  torrent::cleanup();
+  return 0;
+}
@@ -0,0 +1,144 @@
+// Churns the objects a connection goes through, a handshake, the peer
+// connection and its block transfers, and counts heap allocations with
+// the pooled operator new against plain global allocation.
+//
+// The plain run uses '::new' and '::delete', which skip the class
+// specific operators just like before the pools were added. Only the
+// objects are churned, no sockets are opened.
+//
+// Usage: bench_connection_churn [live connections] [churns] [transfers per connection]
+
+#include "config.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "globals.h"
+#include "net/socket_fd.h"
+#include "net/throttle_list.h"
+#include "torrent/net/socket_address.h"
+#include "protocol/handshake.h"
+#include "protocol/handshake_manager.h"
+#include "protocol/peer_connection_leech.h"
+#include "torrent/data/block_transfer.h"
+#include "torrent/poll_select.h"
+#include "torrent/torrent.h"
+
+typedef std::chrono::steady_clock clock_type;
+typedef torrent::PeerConnection<torrent::Download::CONNECTION_LEECH> connection_type;
+
+static uint64_t allocations = 0;
+
+void*
+operator new(std::size_t size) {
+  allocations++;
+
+  if (void* ptr = std::malloc(size))
+    return ptr;
+
+  throw std::bad_alloc();
+}
+
+void
+operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void
+operator delete(void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+// The pools get their chunks from rak::cacheline_allocator, count
+// those too.
+extern "C" void*
+aligned_alloc(std::size_t alignment, std::size_t size) {
+  allocations++;
+  return ::memalign(alignment, size);
+}
+
+template <bool pooled, typename T, typename... Args>
+static T*
+create(Args... args) {
+  return pooled ? new T(args...) : ::new T(args...);
+}
+
+template <bool pooled, typename T>
+static void
+destroy(T* object) {
+  if (pooled)
+    delete object;
+  else
+    ::delete object;
+}
+
+template <bool pooled>
+static void
+run(const char* name, unsigned int live, unsigned int churns, unsigned int transfers) {
+  std::mt19937 rng(1);
+  torrent::HandshakeManager handshake_manager;
+
+  std::vector<torrent::PeerConnectionBase*> connections;
+  std::vector<torrent::BlockTransfer*> block_transfers;
+
+  for (unsigned int i = 0; i != live; i++)
+    connections.push_back(create<pooled, connection_type>());
+
+  for (unsigned int i = 0; i != live * transfers; i++)
+    block_transfers.push_back(create<pooled, torrent::BlockTransfer>());
+
+  uint64_t start_allocations = allocations;
+  auto start = clock_type::now();
+
+  for (unsigned int i = 0; i != churns; i++) {
+    torrent::Handshake* handshake = create<pooled, torrent::Handshake>(torrent::SocketFd(), &handshake_manager, 0);
+    destroy<pooled>(handshake);
+
+    torrent::PeerConnectionBase*& connection = connections[rng() % connections.size()];
+    destroy<pooled>(connection);
+    connection = create<pooled, connection_type>();
+
+    // The new connection's requests replace transfers that finished
+    // on other connections.
+    for (unsigned int j = 0; j != transfers; j++) {
+      torrent::BlockTransfer*& transfer = block_transfers[rng() % block_transfers.size()];
+      destroy<pooled>(transfer);
+      transfer = create<pooled, torrent::BlockTransfer>();
+    }
+  }
+
+  double elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+  uint64_t used = allocations - start_allocations;
+
+  std::printf("%-8s %9.3f ms  %7.1f ns/churn  allocations:%-9llu %.2f/churn\n",
+              name, elapsed * 1e3, elapsed * 1e9 / churns, (unsigned long long)used, (double)used / churns);
+
+  for (auto connection : connections)
+    destroy<pooled>(connection);
+
+  for (auto transfer : block_transfers)
+    destroy<pooled>(transfer);
+}
+
+int
+main(int argc, char** argv) {
+  unsigned int live      = argc > 1 ? std::atoi(argv[1]) : 1000;
+  unsigned int churns    = argc > 2 ? std::atoi(argv[2]) : 200000;
+  unsigned int transfers = argc > 3 ? std::atoi(argv[3]) : 8;
+
+  std::printf("live:%u churns:%u transfers:%u\n", live, churns, transfers);
+
+  torrent::Poll::slot_create_poll() = [] { return torrent::PollSelect::create(256); };
+  torrent::initialize();
+
+  run<false>("plain", live, churns, transfers);
+  run<true>("pooled", live, churns, transfers);
+
+  torrent::cleanup();
+  return 0;
+}
@@ -0,0 +1,170 @@
+// Creates the chunks of a synthetic torrent with many small files, and
+// compares the file lookup create_chunk() does with the linear scan it
+// replaced. The files are created sparse in a temporary directory,
+// mapping them does not touch the pages.
+//
+// Usage: bench_file_list_chunks [files] [max file size] [chunk size]
+
+#include "config.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "manager.h"
+#include "data/chunk.h"
+#include "torrent/bitfield.h"
+#include "torrent/data/file.h"
+#include "torrent/data/file_list.h"
+#include "torrent/data/file_manager.h"
+#include "torrent/poll_select.h"
+#include "torrent/torrent.h"
+
+typedef std::chrono::steady_clock clock_type;
+
+// Exposes the parts of FileList the download normally drives.
+class bench_file_list : public torrent::FileList {
+public:
+  using FileList::open_no_create;
+
+  using FileList::initialize;
+  using FileList::open;
+  using FileList::create_chunk_index;
+  using FileList::mark_completed;
+};
+
+static double
+elapsed_since(clock_type::time_point start) {
+  return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+// The previous lookup in create_chunk().
+static torrent::FileList::iterator
+linear_contains_position(torrent::FileList* file_list, uint64_t pos) {
+  return std::find_if(file_list->begin(), file_list->end(), [pos](torrent::File* file) {
+    return file->is_valid_position(pos);
+  });
+}
+
+template <typename Func>
+static void
+run_lookup(const char* name, torrent::FileList* file_list, Func func) {
+  uint64_t sum = 0;
+  auto start = clock_type::now();
+
+  for (uint32_t index = 0; index != file_list->size_chunks(); index++)
+    sum += (*func(file_list, (uint64_t)index * file_list->chunk_size()))->offset();
+
+  double elapsed = elapsed_since(start);
+
+  std::printf("%-16s %9.3f ms  %9.3f us/chunk  (sum %llu)\n",
+              name, elapsed * 1e3, elapsed * 1e6 / file_list->size_chunks(), (unsigned long long)sum);
+}
+
+int
+main(int argc, char** argv) {
+  unsigned int files      = argc > 1 ? std::atoi(argv[1]) : 200000;
+  unsigned int max_size   = argc > 2 ? std::atoi(argv[2]) : 64 << 10;
+  unsigned int chunk_size = argc > 3 ? std::atoi(argv[3]) : 4 << 20;
+
+  char root_template[] = "/tmp/bench_file_list_chunks.XXXXXX";
+
+  if (::mkdtemp(root_template) == NULL) {
+    std::perror("mkdtemp");
+    return 1;
+  }
+
+  std::string root = root_template;
+
+  torrent::Poll::slot_create_poll() = [] { return torrent::PollSelect::create(256); };
+  torrent::initialize();
+  torrent::manager->file_manager()->set_max_open_files(1024);
+
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<uint64_t> file_size(1, max_size);
+
+  std::vector<torrent::FileList::split_type> split_list;
+  uint64_t torrent_size = 0;
+
+  for (unsigned int i = 0; i != files; i++) {
+    torrent::Path path;
+    path.push_back("dir" + std::to_string(i / 1000));
+    path.push_back("file" + std::to_string(i));
+
+    split_list.emplace_back(file_size(rng), path, 0);
+    torrent_size += std::get<0>(split_list.back());
+  }
+
+  std::unique_ptr<bench_file_list> file_list(new bench_file_list);
+  file_list->initialize(torrent_size, chunk_size);
+  file_list->split(file_list->begin(), &*split_list.begin(), &*split_list.end());
+  file_list->set_root_dir(root);
+
+  for (auto file : *file_list)
+    file->set_flags(torrent::File::flag_create_queued);
+
+  // Opened the way a download is, the files are only created by the
+  // second call.
+  auto start = clock_type::now();
+  file_list->open(bench_file_list::open_no_create);
+  file_list->open(0);
+
+  std::printf("files:%zu chunks:%u chunk_size:%u size:%llu open:%.0f ms\n",
+              file_list->size_files(), file_list->size_chunks(), chunk_size,
+              (unsigned long long)torrent_size, elapsed_since(start) * 1e3);
+
+  for (auto file : *file_list)
+    if (::truncate(file->frozen_path().c_str(), file->size_bytes()) != 0) {
+      std::perror("truncate");
+      return 1;
+    }
+
+  run_lookup("lookup linear", file_list.get(), &linear_contains_position);
+  run_lookup("lookup search", file_list.get(), &torrent::file_list_contains_position);
+
+  uint64_t parts = 0;
+  start = clock_type::now();
+
+  for (uint32_t index = 0; index != file_list->size_chunks(); index++) {
+    std::unique_ptr<torrent::Chunk> chunk(file_list->create_chunk_index(index, torrent::MemoryChunk::prot_read));
+
+    if (chunk == nullptr) {
+      std::printf("create_chunk failed for index %u\n", index);
+      break;
+    }
+
+    parts += std::distance(chunk->begin(), chunk->end());
+  }
+
+  double elapsed = elapsed_since(start);
+
+  std::printf("create_chunk     %9.3f ms  %9.3f us/chunk  parts:%llu\n",
+              elapsed * 1e3, elapsed * 1e6 / file_list->size_chunks(), (unsigned long long)parts);
+
+  // Download allocates the bitfield through its friend access to
+  // download_data, which is not available here.
+  torrent::Bitfield* bitfield = const_cast<torrent::Bitfield*>(file_list->bitfield());
+  bitfield->allocate();
+  bitfield->unset_all();
+
+  start = clock_type::now();
+
+  for (uint32_t index = 0; index != file_list->size_chunks(); index++)
+    file_list->mark_completed(index);
+
+  elapsed = elapsed_since(start);
+
+  std::printf("mark_completed   %9.3f ms  %9.3f us/chunk  completed:%u\n",
+              elapsed * 1e3, elapsed * 1e6 / file_list->size_chunks(), file_list->completed_chunks());
+
+  file_list.reset();
+  torrent::cleanup();
+
+  return std::system(("rm -rf " + root).c_str()) == 0 ? 0 : 1;
+}
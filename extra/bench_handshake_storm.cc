@@ -0,0 +1,235 @@
+// Opens many encrypted connections to a listening libtorrent at once
+// over loopback, and measures how long the main thread's event loop
+// stalls while the Diffie-Hellman work is done. The handshakes are run
+// with the HandshakeKeyPool workers, then with the pool stopped so the
+// keys and secrets are computed inline as before.
+//
+// Each client sends a public key and padding without a valid sync
+// string, so the handshake fails and the connection is closed right
+// after the shared secret is computed. No download is needed.
+//
+// Usage: bench_handshake_storm [connections]
+
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "globals.h"
+#include "manager.h"
+#include "thread_main.h"
+#include "protocol/handshake_key_pool.h"
+#include "protocol/handshake_manager.h"
+#include "torrent/connection_manager.h"
+#include "torrent/poll_select.h"
+#include "torrent/torrent.h"
+
+typedef std::chrono::steady_clock clock_type;
+
+static const unsigned int payload_size = 96 + 700;
+
+struct client_result {
+  double key_exchange_ms{-1};
+  double closed_ms{-1};
+};
+
+static double
+elapsed_ms(clock_type::time_point start) {
+  return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+}
+
+// Connects all clients at once and waits for the server to answer
+// with its key and then close the connection.
+static void
+run_clients(uint16_t port, unsigned int connections, std::vector<client_result>* results, std::atomic<bool>* done) {
+  std::mt19937 rng(1);
+  char payload[payload_size];
+
+  for (auto& c : payload)
+    c = rng();
+
+  sockaddr_in sa{};
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(port);
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  std::vector<pollfd> fds(connections);
+  std::vector<unsigned int> received(connections, 0);
+  std::vector<bool> sent(connections, false);
+
+  auto start = clock_type::now();
+
+  for (auto& pfd : fds) {
+    pfd.fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    pfd.events = POLLOUT | POLLIN;
+
+    if (::connect(pfd.fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0 && errno != EINPROGRESS) {
+      std::perror("connect");
+      std::exit(1);
+    }
+  }
+
+  unsigned int remaining = connections;
+
+  while (remaining != 0 && elapsed_ms(start) < 60000) {
+    if (::poll(fds.data(), fds.size(), 100) <= 0)
+      continue;
+
+    for (unsigned int i = 0; i != connections; i++) {
+      pollfd& pfd = fds[i];
+
+      if (pfd.fd == -1 || pfd.revents == 0)
+        continue;
+
+      if (!sent[i] && (pfd.revents & POLLOUT)) {
+        if (::write(pfd.fd, payload, payload_size) != payload_size) {
+          std::perror("write");
+          std::exit(1);
+        }
+
+        sent[i] = true;
+        pfd.events = POLLIN;
+      }
+
+      if (!(pfd.revents & (POLLIN | POLLHUP | POLLERR)))
+        continue;
+
+      char buffer[4096];
+      ssize_t result = ::read(pfd.fd, buffer, sizeof(buffer));
+
+      if (result > 0) {
+        received[i] += result;
+
+        if (received[i] >= 96 && (*results)[i].key_exchange_ms < 0)
+          (*results)[i].key_exchange_ms = elapsed_ms(start);
+
+        continue;
+      }
+
+      if (result < 0 && errno == EAGAIN)
+        continue;
+
+      (*results)[i].closed_ms = elapsed_ms(start);
+
+      ::close(pfd.fd);
+      pfd.fd = -1;
+      remaining--;
+    }
+  }
+
+  for (auto& pfd : fds)
+    if (pfd.fd != -1)
+      ::close(pfd.fd);
+
+  *done = true;
+}
+
+static double
+percentile(std::vector<double> values, double p) {
+  values.erase(std::remove_if(values.begin(), values.end(), [](double v) { return v < 0; }), values.end());
+
+  if (values.empty())
+    return -1;
+
+  std::sort(values.begin(), values.end());
+  return values[std::min<size_t>(values.size() - 1, values.size() * p)];
+}
+
+static void
+run(const char* name, uint16_t port, unsigned int connections) {
+  std::vector<client_result> results(connections);
+  std::atomic<bool> done{false};
+
+  unsigned int loops = 0;
+  double longest_loop = 0;
+  auto start = clock_type::now();
+
+  std::thread clients(&run_clients, port, connections, &results, &done);
+
+  while (!done || torrent::manager->handshake_manager()->size() != 0) {
+    auto loop_start = clock_type::now();
+
+    torrent::cachedTime = rak::timer::current();
+    rak::priority_queue_perform(&torrent::taskScheduler, torrent::cachedTime);
+
+    torrent::manager->poll()->do_poll(1000, torrent::Poll::poll_worker_thread);
+    torrent::manager->main_thread_main()->signal_bitfield()->work();
+
+    longest_loop = std::max(longest_loop, elapsed_ms(loop_start));
+    loops++;
+  }
+
+  clients.join();
+
+  double total = elapsed_ms(start);
+
+  std::vector<double> key_exchange;
+  std::vector<double> closed;
+
+  for (const auto& result : results) {
+    key_exchange.push_back(result.key_exchange_ms);
+    closed.push_back(result.closed_ms);
+  }
+
+  unsigned int completed = std::count_if(closed.begin(), closed.end(), [](double v) { return v >= 0; });
+
+  std::printf("%-7s total:%8.1f ms  completed:%u  key p50:%7.1f max:%7.1f ms  closed p50:%7.1f max:%7.1f ms  longest loop:%6.1f ms  loops:%u\n",
+              name, total, completed,
+              percentile(key_exchange, 0.5), percentile(key_exchange, 1.0),
+              percentile(closed, 0.5), percentile(closed, 1.0),
+              longest_loop, loops);
+}
+
+int
+main(int argc, char** argv) {
+  unsigned int connections = argc > 1 ? std::atoi(argv[1]) : 400;
+
+  torrent::Poll::slot_create_poll() = [] { return torrent::PollSelect::create(1024); };
+  torrent::initialize();
+
+  torrent::ConnectionManager* connection_manager = torrent::manager->connection_manager();
+
+  connection_manager->set_max_size(connections + 64);
+  connection_manager->set_encryption_options(torrent::ConnectionManager::encryption_allow_incoming);
+  connection_manager->set_listen_backlog(std::max<int>(SOMAXCONN, connections));
+
+  if (!connection_manager->listen_open(16881, 16999)) {
+    std::printf("could not open a listen port\n");
+    return 1;
+  }
+
+  std::printf("connections:%u port:%u workers:%u\n",
+              connections, connection_manager->listen_port(), torrent::HandshakeKeyPool::default_workers);
+
+  // Let the workers fill the stack of ready keys, as they would have
+  // well before a storm.
+  torrent::HandshakeKeyPool* key_pool = torrent::manager->handshake_key_pool();
+  auto wait_start = clock_type::now();
+
+  while (key_pool->size_ready() < torrent::HandshakeKeyPool::max_ready && elapsed_ms(wait_start) < 10000)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  std::printf("ready keys:%zu\n", key_pool->size_ready());
+
+  run("pool", connection_manager->listen_port(), connections);
+
+  key_pool->stop();
+  run("inline", connection_manager->listen_port(), connections);
+
+  connection_manager->listen_close();
+  torrent::cleanup();
+
+  return 0;
+}
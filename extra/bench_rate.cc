@@ -0,0 +1,134 @@
+// Compares torrent::Rate with the deque based implementation it
+// replaced, by feeding and reading many Rate objects as the peer
+// connections and throttles do each second.
+//
+// Usage: bench_rate [objects] [seconds] [inserts per second]
+
+#include "config.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "globals.h"
+#include "torrent/rate.h"
+
+typedef std::chrono::steady_clock clock_type;
+
+static uint64_t allocations = 0;
+
+void*
+operator new(std::size_t size) {
+  allocations++;
+
+  if (void* ptr = std::malloc(size))
+    return ptr;
+
+  throw std::bad_alloc();
+}
+
+void
+operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void
+operator delete(void* ptr, std::size_t) noexcept {
+  std::free(ptr);
+}
+
+// The previous implementation, a deque of per-second totals.
+class DequeRate {
+public:
+  typedef torrent::Rate::rate_type  rate_type;
+  typedef torrent::Rate::timer_type timer_type;
+
+  DequeRate(timer_type span) : m_current(0), m_span(span) {}
+
+  rate_type
+  rate() const {
+    discard_old();
+    return m_current / m_span;
+  }
+
+  void
+  insert(rate_type bytes) {
+    discard_old();
+
+    if (m_container.empty() || m_container.front().first != torrent::cachedTime.seconds())
+      m_container.emplace_front(torrent::cachedTime.seconds(), bytes);
+    else
+      m_container.front().second += bytes;
+
+    m_current += bytes;
+  }
+
+private:
+  void
+  discard_old() const {
+    while (!m_container.empty() && m_container.back().first < torrent::cachedTime.seconds() - m_span) {
+      m_current -= m_container.back().second;
+      m_container.pop_back();
+    }
+  }
+
+  mutable std::deque<std::pair<timer_type, rate_type>> m_container;
+  mutable rate_type m_current;
+  timer_type        m_span;
+};
+
+template <typename Rate, typename... Args>
+static void
+run(const char* name, unsigned int objects, unsigned int seconds, unsigned int inserts, Args... args) {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<unsigned int> pick(0, objects - 1);
+  std::uniform_int_distribution<unsigned int> bytes(1, 16 << 10);
+
+  torrent::cachedTime = rak::timer::from_seconds(1000000);
+
+  uint64_t start_allocations = allocations;
+  std::vector<Rate> rates;
+  rates.reserve(objects);
+
+  for (unsigned int i = 0; i != objects; i++)
+    rates.emplace_back(args...);
+
+  uint64_t sum = 0;
+  auto start = clock_type::now();
+
+  for (unsigned int second = 0; second != seconds; second++) {
+    torrent::cachedTime += rak::timer::from_seconds(1);
+
+    for (unsigned int i = 0; i != inserts; i++)
+      rates[pick(rng)].insert(bytes(rng));
+
+    // The choke queue and the client read the rates every tick.
+    for (auto& rate : rates)
+      sum += rate.rate();
+  }
+
+  double elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+
+  std::printf("%-14s %9.3f ms  %7.1f ns/op  allocations:%-9llu object:%zu bytes  (sum %llu)\n",
+              name, elapsed * 1e3, elapsed * 1e9 / ((double)seconds * (inserts + objects)),
+              (unsigned long long)(allocations - start_allocations), sizeof(Rate), (unsigned long long)sum);
+}
+
+int
+main(int argc, char** argv) {
+  unsigned int objects = argc > 1 ? std::atoi(argv[1]) : 50000;
+  unsigned int seconds = argc > 2 ? std::atoi(argv[2]) : 120;
+  unsigned int inserts = argc > 3 ? std::atoi(argv[3]) : 100000;
+
+  std::printf("objects:%u seconds:%u inserts/second:%u span:60\n", objects, seconds, inserts);
+
+  run<DequeRate>("deque", objects, seconds, inserts, 60);
+  run<torrent::Rate>("buckets", objects, seconds, inserts, 60);
+  run<torrent::Rate>("buckets ewma", objects, seconds, inserts, 60, torrent::Rate::mode_ewma);
+
+  return 0;
+}
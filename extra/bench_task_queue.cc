@@ -0,0 +1,207 @@
+// Measures the task_queue each thread_base owns. Throughput is the
+// rate producer threads can hand tasks to a consumer, compared with a
+// deque of std::function under a mutex. Latency is the time from
+// thread_base::post() to the task running in a thread_disk that is
+// idle in poll, compared with the signal bitfield and a locked deque
+// that were used to pass results before.
+//
+// Usage: bench_task_queue [producers] [tasks per producer] [latency samples]
+
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "thread_disk.h"
+#include "torrent/poll_select.h"
+#include "torrent/utils/task_queue.h"
+
+typedef std::chrono::steady_clock clock_type;
+
+// The payload of the last throughput run, it only moves as the hash
+// results do.
+struct payload_type {
+  std::unique_ptr<uint64_t> value;
+};
+
+// The baseline, std::function needs copyable tasks so it only gets the
+// plain value.
+class locked_queue {
+public:
+  void
+  push(std::function<void ()> func) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tasks.push_back(std::move(func));
+  }
+
+  unsigned int
+  process() {
+    std::deque<std::function<void ()>> tasks;
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      tasks.swap(m_tasks);
+    }
+
+    for (auto& func : tasks)
+      func();
+
+    return tasks.size();
+  }
+
+private:
+  std::mutex                         m_mutex;
+  std::deque<std::function<void ()>> m_tasks;
+};
+
+// Wraps task_queue to push the same plain value as the baseline.
+class plain_task_queue : public torrent::task_queue {
+};
+
+static void
+push_task(torrent::task_queue* queue, uint64_t* sum, uint64_t value) {
+  payload_type payload{std::unique_ptr<uint64_t>(new uint64_t(value))};
+
+  queue->push([sum, payload = std::move(payload)] { *sum += *payload.value; });
+}
+
+static void
+push_task(plain_task_queue* queue, uint64_t* sum, uint64_t value) {
+  queue->push([sum, value] { *sum += value; });
+}
+
+static void
+push_task(locked_queue* queue, uint64_t* sum, uint64_t value) {
+  queue->push([sum, value] { *sum += value; });
+}
+
+static unsigned int
+process_tasks(torrent::task_queue* queue) {
+  return queue->process();
+}
+
+static unsigned int
+process_tasks(locked_queue* queue) {
+  return queue->process();
+}
+
+template <typename Queue>
+static void
+run_throughput(const char* name, unsigned int producers, unsigned int tasks) {
+  Queue queue;
+  uint64_t sum = 0;
+  uint64_t total = (uint64_t)producers * tasks;
+
+  std::atomic<bool> go{false};
+  std::vector<std::thread> threads;
+
+  for (unsigned int i = 0; i != producers; i++)
+    threads.emplace_back([&queue, &sum, &go, tasks] {
+      while (!go)
+        std::this_thread::yield();
+
+      for (unsigned int j = 0; j != tasks; j++)
+        push_task(&queue, &sum, j);
+    });
+
+  auto start = clock_type::now();
+  go = true;
+
+  for (uint64_t done = 0; done != total; ) {
+    unsigned int count = process_tasks(&queue);
+
+    if (count == 0)
+      std::this_thread::yield();
+
+    done += count;
+  }
+
+  double elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+
+  for (auto& thread : threads)
+    thread.join();
+
+  std::printf("%-14s %9.3f ms  %7.1f ns/task  %6.2f Mtasks/s  (sum %llu)\n",
+              name, elapsed * 1e3, elapsed * 1e9 / total, total / elapsed / 1e6, (unsigned long long)sum);
+}
+
+static void
+print_latency(const char* name, std::vector<double> samples) {
+  std::sort(samples.begin(), samples.end());
+
+  auto at = [&samples](double p) { return samples[std::min<size_t>(samples.size() - 1, samples.size() * p)]; };
+
+  std::printf("%-14s p50:%8.1f us  p99:%8.1f us  max:%8.1f us\n", name, at(0.5), at(0.99), at(1.0));
+}
+
+// Posts one task at a time and waits for it to run, so each post finds
+// the thread idle in poll and has to wake it.
+template <typename Post>
+static std::vector<double>
+run_latency(unsigned int samples, Post post) {
+  std::vector<double> result;
+  std::atomic<bool> done;
+
+  for (unsigned int i = 0; i != samples; i++) {
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+
+    done = false;
+    auto start = clock_type::now();
+
+    post([&done] { done = true; });
+
+    while (!done)
+      std::this_thread::yield();
+
+    result.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - start).count());
+  }
+
+  return result;
+}
+
+int
+main(int argc, char** argv) {
+  unsigned int producers = argc > 1 ? std::atoi(argv[1]) : 2;
+  unsigned int tasks     = argc > 2 ? std::atoi(argv[2]) : 1000000;
+  unsigned int samples   = argc > 3 ? std::atoi(argv[3]) : 2000;
+
+  std::printf("producers:%u tasks:%u samples:%u\n", producers, tasks, samples);
+
+  run_throughput<locked_queue>("locked deque", producers, tasks);
+  run_throughput<plain_task_queue>("task_queue", producers, tasks);
+  run_throughput<torrent::task_queue>("task_queue ptr", producers, tasks);
+
+  torrent::Poll::slot_create_poll() = [] { return torrent::PollSelect::create(256); };
+  torrent::thread_base::acquire_global_lock();
+
+  torrent::thread_disk thread;
+  thread.init_thread();
+
+  locked_queue signal_queue;
+  unsigned int signal_index = thread.signal_bitfield()->add_signal([&signal_queue] { signal_queue.process(); });
+
+  thread.start_thread();
+
+  print_latency("signal + lock", run_latency(samples, [&](std::function<void ()> func) {
+    signal_queue.push(std::move(func));
+    thread.send_event_signal(signal_index);
+  }));
+
+  print_latency("post", run_latency(samples, [&](std::function<void ()> func) {
+    thread.post(std::move(func));
+  }));
+
+  thread.stop_thread_wait();
+  torrent::thread_base::release_global_lock();
+
+  return 0;
+}
@@ -0,0 +1,101 @@
+// Compares the task scheduler's timer wheel with the binary heap it
+// replaced, under the churn of many connections resetting their
+// timeouts.
+//
+// Usage: bench_timer_wheel [timers] [reschedules per tick] [ticks]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <rak/priority_queue_default.h>
+
+typedef std::chrono::steady_clock clock_type;
+
+static void
+advance(rak::priority_queue_heap*, rak::timer) {
+}
+
+static void
+advance(rak::priority_queue_default* queue, rak::timer t) {
+  queue->advance(t);
+}
+
+template <typename Queue>
+static double
+run(unsigned int timers, unsigned int reschedules, unsigned int ticks, uint64_t* fired) {
+  Queue queue;
+  std::vector<rak::priority_item> items(timers);
+  std::mt19937 rng(1);
+
+  // Timeouts between 10 ms and 30 seconds, the clock moves in 1 ms
+  // ticks.
+  std::uniform_int_distribution<int64_t> delay(10000, 30000000);
+  std::uniform_int_distribution<unsigned int> pick(0, timers - 1);
+
+  rak::timer now = rak::timer::from_seconds(1000);
+
+  for (auto& item : items) {
+    item.slot() = [fired] { (*fired)++; };
+    item.set_time(now + delay(rng));
+    queue.push(&item);
+  }
+
+  auto start = clock_type::now();
+
+  for (unsigned int tick = 0; tick != ticks; tick++) {
+    now += 1000;
+
+    while (!queue.empty() && queue.top()->time() <= now) {
+      rak::priority_item* item = queue.top();
+      queue.pop();
+
+      item->slot()();
+      item->set_time(now + delay(rng));
+      queue.push(item);
+    }
+
+    advance(&queue, now);
+
+    for (unsigned int i = 0; i != reschedules; i++) {
+      rak::priority_item* item = &items[pick(rng)];
+
+      queue.erase(item);
+      item->set_time(now + delay(rng));
+      queue.push(item);
+    }
+  }
+
+  double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+
+  while (!queue.empty()) {
+    rak::priority_item* item = queue.top();
+    queue.pop();
+    item->clear_time();
+  }
+
+  return seconds;
+}
+
+int
+main(int argc, char** argv) {
+  unsigned int timers      = argc > 1 ? std::atoi(argv[1]) : 10000;
+  unsigned int reschedules = argc > 2 ? std::atoi(argv[2]) : 20;
+  unsigned int ticks       = argc > 3 ? std::atoi(argv[3]) : 1000;
+
+  std::printf("timers:%u reschedules/tick:%u ticks:%u\n", timers, reschedules, ticks);
+
+  uint64_t heap_fired = 0;
+  uint64_t wheel_fired = 0;
+
+  double heap = run<rak::priority_queue_heap>(timers, reschedules, ticks, &heap_fired);
+  double wheel = run<rak::priority_queue_default>(timers, reschedules, ticks, &wheel_fired);
+
+  std::printf("heap:  %10.3f ms  %8.3f us/reschedule  fired:%llu\n",
+              heap * 1e3, heap * 1e6 / ((double)reschedules * ticks), (unsigned long long)heap_fired);
+  std::printf("wheel: %10.3f ms  %8.3f us/reschedule  fired:%llu\n",
+              wheel * 1e3, wheel * 1e6 / ((double)reschedules * ticks), (unsigned long long)wheel_fired);
+
+  return 0;
+}
@@ -0,0 +1,5 @@
+# Run from extra/ in a built tree, links the uninstalled library objects.
+g++ -std=c++17 -Wall -O2 -g -DHAVE_CONFIG_H -I.. -I../src -o bench_connection_churn bench_connection_churn.cc \
+  -Wl,--start-group ../src/.libs/libtorrent_other.a ../src/torrent/.libs/libtorrent_torrent.a \
+  ../src/.libs/globals.o ../src/.libs/manager.o ../src/.libs/thread_main.o ../src/.libs/thread_disk.o \
+  -Wl,--end-group -lcrypto -lz -lpthread
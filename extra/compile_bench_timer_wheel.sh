@@ -0,0 +1 @@
+g++ -std=c++17 -Wall -O2 -g -I.. -I../src -o bench_timer_wheel bench_timer_wheel.cc
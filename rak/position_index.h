@@ -0,0 +1,171 @@
+// position_index is an open addressing hash index of positions in a
+// container owned by the caller, such as a vector kept dense by
+// swapping erased elements with the back.
+//
+// Each slot holds the hash and the position plus one, zero marking an
+// empty slot. Lookups compare the hash and then ask the caller if the
+// element at a position matches, so keys are not stored twice and
+// several positions may share a key.
+//
+// Uses linear probing with backward shift deletion so no tombstones
+// are needed, and the table is kept at most half full. Growing only
+// needs the stored hashes.
+
+#ifndef RAK_POSITION_INDEX_H
+#define RAK_POSITION_INDEX_H
+
+#include <algorithm>
+#include <cinttypes>
+#include <vector>
+
+namespace rak {
+
+class position_index {
+public:
+  typedef uint32_t size_type;
+
+  static constexpr size_type npos = ~size_type();
+  static constexpr size_type min_table_size = 16;
+
+  size_type           size() const                { return m_size; }
+  size_type           table_size() const          { return m_table.size(); }
+
+  size_type           position(size_type slot) const                      { return m_table[slot].position - 1; }
+  void                set_position(size_type slot, size_type position)    { m_table[slot].position = position + 1; }
+
+  // Returns the first slot whose position matches 'equal', or npos.
+  template <typename Equal>
+  size_type           find(uint32_t hash, Equal equal) const              { return find_from(ideal_slot(hash), hash, equal); }
+
+  // Continues a search after 'slot', for keys with several positions.
+  template <typename Equal>
+  size_type           find_next(size_type slot, uint32_t hash, Equal equal) const;
+
+  // Returns the slot holding 'position', which must be indexed.
+  size_type           find_position(uint32_t hash, size_type position) const;
+
+  void                insert(uint32_t hash, size_type position);
+  void                erase(size_type slot);
+
+  void                reserve(size_type size);
+  void                clear()                     { m_table.clear(); m_size = 0; }
+
+  // The MurmurHash3 finalizer, for callers building a hash from
+  // several words of a key.
+  static uint64_t     mix(uint64_t value);
+
+private:
+  struct slot_type {
+    uint32_t hash;
+    uint32_t position;
+  };
+
+  size_type           mask() const                { return m_table.size() - 1; }
+  size_type           ideal_slot(uint32_t hash) const { return m_table.empty() ? npos : hash & mask(); }
+
+  template <typename Equal>
+  size_type           find_from(size_type slot, uint32_t hash, Equal equal) const;
+
+  void                insert_slot(slot_type entry);
+  void                rehash(size_type table_size);
+
+  std::vector<slot_type> m_table;
+  size_type              m_size{0};
+};
+
+template <typename Equal>
+inline position_index::size_type
+position_index::find_from(size_type slot, uint32_t hash, Equal equal) const {
+  if (slot == npos)
+    return npos;
+
+  for (; m_table[slot].position != 0; slot = (slot + 1) & mask())
+    if (m_table[slot].hash == hash && equal(m_table[slot].position - 1))
+      return slot;
+
+  return npos;
+}
+
+template <typename Equal>
+inline position_index::size_type
+position_index::find_next(size_type slot, uint32_t hash, Equal equal) const {
+  return find_from((slot + 1) & mask(), hash, equal);
+}
+
+inline position_index::size_type
+position_index::find_position(uint32_t hash, size_type position) const {
+  return find(hash, [position](size_type p) { return p == position; });
+}
+
+inline void
+position_index::insert_slot(slot_type entry) {
+  size_type slot = entry.hash & mask();
+
+  while (m_table[slot].position != 0)
+    slot = (slot + 1) & mask();
+
+  m_table[slot] = entry;
+}
+
+inline void
+position_index::insert(uint32_t hash, size_type position) {
+  if (2 * (m_size + 1) > m_table.size())
+    rehash(std::max<size_type>(2 * m_table.size(), min_table_size));
+
+  insert_slot(slot_type{ hash, position + 1 });
+  m_size++;
+}
+
+// Move later entries of the probe sequence back into the hole, unless
+// their ideal slot lies cyclically in (hole, next].
+inline void
+position_index::erase(size_type slot) {
+  size_type hole = slot;
+
+  for (size_type next = (slot + 1) & mask(); m_table[next].position != 0; next = (next + 1) & mask()) {
+    size_type ideal = m_table[next].hash & mask();
+
+    if (hole <= next ? (hole < ideal && ideal <= next) : (hole < ideal || ideal <= next))
+      continue;
+
+    m_table[hole] = m_table[next];
+    hole = next;
+  }
+
+  m_table[hole] = slot_type{ 0, 0 };
+  m_size--;
+}
+
+inline void
+position_index::reserve(size_type size) {
+  size_type table_size = std::max<size_type>(m_table.size(), min_table_size);
+
+  while (table_size < 2 * size)
+    table_size *= 2;
+
+  if (table_size != m_table.size())
+    rehash(table_size);
+}
+
+inline uint64_t
+position_index::mix(uint64_t value) {
+  value ^= value >> 33;
+  value *= UINT64_C(0xff51afd7ed558ccd);
+  value ^= value >> 33;
+  value *= UINT64_C(0xc4ceb9fe1a85ec53);
+  return value ^ (value >> 33);
+}
+
+inline void
+position_index::rehash(size_type table_size) {
+  std::vector<slot_type> old_table(table_size, slot_type{ 0, 0 });
+  old_table.swap(m_table);
+
+  for (const auto& entry : old_table)
+    if (entry.position != 0)
+      insert_slot(entry);
+}
+
+}
+
+#endif
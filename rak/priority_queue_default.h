@@ -5,12 +5,13 @@
 #include <functional>
 #include <rak/priority_queue.h>
 #include <rak/timer.h>
+#include <rak/timer_wheel.h>
 
 #include "torrent/exceptions.h"
 
 namespace rak {
 
-class priority_item {
+class priority_item : public timer_wheel_node {
 public:
   typedef std::function<void (void)> slot_void;
 
@@ -46,8 +47,11 @@ struct priority_compare {
   }
 };
 
+// The binary heap is kept for comparison with the timer wheel, which
+// replaced it as the default as it does insert and erase in O(1).
 typedef std::equal_to<priority_item*> priority_equal;
-typedef priority_queue<priority_item*, priority_compare, priority_equal> priority_queue_default;
+typedef priority_queue<priority_item*, priority_compare, priority_equal> priority_queue_heap;
+typedef timer_wheel<priority_item> priority_queue_default;
 
 inline void
 priority_queue_perform(priority_queue_default* queue, timer t) {
@@ -58,6 +62,8 @@ priority_queue_perform(priority_queue_default* queue, timer t) {
     v->clear_time();
     v->slot()();
   }
+
+  queue->advance(t);
 }
 
 inline void
@@ -71,7 +77,7 @@ priority_queue_insert(priority_queue_default* queue, priority_item* item, timer
   if (item->is_queued())
     throw torrent::internal_error("priority_queue_insert(...) called on an already queued item.");
 
-  if (queue->find(item) != queue->end())
+  if (queue->contains(item))
     throw torrent::internal_error("priority_queue_insert(...) item found in queue.");
 
   item->set_time(t);
@@ -103,7 +109,7 @@ priority_queue_update(priority_queue_default* queue, priority_item* item, timer
   if (!item->is_valid())
     throw torrent::internal_error("priority_queue_insert(...) called on an invalid item.");
 
-  if (queue->find(item) == queue->end()) {
+  if (!queue->contains(item)) {
     if (item->is_queued())
       throw torrent::internal_error("priority_queue_update(...) cannot insert an already queued item.");
 
@@ -111,8 +117,9 @@ priority_queue_update(priority_queue_default* queue, priority_item* item, timer
     queue->push(item);
 
   } else {
+    queue->erase(item);
     item->set_time(t);
-    queue->update();
+    queue->push(item);
   }
 }
 
@@ -0,0 +1,135 @@
+// slab_pool hands out fixed size slots from chunks of 'chunk_slots'
+// slots, reusing freed slots before allocating another chunk. The
+// caller constructs and destroys the objects.
+//
+// Slots are padded to a multiple of the cacheline size and chunks
+// are allocated with cacheline_allocator, so objects never share a
+// cacheline.
+//
+// Chunks are only released when the pool is destroyed, so it suits
+// owners that allocate many short-lived objects of a size and outlive
+// all of them. Not thread-safe.
+
+#ifndef RAK_SLAB_ALLOCATOR_H
+#define RAK_SLAB_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include "allocators.h"
+
+namespace rak {
+
+class slab_pool {
+public:
+  typedef size_t size_type;
+
+  slab_pool(size_type object_size, size_type chunk_slots);
+  ~slab_pool();
+  slab_pool(const slab_pool&) = delete;
+  slab_pool& operator=(const slab_pool&) = delete;
+
+  size_type           object_size() const         { return m_object_size; }
+  size_type           slot_size() const           { return m_slot_size; }
+
+  // Number of allocated slots, and the most ever allocated at once.
+  size_type           size() const                { return m_size; }
+  size_type           peak() const                { return m_peak; }
+  size_type           capacity() const            { return m_chunks.size() * m_chunk_slots; }
+
+  // Number of chunk allocations made, compare with the number of
+  // 'allocate()' calls to see how many heap allocations were saved.
+  size_type           chunks() const              { return m_chunks.size(); }
+
+  void*               allocate();
+  void                deallocate(void* ptr);
+
+private:
+  struct free_slot {
+    free_slot* next;
+  };
+
+  static size_type    round_slot_size(size_type size);
+
+  size_type           m_object_size;
+  size_type           m_slot_size;
+  size_type           m_chunk_slots;
+
+  std::vector<char*>  m_chunks;
+  free_slot*          m_free{nullptr};
+
+  size_type           m_size{0};
+  size_type           m_peak{0};
+};
+
+template <typename T, size_t ChunkSize = 64>
+class slab_allocator : public slab_pool {
+public:
+  static_assert(alignof(T) <= LT_SMP_CACHE_BYTES, "slab_allocator does not support over-aligned types");
+
+  static constexpr size_type chunk_size = ChunkSize;
+
+  slab_allocator() : slab_pool(sizeof(T), ChunkSize) {}
+};
+
+inline slab_pool::size_type
+slab_pool::round_slot_size(size_type size) {
+  if (size < sizeof(free_slot))
+    size = sizeof(free_slot);
+
+  return (size + LT_SMP_CACHE_BYTES - 1) / LT_SMP_CACHE_BYTES * LT_SMP_CACHE_BYTES;
+}
+
+inline
+slab_pool::slab_pool(size_type object_size, size_type chunk_slots) :
+  m_object_size(object_size),
+  m_slot_size(round_slot_size(object_size)),
+  m_chunk_slots(chunk_slots) {
+}
+
+inline
+slab_pool::~slab_pool() {
+  for (char* chunk : m_chunks)
+    cacheline_allocator<char>().deallocate(chunk, m_slot_size * m_chunk_slots);
+}
+
+inline void*
+slab_pool::allocate() {
+  if (m_free == nullptr) {
+    char* chunk = cacheline_allocator<char>::alloc_size(m_slot_size * m_chunk_slots);
+
+    if (chunk == nullptr)
+      throw std::bad_alloc();
+
+    m_chunks.push_back(chunk);
+
+    for (size_type i = m_chunk_slots; i != 0; i--) {
+      free_slot* slot = reinterpret_cast<free_slot*>(chunk + (i - 1) * m_slot_size);
+      slot->next = m_free;
+      m_free = slot;
+    }
+  }
+
+  free_slot* slot = m_free;
+  m_free = slot->next;
+
+  if (++m_size > m_peak)
+    m_peak = m_size;
+
+  return slot;
+}
+
+inline void
+slab_pool::deallocate(void* ptr) {
+  free_slot* slot = static_cast<free_slot*>(ptr);
+
+  slot->next = m_free;
+  m_free = slot;
+  m_size--;
+}
+
+}
+
+#endif
@@ -0,0 +1,366 @@
+// timer_wheel is a hierarchical timing wheel of intrusively linked
+// items, giving O(1) insert and erase. The items must derive from
+// timer_wheel_node and provide 'time()'.
+//
+// Time is divided into ticks of 2^10 usec. The root level has 256
+// slots of one tick each, and the four outer levels have 64 slots
+// that each span all the slots of the level below. An item is stored
+// in the level of the highest group of tick bits in which it differs
+// from the current tick, so every item in a level expires before any
+// item in the levels above it. Items further away than 2^32 ticks are
+// kept in an overflow list.
+//
+// Root level slots are kept sorted by time, and 'top()' is cached, so
+// draining expired items does not need to search the wheel.
+//
+// Call 'advance(t)' after all items with time <= t have been removed
+// to move the wheel forward, cascading the outer slots we enter into
+// the lower levels.
+//
+// Until the first 'advance(t)' the current tick is taken from the
+// first item inserted into an empty wheel, and the items are placed
+// again if the first advance turns out to be earlier.
+
+#ifndef RAK_TIMER_WHEEL_H
+#define RAK_TIMER_WHEEL_H
+
+#include <algorithm>
+#include <cinttypes>
+#include <iterator>
+#include <rak/timer.h>
+
+namespace rak {
+
+template <typename Value> class timer_wheel;
+
+class timer_wheel_node {
+public:
+  timer_wheel_node() = default;
+  timer_wheel_node(const timer_wheel_node&) = delete;
+  timer_wheel_node& operator=(const timer_wheel_node&) = delete;
+
+  bool                is_linked() const { return m_wheel_next != nullptr; }
+
+protected:
+  template <typename Value> friend class timer_wheel;
+
+  void                link_before(timer_wheel_node* pos);
+  void                unlink();
+
+  timer_wheel_node*   m_wheel_prev{nullptr};
+  timer_wheel_node*   m_wheel_next{nullptr};
+  uint32_t            m_wheel_slot{0};
+};
+
+template <typename Value>
+class timer_wheel {
+public:
+  typedef Value*      value_type;
+  typedef uint32_t    size_type;
+
+  static constexpr unsigned int tick_shift   = 10;
+  static constexpr unsigned int root_bits    = 8;
+  static constexpr unsigned int level_bits   = 6;
+  static constexpr unsigned int level_count  = 5;
+
+  static constexpr unsigned int root_size    = 1 << root_bits;
+  static constexpr unsigned int level_size   = 1 << level_bits;
+  static constexpr unsigned int slot_count   = root_size + (level_count - 1) * level_size;
+  static constexpr unsigned int overflow_slot = slot_count;
+
+  timer_wheel();
+  timer_wheel(const timer_wheel&) = delete;
+  timer_wheel& operator=(const timer_wheel&) = delete;
+
+  bool                empty() const                   { return m_size == 0; }
+  size_type           size() const                    { return m_size; }
+
+  bool                contains(const Value* item) const { return item->is_linked(); }
+
+  // The item with the earliest time, the queue must not be empty.
+  Value*              top();
+  void                pop()                           { erase(top()); }
+
+  void                push(Value* item);
+  bool                erase(Value* item);
+
+  void                advance(timer t);
+
+  // Unlinks all items without touching their time, like clearing the
+  // old binary heap did.
+  void                clear();
+
+private:
+  typedef timer_wheel_node node_type;
+
+  static uint64_t     to_tick(timer t)                { return t.usec() <= 0 ? 0 : (uint64_t)t.usec() >> tick_shift; }
+  static unsigned int level_shift(unsigned int level) { return root_bits + (level - 1) * level_bits; }
+  static unsigned int level_offset(unsigned int level) { return root_size + (level - 1) * level_size; }
+
+  uint32_t            slot_index(uint64_t tick) const;
+
+  void                insert_slot(Value* item, uint32_t slot);
+  void                erase_slot(node_type* item);
+
+  void                set_bit(uint32_t slot)          { m_bitmap[slot / 64] |= (uint64_t)1 << (slot % 64); }
+  void                clear_bit(uint32_t slot)        { m_bitmap[slot / 64] &= ~((uint64_t)1 << (slot % 64)); }
+
+  int                 find_slot(uint32_t first, uint32_t last) const;
+  Value*              find_min(uint32_t slot);
+
+  void                cascade(uint32_t slot);
+  void                rebase(uint64_t tick);
+
+  uint64_t            m_current{0};
+  bool                m_seeded{false};
+  size_type           m_size{0};
+  Value*              m_top{nullptr};
+
+  node_type           m_slots[slot_count + 1];
+  uint64_t            m_bitmap[(slot_count + 63) / 64]{};
+};
+
+inline void
+timer_wheel_node::link_before(timer_wheel_node* pos) {
+  m_wheel_next = pos;
+  m_wheel_prev = pos->m_wheel_prev;
+  m_wheel_prev->m_wheel_next = this;
+  pos->m_wheel_prev = this;
+}
+
+inline void
+timer_wheel_node::unlink() {
+  m_wheel_prev->m_wheel_next = m_wheel_next;
+  m_wheel_next->m_wheel_prev = m_wheel_prev;
+  m_wheel_prev = nullptr;
+  m_wheel_next = nullptr;
+}
+
+template <typename Value>
+timer_wheel<Value>::timer_wheel() {
+  for (node_type& sentinel : m_slots)
+    sentinel.m_wheel_prev = sentinel.m_wheel_next = &sentinel;
+}
+
+template <typename Value>
+inline uint32_t
+timer_wheel<Value>::slot_index(uint64_t tick) const {
+  if (tick <= m_current)
+    return m_current & (root_size - 1);
+
+  uint64_t diff = tick ^ m_current;
+
+  if ((diff >> root_bits) == 0)
+    return tick & (root_size - 1);
+
+  for (unsigned int level = 1; level < level_count; level++)
+    if ((diff >> (level_shift(level) + level_bits)) == 0)
+      return level_offset(level) + ((tick >> level_shift(level)) & (level_size - 1));
+
+  return overflow_slot;
+}
+
+template <typename Value>
+inline void
+timer_wheel<Value>::insert_slot(Value* item, uint32_t slot) {
+  node_type* sentinel = &m_slots[slot];
+  node_type* pos = sentinel;
+
+  // Keep root slots sorted, searching from the back as new items
+  // usually expire last.
+  if (slot < root_size)
+    while (pos->m_wheel_prev != sentinel && item->time() < static_cast<Value*>(pos->m_wheel_prev)->time())
+      pos = pos->m_wheel_prev;
+
+  item->link_before(pos);
+  item->m_wheel_slot = slot;
+
+  if (slot != overflow_slot)
+    set_bit(slot);
+}
+
+template <typename Value>
+inline void
+timer_wheel<Value>::erase_slot(node_type* item) {
+  uint32_t slot = item->m_wheel_slot;
+  item->unlink();
+
+  if (slot != overflow_slot && m_slots[slot].m_wheel_next == &m_slots[slot])
+    clear_bit(slot);
+}
+
+template <typename Value>
+inline void
+timer_wheel<Value>::push(Value* item) {
+  if (!m_seeded && m_size == 0)
+    m_current = to_tick(item->time());
+
+  insert_slot(item, slot_index(to_tick(item->time())));
+  m_size++;
+
+  if (m_top != nullptr && item->time() < m_top->time())
+    m_top = item;
+}
+
+template <typename Value>
+inline bool
+timer_wheel<Value>::erase(Value* item) {
+  if (!item->is_linked())
+    return false;
+
+  erase_slot(item);
+  m_size--;
+
+  if (item == m_top)
+    m_top = nullptr;
+
+  return true;
+}
+
+// Returns the first non-empty slot in [first, last), or -1.
+template <typename Value>
+inline int
+timer_wheel<Value>::find_slot(uint32_t first, uint32_t last) const {
+  while (first < last) {
+    uint64_t word = m_bitmap[first / 64] & (~(uint64_t)0 << (first % 64));
+
+    if (word != 0) {
+      uint32_t slot = (first & ~(uint32_t)63) + __builtin_ctzll(word);
+      return slot < last ? (int)slot : -1;
+    }
+
+    first = (first & ~(uint32_t)63) + 64;
+  }
+
+  return -1;
+}
+
+template <typename Value>
+inline Value*
+timer_wheel<Value>::find_min(uint32_t slot) {
+  node_type* sentinel = &m_slots[slot];
+  Value* result = static_cast<Value*>(sentinel->m_wheel_next);
+
+  if (slot < root_size)
+    return result;
+
+  for (node_type* itr = result->m_wheel_next; itr != sentinel; itr = itr->m_wheel_next)
+    if (static_cast<Value*>(itr)->time() < result->time())
+      result = static_cast<Value*>(itr);
+
+  return result;
+}
+
+template <typename Value>
+Value*
+timer_wheel<Value>::top() {
+  if (m_top != nullptr)
+    return m_top;
+
+  int slot = find_slot(m_current & (root_size - 1), root_size);
+
+  for (unsigned int level = 1; slot == -1 && level < level_count; level++) {
+    uint32_t current = (m_current >> level_shift(level)) & (level_size - 1);
+
+    slot = find_slot(level_offset(level) + current + 1, level_offset(level) + level_size);
+  }
+
+  if (slot == -1)
+    slot = overflow_slot;
+
+  return (m_top = find_min(slot));
+}
+
+template <typename Value>
+void
+timer_wheel<Value>::cascade(uint32_t slot) {
+  node_type* sentinel = &m_slots[slot];
+
+  if (sentinel->m_wheel_next == sentinel)
+    return;
+
+  // Move the items to a local list first, as those that belong in the
+  // same slot again would otherwise be cascaded forever.
+  node_type pending;
+
+  pending.m_wheel_next = sentinel->m_wheel_next;
+  pending.m_wheel_prev = sentinel->m_wheel_prev;
+  pending.m_wheel_next->m_wheel_prev = &pending;
+  pending.m_wheel_prev->m_wheel_next = &pending;
+
+  sentinel->m_wheel_next = sentinel->m_wheel_prev = sentinel;
+
+  if (slot != overflow_slot)
+    clear_bit(slot);
+
+  while (pending.m_wheel_next != &pending) {
+    Value* item = static_cast<Value*>(pending.m_wheel_next);
+
+    item->unlink();
+    insert_slot(item, slot_index(to_tick(item->time())));
+  }
+}
+
+// Places all items relative to an earlier current tick.
+template <typename Value>
+void
+timer_wheel<Value>::rebase(uint64_t tick) {
+  m_current = tick;
+
+  for (uint32_t slot = 0; slot <= overflow_slot; slot++)
+    cascade(slot);
+}
+
+template <typename Value>
+void
+timer_wheel<Value>::advance(timer t) {
+  uint64_t tick = to_tick(t);
+
+  if (!m_seeded) {
+    m_seeded = true;
+
+    if (tick < m_current)
+      return rebase(tick);
+  }
+
+  if (tick <= m_current)
+    return;
+
+  uint64_t diff = tick ^ m_current;
+  m_current = tick;
+
+  if ((diff >> root_bits) == 0)
+    return;
+
+  if ((diff >> (level_shift(level_count - 1) + level_bits)) != 0) {
+    cascade(overflow_slot);
+    return;
+  }
+
+  // Only the slot we entered in the highest level that changed can
+  // contain items, as any others would already have expired.
+  for (unsigned int level = level_count - 1; level != 0; level--) {
+    if ((diff >> level_shift(level)) == 0)
+      continue;
+
+    cascade(level_offset(level) + ((tick >> level_shift(level)) & (level_size - 1)));
+    return;
+  }
+}
+
+template <typename Value>
+void
+timer_wheel<Value>::clear() {
+  for (node_type& sentinel : m_slots)
+    while (sentinel.m_wheel_next != &sentinel)
+      sentinel.m_wheel_next->unlink();
+
+  std::fill(std::begin(m_bitmap), std::end(m_bitmap), 0);
+
+  m_size = 0;
+  m_top = nullptr;
+}
+
+}
+
+#endif
@@ -36,23 +36,95 @@
 
 #include "config.h"
 
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <mutex>
 #include <rak/error_number.h>
 
 #include "torrent/exceptions.h"
 #include "torrent/chunk_manager.h"
 #include "torrent/data/download_data.h"
 #include "torrent/utils/log.h"
+#include "torrent/utils/thread_base.h"
 #include "utils/instrumentation.h"
 
 #include "chunk_list.h"
 #include "chunk.h"
 #include "globals.h"
+#include "socket_file.h"
 
 #define LT_LOG_THIS(log_level, log_fmt, ...)                              \
   lt_log_print_data(LOG_STORAGE_##log_level, m_data, "chunk_list", log_fmt, __VA_ARGS__);
 
 namespace torrent {
 
+// A write-back of a cached chunk's buffer, run by the disk thread or
+// by 'flush' if the disk thread has not started it yet.
+struct ChunkList::write_type {
+  enum state_type {
+    state_queued,
+    state_running,
+    state_done
+  };
+
+  write_type(ChunkListNode* n, char* b, chunk_read_list p, bool s) :
+    node(n), buffer(b), parts(std::move(p)), sync(s) {}
+
+  bool                claim();
+  void                run();
+  void                wait();
+
+  ChunkListNode*      node;
+  char*               buffer;
+  chunk_read_list     parts;
+  bool                sync;
+
+  // Only used by the owner thread.
+  bool                modified{false};
+  bool                handled{false};
+
+  std::atomic<int>    state{state_queued};
+  int                 error{0};
+
+  std::mutex              mutex;
+  std::condition_variable cond;
+};
+
+bool
+ChunkList::write_type::claim() {
+  int expected = state_queued;
+  return state.compare_exchange_strong(expected, state_running);
+}
+
+void
+ChunkList::write_type::run() {
+  int result = 0;
+
+  for (auto& part : parts) {
+    SocketFile file(part.fd);
+
+    if (part.fd != -1 && result == 0 &&
+        (!file.write(buffer + part.position, part.length, part.offset) || (sync && !file.sync())))
+      result = errno != 0 ? errno : EIO;
+
+    file.close();
+    part.fd = -1;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  error = result;
+  state = state_done;
+  cond.notify_all();
+}
+
+void
+ChunkList::write_type::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  cond.wait(lock, [this] { return state == state_done; });
+}
+
 struct chunk_list_earliest_modified {
   chunk_list_earliest_modified() : m_time(cachedTime) {}
 
@@ -95,8 +167,14 @@ void
 ChunkList::clear() {
   LT_LOG_THIS(INFO, "Clearing.", 0);
 
-  // Don't do any sync'ing as whomever decided to shut down really
-  // doesn't care, so just de-reference all chunks in queue.
+  // Cached chunks only exist in memory, so they must have been
+  // written by 'flush'.
+  if (!m_writes.empty() || std::any_of(m_queue.begin(), m_queue.end(), std::mem_fn(&ChunkListNode::is_cached)))
+    throw internal_error("ChunkList::clear() called with cached chunks that have not been flushed.");
+
+  // Don't do any sync'ing of mapped chunks as whomever decided to
+  // shut down really doesn't care, so just de-reference all chunks in
+  // queue.
   for (auto chunk : m_queue) {
     if (chunk->references() != 1 || chunk->writable() != 1)
       throw internal_error("ChunkList::clear() called but a node in the queue is still referenced.");
@@ -119,6 +197,9 @@ ChunkList::clear() {
   if (std::any_of(begin(), end(), std::mem_fn(&ChunkListNode::blocking)))
     throw internal_error("ChunkList::clear() called but a node with blocking != 0 was found.");
 
+  if (m_manager != NULL)
+    m_manager->read_cache()->erase(this);
+
   base_type::clear();
 }
 
@@ -133,14 +214,28 @@ ChunkList::get(size_type index, int flags) {
   int allocate_flags = (flags & get_dont_log) ? ChunkManager::allocate_dont_log : 0;
   int prot_flags = MemoryChunk::prot_read | ((flags & get_writable) ? MemoryChunk::prot_write : 0);
 
-  if (!node->is_valid()) {
+  Chunk* read_cached = NULL;
+
+  if (!node->is_valid() && (flags & get_read_cache) && !(flags & get_writable) &&
+      (read_cached = m_manager->read_cache()->acquire(this, index)) != NULL) {
+    // Read cached chunks are not mapped so don't count towards the
+    // memory usage.
+    node->set_chunk(read_cached);
+    node->set_read_cached(true);
+    node->set_time_modified(rak::timer());
+
+  } else if (!node->is_valid()) {
     if (!m_manager->allocate(m_chunk_size, allocate_flags)) {
       LT_LOG_THIS(DEBUG, "Could not allocate: memory:%" PRIu64 " block:%" PRIu32 ".",
                   m_manager->memory_usage(), m_manager->memory_block_count());
       return ChunkHandle::from_error(rak::error_number::e_nomem);
     }
 
-    Chunk* chunk = m_slot_create_chunk(index, prot_flags);
+    Chunk* chunk = (flags & get_writable) ? create_cached_chunk(node) : NULL;
+    bool cached = chunk != NULL;
+
+    if (!cached)
+      chunk = m_slot_create_chunk(index, prot_flags);
 
     if (chunk == NULL) {
       rak::error_number current_error = rak::error_number::current();
@@ -153,8 +248,12 @@ ChunkList::get(size_type index, int flags) {
     }
 
     node->set_chunk(chunk);
+    node->set_cached(cached);
     node->set_time_modified(rak::timer());
 
+    if ((flags & get_writable) && !cached)
+      node->set_written(true);
+
   } else if (flags & get_writable && !node->chunk()->is_writable()) {
     if (node->blocking() != 0) {
       if ((flags & get_nonblock))
@@ -163,17 +262,29 @@ ChunkList::get(size_type index, int flags) {
       throw internal_error("No support yet for getting write permission for blocked chunk.");
     }
 
+    if (node->is_read_cached() && !m_manager->allocate(m_chunk_size, allocate_flags))
+      return ChunkHandle::from_error(rak::error_number::e_nomem);
+
     Chunk* chunk = m_slot_create_chunk(index, prot_flags);
 
-    if (chunk == NULL)
+    if (chunk == NULL) {
+      if (node->is_read_cached())
+        m_manager->deallocate(m_chunk_size, allocate_flags | ChunkManager::allocate_revert_log);
+
       return ChunkHandle::from_error(rak::error_number::current().is_valid() ? rak::error_number::current() : rak::error_number::e_noent);
+    }
 
-    delete node->chunk();
+    delete_chunk(node);
 
     node->set_chunk(chunk);
     node->set_time_modified(rak::timer());
+    node->set_written(true);
   }
 
+  // The read cache must not serve a chunk that is being modified.
+  if (flags & get_writable)
+    m_manager->read_cache()->erase(this, index);
+
   node->inc_references();
 
   if (flags & get_writable) {
@@ -182,6 +293,11 @@ ChunkList::get(size_type index, int flags) {
     // Make sure that periodic syncing uses async on any subsequent
     // changes even if it was triggered before this get.
     node->set_sync_triggered(false);
+
+    // The write in progress may miss any changes, so it needs to be
+    // queued again once done.
+    if (node->is_writing())
+      (*find_write(node))->modified = true;
   }
 
   if (flags & get_blocking) {
@@ -242,15 +358,234 @@ ChunkList::release(ChunkHandle* handle, int release_flags) {
   handle->clear();
 }
 
+// Falls back to mapping the files when the write cache is disabled or
+// over budget, or when earlier writes to the chunk are only held by
+// the files. The buffer is not filled from the files, as blocks of an
+// unfinished chunk are downloaded again unless written to the chunk
+// since it was last mapped or written back.
+inline Chunk*
+ChunkList::create_cached_chunk(ChunkListNode* node) {
+  if (!m_slot_create_cached_chunk || !m_slot_create_chunk_writes || m_thread_disk == NULL || node->is_written())
+    return NULL;
+
+  char* buffer = m_manager->write_cache_allocate(m_chunk_size);
+
+  if (buffer == NULL)
+    return NULL;
+
+  Chunk* chunk = m_slot_create_cached_chunk(node->index(), buffer);
+
+  if (chunk == NULL) {
+    LT_LOG_THIS(DEBUG, "Could not create cached chunk: index:%" PRIu32 ".", node->index());
+
+    m_manager->write_cache_deallocate(buffer, m_chunk_size);
+  }
+
+  return chunk;
+}
+
+// The queue's reference to the node moves to the write. The buffer
+// stays with the node, so it may still be read or be modified while
+// the disk thread writes it.
+inline bool
+ChunkList::write_chunk(ChunkListNode* node, bool sync) {
+  chunk_read_list parts;
+
+  if (!m_slot_create_chunk_writes(node->index(), &parts))
+    return false;
+
+  // The first part starts at the beginning of the buffer.
+  auto write = std::make_shared<write_type>(node, node->chunk()->front().chunk().ptr(), std::move(parts), sync);
+
+  node->set_writing(true);
+  node->set_written(true);
+  m_writes.push_back(write);
+
+  m_thread_disk->post([this, write, owner = m_thread_owner]() {
+      if (!write->claim())
+        return;
+
+      write->run();
+
+      owner->post([this, write]() {
+          if (!write->handled)
+            write_done(write);
+        });
+    });
+
+  return true;
+}
+
+// Chunks that failed to write or were modified during the write are
+// queued again, keeping the buffer until the next sync.
+void
+ChunkList::write_done(const write_ptr& write) {
+  ChunkListNode* node = write->node;
+
+  finish_write(write);
+
+  if (write->error != 0 || write->modified) {
+    m_queue.push_back(node);
+
+    if (write->error != 0)
+      m_slot_storage_error("Could not write chunk: " + std::string(rak::error_number(write->error).c_str()));
+
+    return;
+  }
+
+  node->dec_rw();
+
+  if (node->references() == 0)
+    clear_chunk(node);
+}
+
+void
+ChunkList::finish_write(const write_ptr& write) {
+  auto itr = std::find(m_writes.begin(), m_writes.end(), write);
+
+  if (itr == m_writes.end() || write->state != write_type::state_done)
+    throw internal_error("ChunkList::finish_write(...) received an unknown or unfinished write.");
+
+  m_writes.erase(itr);
+
+  write->handled = true;
+  write->node->set_writing(false);
+}
+
+ChunkList::write_list::iterator
+ChunkList::find_write(ChunkListNode* node) {
+  auto itr = std::find_if(m_writes.begin(), m_writes.end(), [node](const write_ptr& write) { return write->node == node; });
+
+  if (itr == m_writes.end())
+    throw internal_error("ChunkList::find_write(...) could not find the write of a node.");
+
+  return itr;
+}
+
+std::vector<ChunkList::size_type>
+ChunkList::flush() {
+  LT_LOG_THIS(DEBUG, "Flush: queued:%zu writing:%zu.", m_queue.size(), m_writes.size());
+
+  std::vector<size_type> lost;
+
+  auto drop = [this, &lost](ChunkListNode* node) {
+    lost.push_back(node->index());
+    node->dec_rw();
+
+    if (node->references() == 0)
+      clear_chunk(node);
+  };
+
+  auto split = std::stable_partition(m_queue.begin(), m_queue.end(), [](ChunkListNode* n) {
+      return !n->is_cached() || n->writable() != 1;
+    });
+
+  for (auto itr = split; itr != m_queue.end(); ++itr)
+    if (!write_chunk(*itr, false)) {
+      LT_LOG_THIS(ERROR, "Could not write cached chunk: index:%" PRIu32 " errno:%i errmsg:%s.",
+                  (*itr)->index(), rak::error_number::current().value(), rak::error_number::current().c_str());
+      drop(*itr);
+    }
+
+  m_queue.erase(split, m_queue.end());
+
+  while (!m_writes.empty()) {
+    write_ptr write = m_writes.front();
+    ChunkListNode* node = write->node;
+
+    if (write->claim())
+      write->run();
+    else
+      write->wait();
+
+    finish_write(write);
+
+    if (write->error == 0 && !write->modified) {
+      node->dec_rw();
+
+      if (node->references() == 0)
+        clear_chunk(node);
+
+      continue;
+    }
+
+    if (write->error == 0 && write_chunk(node, false))
+      continue;
+
+    int error = write->error != 0 ? write->error : rak::error_number::current().value();
+
+    LT_LOG_THIS(ERROR, "Could not write cached chunk: index:%" PRIu32 " errno:%i errmsg:%s.",
+                node->index(), error, rak::error_number(error).c_str());
+    drop(node);
+  }
+
+  return lost;
+}
+
+bool
+ChunkList::prefetch(size_type index) {
+  if (index >= size() || base_type::at(index).is_valid() ||
+      !m_slot_create_chunk_reads || !m_data->completed_bitfield()->get(index))
+    return true;
+
+  ChunkReadCache* read_cache = m_manager->read_cache();
+
+  if (!read_cache->is_enabled())
+    return true;
+
+  switch (read_cache->state(this, index)) {
+  case ChunkReadCache::state_loading:
+    return false;
+  case ChunkReadCache::state_none:
+    break;
+  default:
+    return true;
+  }
+
+  chunk_read_list parts;
+
+  // Let 'get' report any errors opening the files.
+  if (!m_slot_create_chunk_reads(index, &parts))
+    return true;
+
+  uint32_t size = parts.back().position + parts.back().length;
+
+  return !read_cache->load(this, index, size, std::move(parts));
+}
+
 void
 ChunkList::clear_chunk(ChunkListNode* node, int flags) {
   if (!node->is_valid())
     throw internal_error("ChunkList::clear_chunk(...) !node->is_valid().");
 
-  delete node->chunk();
-  node->set_chunk(NULL);
+  bool allocated = !node->is_read_cached();
+
+  delete_chunk(node);
+
+  if (allocated)
+    m_manager->deallocate(m_chunk_size, (flags & get_dont_log) ? ChunkManager::allocate_dont_log : 0);
+}
+
+inline void
+ChunkList::delete_chunk(ChunkListNode* node) {
+  if (node->is_cached()) {
+    // The first part starts at the beginning of the buffer.
+    char* buffer = node->chunk()->front().chunk().ptr();
+
+    delete node->chunk();
+    m_manager->write_cache_deallocate(buffer, m_chunk_size);
+
+    node->set_cached(false);
+
+  } else if (node->is_read_cached()) {
+    m_manager->read_cache()->release(this, node->index());
+    node->set_read_cached(false);
 
-  m_manager->deallocate(m_chunk_size, (flags & get_dont_log) ? ChunkManager::allocate_dont_log : 0);
+  } else {
+    delete node->chunk();
+  }
+
+  node->set_chunk(NULL);
 }
 
 inline bool
@@ -258,6 +593,15 @@ ChunkList::sync_chunk(ChunkListNode* node, std::pair<int,bool> options) {
   if (node->references() <= 0 || node->writable() <= 0)
     throw internal_error("ChunkList::sync_chunk(...) got a node with invalid reference count.");
 
+  // The write releases the chunk once done.
+  if (node->is_cached()) {
+    if (!write_chunk(node, options.first == MemoryChunk::sync_sync))
+      return false;
+
+    node->set_sync_triggered(true);
+    return true;
+  }
+
   if (!node->chunk()->sync(options.first))
     return false;
 
@@ -286,8 +630,8 @@ ChunkList::sync_chunks(int flags) {
   if (flags & sync_all)
     split = m_queue.begin();
   else
-    split = std::stable_partition(m_queue.begin(), m_queue.end(), [](ChunkListNode* n) {
-      return 1 != n->writable();
+    split = std::stable_partition(m_queue.begin(), m_queue.end(), [this, flags](ChunkListNode* n) {
+      return 1 != n->writable() || (n->is_cached() && !check_cached_node(n, flags));
     });
 
   // Allow a flag that does more culling, so that we only get large
@@ -360,7 +704,16 @@ ChunkList::sync_options(ChunkListNode* node, int flags) {
   // const int members inside the ?: operators. The compiler should
   // be optimizing this anyway.
 
-  if (flags & sync_force) {
+  // Cached chunks have no mapping left for the kernel to write back,
+  // so they are always released once written.
+  if (node->is_cached()) {
+
+    if (flags & sync_safe)
+      return std::make_pair(MemoryChunk::sync_sync, true);
+    else
+      return std::make_pair(MemoryChunk::sync_async, true);
+
+  } else if (flags & sync_force) {
 
     if (flags & sync_safe)
       return std::make_pair(MemoryChunk::sync_sync, true);
@@ -403,6 +756,18 @@ ChunkList::check_node(ChunkListNode* node) {
     node->time_modified() + rak::timer::from_seconds(m_manager->timeout_sync()) < cachedTime;
 }
 
+// Cached chunks are held until their piece is verified, so that most
+// failed pieces never reach the files. They are still written if they
+// have gone unmodified for the sync timeout, if the caller needs the
+// memory or syncs everything, and when flushed on close.
+inline bool
+ChunkList::check_cached_node(ChunkListNode* node, int flags) {
+  return
+    !(flags & sync_use_timeout) ||
+    m_data->completed_bitfield()->get(node->index()) ||
+    check_node(node);
+}
+
 // Optimize the selection of chunks to sync. Continuous regions are
 // preferred, while if too fragmented or if too few chunks are
 // available it skips syncing of all chunks.
@@ -2,12 +2,14 @@
 #define LIBTORRENT_DATA_CHUNK_LIST_H
 
 #include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "chunk.h"
 #include "chunk_handle.h"
 #include "chunk_list_node.h"
+#include "chunk_read_cache.h"
 
 namespace torrent {
 
@@ -16,6 +18,7 @@ class Content;
 class download_data;
 class DownloadWrapper;
 class FileList;
+class thread_base;
 
 class ChunkList : private std::vector<ChunkListNode> {
 public:
@@ -24,6 +27,9 @@ public:
   typedef std::vector<ChunkListNode*>         Queue;
 
   typedef std::function<Chunk* (uint32_t, int)>    slot_chunk_index;
+  typedef std::function<Chunk* (uint32_t, char*)>  slot_chunk_buffer;
+  typedef std::function<bool (uint32_t, chunk_read_list*)> slot_chunk_parts;
+  typedef std::function<void (uint32_t)>           slot_chunk_loaded_type;
   typedef std::function<uint64_t ()>               slot_value;
   typedef std::function<void (const std::string&)> slot_string;
 
@@ -52,10 +58,11 @@ public:
   static const int get_blocking      = (1 << 1);
   static const int get_dont_log      = (1 << 2);
   static const int get_nonblock      = (1 << 3);
+  static const int get_read_cache    = (1 << 4);
 
   static const int flag_active       = (1 << 0);
 
-  ChunkList() : m_data(NULL), m_manager(NULL), m_flags(0), m_chunk_size(0) {}
+  ChunkList() : m_data(NULL), m_manager(NULL), m_flags(0), m_chunk_size(0), m_thread_disk(NULL), m_thread_owner(NULL) {}
   ~ChunkList() { clear(); }
 
   int                 flags() const                       { return m_flags; }
@@ -66,6 +73,7 @@ public:
 
   uint32_t            chunk_size() const                  { return m_chunk_size; }
   size_type           queue_size() const                  { return m_queue.size(); }
+  size_type           writes_size() const                 { return m_writes.size(); }
 
   download_data*      data()                              { return m_data; }
 
@@ -73,6 +81,9 @@ public:
   void                set_manager(ChunkManager* manager)  { m_manager = manager; }
   void                set_chunk_size(uint32_t cs)         { m_chunk_size = cs; }
 
+  // Cached chunks are written back on 'disk' and completed on 'owner'.
+  void                set_threads(thread_base* disk, thread_base* owner) { m_thread_disk = disk; m_thread_owner = owner; }
+
   bool                has_chunk(size_type index, int prot) const;
 
   void                resize(size_type to_size);
@@ -81,31 +92,64 @@ public:
   ChunkHandle         get(size_type index, int flags = 0);
   void                release(ChunkHandle* handle, int flags = 0);
 
+  // Returns true if a 'get_read_cache' get of a completed chunk will
+  // not block on disk reads, else starts loading it into the read
+  // cache and returns false until 'slot_chunk_loaded' is called.
+  bool                prefetch(size_type index);
+
   // Replace use_timeout with something like performance related
   // keyword. Then use that flag to decide if we should skip
   // non-continious regions.
 
-  // Returns the number of failed syncs.
+  // Returns the number of failed syncs. Cached chunks are only
+  // queued for writing, failed writes are reported to
+  // 'slot_storage_error' once done.
   uint32_t            sync_chunks(int flags);
 
+  // Writes back all cached chunks and waits for them, running the
+  // writes the disk thread has not started itself. Cached chunks that
+  // could not be written are released and their indices returned, as
+  // their data is lost. Must be called before 'clear'.
+  std::vector<size_type> flush();
+
   slot_string&        slot_storage_error()  { return m_slot_storage_error; }
   slot_chunk_index&   slot_create_chunk()   { return m_slot_create_chunk; }
   slot_value&         slot_free_diskspace() { return m_slot_free_diskspace; }
 
+  // Used by the write cache, which is disabled unless both are set
+  // along with the threads.
+  slot_chunk_buffer&  slot_create_cached_chunk() { return m_slot_create_cached_chunk; }
+  slot_chunk_parts&   slot_create_chunk_writes() { return m_slot_create_chunk_writes; }
+
+  // Used by the read cache, which is disabled unless set.
+  slot_chunk_parts&   slot_create_chunk_reads()  { return m_slot_create_chunk_reads; }
+  slot_chunk_loaded_type& slot_chunk_loaded()    { return m_slot_chunk_loaded; }
   typedef std::pair<iterator, Chunk::iterator> chunk_address_result;
 
   chunk_address_result find_address(void* ptr);
 
 private:
+  struct write_type;
+  typedef std::shared_ptr<write_type> write_ptr;
+  typedef std::vector<write_ptr>      write_list;
+
   inline bool         is_queued(ChunkListNode* node);
 
+  inline Chunk*       create_cached_chunk(ChunkListNode* node);
+  inline bool         write_chunk(ChunkListNode* node, bool sync);
+  void                write_done(const write_ptr& write);
+  void                finish_write(const write_ptr& write);
+  write_list::iterator find_write(ChunkListNode* node);
+
   inline void         clear_chunk(ChunkListNode* node, int flags = 0);
+  inline void         delete_chunk(ChunkListNode* node);
   inline bool         sync_chunk(ChunkListNode* node, std::pair<int,bool> options);
 
   Queue::iterator     partition_optimize(Queue::iterator first, Queue::iterator last, int weight, int maxDistance, bool dontSkip);
 
   inline Queue::iterator seek_range(Queue::iterator first, Queue::iterator last);
   inline bool            check_node(ChunkListNode* node);
+  inline bool            check_cached_node(ChunkListNode* node, int flags);
 
   std::pair<int,bool> sync_options(ChunkListNode* node, int flags);
 
@@ -116,9 +160,17 @@ private:
   int                 m_flags;
   uint32_t            m_chunk_size;
 
+  write_list          m_writes;
+  thread_base*        m_thread_disk;
+  thread_base*        m_thread_owner;
+
   slot_string         m_slot_storage_error;
   slot_chunk_index    m_slot_create_chunk;
   slot_value          m_slot_free_diskspace;
+  slot_chunk_buffer   m_slot_create_cached_chunk;
+  slot_chunk_parts    m_slot_create_chunk_writes;
+  slot_chunk_parts    m_slot_create_chunk_reads;
+  slot_chunk_loaded_type m_slot_chunk_loaded;
 };
 
 }
@@ -62,7 +62,11 @@ public:
     m_references(0),
     m_writable(0),
     m_blocking(0),
-    m_asyncTriggered(false) {}
+    m_asyncTriggered(false),
+    m_cached(false),
+    m_writing(false),
+    m_written(false),
+    m_readCached(false) {}
 
   bool                is_valid() const               { return m_chunk != NULL; }
 
@@ -81,6 +85,25 @@ public:
   bool                sync_triggered() const         { return m_asyncTriggered; }
   void                set_sync_triggered(bool v)     { m_asyncTriggered = v; }
 
+  // The chunk is held in ChunkManager's write cache rather than
+  // mapped from the files, and must be written back before release.
+  bool                is_cached() const              { return m_cached; }
+  void                set_cached(bool v)             { m_cached = v; }
+
+  // The cached chunk is being written back by the disk thread, which
+  // holds a writable reference until done.
+  bool                is_writing() const             { return m_writing; }
+  void                set_writing(bool v)            { m_writing = v; }
+
+  // Writes to the chunk have reached the files, so it must be mapped
+  // rather than cached as a new buffer would not hold them.
+  bool                is_written() const             { return m_written; }
+  void                set_written(bool v)            { m_written = v; }
+
+  // The chunk is pinned in ChunkManager's read cache.
+  bool                is_read_cached() const         { return m_readCached; }
+  void                set_read_cached(bool v)        { m_readCached = v; }
+
   int                 references() const             { return m_references; }
   int                 dec_references()               { return --m_references; }
   int                 inc_references()               { return ++m_references; }
@@ -105,6 +128,10 @@ private:
   int                 m_blocking;
 
   bool                m_asyncTriggered;
+  bool                m_cached;
+  bool                m_writing;
+  bool                m_written;
+  bool                m_readCached;
 
   rak::timer          m_timeModified;
   rak::timer          m_timePreloaded;
@@ -51,9 +51,13 @@ ChunkPart::clear() {
     m_chunk.unmap();
     break;
 
+  // The buffer is owned by ChunkManager's write cache.
+  case MAPPED_CACHE:
+    break;
+
   default:
   case MAPPED_STATIC:
-    throw internal_error("ChunkPart::clear() only MAPPED_MMAP supported.");
+    throw internal_error("ChunkPart::clear() only MAPPED_MMAP and MAPPED_CACHE supported.");
     break;
   }
 
@@ -47,7 +47,8 @@ class lt_cacheline_aligned ChunkPart {
 public:
   typedef enum {
     MAPPED_MMAP,
-    MAPPED_STATIC
+    MAPPED_STATIC,
+    MAPPED_CACHE
   } mapped_type;
 
   ChunkPart(mapped_type mapped, const MemoryChunk& c, uint32_t pos) :
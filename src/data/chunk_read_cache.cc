@@ -0,0 +1,348 @@
+#include "config.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sys/mman.h>
+
+#include "torrent/exceptions.h"
+#include "torrent/utils/thread_base.h"
+
+#include "chunk.h"
+#include "chunk_list.h"
+#include "chunk_read_cache.h"
+#include "socket_file.h"
+
+namespace torrent {
+
+ChunkReadCache::~ChunkReadCache() {
+  // Buffers of loads in flight belong to their tasks.
+  for (auto& entry : m_entries)
+    if (entry.second.list != list_loading)
+      free_buffer(entry.second);
+}
+
+void
+ChunkReadCache::set_max_memory(uint64_t bytes) {
+  m_max_memory = bytes;
+  m_target = std::min(m_target, bytes);
+
+  make_room(0, false);
+  trim_ghosts();
+}
+
+ChunkReadCache::state_type
+ChunkReadCache::state(ChunkList* list, uint32_t index) const {
+  auto itr = m_entries.find(key_type(list, index));
+
+  if (itr == m_entries.end())
+    return state_none;
+
+  switch (itr->second.list) {
+  case list_t1:
+  case list_t2:
+    return state_resident;
+  case list_loading:
+    return state_loading;
+  default:
+    return itr->second.failed ? state_failed : state_none;
+  }
+}
+
+Chunk*
+ChunkReadCache::acquire(ChunkList* list, uint32_t index) {
+  auto itr = m_entries.find(key_type(list, index));
+
+  if (itr == m_entries.end() || (itr->second.list != list_t1 && itr->second.list != list_t2))
+    return NULL;
+
+  m_stats_hits++;
+
+  move_to(itr, list_t2);
+  itr->second.pins++;
+
+  return itr->second.chunk;
+}
+
+void
+ChunkReadCache::release(ChunkList* list, uint32_t index) {
+  auto itr = m_entries.find(key_type(list, index));
+
+  if (itr == m_entries.end() || itr->second.pins == 0)
+    throw internal_error("ChunkReadCache::release(...) chunk is not pinned.");
+
+  if (--itr->second.pins == 0 && m_memory_usage > m_max_memory)
+    make_room(0, false);
+}
+
+// A miss found in B1 means T1 was too small, and one found in B2
+// that T2 was, so the target of T1 moves by the ratio of the ghost
+// lists as in ARC.
+bool
+ChunkReadCache::load(ChunkList* list, uint32_t index, uint32_t size, chunk_read_list parts) {
+  if (!is_enabled()) {
+    close_parts(parts);
+    return false;
+  }
+
+  key_type key(list, index);
+  auto itr = m_entries.find(key);
+
+  list_type target = list_t1;
+  bool ghost_b2 = false;
+
+  if (itr != m_entries.end()) {
+    uint64_t b1 = std::max<uint64_t>(m_list_bytes[list_b1], 1);
+    uint64_t b2 = std::max<uint64_t>(m_list_bytes[list_b2], 1);
+
+    switch (itr->second.list) {
+    case list_b1:
+      m_target = std::min(m_max_memory, m_target + std::max<uint64_t>(b2 / b1, 1) * size);
+      break;
+    case list_b2:
+      m_target -= std::min(m_target, std::max<uint64_t>(b1 / b2, 1) * size);
+      ghost_b2 = true;
+      break;
+    default:
+      throw internal_error("ChunkReadCache::load(...) chunk is already cached.");
+    }
+
+    m_stats_ghost_hits++;
+    target = list_t2;
+  }
+
+  m_stats_misses++;
+
+  char* buffer = NULL;
+
+  if (!make_room(size, ghost_b2) ||
+      (buffer = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0)) == MAP_FAILED) {
+    close_parts(parts);
+    return false;
+  }
+
+  if (itr != m_entries.end())
+    remove(itr);
+
+  uint64_t sequence = ++m_sequence;
+
+  m_lists[list_loading].push_back(key);
+  m_list_bytes[list_loading] += size;
+  m_memory_usage += size;
+
+  m_entries.emplace(key, entry_type{ list_loading, target, size, 0, sequence, false, buffer, NULL, std::prev(m_lists[list_loading].end()) });
+
+  trim_ghosts();
+
+  m_thread_disk->post([this, key, sequence, buffer, size, parts = std::move(parts), owner = m_thread_owner]() mutable {
+      bool success = read_parts(buffer, parts);
+
+      owner->post([this, key, sequence, buffer, size, parts = std::move(parts), success]() mutable {
+          load_done(key, sequence, buffer, size, std::move(parts), success);
+        });
+    });
+
+  return true;
+}
+
+void
+ChunkReadCache::erase(ChunkList* list, uint32_t index) {
+  auto itr = m_entries.find(key_type(list, index));
+
+  if (itr != m_entries.end())
+    erase_entry(itr);
+}
+
+void
+ChunkReadCache::erase(ChunkList* list) {
+  for (auto itr = m_entries.begin(); itr != m_entries.end(); ) {
+    auto current = itr++;
+
+    if (current->first.first == list)
+      erase_entry(current);
+  }
+}
+
+bool
+ChunkReadCache::read_parts(char* buffer, chunk_read_list& parts) {
+  bool success = true;
+
+  for (auto& part : parts) {
+    int64_t done = 0;
+
+    if (part.fd != -1 && success)
+      done = SocketFile(part.fd).read(buffer + part.position, part.length, part.offset);
+
+    if (done == -1)
+      success = false;
+    else
+      std::memset(buffer + part.position + done, 0, part.length - done);
+  }
+
+  close_parts(parts);
+  return success;
+}
+
+// Like the write cache, each part maps a slice of the buffer with the
+// page aligned start MemoryChunk requires.
+Chunk*
+ChunkReadCache::create_chunk(char* buffer, const chunk_read_list& parts) {
+  Chunk* chunk = new Chunk;
+
+  for (const auto& part : parts) {
+    char* begin = buffer + part.position;
+
+    chunk->push_back(ChunkPart::MAPPED_CACHE,
+                     MemoryChunk(begin - part.position % MemoryChunk::page_size(), begin, begin + part.length,
+                                 MemoryChunk::prot_read, MemoryChunk::map_anon));
+  }
+
+  return chunk;
+}
+
+void
+ChunkReadCache::close_parts(chunk_read_list& parts) {
+  for (auto& part : parts) {
+    SocketFile file(part.fd);
+    file.close();
+
+    part.fd = -1;
+  }
+}
+
+// Loads whose entry was erased or replaced in the meantime are
+// discarded, a failed load leaves a ghost so that the caller falls
+// back to mapping the files instead of retrying.
+void
+ChunkReadCache::load_done(key_type key, uint64_t sequence, char* buffer, uint32_t size, chunk_read_list parts, bool success) {
+  auto itr = m_entries.find(key);
+
+  if (itr == m_entries.end() || itr->second.list != list_loading || itr->second.sequence != sequence) {
+    if (munmap(buffer, size) != 0)
+      throw internal_error("ChunkReadCache::load_done(...) munmap failed.");
+
+    m_memory_usage -= size;
+    return;
+  }
+
+  if (success) {
+    itr->second.chunk = create_chunk(buffer, parts);
+    move_to(itr, itr->second.target);
+
+  } else {
+    free_buffer(itr->second);
+    move_to(itr, list_b1);
+
+    itr->second.failed = true;
+  }
+
+  if (m_memory_usage > m_max_memory)
+    make_room(0, false);
+
+  trim_ghosts();
+
+  if (key.first->slot_chunk_loaded())
+    key.first->slot_chunk_loaded()(key.second);
+}
+
+void
+ChunkReadCache::move_to(entry_map::iterator itr, list_type list) {
+  entry_type& entry = itr->second;
+
+  m_lists[entry.list].erase(entry.position);
+  m_list_bytes[entry.list] -= entry.size;
+
+  m_lists[list].push_back(itr->first);
+  m_list_bytes[list] += entry.size;
+
+  entry.list = list;
+  entry.position = std::prev(m_lists[list].end());
+}
+
+void
+ChunkReadCache::remove(entry_map::iterator itr) {
+  entry_type& entry = itr->second;
+
+  m_lists[entry.list].erase(entry.position);
+  m_list_bytes[entry.list] -= entry.size;
+
+  free_buffer(entry);
+  m_entries.erase(itr);
+}
+
+// The buffer of a loading entry stays with its task, which unmaps it
+// once it sees the entry is gone.
+void
+ChunkReadCache::erase_entry(entry_map::iterator itr) {
+  if (itr->second.pins != 0)
+    throw internal_error("ChunkReadCache::erase(...) chunk is pinned.");
+
+  if (itr->second.list == list_loading)
+    itr->second.buffer = NULL;
+
+  remove(itr);
+}
+
+void
+ChunkReadCache::free_buffer(entry_type& entry) {
+  if (entry.buffer == NULL)
+    return;
+
+  delete entry.chunk;
+
+  if (munmap(entry.buffer, entry.size) != 0)
+    throw internal_error("ChunkReadCache::free_buffer(...) munmap failed.");
+
+  m_memory_usage -= entry.size;
+
+  entry.buffer = NULL;
+  entry.chunk = NULL;
+}
+
+bool
+ChunkReadCache::make_room(uint32_t size, bool ghost_b2) {
+  if (size > m_max_memory)
+    return false;
+
+  while (m_memory_usage + size > m_max_memory) {
+    bool from_t1 =
+      m_list_bytes[list_t1] != 0 &&
+      (m_list_bytes[list_t1] > m_target || (ghost_b2 && m_list_bytes[list_t1] == m_target));
+
+    if (!evict_lru(from_t1 ? list_t1 : list_t2) && !evict_lru(from_t1 ? list_t2 : list_t1))
+      return false;
+  }
+
+  return true;
+}
+
+bool
+ChunkReadCache::evict_lru(list_type list) {
+  auto key_itr = std::find_if(m_lists[list].begin(), m_lists[list].end(), [this](const key_type& key) {
+      return m_entries.find(key)->second.pins == 0;
+    });
+
+  if (key_itr == m_lists[list].end())
+    return false;
+
+  auto itr = m_entries.find(*key_itr);
+
+  free_buffer(itr->second);
+  move_to(itr, list == list_t1 ? list_b1 : list_b2);
+
+  m_stats_evictions++;
+  return true;
+}
+
+// Ghosts are bounded so that T1 and B1 together stay within the
+// budget and the whole directory within twice the budget.
+void
+ChunkReadCache::trim_ghosts() {
+  while (!m_lists[list_b1].empty() && m_list_bytes[list_t1] + m_list_bytes[list_b1] > m_max_memory)
+    remove(m_entries.find(m_lists[list_b1].front()));
+
+  while (!m_lists[list_b2].empty() &&
+         m_list_bytes[list_t1] + m_list_bytes[list_t2] + m_list_bytes[list_b1] + m_list_bytes[list_b2] > 2 * m_max_memory)
+    remove(m_entries.find(m_lists[list_b2].front()));
+}
+
+}
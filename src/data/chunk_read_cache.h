@@ -0,0 +1,156 @@
+// Session wide cache of completed chunks used for uploads, so that
+// popular chunks are served from memory instead of being mapped and
+// paged in again for every burst of requests.
+//
+// Entries are keyed by chunk list and index, and are evicted using
+// ARC weighted by chunk size: recently used chunks live in T1 and
+// chunks used more than once in T2, while the B1 and B2 ghost lists
+// remember evicted keys to adapt the target size of T1. Chunks that
+// are referenced by a ChunkList are pinned and never evicted.
+//
+// Misses are read on the disk thread into a freshly mapped buffer,
+// and become visible to 'acquire' once the owner thread has processed
+// the completion, which then calls the chunk list's
+// 'slot_chunk_loaded'.
+
+#ifndef LIBTORRENT_DATA_CHUNK_READ_CACHE_H
+#define LIBTORRENT_DATA_CHUNK_READ_CACHE_H
+
+#include <cinttypes>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace torrent {
+
+class Chunk;
+class ChunkList;
+class thread_base;
+
+struct chunk_read_part {
+  // Duplicated descriptor that is closed by the reader or writer, or
+  // -1 for padding that reads as zeros and is never written.
+  int                 fd;
+  uint64_t            offset;
+  uint32_t            position;
+  uint32_t            length;
+};
+
+typedef std::vector<chunk_read_part> chunk_read_list;
+
+class ChunkReadCache {
+public:
+  typedef std::pair<ChunkList*, uint32_t> key_type;
+
+  enum state_type {
+    state_none,
+    state_loading,
+    state_resident,
+    state_failed
+  };
+
+  ChunkReadCache() = default;
+  ~ChunkReadCache();
+  ChunkReadCache(const ChunkReadCache&) = delete;
+  ChunkReadCache& operator=(const ChunkReadCache&) = delete;
+
+  bool                is_enabled() const                { return m_max_memory != 0 && m_thread_disk != NULL; }
+
+  uint64_t            max_memory() const                { return m_max_memory; }
+  void                set_max_memory(uint64_t bytes);
+
+  // Includes buffers of chunks being loaded.
+  uint64_t            memory_usage() const              { return m_memory_usage; }
+  uint64_t            target_recent() const             { return m_target; }
+
+  uint64_t            stats_hits() const                { return m_stats_hits; }
+  uint64_t            stats_misses() const              { return m_stats_misses; }
+  uint64_t            stats_ghost_hits() const          { return m_stats_ghost_hits; }
+  uint64_t            stats_evictions() const           { return m_stats_evictions; }
+
+  // Loads are read on 'disk' and completed on 'owner'.
+  void                set_threads(thread_base* disk, thread_base* owner) { m_thread_disk = disk; m_thread_owner = owner; }
+
+  state_type          state(ChunkList* list, uint32_t index) const;
+
+  // Returns a pinned read-only chunk if resident, else NULL.
+  Chunk*              acquire(ChunkList* list, uint32_t index);
+  void                release(ChunkList* list, uint32_t index);
+
+  // Takes ownership of the descriptors in 'parts'. Returns false if
+  // the chunk could not fit within the budget, in which case the
+  // descriptors have been closed.
+  bool                load(ChunkList* list, uint32_t index, uint32_t size, chunk_read_list parts);
+
+  // Drops unpinned entries and cancels loads, e.g. when the chunk is
+  // about to be modified or the chunk list is cleared.
+  void                erase(ChunkList* list, uint32_t index);
+  void                erase(ChunkList* list);
+
+private:
+  enum list_type {
+    list_t1,
+    list_t2,
+    list_b1,
+    list_b2,
+    list_loading,
+    list_size
+  };
+
+  struct key_hash {
+    size_t operator () (const key_type& key) const { return std::hash<ChunkList*>()(key.first) ^ (std::hash<uint32_t>()(key.second) << 1); }
+  };
+
+  struct entry_type {
+    list_type                     list;
+    list_type                     target;
+    uint32_t                      size;
+    uint32_t                      pins;
+    uint64_t                      sequence;
+    bool                          failed;
+    char*                         buffer;
+    Chunk*                        chunk;
+    std::list<key_type>::iterator position;
+  };
+
+  typedef std::unordered_map<key_type, entry_type, key_hash> entry_map;
+
+  static bool         read_parts(char* buffer, chunk_read_list& parts);
+  static Chunk*       create_chunk(char* buffer, const chunk_read_list& parts);
+  static void         close_parts(chunk_read_list& parts);
+
+  void                load_done(key_type key, uint64_t sequence, char* buffer, uint32_t size, chunk_read_list parts, bool success);
+
+  void                move_to(entry_map::iterator itr, list_type list);
+  void                remove(entry_map::iterator itr);
+  void                erase_entry(entry_map::iterator itr);
+  void                free_buffer(entry_type& entry);
+
+  bool                make_room(uint32_t size, bool ghost_b2);
+  bool                evict_lru(list_type list);
+  void                trim_ghosts();
+
+  entry_map           m_entries;
+
+  std::list<key_type> m_lists[list_size];
+  uint64_t            m_list_bytes[list_size]{};
+
+  uint64_t            m_max_memory{0};
+  uint64_t            m_memory_usage{0};
+  uint64_t            m_target{0};
+  uint64_t            m_sequence{0};
+
+  uint64_t            m_stats_hits{0};
+  uint64_t            m_stats_misses{0};
+  uint64_t            m_stats_ghost_hits{0};
+  uint64_t            m_stats_evictions{0};
+
+  thread_base*        m_thread_disk{NULL};
+  thread_base*        m_thread_owner{NULL};
+};
+
+}
+
+#endif
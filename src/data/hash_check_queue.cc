@@ -46,7 +46,7 @@ HashCheckQueue::push_back(HashChunk* hash_chunk) {
 
 bool
 HashCheckQueue::remove(HashChunk* hash_chunk) {
-  auto lock = std::scoped_lock(m_lock);
+  auto lock = std::unique_lock(m_lock);
 
   bool result;
   iterator itr = std::find(begin(), end(), hash_chunk);
@@ -60,6 +60,7 @@ HashCheckQueue::remove(HashChunk* hash_chunk) {
     instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, -size);
 
   } else {
+    m_cv_working.wait(lock, [this, hash_chunk] { return m_working != hash_chunk; });
     result = false;
   }
 
@@ -73,6 +74,7 @@ HashCheckQueue::perform() {
   while (!empty()) {
     HashChunk* hash_chunk = base_type::front();
     base_type::pop_front();
+    m_working = hash_chunk;
 
     if (!hash_chunk->chunk()->is_loaded())
       throw internal_error("HashCheckQueue::perform(): !entry.node->is_loaded().");
@@ -81,6 +83,8 @@ HashCheckQueue::perform() {
     instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, -1);
     instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, -size);
 
+    instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_QUEUED_BYTES, hash_chunk->remaining());
+
     lock.unlock();
 
     if (!hash_chunk->perform(~uint32_t(), true))
@@ -91,6 +95,9 @@ HashCheckQueue::perform() {
 
     m_slot_chunk_done(hash_chunk, hash);
     lock.lock();
+
+    m_working = nullptr;
+    m_cv_working.notify_all();
   }
 }
 
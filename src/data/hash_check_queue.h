@@ -1,6 +1,7 @@
 #ifndef LIBTORRENT_DATA_HASH_CHECK_QUEUE_H
 #define LIBTORRENT_DATA_HASH_CHECK_QUEUE_H
 
+#include <condition_variable>
 #include <deque>
 #include <functional>
 #include <mutex>
@@ -35,13 +36,18 @@ public:
   void                push_back(HashChunk* node);
   void                perform();
 
+  // Returns false if the chunk was already taken for hashing, after
+  // waiting for 'slot_chunk_done' to return if it is being hashed.
   bool                remove(HashChunk* node);
 
   slot_chunk_handle&  slot_chunk_done() { return m_slot_chunk_done; }
 
 private:
-  std::mutex          m_lock;
-  slot_chunk_handle   m_slot_chunk_done;
+  std::mutex              m_lock;
+  std::condition_variable m_cv_working;
+  HashChunk*              m_working{nullptr};
+
+  slot_chunk_handle       m_slot_chunk_done;
 };
 
 }
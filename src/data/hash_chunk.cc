@@ -39,9 +39,27 @@
 #include "hash_chunk.h"
 #include "chunk.h"
 #include "chunk_list_node.h"
+#include "utils/instrumentation.h"
 
 namespace torrent {
 
+void
+HashPrefix::update(Chunk* chunk, uint32_t length) {
+  if (m_length + length > chunk->chunk_size())
+    throw internal_error("HashPrefix::update(...) received length out of range");
+
+  instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_INLINE_BYTES, length);
+
+  while (length != 0) {
+    Chunk::iterator itr = chunk->at_position(m_length);
+    uint32_t l = std::min(length, itr->size() - (m_length - itr->position()));
+
+    m_hash.update(itr->chunk().begin() + m_length - itr->position(), l);
+    m_length += l;
+    length   -= l;
+  }
+}
+
 bool
 HashChunk::perform(uint32_t length, bool force) {
   length = std::min(length, remaining());
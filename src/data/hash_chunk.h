@@ -15,12 +15,30 @@ namespace torrent {
 
 class ChunkListNode;
 
+// Running hash of the start of a chunk, updated as the data becomes
+// available in order so that HashChunk only needs to hash the rest.
+class HashPrefix {
+public:
+  HashPrefix()                                                { m_hash.init(); }
+
+  uint32_t            length() const                          { return m_length; }
+  const Sha1&         hash() const                            { return m_hash; }
+
+  // Hashes the 'length' bytes of 'chunk' following the prefix.
+  void                update(Chunk* chunk, uint32_t length);
+
+private:
+  uint32_t            m_length{0};
+  Sha1                m_hash;
+};
+
 class HashChunk {
 public:
   HashChunk()         {}
   HashChunk(ChunkHandle h)  { set_chunk(h); }
 
   void                set_chunk(ChunkHandle h)                { m_position = 0; m_chunk = h; m_hash.init(); }
+  void                set_prefix(const HashPrefix& prefix)    { m_position = prefix.length(); m_hash = prefix.hash(); }
 
   ChunkHandle*        chunk()                                 { return &m_chunk; }
   ChunkHandle&        handle()                                { return m_chunk; }
@@ -42,15 +42,16 @@ struct HashQueueWillneed {
 // disk usage. But this may cause too much blocking as it will think
 // everything is in memory, thus we need to throttle.
 
-HashQueue::HashQueue(thread_disk* thread) :
-    m_thread_disk(thread) {
+HashQueue::HashQueue(thread_disk* thread, thread_base* owner) :
+    m_thread_disk(thread),
+    m_thread_owner(owner) {
   m_thread_disk->hash_queue()->slot_chunk_done() = [this](auto hc, const auto& hv) { chunk_done(hc, hv); };
 }
 
 // If we're done immediately, move the chunk to the front of the list so
 // the next work cycle gets stuff done.
 void
-HashQueue::push_back(ChunkHandle handle, HashQueueNode::id_type id, slot_done_type d) {
+HashQueue::push_back(ChunkHandle handle, HashQueueNode::id_type id, slot_done_type d, const HashPrefix* prefix) {
   LT_LOG_DATA(id, DEBUG, "Adding index:%" PRIu32 " to queue.", handle.index());
 
   if (!handle.is_loaded())
@@ -58,6 +59,9 @@ HashQueue::push_back(ChunkHandle handle, HashQueueNode::id_type id, slot_done_ty
 
   HashChunk* hash_chunk = new HashChunk(handle);
 
+  if (prefix != NULL)
+    hash_chunk->set_prefix(*prefix);
+
   base_type::push_back(HashQueueNode(id, hash_chunk, d));
 
   m_thread_disk->hash_queue()->push_back(hash_chunk);
@@ -88,14 +92,10 @@ HashQueue::remove(HashQueueNode::id_type id) {
     bool result = m_thread_disk->hash_queue()->remove(hash_chunk);
     thread_base::acquire_global_lock();
 
-    // The hash chunk was not found, so we need to wait until the hash
-    // check finishes.
-    if (!result) {
-      auto lock = std::unique_lock(m_done_chunks_lock);
-
-      m_cv.wait(lock, [this, hash_chunk] { return m_done_chunks.find(hash_chunk) != m_done_chunks.end(); });
-      m_done_chunks.erase(hash_chunk);
-    }
+    // The hash check has finished and posted the chunk, which must be
+    // ignored when the task is run.
+    if (!result)
+      m_cancelled.insert(hash_chunk);
 
     itr.slot_done()(*hash_chunk->chunk(), NULL);
     itr.clear();
@@ -116,44 +116,40 @@ HashQueue::clear() {
 }
 
 void
-HashQueue::work() {
-  auto lock = std::scoped_lock(m_done_chunks_lock);
+HashQueue::chunk_finished(HashChunk* hash_chunk, const HashString& hash_value) {
+  auto cancelled_itr = m_cancelled.find(hash_chunk);
 
-  while (!m_done_chunks.empty()) {
-    HashChunk* hash_chunk = m_done_chunks.begin()->first;
-    HashString hash_value = m_done_chunks.begin()->second;
-    m_done_chunks.erase(m_done_chunks.begin());
+  if (cancelled_itr != m_cancelled.end()) {
+    m_cancelled.erase(cancelled_itr);
+    return;
+  }
 
-    // TODO: This is not optimal as we jump around... Check for front
-    // of HashQueue in done_chunks instead.
+  // TODO: This is not optimal as we jump around... Check the front
+  // of HashQueue first instead.
 
-    iterator itr = std::find_if(begin(), end(), std::bind(std::equal_to<HashChunk*>(),
-                                                          hash_chunk,
-                                                          std::bind(&HashQueueNode::get_chunk, std::placeholders::_1)));
+  iterator itr = std::find_if(begin(), end(), std::bind(std::equal_to<HashChunk*>(),
+                                                        hash_chunk,
+                                                        std::bind(&HashQueueNode::get_chunk, std::placeholders::_1)));
 
-    // TODO: Fix this...
-    if (itr == end())
-      throw internal_error("Could not find done chunk's node.");
+  // TODO: Fix this...
+  if (itr == end())
+    throw internal_error("Could not find done chunk's node.");
 
-    LT_LOG_DATA(itr->id(), DEBUG, "Passing index:%" PRIu32 " to owner: %s.",
-                hash_chunk->handle().index(),
-                hash_string_to_hex_str(hash_value).c_str());
+  LT_LOG_DATA(itr->id(), DEBUG, "Passing index:%" PRIu32 " to owner: %s.",
+              hash_chunk->handle().index(),
+              hash_string_to_hex_str(hash_value).c_str());
 
-    HashQueueNode::slot_done_type slotDone = itr->slot_done();
-    base_type::erase(itr);
+  HashQueueNode::slot_done_type slotDone = itr->slot_done();
+  base_type::erase(itr);
 
-    slotDone(hash_chunk->handle(), hash_value.c_str());
-    delete hash_chunk;
-  }
+  slotDone(hash_chunk->handle(), hash_value.c_str());
+  delete hash_chunk;
 }
 
+// Called from the disk thread.
 void
 HashQueue::chunk_done(HashChunk* hash_chunk, const HashString& hash_value) {
-  auto lock = std::scoped_lock(m_done_chunks_lock);
-
-  m_done_chunks[hash_chunk] = hash_value;
-  m_slot_has_work(m_done_chunks.empty());
-  m_cv.notify_all();
+  m_thread_owner->post([this, hash_chunk, hash_value] { chunk_finished(hash_chunk, hash_value); });
 }
 
 }
@@ -37,11 +37,9 @@
 #ifndef LIBTORRENT_DATA_HASH_QUEUE_H
 #define LIBTORRENT_DATA_HASH_QUEUE_H
 
-#include <condition_variable>
 #include <deque>
 #include <functional>
-#include <map>
-#include <mutex>
+#include <unordered_set>
 
 #include "torrent/hash_string.h"
 #include "hash_queue_node.h"
@@ -50,6 +48,8 @@
 namespace torrent {
 
 class HashChunk;
+class HashPrefix;
+class thread_base;
 class thread_disk;
 
 // Calculating hash of incore memory is blindingly fast, it's always
@@ -57,14 +57,16 @@ class thread_disk;
 // of large resumed downloads, try to check the hash immediately. This
 // helps us in getting as much done as possible while the pages are in
 // memory.
+//
+// Finished chunks are posted to the owner thread's task queue by the
+// disk thread.
 
 class lt_cacheline_aligned HashQueue : private std::deque<HashQueueNode> {
 public:
-  typedef std::deque<HashQueueNode>                 base_type;
-  typedef std::map<HashChunk*, torrent::HashString> done_chunks_type;
+  typedef std::deque<HashQueueNode>        base_type;
+  typedef std::unordered_multiset<HashChunk*> cancelled_type;
 
   typedef HashQueueNode::slot_done_type   slot_done_type;
-  typedef std::function<void (bool)> slot_bool;
 
   using base_type::iterator;
 
@@ -76,10 +78,11 @@ public:
   using base_type::front;
   using base_type::back;
 
-  HashQueue(thread_disk* thread);
+  HashQueue(thread_disk* thread, thread_base* owner);
   ~HashQueue() { clear(); }
 
-  void                push_back(ChunkHandle handle, HashQueueNode::id_type id, slot_done_type d);
+  // The hash check continues from 'prefix' if not NULL.
+  void                push_back(ChunkHandle handle, HashQueueNode::id_type id, slot_done_type d, const HashPrefix* prefix = NULL);
 
   bool                has(HashQueueNode::id_type id);
   bool                has(HashQueueNode::id_type id, uint32_t index);
@@ -87,20 +90,16 @@ public:
   void                remove(HashQueueNode::id_type id);
   void                clear();
 
-  void                work();
-
-  slot_bool&          slot_has_work() { return m_slot_has_work; }
-
 private:
   void                chunk_done(HashChunk* hash_chunk, const HashString& hash_value);
+  void                chunk_finished(HashChunk* hash_chunk, const HashString& hash_value);
 
   thread_disk*        m_thread_disk;
+  thread_base*        m_thread_owner;
 
-  done_chunks_type    m_done_chunks;
-  slot_bool           m_slot_has_work;
-
-  std::mutex m_done_chunks_lock;
-  std::condition_variable m_cv;
+  // Chunks removed after hashing started, whose completion is still
+  // in the owner's task queue.
+  cancelled_type      m_cancelled;
 };
 
 }
@@ -0,0 +1,94 @@
+#include "config.h"
+
+#include "torrent/exceptions.h"
+#include "utils/sha256.h"
+
+#include "merkle_tree.h"
+
+namespace torrent {
+
+static std::string
+merkle_hash_pair(const char* left, const char* right) {
+  char buffer[2 * merkle_hash_size];
+  std::string result(merkle_hash_size, '\0');
+
+  std::memcpy(buffer, left, merkle_hash_size);
+  std::memcpy(buffer + merkle_hash_size, right, merkle_hash_size);
+
+  sha256_hash(buffer, sizeof(buffer), &result[0]);
+  return result;
+}
+
+unsigned int
+merkle_height(uint32_t length) {
+  if (length < merkle_block_size || (length & (length - 1)) != 0)
+    throw internal_error("merkle_height(...) length is not a power of two of at least one block.");
+
+  unsigned int height = 0;
+
+  while ((merkle_block_size << height) != length)
+    height++;
+
+  return height;
+}
+
+std::string
+merkle_pad_hash(unsigned int height) {
+  std::string hash(merkle_hash_size, '\0');
+
+  while (height-- != 0)
+    hash = merkle_hash_pair(hash.c_str(), hash.c_str());
+
+  return hash;
+}
+
+std::string
+merkle_root(const std::string& layer, unsigned int height) {
+  if (layer.empty() || layer.size() % merkle_hash_size != 0)
+    return std::string();
+
+  std::string nodes = layer;
+  std::string pad = merkle_pad_hash(height);
+
+  while (nodes.size() > merkle_hash_size) {
+    std::string parents;
+    parents.reserve((nodes.size() / merkle_hash_size + 1) / 2 * merkle_hash_size);
+
+    for (size_t pos = 0; pos < nodes.size(); pos += 2 * merkle_hash_size) {
+      const char* right = pos + merkle_hash_size < nodes.size() ? nodes.c_str() + pos + merkle_hash_size : pad.c_str();
+
+      parents += merkle_hash_pair(nodes.c_str() + pos, right);
+    }
+
+    nodes.swap(parents);
+    pad = merkle_hash_pair(pad.c_str(), pad.c_str());
+  }
+
+  return nodes;
+}
+
+std::string
+merkle_subtree_root(const std::string& leaves, unsigned int height) {
+  unsigned int covered = 0;
+
+  while (((size_t)merkle_hash_size << covered) < leaves.size())
+    covered++;
+
+  if (covered > height)
+    return std::string();
+
+  std::string root = merkle_root(leaves, 0);
+  std::string pad = merkle_pad_hash(covered);
+
+  if (root.empty())
+    return root;
+
+  for (; covered != height; covered++) {
+    root = merkle_hash_pair(root.c_str(), pad.c_str());
+    pad = merkle_hash_pair(pad.c_str(), pad.c_str());
+  }
+
+  return root;
+}
+
+}
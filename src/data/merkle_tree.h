@@ -0,0 +1,37 @@
+// BitTorrent v2 (BEP 52) merkle trees. The leaves are the SHA-256
+// hashes of the 16 KiB blocks of a file, and every node hashes the
+// concatenation of its two children. Each layer is padded up to a
+// power of two with the hashes of all-zero subtrees.
+
+#ifndef LIBTORRENT_DATA_MERKLE_TREE_H
+#define LIBTORRENT_DATA_MERKLE_TREE_H
+
+#include <cinttypes>
+#include <string>
+
+namespace torrent {
+
+static const uint32_t merkle_block_size = 16 << 10;
+static const uint32_t merkle_hash_size  = 32;
+
+// Number of layers between the leaves and the layer whose nodes each
+// cover 'length' bytes, which must be a power of two of at least one
+// block.
+unsigned int merkle_height(uint32_t length);
+
+// Root of a subtree of 'height' layers whose leaves are all zero.
+std::string  merkle_pad_hash(unsigned int height);
+
+// Root of the tree whose layer at 'height' above the leaves is the
+// concatenated node hashes in 'layer'. Returns an empty string if the
+// layer is empty or not a whole number of hashes.
+std::string  merkle_root(const std::string& layer, unsigned int height);
+
+// Root of the subtree 'height' layers above the leaf hashes in
+// 'leaves', with the leaves missing at the end being all zero. Returns
+// an empty string if there are no leaves or more than fit.
+std::string  merkle_subtree_root(const std::string& leaves, unsigned int height);
+
+}
+
+#endif
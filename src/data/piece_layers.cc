@@ -0,0 +1,92 @@
+#include "config.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "torrent/exceptions.h"
+#include "torrent/data/block_list.h"
+#include "utils/sha256.h"
+
+#include "chunk.h"
+#include "piece_layers.h"
+
+namespace torrent {
+
+void
+PieceLayers::set_piece(uint32_t index, const char* hash, uint32_t length, unsigned int height) {
+  if (length == 0 || length > ((uint64_t)merkle_block_size << height))
+    throw internal_error("PieceLayers::set_piece(...) length does not fit the subtree.");
+
+  if (index >= m_pieces.size())
+    m_pieces.resize(index + 1, piece_type{ {}, 0, 0 });
+
+  std::memcpy(m_pieces[index].hash, hash, merkle_hash_size);
+  m_pieces[index].length = length;
+  m_pieces[index].height = height;
+}
+
+uint32_t
+PieceLayers::leaf_count(uint32_t index) const {
+  if (!has_piece(index))
+    return 0;
+
+  return (m_pieces[index].length + merkle_block_size - 1) / merkle_block_size;
+}
+
+void
+PieceLayers::hash_leaf(uint32_t index, uint32_t leaf, Chunk* chunk, char* buffer) const {
+  if (leaf >= leaf_count(index))
+    throw internal_error("PieceLayers::hash_leaf(...) leaf out of range.");
+
+  uint32_t position = leaf * merkle_block_size;
+  uint32_t length = std::min(merkle_block_size, m_pieces[index].length - position);
+
+  if (position + length > chunk->chunk_size())
+    throw internal_error("PieceLayers::hash_leaf(...) chunk is smaller than the piece's file data.");
+
+  Sha256 sha256;
+  sha256.init();
+
+  while (length != 0) {
+    Chunk::iterator itr = chunk->at_position(position);
+    uint32_t l = std::min(length, itr->size() - (position - itr->position()));
+
+    sha256.update(itr->chunk().begin() + position - itr->position(), l);
+    position += l;
+    length   -= l;
+  }
+
+  sha256.final_c(buffer);
+}
+
+std::string
+PieceLayers::leaves(uint32_t index, Chunk* chunk, const BlockList* block_list) const {
+  uint32_t count = leaf_count(index);
+  std::string result(count * merkle_hash_size, '\0');
+
+  for (uint32_t leaf = 0; leaf != count; leaf++) {
+    const char* hash = block_list != NULL ? block_list->leaf_hash(leaf) : NULL;
+
+    if (hash != NULL)
+      std::memcpy(&result[leaf * merkle_hash_size], hash, merkle_hash_size);
+    else
+      hash_leaf(index, leaf, chunk, &result[leaf * merkle_hash_size]);
+  }
+
+  return result;
+}
+
+bool
+PieceLayers::verify(uint32_t index, const std::string& leaves) const {
+  if (!has_piece(index))
+    throw internal_error("PieceLayers::verify(...) piece has no v2 hash.");
+
+  if (leaves.size() != leaf_count(index) * merkle_hash_size)
+    return false;
+
+  std::string root = merkle_subtree_root(leaves, m_pieces[index].height);
+
+  return root.size() == merkle_hash_size && std::memcmp(root.c_str(), m_pieces[index].hash, merkle_hash_size) == 0;
+}
+
+}
@@ -0,0 +1,57 @@
+// Expected BitTorrent v2 hashes of the pieces of a hybrid torrent,
+// taken from its piece layers and from the roots of files that fit in
+// a single piece. The files of a hybrid torrent are aligned to pieces
+// by padding files, so a piece holds the data of at most one file
+// followed by padding that is not part of the file's merkle tree.
+
+#ifndef LIBTORRENT_DATA_PIECE_LAYERS_H
+#define LIBTORRENT_DATA_PIECE_LAYERS_H
+
+#include <cinttypes>
+#include <string>
+#include <vector>
+
+#include "data/merkle_tree.h"
+
+namespace torrent {
+
+class BlockList;
+class Chunk;
+
+class PieceLayers {
+public:
+  bool                empty() const                           { return m_pieces.empty(); }
+  void                clear()                                 { m_pieces.clear(); }
+
+  bool                has_piece(uint32_t index) const         { return index < m_pieces.size() && m_pieces[index].length != 0; }
+
+  // Sets the root of the subtree 'height' layers above the leaves of
+  // the 'length' bytes of file data at the start of the piece.
+  void                set_piece(uint32_t index, const char* hash, uint32_t length, unsigned int height);
+
+  // Bytes of file data at the start of the piece.
+  uint32_t            file_length(uint32_t index) const       { return has_piece(index) ? m_pieces[index].length : 0; }
+  uint32_t            leaf_count(uint32_t index) const;
+
+  // Hashes the file data of the block 'leaf' of the piece.
+  void                hash_leaf(uint32_t index, uint32_t leaf, Chunk* chunk, char* buffer) const;
+
+  // Leaf hashes of the piece, reusing those kept by 'block_list' as
+  // the blocks arrived and hashing the rest from the chunk.
+  std::string         leaves(uint32_t index, Chunk* chunk, const BlockList* block_list) const;
+
+  bool                verify(uint32_t index, const std::string& leaves) const;
+
+private:
+  struct piece_type {
+    char              hash[merkle_hash_size];
+    uint32_t          length;
+    uint32_t          height;
+  };
+
+  std::vector<piece_type> m_pieces;
+};
+
+}
+
+#endif
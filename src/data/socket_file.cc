@@ -4,6 +4,7 @@
 #include "torrent/exceptions.h"
 #include "torrent/utils/log.h"
 
+#include <cerrno>
 #include <fcntl.h>
 #include <unistd.h>
 #include <rak/error_number.h>
@@ -162,5 +163,59 @@ SocketFile::create_chunk(uint64_t offset, uint32_t length, int prot, int flags)
   return MemoryChunk(ptr, ptr + align, ptr + align + length, prot, flags);
 }
 
+int64_t
+SocketFile::read(void* buffer, uint32_t length, uint64_t offset) const {
+  if (!is_open())
+    throw internal_error("SocketFile::read() called on a closed file");
+
+  uint32_t done = 0;
+
+  while (done != length) {
+    ssize_t result = ::pread(m_fd, static_cast<char*>(buffer) + done, length - done, offset + done);
+
+    if (result == -1 && errno == EINTR)
+      continue;
+
+    if (result == -1)
+      return -1;
+
+    if (result == 0)
+      break;
+
+    done += result;
+  }
+
+  return done;
+}
+
+bool
+SocketFile::write(const void* buffer, uint32_t length, uint64_t offset) const {
+  if (!is_open())
+    throw internal_error("SocketFile::write() called on a closed file");
+
+  uint32_t done = 0;
+
+  while (done != length) {
+    ssize_t result = ::pwrite(m_fd, static_cast<const char*>(buffer) + done, length - done, offset + done);
+
+    if (result == -1 && errno == EINTR)
+      continue;
+
+    if (result <= 0)
+      return false;
+
+    done += result;
+  }
+
+  return true;
 }
 
+bool
+SocketFile::sync() const {
+  if (!is_open())
+    throw internal_error("SocketFile::sync() called on a closed file");
+
+  return ::fsync(m_fd) == 0;
+}
+
+}
@@ -43,6 +43,13 @@ public:
   MemoryChunk         create_padding_chunk(uint32_t length, int prot, int flags) const;
   MemoryChunk         create_chunk(uint64_t offset, uint32_t length, int prot, int flags) const;
 
+  // Positioned I/O that retries on short transfers. 'read' returns
+  // the number of bytes read before the end of the file, or -1 on
+  // error.
+  int64_t             read(void* buffer, uint32_t length, uint64_t offset) const;
+  bool                write(const void* buffer, uint32_t length, uint64_t offset) const;
+  bool                sync() const;
+
   fd_type             fd() const                                        { return m_fd; }
 
 private:
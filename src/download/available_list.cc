@@ -38,34 +38,106 @@
 
 #include <stdlib.h>
 #include <algorithm>
-#include <iterator>
+#include <cstring>
 
 #include "torrent/exceptions.h"
 #include "available_list.h"
 
 namespace torrent {
 
+AvailableList::AvailableList() :
+  m_seed(((uint64_t)::random() << 32) ^ ::random()) {
+}
+
+uint32_t
+AvailableList::hash_address(const rak::socket_address& sa) const {
+  uint64_t value = m_seed ^ sa.family();
+
+  switch (sa.family()) {
+  case rak::socket_address::af_inet:
+    value = rak::position_index::mix(value ^ ((uint64_t)sa.sa_inet()->address_h() << 16 | sa.port()));
+    break;
+
+  case rak::socket_address::af_inet6: {
+    uint64_t words[2];
+    std::memcpy(words, sa.sa_inet6()->address_ptr(), sizeof(words));
+
+    value = rak::position_index::mix(value ^ words[0]);
+    value = rak::position_index::mix(value ^ words[1]);
+    value = rak::position_index::mix(value ^ sa.port());
+    break;
+  }
+  default:
+    break;
+  }
+
+  return value >> 32;
+}
+
+AvailableList::size_type
+AvailableList::find_slot(const rak::socket_address& sa) const {
+  return m_index.find(hash_address(sa), [this, &sa](size_type position) { return base_type::operator[](position) == sa; });
+}
+
+void
+AvailableList::erase_position(size_type position) {
+  const rak::socket_address& sa = base_type::operator[](position);
+  size_type slot = m_index.find_position(hash_address(sa), position);
+
+  if (slot == rak::position_index::npos)
+    throw internal_error("AvailableList::erase_position(...) address not found in index.");
+
+  m_index.erase(slot);
+
+  if (position + 1 != base_type::size()) {
+    const rak::socket_address& last = base_type::back();
+    size_type last_slot = m_index.find_position(hash_address(last), base_type::size() - 1);
+
+    if (last_slot == rak::position_index::npos)
+      throw internal_error("AvailableList::erase_position(...) last address not found in index.");
+
+    m_index.set_position(last_slot, position);
+    base_type::operator[](position) = last;
+  }
+
+  base_type::pop_back();
+}
+
+void
+AvailableList::reserve(size_type n) {
+  base_type::reserve(n);
+  m_index.reserve(n);
+}
+
+void
+AvailableList::clear() {
+  base_type::clear();
+  m_index.clear();
+}
+
 AvailableList::value_type
 AvailableList::pop_random() {
   if (empty())
     throw internal_error("AvailableList::pop_random() called on an empty container");
 
   size_type idx = random() % size();
+  value_type tmp = base_type::operator[](idx);
 
-  value_type tmp = *(begin() + idx);
-  *(begin() + idx) = back();
-
-  pop_back();
+  erase_position(idx);
 
   return tmp;
 }
 
 void
 AvailableList::push_back(const rak::socket_address* sa) {
-  if (std::find(begin(), end(), *sa) != end())
+  if (!sa->is_valid_inet_class())
+    return;
+
+  if (find_slot(*sa) != rak::position_index::npos)
     return;
 
   base_type::push_back(*sa);
+  m_index.insert(hash_address(*sa), size() - 1);
 }
 
 void
@@ -73,27 +145,16 @@ AvailableList::insert(AddressList* l) {
   if (!want_more())
     return;
 
-  std::sort(begin(), end());
-
-  // Can i use use the std::remove* semantics for this, and just copy
-  // to 'l'?.
-  //
-  // 'l' is guaranteed to be sorted, so we can just do
-  // std::set_difference.
-  AddressList difference;
-  std::set_difference(l->begin(), l->end(), begin(), end(), std::back_inserter(difference));
-
-  std::copy(difference.begin(), difference.end(), std::back_inserter(*static_cast<base_type*>(this)));
+  for (const auto& sa : *l)
+    push_back(&sa);
 }
 
 void
 AvailableList::erase(const rak::socket_address& sa) {
-  iterator itr = std::find(begin(), end(), sa);
+  size_type slot = find_slot(sa);
 
-  if (itr != end()) {
-    *itr = back();
-    pop_back();
-  }
+  if (slot != rak::position_index::npos)
+    erase_position(m_index.position(slot));
 }
 
 }
@@ -40,12 +40,19 @@
 #include <vector>
 #include <list>
 
+#include <rak/position_index.h>
 #include <rak/socket_address.h>
 
 #include "net/address_list.h"
 
 namespace torrent {
 
+// Addresses we may connect to, kept in a vector so 'pop_random()' is
+// a constant time swap with the back, and indexed by a hash table of
+// positions in the vector so duplicates are found without searching
+// the list. The hash is seeded per list so addresses received from
+// peers can't be chosen to collide.
+
 class AvailableList : private std::vector<rak::socket_address> {
 public:
   typedef std::vector<rak::socket_address> base_type;
@@ -55,21 +62,21 @@ public:
   using base_type::reference;
   using base_type::const_reference;
 
-  using base_type::iterator;
   using base_type::const_iterator;
-  using base_type::reverse_iterator;
   using base_type::size;
   using base_type::capacity;
-  using base_type::reserve;
   using base_type::empty;
-  using base_type::clear;
 
-  using base_type::back;
-  using base_type::pop_back;
-  using base_type::begin;
-  using base_type::end;
-  using base_type::rbegin;
-  using base_type::rend;
+  AvailableList();
+
+  const_iterator      begin() const                      { return base_type::begin(); }
+  const_iterator      end() const                        { return base_type::end(); }
+  const_reference     back() const                       { return base_type::back(); }
+
+  void                reserve(size_type n);
+  void                clear();
+
+  bool                contains(const rak::socket_address& sa) const { return find_slot(sa) != rak::position_index::npos; }
 
   value_type          pop_random();
 
@@ -79,20 +86,27 @@ public:
 
   bool                want_more() const                  { return size() <= m_maxSize; }
 
-  // This push is somewhat inefficient as it iterates through the
-  // whole container to see if the address already exists.
+  // Addresses already in the list and addresses that are neither
+  // IPv4 nor IPv6 are ignored.
   void                push_back(const rak::socket_address* sa);
 
   void                insert(AddressList* l);
   void                erase(const rak::socket_address& sa);
-  void                erase(iterator itr)                 { *itr = back(); pop_back(); }
-  
+
   // A place to temporarily put addresses before re-adding them to the
   // AvailableList.
   AddressList*        buffer()                            { return &m_buffer; }
 
 private:
+  uint32_t            hash_address(const rak::socket_address& sa) const;
+
+  size_type           find_slot(const rak::socket_address& sa) const;
+  void                erase_position(size_type position);
+
   size_type           m_maxSize{1000};
+  uint64_t            m_seed;
+
+  rak::position_index m_index;
 
   AddressList         m_buffer;
 };
@@ -41,6 +41,9 @@
 
 #include "protocol/peer_chunks.h"
 #include "torrent/exceptions.h"
+#include "torrent/rate.h"
+
+#include "globals.h"
 
 #include "chunk_selector.h"
 #include "chunk_statistics.h"
@@ -92,6 +95,13 @@ ChunkSelector::find(PeerChunks* pc, [[maybe_unused]] bool highPriority) {
   if (m_position == invalid_chunk)
     return invalid_chunk;
 
+  if (is_streaming()) {
+    uint32_t index = find_stream(pc);
+
+    if (index != invalid_chunk)
+      return index;
+  }
+
   // When we're a seeder, 'm_sharedQueue' is used. Since the peer's
   // bitfield is guaranteed to be filled we can use the same code as
   // for non-seeders. This generalization does incur a slight
@@ -271,6 +281,81 @@ ChunkSelector::search_linear_byte(rak::partial_queue* pq, uint32_t index, Bitfie
   return true;
 }
 
+void
+ChunkSelector::set_stream_playhead(uint32_t index) {
+  if (index >= size())
+    throw internal_error("ChunkSelector::set_stream_playhead(...) index out of range.");
+
+  m_streamPlayhead = index;
+  m_streamTime = cachedTime;
+}
+
+void
+ChunkSelector::set_stream_window(uint32_t window, uint32_t chunk_size, uint32_t rate) {
+  if (window != 0 && (chunk_size == 0 || rate == 0))
+    throw internal_error("ChunkSelector::set_stream_window(...) invalid chunk size or rate.");
+
+  if (!is_streaming())
+    m_streamTime = cachedTime;
+
+  m_streamWindow = window;
+  m_streamChunkSize = chunk_size;
+  m_streamRate = rate;
+}
+
+bool
+ChunkSelector::is_stream_urgent(PeerChunks* pc, uint32_t index) const {
+  if (!is_streaming() || index < m_streamPlayhead || index - m_streamPlayhead >= m_streamWindow)
+    return false;
+
+  return
+    stream_time_left(index) < stream_chunk_time(m_streamRate) &&
+    pc->download_throttle()->rate()->rate() >= m_streamRate;
+}
+
+bool
+ChunkSelector::is_stream_in_time(PeerChunks* pc, uint32_t index) const {
+  if (!is_streaming() || index < m_streamPlayhead || index - m_streamPlayhead >= m_streamWindow)
+    return true;
+
+  return stream_peer_time(pc) <= std::max(stream_time_left(index), stream_chunk_time(m_streamRate));
+}
+
+// Late chunks are given to any peer so that they get started, while
+// slow peers otherwise end up with the chunks further from the
+// playhead.
+uint32_t
+ChunkSelector::find_stream(PeerChunks* pc) {
+  int64_t peer_time = stream_peer_time(pc);
+
+  uint32_t last = std::min<uint64_t>((uint64_t)m_streamPlayhead + m_streamWindow, size());
+
+  for (uint32_t index = m_streamPlayhead; index != last; index++) {
+    if (!is_wanted(index) || !pc->bitfield()->get(index))
+      continue;
+
+    int64_t time_left = stream_time_left(index);
+
+    if (time_left <= 0 || peer_time <= time_left)
+      return index;
+  }
+
+  return invalid_chunk;
+}
+
+// Peers without a measured rate are assumed to keep up with playback.
+int64_t
+ChunkSelector::stream_peer_time(PeerChunks* pc) const {
+  uint64_t rate = pc->download_throttle()->rate()->rate();
+
+  return stream_chunk_time(rate != 0 ? rate : m_streamRate);
+}
+
+int64_t
+ChunkSelector::stream_time_left(uint32_t index) const {
+  return m_streamTime.usec() + (int64_t)(index - m_streamPlayhead) * stream_chunk_time(m_streamRate) - cachedTime.usec();
+}
+
 void
 ChunkSelector::advance_position() {
 
@@ -39,6 +39,7 @@
 
 #include <cinttypes>
 #include <rak/partial_queue.h>
+#include <rak/timer.h>
 
 #include "torrent/bitfield.h"
 #include "torrent/data/download_data.h"
@@ -100,6 +101,28 @@ public:
   // Returns whetever we're interested in that piece.
   bool                received_have_chunk(PeerChunks* pc, uint32_t index);
 
+  // In streaming mode the chunks in the window starting at the
+  // playhead get deadlines spaced by the time it takes to play a
+  // chunk at 'rate' bytes per second, counted from when the playhead
+  // was last set. Peers are given the most urgent chunk they can
+  // deliver in time, and fall back to the normal search otherwise. A
+  // window of zero disables streaming.
+  bool                is_streaming() const          { return m_streamWindow != 0; }
+
+  uint32_t            stream_playhead() const       { return m_streamPlayhead; }
+  uint32_t            stream_window() const         { return m_streamWindow; }
+
+  void                set_stream_playhead(uint32_t index);
+  void                set_stream_window(uint32_t window, uint32_t chunk_size, uint32_t rate);
+
+  // Chunks due within the time it takes to play one are urgent, and
+  // peers that keep up with playback may duplicate requests for them.
+  bool                is_stream_urgent(PeerChunks* pc, uint32_t index) const;
+
+  // False if the peer is too slow to help with a chunk in the window
+  // before its deadline, or to keep up with playback once it's late.
+  bool                is_stream_in_time(PeerChunks* pc, uint32_t index) const;
+
 private:
   bool                search_linear(const Bitfield* bf, rak::partial_queue* pq, const download_data::priority_ranges* ranges, uint32_t first, uint32_t last);
   inline bool         search_linear_range(const Bitfield* bf, rak::partial_queue* pq, uint32_t first, uint32_t last);
@@ -111,6 +134,12 @@ private:
 
   void                advance_position();
 
+  uint32_t            find_stream(PeerChunks* pc);
+
+  int64_t             stream_chunk_time(uint64_t rate) const { return (int64_t)m_streamChunkSize * 1000000 / rate; }
+  int64_t             stream_peer_time(PeerChunks* pc) const;
+  int64_t             stream_time_left(uint32_t index) const;
+
   download_data*      m_data;
 
   ChunkStatistics*    m_statistics;
@@ -118,6 +147,12 @@ private:
   rak::partial_queue  m_sharedQueue;
 
   uint32_t            m_position;
+
+  uint32_t            m_streamPlayhead{0};
+  uint32_t            m_streamWindow{0};
+  uint32_t            m_streamChunkSize{0};
+  uint32_t            m_streamRate{0};
+  rak::timer          m_streamTime;
 };
 
 }
@@ -47,39 +47,51 @@
 #include "torrent/data/block.h"
 #include "torrent/data/block_list.h"
 #include "torrent/data/block_transfer.h"
+#include "torrent/peer/peer_info.h"
 #include "protocol/peer_chunks.h"
+#include "protocol/peer_connection_base.h"
+#include "utils/instrumentation.h"
 
 #include "delegator.h"
+#include "globals.h"
 
 namespace torrent {
 
 std::vector<BlockTransfer*>
-Delegator::delegate(PeerChunks* peerChunks, uint32_t affinity, uint32_t maxPieces) {
+Delegator::delegate(PeerChunks* peerChunks, uint32_t affinity, uint32_t maxPieces, uint32_t maxDuplicates) {
   // TODO: Make sure we don't queue the same piece several time on the same peer when
   // it timeout cancels them.
   std::vector<BlockTransfer*> new_transfers;
   PeerInfo* peerInfo = peerChunks->peer_info();
 
-  // Find piece with same index as affinity. This affinity should ensure that we
-  // never start another piece while the chunk this peer used to download is still
-  // in progress.
-
-  // TODO: What if the hash failed? Don't want data from that peer again.
-  if (affinity >= 0) {
+  // Chunks about to be played when streaming come before affinity,
+  // and may get duplicate requests. The slot is only bound while
+  // streaming, as this pass walks every transfer.
+  if (m_slot_chunk_urgent) {
     for (BlockList* itr : m_transfers) {
       if (new_transfers.size() >= maxPieces)
         return new_transfers;
-      if (affinity == itr->index())
-        delegate_from_blocklist(new_transfers, maxPieces, itr, peerInfo);
+      if (peerChunks->bitfield()->get(itr->index()) && m_slot_chunk_urgent(peerChunks, itr->index()))
+        delegate_urgent(new_transfers, maxPieces, itr, peerInfo);
     }
   }
 
+  // Find piece with same index as affinity. This affinity should ensure that we
+  // never start another piece while the chunk this peer used to download is still
+  // in progress.
+
+  // TODO: What if the hash failed? Don't want data from that peer again.
+  BlockList* affinity_list = m_transfers.get(affinity);
+
+  if (affinity_list != NULL)
+    delegate_from_blocklist(new_transfers, maxPieces, affinity_list, peerInfo);
+
   // Prioritize full seeders
   if (peerChunks->is_seeder()) {
     for (BlockList* itr : m_transfers) {
       if (new_transfers.size() >= maxPieces)
         return new_transfers;
-      if (itr->by_seeder())
+      if (itr->stalled() != 0 && itr->by_seeder() && is_in_time(peerChunks, itr->index()))
         delegate_from_blocklist(new_transfers, maxPieces, itr, peerInfo);
     }
     // Create new high priority pieces.
@@ -94,7 +106,7 @@ Delegator::delegate(PeerChunks* peerChunks, uint32_t affinity, uint32_t maxPiece
   for (BlockList* itr : m_transfers) {
     if (new_transfers.size() >= maxPieces)
       return new_transfers;
-    if (itr->priority() == PRIORITY_HIGH && peerChunks->bitfield()->get(itr->index()))
+    if (itr->stalled() != 0 && itr->priority() == PRIORITY_HIGH && peerChunks->bitfield()->get(itr->index()) && is_in_time(peerChunks, itr->index()))
       delegate_from_blocklist(new_transfers, maxPieces, itr, peerInfo);
   }
 
@@ -105,7 +117,7 @@ Delegator::delegate(PeerChunks* peerChunks, uint32_t affinity, uint32_t maxPiece
   for (BlockList* itr : m_transfers) {
     if (new_transfers.size() >= maxPieces)
       return new_transfers;
-    if (itr->priority() == PRIORITY_NORMAL && peerChunks->bitfield()->get(itr->index()))
+    if (itr->stalled() != 0 && itr->priority() == PRIORITY_NORMAL && peerChunks->bitfield()->get(itr->index()) && is_in_time(peerChunks, itr->index()))
       delegate_from_blocklist(new_transfers, maxPieces, itr, peerInfo);
   }
 
@@ -117,28 +129,55 @@ Delegator::delegate(PeerChunks* peerChunks, uint32_t affinity, uint32_t maxPiece
 
   // In aggressive mode, look for possible downloads that already have
   // one or more transfers queued.
+  delegate_duplicates(new_transfers, std::min<uint32_t>(maxPieces, new_transfers.size() + maxDuplicates), peerChunks);
+
+  return new_transfers;
+}
+
+// A holder whose request is stalled, or that is no faster than the
+// requesting peer, is unlikely to deliver the block first.
+static bool
+delegator_is_slower_holder(BlockTransfer* transfer, uint64_t rate) {
+  PeerInfo* peer_info = transfer->peer_info();
+
+  return
+    transfer->stall() != 0 || peer_info == NULL || peer_info->connection() == NULL ||
+    peer_info->connection()->c_peer_chunks()->download_throttle()->rate()->rate() <= rate;
+}
+
+// End-game hands out blocks that have already been requested from
+// other peers, but no more than 'endgame_block_requests' active
+// requests per block, and only when one of the peers holding the
+// block is no faster than this one. Otherwise the duplicate would
+// only waste the bandwidth of both peers.
+void
+Delegator::delegate_duplicates(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, PeerChunks* pc) {
+  uint64_t rate = pc->download_throttle()->rate()->rate();
+  auto is_slower = [rate](BlockTransfer* transfer) { return delegator_is_slower_holder(transfer, rate); };
 
-  // No more than 4 per piece.
-  uint16_t overlapped = 5;
   for (BlockList* itr : m_transfers) {
-    if (new_transfers.size() >= maxPieces)
-      return new_transfers;
-    if (peerChunks->bitfield()->get(itr->index()) && itr->priority() != PRIORITY_OFF) {
-      for (auto bl_itr = itr->begin(); bl_itr != itr->end() && overlapped != 0; bl_itr++) {
-        if (new_transfers.size() >= maxPieces || bl_itr->size_not_stalled() >= overlapped)
-          break;
-        if (!bl_itr->is_finished()) {
-          BlockTransfer* inserted_info = bl_itr->insert(peerInfo);
-          if (inserted_info != NULL) {
-            new_transfers.push_back(inserted_info);
-            overlapped = bl_itr->size_not_stalled();
-          }
-        }
+    if (transfers.size() >= maxPieces)
+      return;
+    if (!pc->bitfield()->get(itr->index()) || itr->priority() == PRIORITY_OFF)
+      continue;
+
+    for (auto bl_itr = itr->begin(); bl_itr != itr->end() && transfers.size() < maxPieces; bl_itr++) {
+      if (bl_itr->is_finished() || bl_itr->size_not_stalled() >= endgame_block_requests)
+        continue;
+
+      if (bl_itr->size_all() != 0 &&
+          std::none_of(bl_itr->queued()->begin(), bl_itr->queued()->end(), is_slower) &&
+          std::none_of(bl_itr->transfers()->begin(), bl_itr->transfers()->end(), is_slower))
+        continue;
+
+      BlockTransfer* inserted_info = bl_itr->insert(pc->peer_info());
+
+      if (inserted_info != NULL) {
+        transfers.push_back(inserted_info);
+        instrumentation_update(INSTRUMENTATION_TRANSFER_REQUESTS_DUPLICATED, 1);
       }
     }
   }
-
-  return new_transfers;
 }
 
 void
@@ -162,23 +201,66 @@ Delegator::delegate_new_chunks(std::vector<BlockTransfer*> &transfers, uint32_t
   }
 }
 
+static bool
+delegator_recently_requested(const Block& block, int32_t since) {
+  auto recent = [since](const BlockTransfer* transfer) { return transfer->request_time() > since; };
+
+  return
+    std::any_of(block.queued()->begin(), block.queued()->end(), recent) ||
+    std::any_of(block.transfers()->begin(), block.transfers()->end(), recent);
+}
+
+// Like end-game, but limited to one duplicate per block and only for
+// blocks whose requests have been outstanding for a while, so that
+// a slow peer holding the block doesn't stall playback while blocks
+// queued on fast peers are left alone.
 void
-Delegator::delegate_from_blocklist(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, BlockList* c, PeerInfo* peerInfo) {
+Delegator::delegate_urgent(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, BlockList* c, PeerInfo* peerInfo) {
+  delegate_from_blocklist(transfers, maxPieces, c, peerInfo);
+
+  int32_t since = cachedTime.seconds() - urgent_request_age;
+
   for (auto i = c->begin(); i != c->end() && transfers.size() < maxPieces; ++i) {
+    if (i->is_finished() || i->size_not_stalled() >= 2 || delegator_recently_requested(*i, since))
+      continue;
+
+    BlockTransfer* inserted_info = i->insert(peerInfo);
+    if (inserted_info != NULL)
+      transfers.push_back(inserted_info);
+  }
+}
+
+// Only the blocks the block list counts as stalled can be handed
+// out, so each pass stops once it has seen all of them.
+void
+Delegator::delegate_from_blocklist(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, BlockList* c, PeerInfo* peerInfo) {
+  BlockList::size_type remaining = c->stalled();
+
+  for (auto i = c->begin(); i != c->end() && remaining != 0 && transfers.size() < maxPieces; ++i) {
+    if (i->is_finished() || !i->is_stalled())
+      continue;
+
+    remaining--;
+
     // If not finished and stalled, and no one is downloading this, then assign
-    if (!i->is_finished() && i->is_stalled() && i->size_all() == 0)
+    if (i->size_all() == 0)
       transfers.push_back(i->insert(peerInfo));
   }
   if (transfers.size() >= maxPieces)
     return;
 
+  remaining = c->stalled();
+
   // Fill any remaining slots with potentially stalled pieces.
-  for (auto i = c->begin(); i != c->end() && transfers.size() < maxPieces; ++i) {
-    if (!i->is_finished() && i->is_stalled()) {
-      BlockTransfer* inserted_info = i->insert(peerInfo);
-      if (inserted_info != NULL)
-        transfers.push_back(inserted_info);
-    }
+  for (auto i = c->begin(); i != c->end() && remaining != 0 && transfers.size() < maxPieces; ++i) {
+    if (i->is_finished() || !i->is_stalled())
+      continue;
+
+    remaining--;
+
+    BlockTransfer* inserted_info = i->insert(peerInfo);
+    if (inserted_info != NULL)
+      transfers.push_back(inserted_info);
   }
 }
 
@@ -56,22 +56,38 @@ class Delegator {
 public:
   typedef std::function<uint32_t (PeerChunks*, bool)> slot_peer_chunk;
   typedef std::function<uint32_t (uint32_t)>          slot_size;
+  typedef std::function<bool (PeerChunks*, uint32_t)> slot_peer_index;
 
   static const unsigned int block_size = 1 << 14;
 
+  // Seconds a block must have been requested before an urgent
+  // streaming chunk duplicates it.
+  static const int urgent_request_age = 2;
+
+  // End-game limits on the active requests for a block, and on the
+  // duplicate requests each peer may have queued.
+  static const unsigned int endgame_block_requests = 2;
+  static const unsigned int endgame_peer_duplicates = 8;
+
   TransferList*       transfer_list()                     { return &m_transfers; }
   const TransferList* transfer_list() const               { return &m_transfers; }
 
-  std::vector<BlockTransfer*> delegate(PeerChunks* peerChunks, uint32_t affinity, uint32_t maxPieces);
+  std::vector<BlockTransfer*> delegate(PeerChunks* peerChunks, uint32_t affinity, uint32_t maxPieces, uint32_t maxDuplicates);
 
   bool               get_aggressive()                     { return m_aggressive; }
   void               set_aggressive(bool a)               { m_aggressive = a; }
 
   slot_peer_chunk&   slot_chunk_find()                    { return m_slot_chunk_find; }
   slot_size&         slot_chunk_size()                    { return m_slot_chunk_size; }
+  slot_peer_index&   slot_chunk_urgent()                  { return m_slot_chunk_urgent; }
+  slot_peer_index&   slot_chunk_in_time()                 { return m_slot_chunk_in_time; }
 
 private:
+  bool               is_in_time(PeerChunks* pc, uint32_t index) { return !m_slot_chunk_in_time || m_slot_chunk_in_time(pc, index); }
+
   void               delegate_from_blocklist(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, BlockList* c, PeerInfo* peerInfo);
+  void               delegate_urgent(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, BlockList* c, PeerInfo* peerInfo);
+  void               delegate_duplicates(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, PeerChunks* pc);
   void               delegate_new_chunks(std::vector<BlockTransfer*> &transfers, uint32_t maxPieces, PeerChunks* pc, bool highPriority);
   Block*             delegate_seeder(PeerChunks* peerChunks);
 
@@ -83,6 +99,8 @@ private:
   // care of enabling etc, and will be possible to listen to.
   slot_peer_chunk    m_slot_chunk_find;
   slot_size          m_slot_chunk_size;
+  slot_peer_index    m_slot_chunk_urgent;
+  slot_peer_index    m_slot_chunk_in_time;
 };
 
 }
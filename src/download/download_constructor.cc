@@ -4,8 +4,11 @@
 #include <cstdio>
 #include <cstring>
 #include <string.h>
+#include <vector>
 #include <rak/string_manip.h>
 
+#include "data/merkle_tree.h"
+#include "data/piece_layers.h"
 #include "download/download_wrapper.h"
 #include "torrent/dht_manager.h"
 #include "torrent/exceptions.h"
@@ -31,6 +34,24 @@ download_constructor_is_multi_path(Object::map_type::const_reference v) {
   return v.first.rfind("path.", 0) == 0 && v.second.is_list();
 };
 
+// Collects the length and pieces root of the files in a v2 'file
+// tree' in order, the file entries are under an empty key.
+static void
+download_constructor_add_file_tree(const Object& b, std::vector<std::pair<int64_t, std::string>>* files) {
+  if (!b.is_map() || b.as_map().empty())
+    throw input_error("Bad torrent file, invalid \"file tree\" entry.");
+
+  if (b.has_key_map("")) {
+    const Object& file = b.get_key("");
+
+    files->emplace_back(file.get_key_value("length"), file.has_key_string("pieces root") ? file.get_key_string("pieces root") : std::string());
+    return;
+  }
+
+  for (const auto& entry : b.as_map())
+    download_constructor_add_file_tree(entry.second, files);
+}
+
 void
 DownloadConstructor::initialize(Object& b) {
   if (!b.has_key_map("info") && b.has_key_string("magnet-uri"))
@@ -48,6 +69,9 @@ DownloadConstructor::initialize(Object& b) {
 
   parse_name(b.get_key("info"));
   parse_info(b.get_key("info"));
+
+  if (b.get_key("info").has_key_value("meta version") && b.get_key("info").get_key_value("meta version") == 2)
+    parse_file_tree(b.get_key("info"), b.has_key_map("piece layers") ? &b.get_key("piece layers") : NULL);
 }
 
 // Currently using a hack of the path thingie to extract the correct
@@ -92,6 +116,11 @@ DownloadConstructor::parse_info(const Object& b) {
   if (b.flags() & Object::flag_unordered)
     throw input_error("Download has unordered info dictionary.");
 
+  // Torrents without v1 piece hashes would need the pieces aligned to
+  // each file and the v2 hash exchange messages to download.
+  if (b.has_key_value("meta version") && b.get_key_value("meta version") == 2 && !b.has_key_string("pieces"))
+    throw input_error("BitTorrent v2 torrents are only supported in hybrid form.");
+
   uint32_t chunkSize;
 
   if (b.has_key_value("meta_download") && b.get_key_value("meta_download"))
@@ -294,6 +323,91 @@ DownloadConstructor::parse_multi_files(const Object& b, uint32_t chunk_size) {
   file_list->update_paths(file_list->begin(), file_list->end());
 }
 
+// Hybrid torrents list the same files in the v1 'files' and the v2
+// 'file tree', with padding files only in the former. The piece
+// layers are kept so that downloaded pieces are verified against both
+// the v1 and the v2 hashes.
+void
+DownloadConstructor::parse_file_tree(const Object& b, const Object* piece_layers) {
+  FileList* file_list = m_download->main()->file_list();
+  uint32_t chunk_size = file_list->chunk_size();
+
+  if (chunk_size < merkle_block_size || (chunk_size & (chunk_size - 1)) != 0)
+    throw input_error("Hybrid torrent has an invalid \"piece length\".");
+
+  PieceLayers* piece_layers_data = m_download->main()->piece_layers();
+  piece_layers_data->clear();
+
+  std::vector<std::pair<int64_t, std::string>> files;
+  download_constructor_add_file_tree(b.get_key("file tree"), &files);
+
+  FileList::iterator itr = file_list->begin();
+
+  for (const auto& entry : files) {
+    while (itr != file_list->end() && (*itr)->is_padding())
+      ++itr;
+
+    if (itr == file_list->end() || (int64_t)(*itr)->size_bytes() != entry.first)
+      throw input_error("Hybrid torrent has mismatching v1 and v2 file lists.");
+
+    File* file = *itr++;
+
+    if (entry.first == 0)
+      continue;
+
+    if (entry.second.size() != merkle_hash_size)
+      throw input_error("Bad torrent file, invalid \"pieces root\".");
+
+    // Files sharing a piece with another file have no v2 hash of
+    // their own for that piece.
+    bool aligned = file->offset() % chunk_size == 0;
+
+    // The pieces root of a file within a single piece is the root of
+    // the leaves of the file's blocks.
+    if (file->size_bytes() <= chunk_size) {
+      uint32_t blocks = (file->size_bytes() + merkle_block_size - 1) / merkle_block_size;
+      unsigned int height = 0;
+
+      while ((1u << height) < blocks)
+        height++;
+
+      if (aligned)
+        piece_layers_data->set_piece(file->range_first(), entry.second.c_str(), file->size_bytes(), height);
+
+      continue;
+    }
+
+    // Magnet downloads get the piece layers from peers, which is not
+    // supported yet.
+    if (piece_layers == NULL)
+      continue;
+
+    if (!piece_layers->has_key_string(entry.second))
+      throw input_error("Torrent is missing the piece layer of a file.");
+
+    const std::string& layer = piece_layers->get_key_string(entry.second);
+
+    if (layer.size() != (file->size_bytes() + chunk_size - 1) / chunk_size * merkle_hash_size ||
+        merkle_root(layer, merkle_height(chunk_size)) != entry.second)
+      throw input_error("Torrent has an invalid piece layer for a file.");
+
+    if (!aligned)
+      continue;
+
+    for (uint32_t piece = 0; piece != layer.size() / merkle_hash_size; piece++)
+      piece_layers_data->set_piece(file->range_first() + piece,
+                                   layer.c_str() + piece * merkle_hash_size,
+                                   std::min<uint64_t>(chunk_size, file->size_bytes() - (uint64_t)piece * chunk_size),
+                                   merkle_height(chunk_size));
+  }
+
+  while (itr != file_list->end() && (*itr)->is_padding())
+    ++itr;
+
+  if (itr != file_list->end())
+    throw input_error("Hybrid torrent has mismatching v1 and v2 file lists.");
+}
+
 inline Path
 DownloadConstructor::create_path(const Object::list_type& plist, const std::string enc) {
   // Make sure we are given a proper file path.
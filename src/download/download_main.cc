@@ -85,7 +85,12 @@ DownloadMain::DownloadMain() :
   m_taskTrackerRequest.slot() = std::bind(&DownloadMain::receive_tracker_request, this);
 
   m_chunkList->set_data(file_list()->mutable_data());
+  m_chunkList->set_threads(manager->main_thread_disk(), manager->main_thread_main());
   m_chunkList->slot_create_chunk() = std::bind(&FileList::create_chunk_index, file_list(), std::placeholders::_1, std::placeholders::_2);
+  m_chunkList->slot_create_cached_chunk() = std::bind(&FileList::create_cached_chunk_index, file_list(), std::placeholders::_1, std::placeholders::_2);
+  m_chunkList->slot_create_chunk_writes() = std::bind(&FileList::create_chunk_writes, file_list(), std::placeholders::_1, std::placeholders::_2);
+  m_chunkList->slot_create_chunk_reads() = std::bind(&FileList::create_chunk_reads, file_list(), std::placeholders::_1, std::placeholders::_2);
+  m_chunkList->slot_chunk_loaded() = std::bind(&DownloadMain::receive_chunk_loaded, this, std::placeholders::_1);
   m_chunkList->slot_free_diskspace() = std::bind(&FileList::free_diskspace, file_list());
 }
 
@@ -257,6 +262,20 @@ DownloadMain::update_endgame() {
     m_delegator.set_aggressive(true);
 }
 
+void
+DownloadMain::set_stream_window(uint32_t window, uint32_t rate) {
+  m_chunkSelector->set_stream_window(window, file_list()->chunk_size(), rate);
+
+  if (!m_chunkSelector->is_streaming()) {
+    m_delegator.slot_chunk_urgent() = Delegator::slot_peer_index();
+    m_delegator.slot_chunk_in_time() = Delegator::slot_peer_index();
+    return;
+  }
+
+  m_delegator.slot_chunk_urgent() = std::bind(&ChunkSelector::is_stream_urgent, m_chunkSelector, std::placeholders::_1, std::placeholders::_2);
+  m_delegator.slot_chunk_in_time() = std::bind(&ChunkSelector::is_stream_in_time, m_chunkSelector, std::placeholders::_1, std::placeholders::_2);
+}
+
 void
 DownloadMain::receive_chunk_done(unsigned int index) {
   ChunkHandle handle = m_chunkList->get(index);
@@ -267,6 +286,19 @@ DownloadMain::receive_chunk_done(unsigned int index) {
   m_slotHashCheckAdd(handle);
 }
 
+// Wake connections waiting for the chunk to be read into the read
+// cache before writing their next piece.
+void
+DownloadMain::receive_chunk_loaded(unsigned int index) {
+  for (auto& connection : *connection_list()) {
+    PeerConnectionBase* pcb = connection->m_ptr();
+    auto upload_queue = pcb->peer_chunks()->upload_queue();
+
+    if (!upload_queue->empty() && upload_queue->front().index() == index)
+      pcb->write_insert_poll_safe();
+  }
+}
+
 void
 DownloadMain::receive_corrupt_chunk(PeerInfo* peerInfo) {
   peerInfo->set_failed_counter(peerInfo->failed_counter() + 1);
@@ -295,7 +327,6 @@ DownloadMain::receive_connect_peers() {
   AddressList* alist = peer_list()->available_list()->buffer();
 
   if (!alist->empty()) {
-    alist->sort();
     peer_list()->insert_available(alist);
     alist->clear();
   }
@@ -6,8 +6,10 @@
 #include "globals.h"
 
 #include "data/chunk_handle.h"
+#include "data/piece_layers.h"
 #include "download/available_list.h"
 #include "download/delegator.h"
+#include "download/have_queue.h"
 #include "net/data_buffer.h"
 #include "torrent/download_info.h"
 #include "torrent/download/group_entry.h"
@@ -31,7 +33,7 @@ class InitialSeeding;
 
 class DownloadMain {
 public:
-  typedef std::deque<std::pair<rak::timer, uint32_t> > have_queue_type;
+  typedef HaveQueue                                    have_queue_type;
   typedef std::vector<SocketAddressCompact>            pex_list;
 
   DownloadMain();
@@ -72,6 +74,7 @@ public:
 
   ConnectionList*     connection_list()                          { return m_connectionList; }
   FileList*           file_list()                                { return &m_fileList; }
+  PieceLayers*        piece_layers()                             { return &m_pieceLayers; }
   PeerList*           peer_list()                                { return &m_peerList; }
 
   std::pair<ThrottleList*, ThrottleList*> throttles(const sockaddr* sa);
@@ -91,6 +94,10 @@ public:
 
   void                set_metadata_size(size_t s);
 
+  // The delegator only consults the streaming deadlines while a
+  // stream window is set.
+  void                set_stream_window(uint32_t window, uint32_t rate);
+
   // Carefull with these.
   void                setup_delegator();
   void                setup_tracker();
@@ -110,6 +117,7 @@ public:
 
   void                receive_connect_peers();
   void                receive_chunk_done(unsigned int index);
+  void                receive_chunk_loaded(unsigned int index);
   void                receive_corrupt_chunk(PeerInfo* peerInfo);
 
   void                receive_tracker_success();
@@ -151,6 +159,7 @@ private:
 
   ConnectionList*     m_connectionList;
   FileList            m_fileList;
+  PieceLayers         m_pieceLayers;
   PeerList            m_peerList;
 
   DataBuffer          m_ut_pex_delta;
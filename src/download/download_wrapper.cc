@@ -7,14 +7,18 @@
 #include <rak/file_stat.h>
 
 #include "data/chunk_list.h"
+#include "data/hash_chunk.h"
 #include "data/hash_queue.h"
 #include "data/hash_torrent.h"
+#include "data/piece_layers.h"
 #include "download/available_list.h"
 #include "download/chunk_selector.h"
 #include "protocol/handshake_manager.h"
 #include "protocol/peer_connection_base.h"
 #include "torrent/exceptions.h"
 #include "torrent/object.h"
+#include "torrent/data/block_list.h"
+#include "torrent/data/transfer_list.h"
 #include "torrent/tracker_list.h"
 #include "torrent/data/file.h"
 #include "torrent/data/file_list.h"
@@ -116,6 +120,19 @@ DownloadWrapper::close() {
   // hash_resume_save get ignored anyway.
   m_main->chunk_list()->sync_chunks(ChunkList::sync_all | ChunkList::sync_force | ChunkList::sync_sloppy | ChunkList::sync_ignore_error);
 
+  // Cached chunks are only in memory, so those that could not be
+  // written are lost and must not be saved as completed.
+  std::vector<uint32_t> lost = m_main->chunk_list()->flush();
+
+  if (!lost.empty()) {
+    for (auto index : lost)
+      data()->mutable_completed_bitfield()->unset(index);
+
+    m_main->file_list()->update_completed();
+
+    LT_LOG_STORAGE_ERRORS("Could not write %zu cached chunks on close, marked them as not completed.", lost.size());
+  }
+
   m_main->close();
 
   // Should this perhaps be in stop?
@@ -187,7 +204,7 @@ DownloadWrapper::receive_hash_done(ChunkHandle handle, const char* hash) {
     if (data()->untouched_bitfield()->get(handle.index()))
       throw internal_error("DownloadWrapper::receive_hash_done(...) received a chunk that isn't set in ChunkSelector.");
 
-    if (std::memcmp(hash, chunk_hash(handle.index()), 20) == 0) {
+    if (std::memcmp(hash, chunk_hash(handle.index()), 20) == 0 && verify_piece_layer(handle)) {
       bool was_partial = data()->wanted_chunks() != 0;
 
       m_main->file_list()->mark_completed(handle.index());
@@ -202,10 +219,7 @@ DownloadWrapper::receive_hash_done(ChunkHandle handle, const char* hash) {
         priority_queue_update(&taskScheduler, &m_main->delay_partially_done(), cachedTime);
       }
 
-      if (!m_main->have_queue()->empty() && m_main->have_queue()->front().first >= cachedTime)
-        m_main->have_queue()->emplace_front(m_main->have_queue()->front().first + 1, handle.index());
-      else
-        m_main->have_queue()->emplace_front(cachedTime, handle.index());
+      m_main->have_queue()->push_back(cachedTime, handle.index());
 
     } else {
       // This needs to ensure the chunk is still valid.
@@ -217,13 +231,39 @@ DownloadWrapper::receive_hash_done(ChunkHandle handle, const char* hash) {
     m_main->chunk_list()->release(&handle);
 }
 
+// Pieces of hybrid torrents must also match their v2 merkle root,
+// built from the leaf hashes kept as the blocks arrived.
+bool
+DownloadWrapper::verify_piece_layer(ChunkHandle& handle) {
+  PieceLayers* piece_layers = m_main->piece_layers();
+
+  if (!piece_layers->has_piece(handle.index()))
+    return true;
+
+  const BlockList* block_list = m_main->delegator()->transfer_list()->get(handle.index());
+
+  if (piece_layers->verify(handle.index(), piece_layers->leaves(handle.index(), handle.chunk(), block_list)))
+    return true;
+
+  LT_LOG_STORAGE_ERRORS("Piece %" PRIu32 " matched its v1 hash but not its v2 hash.", handle.index());
+  return false;
+}
+
 void
 DownloadWrapper::check_chunk_hash(ChunkHandle handle) {
   // TODO: Hack...
   ChunkHandle new_handle = m_main->chunk_list()->get(handle.index(), ChunkList::get_blocking);
   m_main->chunk_list()->release(&handle);
 
-  hash_queue()->push_back(new_handle, data(), std::bind(&DownloadWrapper::receive_hash_done, this, std::placeholders::_1, std::placeholders::_2));
+  // Continue from the part hashed as the blocks arrived, the prefix is
+  // consumed so that a retry with different data is hashed in full.
+  BlockList* block_list = m_main->delegator()->transfer_list()->get(new_handle.index());
+  HashPrefix* prefix = block_list != NULL ? block_list->hash_prefix() : NULL;
+
+  hash_queue()->push_back(new_handle, data(), std::bind(&DownloadWrapper::receive_hash_done, this, std::placeholders::_1, std::placeholders::_2), prefix);
+
+  if (prefix != NULL)
+    block_list->clear_hash_prefix();
 }
 
 void
@@ -286,10 +326,7 @@ DownloadWrapper::receive_tick(uint32_t ticks) {
         itr++;
   }
 
-  DownloadMain::have_queue_type* haveQueue = m_main->have_queue();
-  haveQueue->erase(std::find_if(haveQueue->rbegin(), haveQueue->rend(), [](auto& p) {
-    return (cachedTime - rak::timer::from_seconds(600)) < p.first;
-  }).base(), haveQueue->end());
+  m_main->have_queue()->erase_older_than(cachedTime - rak::timer::from_seconds(600));
 
   m_main->receive_connect_peers();
 }
@@ -73,6 +73,8 @@ public:
 private:
   void                finished_download();
 
+  bool                verify_piece_layer(ChunkHandle& handle);
+
   DownloadMain*       m_main;
   Object*             m_bencode{};
   HashTorrent*        m_hashChecker{};
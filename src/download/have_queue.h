@@ -0,0 +1,81 @@
+#ifndef LIBTORRENT_DOWNLOAD_HAVE_QUEUE_H
+#define LIBTORRENT_DOWNLOAD_HAVE_QUEUE_H
+
+#include <algorithm>
+#include <cinttypes>
+#include <deque>
+#include <rak/timer.h>
+
+namespace torrent {
+
+// Log of chunks that completed hashing, shared by all connections of
+// a download. Entries are appended in order and numbered by an
+// increasing epoch, so each connection only needs to remember the
+// epoch of the next HAVE it should send instead of scanning the
+// queue.
+//
+// Old entries are dropped from the front, which advances
+// 'begin_epoch()'; cursors that fall behind are clamped to it.
+
+class HaveQueue {
+public:
+  typedef uint64_t                        epoch_type;
+  typedef std::pair<rak::timer, uint32_t> value_type;
+  typedef std::deque<value_type>          base_type;
+  typedef base_type::size_type            size_type;
+
+  bool                empty() const                         { return m_queue.empty(); }
+  size_type           size() const                          { return m_queue.size(); }
+
+  epoch_type          begin_epoch() const                   { return m_begin_epoch; }
+  epoch_type          end_epoch() const                     { return m_begin_epoch + m_queue.size(); }
+
+  const value_type&   at_epoch(epoch_type epoch) const      { return m_queue[epoch - m_begin_epoch]; }
+  uint32_t            index_at_epoch(epoch_type epoch) const { return at_epoch(epoch).second; }
+
+  // Returns the epoch of the first entry added at or after 't'.
+  epoch_type          epoch_at_time(rak::timer t) const;
+
+  // Clamp a connection's cursor to the oldest entry still kept.
+  epoch_type          clamp_epoch(epoch_type epoch) const   { return std::max(epoch, m_begin_epoch); }
+
+  void                push_back(rak::timer t, uint32_t index);
+  void                erase_older_than(rak::timer t);
+
+  void                clear()                               { m_begin_epoch = end_epoch(); m_queue.clear(); }
+
+private:
+  epoch_type          m_begin_epoch{0};
+  base_type           m_queue;
+};
+
+inline HaveQueue::epoch_type
+HaveQueue::epoch_at_time(rak::timer t) const {
+  auto itr = std::lower_bound(m_queue.begin(), m_queue.end(), t, [](const value_type& v, rak::timer t) {
+      return v.first < t;
+    });
+
+  return m_begin_epoch + std::distance(m_queue.begin(), itr);
+}
+
+// Timestamps are kept non-decreasing so 'epoch_at_time' can use a
+// binary search even if the cached time goes backwards.
+inline void
+HaveQueue::push_back(rak::timer t, uint32_t index) {
+  if (!m_queue.empty() && t < m_queue.back().first)
+    t = m_queue.back().first;
+
+  m_queue.emplace_back(t, index);
+}
+
+inline void
+HaveQueue::erase_older_than(rak::timer t) {
+  while (!m_queue.empty() && m_queue.front().first < t) {
+    m_queue.pop_front();
+    m_begin_epoch++;
+  }
+}
+
+}
+
+#endif
@@ -6,7 +6,9 @@
 #include "download/download_main.h"
 #include "data/hash_torrent.h"
 #include "data/chunk_list.h"
+#include "protocol/handshake_key_pool.h"
 #include "protocol/handshake_manager.h"
+#include "data/chunk_read_cache.h"
 #include "data/hash_queue.h"
 #include "net/listen.h"
 #include "utils/instrumentation.h"
@@ -22,6 +24,8 @@
 #include "torrent/peer/client_list.h"
 #include "torrent/throttle.h"
 #include "torrent/tracker/tracker_manager.h"
+#include "tracker/tracker_scrape_queue.h"
+#include "tracker/tracker_udp_router.h"
 
 #include "manager.h"
 
@@ -35,9 +39,12 @@ Manager::Manager() :
   m_dht_manager(new DhtManager),
   m_download_manager(new DownloadManager),
   m_file_manager(new FileManager),
+  m_handshake_key_pool(new HandshakeKeyPool),
   m_handshake_manager(new HandshakeManager),
   m_resource_manager(new ResourceManager),
   m_tracker_manager(new TrackerManager),
+  m_tracker_scrape_queue(new TrackerScrapeQueue),
+  m_tracker_udp_router(new TrackerUdpRouter),
 
   m_client_list(new ClientList),
 
@@ -46,14 +53,15 @@ Manager::Manager() :
 
   {
 
-  m_hash_queue = std::make_unique<HashQueue>(&m_main_thread_disk);
+  m_hash_queue = std::make_unique<HashQueue>(&m_main_thread_disk, &m_main_thread_main);
+  m_chunk_manager->read_cache()->set_threads(&m_main_thread_disk, &m_main_thread_main);
 
-  auto hash_work_signal = m_main_thread_main.signal_bitfield()->add_signal([hash_queue = m_hash_queue.get()]() {
-      return hash_queue->work();
+  auto key_work_signal = m_main_thread_main.signal_bitfield()->add_signal([key_pool = m_handshake_key_pool.get()]() {
+      return key_pool->work();
     });
 
-  m_hash_queue->slot_has_work() = [hash_work_signal, thread = &m_main_thread_main](bool is_done) {
-      thread->send_event_signal(hash_work_signal, is_done);
+  m_handshake_key_pool->slot_has_work() = [key_work_signal, thread = &m_main_thread_main]() {
+      thread->send_event_signal(key_work_signal);
     };
 
   m_taskTick.slot() = std::bind(&Manager::receive_tick, this);
@@ -73,7 +81,12 @@ Manager::~Manager() {
   priority_queue_erase(&taskScheduler, &m_taskTick);
 
   m_handshake_manager->clear();
+  m_handshake_key_pool->stop();
   m_download_manager->clear();
+  m_tracker_scrape_queue->clear();
+
+  // Close the shared tracker sockets while the poll is still around.
+  m_tracker_udp_router->clear();
 
   Throttle::destroy_throttle(m_uploadThrottle);
   Throttle::destroy_throttle(m_downloadThrottle);
@@ -19,11 +19,14 @@ class DownloadManager;
 class DownloadWrapper;
 class FileManager;
 class HashQueue;
+class HandshakeKeyPool;
 class HandshakeManager;
 class PeerInfo;
 class Poll;
 class ResourceManager;
 class TrackerManager;
+class TrackerScrapeQueue;
+class TrackerUdpRouter;
 class Throttle;
 
 typedef std::list<std::string> EncodingList;
@@ -38,9 +41,12 @@ public:
   DhtManager*         dht_manager()                             { return m_dht_manager.get(); }
   DownloadManager*    download_manager()                        { return m_download_manager.get(); }
   FileManager*        file_manager()                            { return m_file_manager.get(); }
+  HandshakeKeyPool*   handshake_key_pool()                      { return m_handshake_key_pool.get(); }
   HandshakeManager*   handshake_manager()                       { return m_handshake_manager.get(); }
   ResourceManager*    resource_manager()                        { return m_resource_manager.get(); }
   TrackerManager*     tracker_manager()                         { return m_tracker_manager.get(); }
+  TrackerScrapeQueue* tracker_scrape_queue()                    { return m_tracker_scrape_queue.get(); }
+  TrackerUdpRouter*   tracker_udp_router()                      { return m_tracker_udp_router.get(); }
 
   ClientList*         client_list()                             { return m_client_list.get(); }
   HashQueue*          hash_queue()                              { return m_hash_queue.get(); }
@@ -66,9 +72,12 @@ private:
   std::unique_ptr<DhtManager>        m_dht_manager;
   std::unique_ptr<DownloadManager>   m_download_manager;
   std::unique_ptr<FileManager>       m_file_manager;
+  std::unique_ptr<HandshakeKeyPool>  m_handshake_key_pool;
   std::unique_ptr<HandshakeManager>  m_handshake_manager;
   std::unique_ptr<ResourceManager>   m_resource_manager;
   std::unique_ptr<TrackerManager>    m_tracker_manager;
+  std::unique_ptr<TrackerScrapeQueue> m_tracker_scrape_queue;
+  std::unique_ptr<TrackerUdpRouter>  m_tracker_udp_router;
 
   std::unique_ptr<ClientList>        m_client_list;
   std::unique_ptr<HashQueue>         m_hash_queue;
@@ -3,6 +3,7 @@
 #include <algorithm>
 
 #include "address_list.h"
+#include "torrent/object_stream.h"
 
 namespace torrent {
 
@@ -34,6 +35,57 @@ AddressList::parse_address_normal(const Object::list_type& b) {
     });
 }
 
+// Reads the list of peer dictionaries in place, skipping entries
+// that are not valid like the Object version does.
+void
+AddressList::parse_address_normal(raw_list s) {
+  const char* first = s.begin();
+  const char* last = s.end();
+
+  while (first != last) {
+    if (*first != 'd') {
+      first = object_read_bencode_skip_c(first, last);
+      continue;
+    }
+
+    first++;
+
+    raw_string ip;
+    Object port;
+
+    while (first != last && *first != 'e') {
+      raw_string key = object_read_bencode_c_string(first, last);
+      const char* value = key.end();
+
+      first = object_read_bencode_skip_c(value, last);
+
+      if (raw_bencode_equal_c_str(key, "ip") && *value >= '0' && *value <= '9')
+        ip = object_read_bencode_c_string(value, first);
+      else if (raw_bencode_equal_c_str(key, "port") && *value == 'i')
+        object_read_bencode_c(value, first, &port);
+    }
+
+    if (first == last)
+      throw bencode_error("Invalid bencode data.");
+
+    first++;
+
+    if (ip.empty() || !port.is_value() || port.as_value() <= 0 || port.as_value() >= (1 << 16))
+      continue;
+
+    rak::socket_address sa;
+    sa.clear();
+
+    if (!sa.set_address_str(ip.as_string()))
+      continue;
+
+    sa.set_port(port.as_value());
+
+    if (sa.is_valid())
+      this->push_back(sa);
+  }
+}
+
 void
 AddressList::parse_address_compact(raw_string s) {
   if (sizeof(const SocketAddressCompact) != 6)
@@ -45,12 +97,12 @@ AddressList::parse_address_compact(raw_string s) {
 }
 
 void
-AddressList::parse_address_compact_ipv6(const std::string& s) {
+AddressList::parse_address_compact_ipv6(raw_string s) {
   if (sizeof(const SocketAddressCompact6) != 18)
     throw internal_error("ConnectionList::AddressList::parse_address_compact_ipv6(...) bad struct size.");
 
-  std::copy(reinterpret_cast<const SocketAddressCompact6*>(s.c_str()),
-            reinterpret_cast<const SocketAddressCompact6*>(s.c_str() + s.size() - s.size() % sizeof(SocketAddressCompact6)),
+  std::copy(reinterpret_cast<const SocketAddressCompact6*>(s.data()),
+            reinterpret_cast<const SocketAddressCompact6*>(s.data() + s.size() - s.size() % sizeof(SocketAddressCompact6)),
             std::back_inserter(*this));
 }
 
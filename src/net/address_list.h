@@ -14,10 +14,12 @@ class AddressList : public std::list<rak::socket_address> {
 public:
   // Parse normal or compact list of addresses and add to AddressList
   void                        parse_address_normal(const Object::list_type& b);
+  void                        parse_address_normal(raw_list s);
   void                        parse_address_bencode(raw_list s);
 
   void                        parse_address_compact(raw_string s);
   void                        parse_address_compact(const std::string& s);
+  void                        parse_address_compact_ipv6(raw_string s);
   void                        parse_address_compact_ipv6(const std::string& s);
 };
 
@@ -26,6 +28,11 @@ AddressList::parse_address_compact(const std::string& s) {
   return parse_address_compact(raw_string(s.data(), s.size()));
 }
 
+inline void
+AddressList::parse_address_compact_ipv6(const std::string& s) {
+  return parse_address_compact_ipv6(raw_string(s.data(), s.size()));
+}
+
 // Move somewhere else.
 struct SocketAddressCompact {
   SocketAddressCompact() {}
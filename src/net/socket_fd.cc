@@ -45,6 +45,7 @@
 #include <netinet/in.h>
 #include <netinet/in_systm.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
 #include <rak/socket_address.h>
 
 #include "torrent/exceptions.h"
@@ -124,6 +125,24 @@ SocketFd::get_error() const {
   return err;
 }
 
+bool
+SocketFd::get_tcp_rtt(uint32_t* usec) const {
+  check_valid();
+
+#ifdef TCP_INFO
+  struct tcp_info info;
+  socklen_t length = sizeof(info);
+
+  if (getsockopt(m_fd, IPPROTO_TCP, TCP_INFO, &info, &length) == -1 || info.tcpi_rtt == 0)
+    return false;
+
+  *usec = info.tcpi_rtt;
+  return true;
+#else
+  return false;
+#endif
+}
+
 bool
 SocketFd::open_stream() {
   m_fd = socket(rak::socket_address::pf_inet6, SOCK_STREAM, IPPROTO_TCP);
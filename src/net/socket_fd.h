@@ -71,6 +71,10 @@ public:
 
   int                 get_error() const;
 
+  // Smoothed TCP round-trip time in microseconds, if the platform
+  // provides TCP_INFO.
+  bool                get_tcp_rtt(uint32_t* usec) const;
+
   bool                open_stream();
   bool                open_datagram();
   bool                open_local();
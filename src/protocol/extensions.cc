@@ -340,12 +340,10 @@ ProtocolExtension::parse_ut_pex() {
   if (peers.empty())
     return true;
 
-  // TODO: Sort the list before adding it.
+  // Duplicates are dropped by the available list.
   AddressList l;
   l.parse_address_compact(peers);
-  l.sort();
-  l.erase(std::unique(l.begin(), l.end()), l.end());
- 
+
   m_download->peer_list()->insert_available(&l);
 
   return true;
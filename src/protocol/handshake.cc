@@ -1,6 +1,7 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <rak/slab_allocator.h>
 
 #include "download/download_main.h"
 #include "net/throttle_list.h"
@@ -13,12 +14,14 @@
 #include "torrent/net/socket_address.h"
 #include "torrent/utils/log.h"
 #include "utils/diffie_hellman.h"
+#include "utils/instrumentation.h"
 
 #include "globals.h"
 #include "manager.h"
 
 #include "extensions.h"
 #include "handshake.h"
+#include "handshake_key_pool.h"
 #include "handshake_manager.h"
 
 #define LT_LOG(log_fmt, ...)                                            \
@@ -54,6 +57,31 @@ public:
   handshake_succeeded() {}
 };
 
+// Never destroyed, so handshakes deleted during exit still find it.
+static rak::slab_allocator<Handshake, 32>&
+handshake_pool() {
+  static auto pool = new rak::slab_allocator<Handshake, 32>;
+  return *pool;
+}
+
+void*
+Handshake::operator new(size_t size) {
+  if (size != sizeof(Handshake))
+    throw internal_error("Handshake::operator new(...) called with wrong size.");
+
+  instrumentation_update_peak(INSTRUMENTATION_POOL_HANDSHAKE, INSTRUMENTATION_POOL_HANDSHAKE_PEAK, 1);
+  return handshake_pool().allocate();
+}
+
+void
+Handshake::operator delete(void* ptr) {
+  if (ptr == NULL)
+    return;
+
+  instrumentation_update_peak(INSTRUMENTATION_POOL_HANDSHAKE, INSTRUMENTATION_POOL_HANDSHAKE_PEAK, -1);
+  handshake_pool().deallocate(ptr);
+}
+
 Handshake::Handshake(SocketFd fd, HandshakeManager* m, int encryptionOptions) :
   m_state(INACTIVE),
 
@@ -134,6 +162,11 @@ Handshake::deactivate_connection() {
   if (!get_fd().is_valid())
     throw internal_error("Handshake::deactivate_connection called but m_fd is not open.");
 
+  // A worker may still be using the key, so the pool takes it rather
+  // than us waiting for the secret.
+  if (m_state == READ_ENC_SECRET)
+    manager->handshake_key_pool()->cancel(this, HandshakeKeyPool::key_ptr(m_encryption.release_key()));
+
   m_state = INACTIVE;
 
   priority_queue_erase(&taskScheduler, &m_taskTimeout);
@@ -266,22 +299,40 @@ Handshake::read_encryption_key() {
   if (m_incoming)
     prepare_key_plus_pad();
 
+  // Stop reading until a worker has computed the secret, the rest of
+  // the key, pad and sync string stays in the buffer.
+  if (manager->handshake_key_pool()->is_running()) {
+    manager->handshake_key_pool()->compute_secret(this, m_encryption.key(), m_readBuffer.position(),
+                                                  [this](bool success) { receive_encryption_secret(success); });
+    m_readBuffer.consume(96);
+
+    manager->poll()->remove_read(this);
+    m_state = READ_ENC_SECRET;
+    return true;
+  }
+
   if(!m_encryption.key()->compute_secret(m_readBuffer.position(), 96))
     throw handshake_error(ConnectionManager::handshake_failed, e_handshake_invalid_encryption);
   m_readBuffer.consume(96);
 
-  // Determine the synchronisation string.
-  if (m_incoming)
-    m_encryption.hash_req1_to_sync();
-  else
-    m_encryption.encrypt_vc_to_sync(m_download->info()->hash().c_str());
+  prepare_enc_sync();
+  return true;
+}
 
-  // also put as much as we can write so far in the buffer
-  if (!m_incoming)
-    prepare_enc_negotiation();
+void
+Handshake::receive_encryption_secret(bool success) {
+  if (m_state != READ_ENC_SECRET)
+    throw internal_error("Handshake::receive_encryption_secret() called in invalid state.");
 
-  m_state = READ_ENC_SYNC;
-  return true;
+  if (!success) {
+    m_manager->receive_failed(this, ConnectionManager::handshake_failed, e_handshake_invalid_encryption);
+    return;
+  }
+
+  prepare_enc_sync();
+
+  manager->poll()->insert_read(this);
+  event_read();
 }
 
 // Handshake::read_encryption_sync()
@@ -672,6 +723,11 @@ Handshake::event_read() {
 
 restart:
     switch (m_state) {
+    case READ_ENC_SECRET:
+      // Read interest is removed until the secret is computed, but a
+      // poll may still deliver an event it collected earlier.
+      return;
+
     case PROXY_CONNECT:
       if (!read_proxy_connect())
         break;
@@ -682,7 +738,7 @@ restart:
       return event_write();
 
     case READ_ENC_KEY:
-      if (!read_encryption_key())
+      if (!read_encryption_key() || m_state == READ_ENC_SECRET)
         break;
 
       if (m_state != READ_ENC_SYNC)
@@ -893,6 +949,8 @@ Handshake::validate_download() {
     throw handshake_error(ConnectionManager::handshake_dropped, e_handshake_inactive_download);
   if (!m_download->info()->is_accepting_new_peers())
     throw handshake_error(ConnectionManager::handshake_dropped, e_handshake_not_accepting_connections);
+
+  m_manager->attach_download(this);
 }
 
 void
@@ -1003,6 +1061,21 @@ Handshake::prepare_key_plus_pad() {
   m_writeBuffer.write_len(pad, length);
 }
 
+void
+Handshake::prepare_enc_sync() {
+  // Determine the synchronisation string.
+  if (m_incoming)
+    m_encryption.hash_req1_to_sync();
+  else
+    m_encryption.encrypt_vc_to_sync(m_download->info()->hash().c_str());
+
+  // also put as much as we can write so far in the buffer
+  if (!m_incoming)
+    prepare_enc_negotiation();
+
+  m_state = READ_ENC_SYNC;
+}
+
 void
 Handshake::prepare_enc_negotiation() {
   char hash[20];
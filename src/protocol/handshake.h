@@ -44,6 +44,7 @@ public:
     PROXY_DONE,
 
     READ_ENC_KEY,
+    READ_ENC_SECRET,
     READ_ENC_SYNC,
     READ_ENC_SKEY,
     READ_ENC_NEGOT,
@@ -60,6 +61,10 @@ public:
 
   Handshake(SocketFd fd, HandshakeManager* m, int encryption_options);
   ~Handshake();
+
+  // Allocated from a pool in the main thread.
+  static void*        operator new(size_t size);
+  static void         operator delete(void* ptr);
   Handshake(const Handshake&) = delete;
   Handshake& operator=(const Handshake&) = delete;
 
@@ -82,6 +87,15 @@ public:
   DownloadMain*       download()                    { return m_download; }
   Bitfield*           bitfield()                    { return &m_bitfield; }
 
+  // Positions in HandshakeManager's lists, for constant time removal.
+  static constexpr uint32_t index_none = ~uint32_t();
+
+  uint32_t            manager_index() const         { return m_manager_index; }
+  uint32_t            download_index() const        { return m_download_index; }
+
+  void                set_manager_index(uint32_t i)  { m_manager_index = i; }
+  void                set_download_index(uint32_t i) { m_download_index = i; }
+
   void                deactivate_connection();
   void                release_connection();
   void                destroy_connection();
@@ -109,6 +123,7 @@ protected:
   // Check what is unnessesary.
   bool                read_proxy_connect();
   bool                read_encryption_key();
+  void                receive_encryption_secret(bool success);
   bool                read_encryption_sync();
   bool                read_encryption_skey();
   bool                read_encryption_negotiation();
@@ -121,6 +136,7 @@ protected:
 
   void                prepare_proxy_connect();
   void                prepare_key_plus_pad();
+  void                prepare_enc_sync();
   void                prepare_enc_negotiation();
   void                prepare_handshake();
   void                prepare_peer_info();
@@ -140,6 +156,8 @@ protected:
   State               m_state;
 
   HandshakeManager*   m_manager;
+  uint32_t            m_manager_index{index_none};
+  uint32_t            m_download_index{index_none};
 
   PeerInfo*           m_peerInfo;
   DownloadMain*       m_download;
@@ -46,7 +46,9 @@
 #include "utils/diffie_hellman.h"
 #include "utils/sha1.h"
 
+#include "manager.h"
 #include "handshake_encryption.h"
+#include "handshake_key_pool.h"
 
 namespace torrent {
 
@@ -71,7 +73,7 @@ HandshakeEncryption::should_retry() const {
 
 bool
 HandshakeEncryption::initialize() {
-  m_key = new DiffieHellman(dh_prime, dh_prime_length, dh_generator, dh_generator_length);
+  m_key = manager->handshake_key_pool()->acquire().release();
 
   return m_key->is_valid();
 }
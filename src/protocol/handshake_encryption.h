@@ -77,6 +77,7 @@ public:
   bool                has_crypto_rc4() const                       { return m_crypto & crypto_rc4; }
 
   DiffieHellman*      key()                                        { return m_key; }
+  DiffieHellman*      release_key()                                { DiffieHellman* k = m_key; m_key = NULL; return k; }
   EncryptionInfo*     info()                                       { return &m_info; }
 
   int                 options() const                              { return m_options; }
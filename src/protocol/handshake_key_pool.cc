@@ -0,0 +1,193 @@
+#include "config.h"
+
+#include "handshake_key_pool.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "torrent/exceptions.h"
+#include "utils/diffie_hellman.h"
+
+#include "handshake_encryption.h"
+
+namespace torrent {
+
+HandshakeKeyPool::HandshakeKeyPool() {
+}
+
+HandshakeKeyPool::~HandshakeKeyPool() {
+  stop();
+}
+
+void
+HandshakeKeyPool::start(unsigned int workers) {
+  if (is_running())
+    throw internal_error("HandshakeKeyPool::start(...) already running.");
+
+#ifdef USE_OPENSSL
+  m_stopping = false;
+
+  for (unsigned int i = 0; i < workers; i++)
+    m_workers.emplace_back(&HandshakeKeyPool::worker, this);
+#endif
+}
+
+// Secrets that were pending are dropped, so only stop once all
+// handshakes are gone.
+void
+HandshakeKeyPool::stop() {
+  if (!is_running())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_stopping = true;
+  }
+
+  m_cv_work.notify_all();
+
+  for (auto& thread : m_workers)
+    thread.join();
+
+  m_workers.clear();
+  m_ready.clear();
+  m_pending.clear();
+  m_computing.clear();
+  m_done.clear();
+}
+
+size_t
+HandshakeKeyPool::size_ready() {
+  std::lock_guard<std::mutex> lock(m_lock);
+  return m_ready.size();
+}
+
+HandshakeKeyPool::key_ptr
+HandshakeKeyPool::generate_key() {
+  return key_ptr(new DiffieHellman(HandshakeEncryption::dh_prime, HandshakeEncryption::dh_prime_length,
+                                   HandshakeEncryption::dh_generator, HandshakeEncryption::dh_generator_length));
+}
+
+HandshakeKeyPool::key_ptr
+HandshakeKeyPool::acquire() {
+  {
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (!m_ready.empty()) {
+      key_ptr key = std::move(m_ready.back());
+      m_ready.pop_back();
+
+      m_cv_work.notify_one();
+      return key;
+    }
+  }
+
+  return generate_key();
+}
+
+void
+HandshakeKeyPool::compute_secret(const void* owner, DiffieHellman* key, const unsigned char* pubkey, slot_secret slot) {
+  if (!is_running())
+    throw internal_error("HandshakeKeyPool::compute_secret(...) called while not running.");
+
+  std::lock_guard<std::mutex> lock(m_lock);
+
+  m_pending.push_back(job_type{ owner, key, {}, std::move(slot), false });
+  std::memcpy(m_pending.back().pubkey, pubkey, pubkey_length);
+
+  m_cv_work.notify_one();
+}
+
+void
+HandshakeKeyPool::cancel(const void* owner, key_ptr key) {
+  std::lock_guard<std::mutex> lock(m_lock);
+
+  auto is_owner = [owner](const job_type& job) { return job.owner == owner; };
+
+  m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(), is_owner), m_pending.end());
+  m_done.erase(std::remove_if(m_done.begin(), m_done.end(), is_owner), m_done.end());
+
+  for (auto& computing : m_computing) {
+    if (computing.owner != owner)
+      continue;
+
+    if (computing.key != key.get())
+      throw internal_error("HandshakeKeyPool::cancel(...) key does not match the job being computed.");
+
+    computing.owner = NULL;
+    computing.orphan = std::move(key);
+  }
+}
+
+// Take one job at a time, as a slot may cancel other owners.
+void
+HandshakeKeyPool::work() {
+  while (true) {
+    std::unique_lock<std::mutex> lock(m_lock);
+
+    if (m_done.empty())
+      return;
+
+    job_type job = std::move(m_done.front());
+    m_done.pop_front();
+
+    lock.unlock();
+    job.slot(job.success);
+  }
+}
+
+// Secrets are computed before refilling the stack of ready keys, as
+// handshakes are waiting on them.
+void
+HandshakeKeyPool::worker() {
+  std::unique_lock<std::mutex> lock(m_lock);
+
+  while (true) {
+    m_cv_work.wait(lock, [this] {
+        return m_stopping || !m_pending.empty() || m_ready.size() + m_generating < max_ready;
+      });
+
+    if (m_stopping)
+      return;
+
+    if (!m_pending.empty()) {
+      job_type job = std::move(m_pending.front());
+      m_pending.pop_front();
+      m_computing.push_back(computing_type{ job.owner, job.key, key_ptr() });
+
+      lock.unlock();
+      job.success = job.key->compute_secret(job.pubkey, pubkey_length);
+      lock.lock();
+
+      // Match on the key, as a new owner may have been allocated at
+      // the address of a cancelled one.
+      auto itr = std::find_if(m_computing.begin(), m_computing.end(), [&job](const computing_type& c) { return c.key == job.key; });
+      key_ptr orphan = std::move(itr->orphan);
+
+      m_computing.erase(itr);
+
+      if (orphan)
+        continue;
+
+      m_done.push_back(std::move(job));
+
+      if (m_slot_has_work)
+        m_slot_has_work();
+
+      continue;
+    }
+
+    m_generating++;
+
+    lock.unlock();
+    key_ptr key = generate_key();
+    lock.lock();
+
+    m_generating--;
+
+    if (key->is_valid())
+      m_ready.push_back(std::move(key));
+  }
+}
+
+}
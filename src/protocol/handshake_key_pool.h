@@ -0,0 +1,104 @@
+#ifndef LIBTORRENT_PROTOCOL_HANDSHAKE_KEY_POOL_H
+#define LIBTORRENT_PROTOCOL_HANDSHAKE_KEY_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace torrent {
+
+class DiffieHellman;
+
+// Moves the Diffie-Hellman work of encrypted handshakes off the main
+// thread, so a burst of incoming encrypted connections doesn't stall
+// the event loop on modular exponentiation.
+//
+// Worker threads keep a stack of up to 'max_ready' generated keys and
+// compute shared secrets for handshakes. Finished secrets are passed
+// back by 'work()', called from the main thread when 'slot_has_work'
+// signals.
+//
+// Owners hand the key passed to 'compute_secret()' to 'cancel()'
+// rather than destroying it. If a worker is computing the secret the
+// key is destroyed once it is done, so cancelling never blocks the
+// main thread.
+
+class HandshakeKeyPool {
+public:
+  typedef std::unique_ptr<DiffieHellman>  key_ptr;
+  typedef std::function<void (bool)>      slot_secret;
+  typedef std::function<void ()>          slot_void;
+
+  static const unsigned int max_ready       = 64;
+  static const unsigned int default_workers = 2;
+  static const unsigned int pubkey_length   = 96;
+
+  HandshakeKeyPool();
+  ~HandshakeKeyPool();
+  HandshakeKeyPool(const HandshakeKeyPool&) = delete;
+  HandshakeKeyPool& operator=(const HandshakeKeyPool&) = delete;
+
+  // When not running, keys are generated on the calling thread and
+  // owners should compute secrets directly.
+  bool                is_running() const            { return !m_workers.empty(); }
+
+  void                start(unsigned int workers);
+  void                stop();
+
+  size_t              size_ready();
+
+  // Returns a generated key, or generates one on the calling thread
+  // if none are ready.
+  key_ptr             acquire();
+
+  void                compute_secret(const void* owner, DiffieHellman* key, const unsigned char* pubkey, slot_secret slot);
+  void                cancel(const void* owner, key_ptr key);
+
+  void                work();
+
+  slot_void&          slot_has_work()               { return m_slot_has_work; }
+
+private:
+  struct job_type {
+    const void*   owner;
+    DiffieHellman* key;
+    unsigned char pubkey[pubkey_length];
+    slot_secret   slot;
+    bool          success;
+  };
+
+  // Cancelled jobs keep their key in 'orphan' until the worker is
+  // done with it.
+  struct computing_type {
+    const void*    owner;
+    DiffieHellman* key;
+    key_ptr        orphan;
+  };
+
+  static key_ptr      generate_key();
+
+  void                worker();
+
+  std::mutex              m_lock;
+  std::condition_variable m_cv_work;
+
+  std::vector<key_ptr>    m_ready;
+  unsigned int            m_generating{0};
+
+  std::deque<job_type>    m_pending;
+  std::vector<computing_type> m_computing;
+  std::deque<job_type>    m_done;
+
+  bool                    m_stopping{false};
+  std::vector<std::thread> m_workers;
+
+  slot_void               m_slot_has_work;
+};
+
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include "config.h"
 
+#include <algorithm>
 #include <rak/socket_address.h>
 
 #include "torrent/exceptions.h"
@@ -33,50 +34,192 @@ ProtocolExtension HandshakeManager::DefaultExtensions = ProtocolExtension::make_
 
 HandshakeManager::size_type
 HandshakeManager::size_info(DownloadMain* info) const {
-  return std::count_if(base_type::begin(), base_type::end(), [info](Handshake* h) { return info == h->download(); });
+  auto download_itr = m_downloads.find(info);
+  auto queue_itr = m_queued.find(info);
+
+  return (download_itr != m_downloads.end() ? download_itr->second.size() : 0) +
+    (queue_itr != m_queued.end() ? queue_itr->second.addresses.size() : 0);
+}
+
+HandshakeManager::size_type
+HandshakeManager::size_queued() const {
+  size_type result = 0;
+
+  for (const auto& queue : m_queued)
+    result += queue.second.addresses.size();
+
+  return result;
 }
 
 void
 HandshakeManager::clear() {
-  for (auto h : *this) {
-    h->deactivate_connection();
-    h->destroy_connection();
+  for (auto h : m_handshakes)
+    destroy(h);
+
+  m_handshakes.clear();
+  m_downloads.clear();
+  m_addresses.clear();
+
+  m_queued.clear();
+  m_queue_order.clear();
+}
+
+void
+HandshakeManager::destroy(Handshake* handshake) {
+  handshake->deactivate_connection();
+  handshake->destroy_connection();
+
+  delete handshake;
+}
+
+void
+HandshakeManager::insert(Handshake* handshake) {
+  if (handshake->manager_index() != Handshake::index_none)
+    throw internal_error("HandshakeManager::insert(...) handshake already inserted.");
+
+  handshake->set_manager_index(m_handshakes.size());
+  m_handshakes.push_back(handshake);
+
+  m_addresses.emplace(socket_address_key::from_sockaddr(handshake->socket_address()), handshake);
 
-    delete h;
-  };
-  base_type::clear();
+  if (handshake->download() != NULL)
+    attach_download(handshake);
+}
+
+void
+HandshakeManager::attach_download(Handshake* handshake) {
+  if (handshake->download_index() != Handshake::index_none)
+    return;
+
+  handshake_list& list = m_downloads[handshake->download()];
+
+  handshake->set_download_index(list.size());
+  list.push_back(handshake);
 }
 
 void
 HandshakeManager::erase(Handshake* handshake) {
-  iterator itr = std::find(base_type::begin(), base_type::end(), handshake);
+  uint32_t index = handshake->manager_index();
 
-  if (itr == base_type::end())
+  if (index >= m_handshakes.size() || m_handshakes[index] != handshake)
     throw internal_error("HandshakeManager::erase(...) could not find handshake.");
 
-  base_type::erase(itr);
+  m_handshakes[index] = m_handshakes.back();
+  m_handshakes[index]->set_manager_index(index);
+  m_handshakes.pop_back();
+
+  handshake->set_manager_index(Handshake::index_none);
+
+  auto range = m_addresses.equal_range(socket_address_key::from_sockaddr(handshake->socket_address()));
+  auto address_itr = std::find_if(range.first, range.second, [handshake](auto& v) { return v.second == handshake; });
+
+  if (address_itr == range.second)
+    throw internal_error("HandshakeManager::erase(...) could not find handshake address.");
+
+  m_addresses.erase(address_itr);
+
+  if (handshake->download_index() == Handshake::index_none)
+    return;
+
+  auto download_itr = m_downloads.find(handshake->download());
+
+  if (download_itr == m_downloads.end() ||
+      handshake->download_index() >= download_itr->second.size() ||
+      download_itr->second[handshake->download_index()] != handshake)
+    throw internal_error("HandshakeManager::erase(...) could not find handshake download.");
+
+  handshake_list& list = download_itr->second;
+
+  list[handshake->download_index()] = list.back();
+  list[handshake->download_index()]->set_download_index(handshake->download_index());
+  list.pop_back();
+
+  handshake->set_download_index(Handshake::index_none);
+
+  if (list.empty())
+    m_downloads.erase(download_itr);
 }
 
 bool
 HandshakeManager::find(const rak::socket_address& sa) {
-  return std::any_of(base_type::begin(), base_type::end(), [&sa](auto p2) {
-    return p2->peer_info() && sa == *rak::socket_address::cast_from(p2->peer_info()->socket_address());
+  auto range = m_addresses.equal_range(socket_address_key::from_sockaddr(sa.c_sockaddr()));
+
+  return std::any_of(range.first, range.second, [&sa](auto& v) {
+    return v.second->peer_info() && sa == *rak::socket_address::cast_from(v.second->peer_info()->socket_address());
   });
 }
 
 void
 HandshakeManager::erase_download(DownloadMain* info) {
-  auto split = std::partition(base_type::begin(), base_type::end(), [info](Handshake* h) {
-    return info != h->download();
-  });
+  for (auto itr = m_downloads.find(info); itr != m_downloads.end(); itr = m_downloads.find(info)) {
+    Handshake* h = itr->second.back();
 
-  std::for_each(split, base_type::end(), [](auto h) {
-    h->deactivate_connection();
-    h->destroy_connection();
+    erase(h);
+    destroy(h);
+  }
 
-    delete h;
-  });
-  base_type::erase(split, base_type::end());
+  if (m_queued.erase(info) != 0)
+    m_queue_order.erase(std::remove(m_queue_order.begin(), m_queue_order.end(), info), m_queue_order.end());
+
+  process_queue();
+}
+
+bool
+HandshakeManager::is_full() const {
+  uint32_t max_handshakes = manager->connection_manager()->max_handshakes();
+
+  return max_handshakes != 0 && m_handshakes.size() >= max_handshakes;
+}
+
+bool
+HandshakeManager::is_address_full(const sockaddr* sa) const {
+  uint32_t max_per_address = manager->connection_manager()->max_handshakes_per_address();
+
+  return max_per_address != 0 && m_addresses.count(socket_address_key::from_sockaddr(sa)) >= max_per_address;
+}
+
+void
+HandshakeManager::enqueue(const rak::socket_address& sa, DownloadMain* download) {
+  auto& queue = m_queued[download];
+
+  if (!queue.members.insert(sa).second)
+    return;
+
+  if (queue.addresses.empty())
+    m_queue_order.push_back(download);
+
+  queue.addresses.push_back(sa);
+}
+
+// Starts queued outgoing connections while there is room, taking one
+// address from each download in turn.
+void
+HandshakeManager::process_queue() {
+  while (!m_queue_order.empty() && !is_full()) {
+    DownloadMain* download = m_queue_order.front();
+    m_queue_order.pop_front();
+
+    auto queue_itr = m_queued.find(download);
+
+    if (queue_itr == m_queued.end() || queue_itr->second.addresses.empty())
+      throw internal_error("HandshakeManager::process_queue() queue order out of sync.");
+
+    rak::socket_address sa = queue_itr->second.addresses.front();
+    queue_itr->second.addresses.pop_front();
+    queue_itr->second.members.erase(sa);
+
+    if (queue_itr->second.addresses.empty())
+      m_queued.erase(queue_itr);
+    else
+      m_queue_order.push_back(download);
+
+    if (!manager->connection_manager()->can_connect() ||
+        !manager->connection_manager()->filter(sa.c_sockaddr()) ||
+        is_address_full(sa.c_sockaddr()))
+      continue;
+
+    create_outgoing(sa, download, manager->connection_manager()->encryption_options());
+  }
 }
 
 void
@@ -88,6 +231,12 @@ HandshakeManager::add_incoming(SocketFd fd, const rak::socket_address& sa) {
     return;
   }
 
+  if (is_full() || is_address_full(sa.c_sockaddr())) {
+    LT_LOG_SA(&sa, "rejected incoming connection: fd:%i handshakes:%u", fd.get_fd(), size());
+    fd.close();
+    return;
+  }
+
   LT_LOG_SA(&sa, "accepted incoming connection: fd:%i", fd.get_fd());
 
   manager->connection_manager()->inc_socket_count();
@@ -95,14 +244,20 @@ HandshakeManager::add_incoming(SocketFd fd, const rak::socket_address& sa) {
   Handshake* h = new Handshake(fd, this, manager->connection_manager()->encryption_options());
   h->initialize_incoming(sa.c_sockaddr());
 
-  base_type::push_back(h);
+  insert(h);
 }
 
 void
 HandshakeManager::add_outgoing(const rak::socket_address& sa, DownloadMain* download) {
   if (!manager->connection_manager()->can_connect() ||
-      !manager->connection_manager()->filter(sa.c_sockaddr()))
+      !manager->connection_manager()->filter(sa.c_sockaddr()) ||
+      is_address_full(sa.c_sockaddr()))
+    return;
+
+  if (is_full()) {
+    enqueue(sa, download);
     return;
+  }
 
   create_outgoing(sa, download, manager->connection_manager()->encryption_options());
 }
@@ -155,7 +310,7 @@ HandshakeManager::create_outgoing(const rak::socket_address& sa, DownloadMain* d
   Handshake* handshake = new Handshake(fd, this, encryption_options);
   handshake->initialize_outgoing(sa.c_sockaddr(), download, peerInfo);
 
-  base_type::push_back(handshake);
+  insert(handshake);
 }
 
 void
@@ -181,7 +336,7 @@ HandshakeManager::receive_succeeded(Handshake* handshake) {
                                                  handshake->extensions())) != NULL) {
 
     manager->client_list()->retrieve_id(&handshake->peer_info()->mutable_client_info(), handshake->peer_info()->id());
-    pcb->peer_chunks()->set_have_timer(handshake->initialized_time());
+    pcb->peer_chunks()->set_have_epoch(download->have_queue()->epoch_at_time(handshake->initialized_time()));
 
     LT_LOG_SA_C(handshake->peer_info()->socket_address(), "handshake success: type:%s id:%s",
                 peer_type, hash_string_to_html_str(handshake->peer_info()->id()).c_str());
@@ -213,6 +368,7 @@ HandshakeManager::receive_succeeded(Handshake* handshake) {
   }
 
   delete handshake;
+  process_queue();
 }
 
 void
@@ -242,6 +398,7 @@ HandshakeManager::receive_failed(Handshake* handshake, int message, int error) {
   }
 
   delete handshake;
+  process_queue();
 }
 
 void
@@ -1,12 +1,17 @@
 #ifndef LIBTORRENT_NET_HANDSHAKE_MANAGER_H
 #define LIBTORRENT_NET_HANDSHAKE_MANAGER_H
 
+#include <deque>
 #include <functional>
 #include <inttypes.h>
+#include <set>
 #include <string>
-#include <rak/unordered_vector.h>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 #include <rak/socket_address.h>
 #include <torrent/connection_manager.h>
+#include <torrent/net/socket_address_key.h>
 
 #include "net/socket_fd.h"
 
@@ -17,23 +22,33 @@ class DownloadManager;
 class DownloadMain;
 class PeerConnectionBase;
 
-class HandshakeManager : private rak::unordered_vector<Handshake*> {
+// Handshakes are kept in a vector and indexed by remote IP address
+// and by download, each handshake storing its positions so removal is
+// constant time.
+//
+// ConnectionManager's handshake limits are enforced here. Incoming
+// connections over a limit are closed, outgoing connections over the
+// total limit are queued per download and started round-robin
+// between downloads as handshakes finish.
+
+class HandshakeManager {
 public:
-  typedef rak::unordered_vector<Handshake*> base_type;
-  typedef uint32_t                          size_type;
+  typedef uint32_t size_type;
 
   typedef std::function<DownloadMain* (const char*)> slot_download;
 
   // Do not connect to peers with this many or more failed chunks.
   static const unsigned int max_failed = 3;
 
-  using base_type::empty;
-
   HandshakeManager() { }
   ~HandshakeManager() { clear(); }
 
-  size_type           size() const { return base_type::size(); }
+  bool                empty() const { return m_handshakes.empty(); }
+  size_type           size() const { return m_handshakes.size(); }
+
+  // Includes outgoing connections queued for the download.
   size_type           size_info(DownloadMain* info) const;
+  size_type           size_queued() const;
 
   void                clear();
 
@@ -41,6 +56,9 @@ public:
 
   void                erase_download(DownloadMain* info);
 
+  // Called once an incoming handshake knows its download.
+  void                attach_download(Handshake* h);
+
   // Cleanup.
   void                add_incoming(SocketFd fd, const rak::socket_address& sa);
   void                add_outgoing(const rak::socket_address& sa, DownloadMain* info);
@@ -59,13 +77,45 @@ public:
   ProtocolExtension*  default_extensions() const                        { return &DefaultExtensions; }
 
 private:
+  struct address_hash {
+    size_t operator () (const socket_address_key& key) const {
+      return std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char*>(&key), sizeof(socket_address_key)));
+    }
+  };
+
+  typedef std::vector<Handshake*>                                                 handshake_list;
+  typedef std::unordered_map<DownloadMain*, handshake_list>                       download_map;
+  typedef std::unordered_multimap<socket_address_key, Handshake*, address_hash>   address_map;
+  struct download_queue {
+    std::deque<rak::socket_address> addresses;
+    std::set<rak::socket_address>   members;
+  };
+
+  typedef std::unordered_map<DownloadMain*, download_queue>                       queue_map;
+
   void                create_outgoing(const rak::socket_address& sa, DownloadMain* info, int encryptionOptions);
+
+  void                insert(Handshake* handshake);
   void                erase(Handshake* handshake);
+  void                destroy(Handshake* handshake);
+
+  bool                is_full() const;
+  bool                is_address_full(const sockaddr* sa) const;
+
+  void                enqueue(const rak::socket_address& sa, DownloadMain* download);
+  void                process_queue();
 
   bool                setup_socket(SocketFd fd);
 
   static ProtocolExtension DefaultExtensions;
 
+  handshake_list      m_handshakes;
+  download_map        m_downloads;
+  address_map         m_addresses;
+
+  queue_map           m_queued;
+  std::deque<DownloadMain*> m_queue_order;
+
   slot_download       m_slot_download_id;
   slot_download       m_slot_download_obfuscated;
 };
@@ -74,10 +74,10 @@ public:
   const piece_list_type* upload_queue() const       { return &m_uploadQueue; }
   piece_list_type*       cancel_queue()             { return &m_cancelQueue; }
 
-  // Timer used to figure out what HAVE_PIECE messages have not been
-  // sent.
-  rak::timer          have_timer() const            { return m_haveTimer; }
-  void                set_have_timer(rak::timer t)  { m_haveTimer = t; }
+  // Epoch in the download's HaveQueue of the next HAVE_PIECE message
+  // to be sent.
+  uint64_t            have_epoch() const            { return m_haveEpoch; }
+  void                set_have_epoch(uint64_t e)    { m_haveEpoch = e; }
 
   Rate*               peer_rate()                   { return &m_peerRate; }
   const Rate*         peer_rate() const             { return &m_peerRate; }
@@ -99,7 +99,7 @@ private:
   piece_list_type     m_uploadQueue;
   piece_list_type     m_cancelQueue;
 
-  rak::timer          m_haveTimer;
+  uint64_t            m_haveEpoch;
 
   Rate                m_peerRate;
 
@@ -113,6 +113,8 @@ PeerChunks::PeerChunks() :
 
   m_usingCounter(false),
 
+  m_haveEpoch(0),
+
   m_peerRate(600),
 
   m_downloadThrottle(30),
@@ -36,19 +36,25 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <fcntl.h>
+#include <vector>
 #include <rak/error_number.h>
+#include <rak/slab_allocator.h>
 #include <rak/string_manip.h>
 
 #include "data/chunk_iterator.h"
 #include "data/chunk_list.h"
+#include "data/hash_chunk.h"
+#include "data/piece_layers.h"
 #include "download/chunk_selector.h"
 #include "download/chunk_statistics.h"
 #include "download/download_main.h"
 #include "net/socket_base.h"
 #include "torrent/exceptions.h"
 #include "torrent/data/block.h"
+#include "torrent/data/block_list.h"
 #include "torrent/chunk_manager.h"
 #include "torrent/connection_manager.h"
 #include "torrent/download_info.h"
@@ -91,6 +97,39 @@ log_mincore_stats_func(bool is_incore, bool new_index, bool& continous) {
   continous = is_incore;
 }
 
+// There are only a few connection types, so a linear search over the
+// pools is fine. The pools are never destroyed, so connections deleted
+// by other static destructors at exit still find them.
+static rak::slab_pool*
+peer_connection_pool(size_t size) {
+  static auto pools = new std::vector<rak::slab_pool*>;
+
+  auto itr = std::find_if(pools->begin(), pools->end(), [size](rak::slab_pool* pool) {
+      return pool->object_size() == size;
+    });
+
+  if (itr != pools->end())
+    return *itr;
+
+  pools->push_back(new rak::slab_pool(size, 16));
+  return pools->back();
+}
+
+void*
+PeerConnectionBase::operator new(size_t size) {
+  instrumentation_update_peak(INSTRUMENTATION_POOL_PEER_CONNECTION, INSTRUMENTATION_POOL_PEER_CONNECTION_PEAK, 1);
+  return peer_connection_pool(size)->allocate();
+}
+
+void
+PeerConnectionBase::operator delete(void* ptr, size_t size) {
+  if (ptr == NULL)
+    return;
+
+  instrumentation_update_peak(INSTRUMENTATION_POOL_PEER_CONNECTION, INSTRUMENTATION_POOL_PEER_CONNECTION_PEAK, -1);
+  peer_connection_pool(size)->deallocate(ptr);
+}
+
 PeerConnectionBase::PeerConnectionBase() :
   m_download(NULL),
   
@@ -377,7 +416,7 @@ PeerConnectionBase::load_up_chunk() {
 
   up_chunk_release();
   
-  m_upChunk = m_download->chunk_list()->get(m_upPiece.index());
+  m_upChunk = m_download->chunk_list()->get(m_upPiece.index(), ChunkList::get_read_cache);
   
   if (!m_upChunk.is_valid())
     throw storage_error("File chunk read error: " + std::string(m_upChunk.error_number().c_str()));
@@ -414,6 +453,18 @@ PeerConnectionBase::load_up_chunk() {
   m_upChunk.chunk()->preload(m_upPiece.offset(), m_upChunk.chunk()->chunk_size(), cm->preload_type() == 1);
 }
 
+// Returns false while the next piece to upload is being read into the
+// read cache, the connection is woken by the download once loaded.
+bool
+PeerConnectionBase::up_chunk_prefetch() {
+  uint32_t index = m_peerChunks.upload_queue()->front().index();
+
+  if (m_upChunk.is_valid() && m_upChunk.index() == index)
+    return true;
+
+  return m_download->chunk_list()->prefetch(index);
+}
+
 void
 PeerConnectionBase::cancel_transfer(BlockTransfer* transfer) {
   if (!get_fd().is_valid())
@@ -430,6 +481,7 @@ PeerConnectionBase::cancel_transfer(BlockTransfer* transfer) {
   write_insert_poll_safe();
 
   m_peerChunks.cancel_queue()->push_back(transfer->piece());
+  instrumentation_update(INSTRUMENTATION_TRANSFER_REQUESTS_CANCELED, 1);
 }
 
 void
@@ -495,6 +547,9 @@ PeerConnectionBase::down_chunk_finished() {
     if (!m_downChunk.is_valid())
       throw internal_error("PeerConnectionBase::down_chunk_finished() Transfer is the leader, but no chunk allocated.");
 
+    down_chunk_hash_prefix(transfer);
+    down_chunk_leaf_hash(transfer);
+
     request_list()->finished();
     m_downChunk.object()->set_time_modified(cachedTime);
 
@@ -523,6 +578,46 @@ PeerConnectionBase::down_chunk_finished() {
   write_insert_poll_safe();
 }
 
+// Hash the finished blocks that extend the in-order start of the
+// piece while the data is still in memory, so that the hash check
+// only needs to read the blocks that arrived out of order.
+void
+PeerConnectionBase::down_chunk_hash_prefix(BlockTransfer* transfer) {
+  BlockList* block_list = transfer->block()->parent();
+  HashPrefix* prefix = block_list->hash_prefix();
+
+  if (transfer->piece().offset() != (prefix != NULL ? prefix->length() : 0))
+    return;
+
+  prefix = block_list->make_hash_prefix();
+
+  for (auto itr = block_list->begin() + (transfer->block() - &*block_list->begin());
+       itr != block_list->end() && itr->is_finished(); ++itr)
+    prefix->update(m_downChunk.chunk(), itr->piece().length());
+}
+
+// Hybrid torrents keep the v2 leaf hash of each block, so the piece's
+// merkle root is built without reading the blocks back.
+void
+PeerConnectionBase::down_chunk_leaf_hash(BlockTransfer* transfer) {
+  const PieceLayers* piece_layers = m_download->piece_layers();
+  const Piece& piece = transfer->piece();
+
+  if (!piece_layers->has_piece(piece.index()) || piece.offset() % merkle_block_size != 0)
+    return;
+
+  uint32_t leaf = piece.offset() / merkle_block_size;
+  uint32_t length = piece_layers->file_length(piece.index());
+
+  if (piece.offset() >= length || piece.length() < std::min(merkle_block_size, length - piece.offset()))
+    return;
+
+  char hash[merkle_hash_size];
+
+  piece_layers->hash_leaf(piece.index(), leaf, m_downChunk.chunk(), hash);
+  transfer->block()->parent()->set_leaf_hash(leaf, hash);
+}
+
 bool
 PeerConnectionBase::down_chunk() {
   if (!m_down->throttle()->is_throttled(m_peerChunks.download_throttle()))
@@ -653,6 +748,11 @@ PeerConnectionBase::down_chunk_skip_process(const void* buffer, uint32_t length)
   m_download->info()->mutable_down_rate()->insert(length);
   m_download->info()->mutable_skip_rate()->insert(length);
 
+  // Erased transfers hold unrequested or corrupt data, the rest was
+  // also requested from another peer.
+  if (!transfer->is_erased())
+    instrumentation_update(INSTRUMENTATION_TRANSFER_DUPLICATE_BYTES_WASTED, length);
+
   if (!transfer->is_valid()) {
     transfer->adjust_position(length);
     return length;
@@ -957,7 +1057,7 @@ PeerConnectionBase::try_request_pieces() {
   if (request_list()->queued_empty())
     m_downStall = 0;
 
-  uint32_t pipeSize = request_list()->calculate_pipe_size(m_peerChunks.download_throttle()->rate()->rate());
+  uint32_t pipeSize = request_pipe_size();
 
   // Don't start requesting if we can't do it in large enough chunks.
   if (request_list()->pipe_size() >= (pipeSize + 10) / 2)
@@ -991,6 +1091,20 @@ PeerConnectionBase::try_request_pieces() {
   return success;
 }
 
+// The kernel's smoothed RTT is sampled at most once a second, falling
+// back to the request list's own timing where TCP_INFO is missing.
+uint32_t
+PeerConnectionBase::request_pipe_size() {
+  uint32_t rtt;
+
+  if (cachedTime >= m_timeLastRtt + rak::timer::from_seconds(1) && get_fd().is_valid() && get_fd().get_tcp_rtt(&rtt)) {
+    m_timeLastRtt = cachedTime;
+    request_list()->rtt_sample(rtt, true);
+  }
+
+  return request_list()->calculate_pipe_size(m_peerChunks.download_throttle()->rate()->rate());
+}
+
 // Send one peer exchange message according to bits set in m_sendPEXMask.
 // We can only send one message at a time, because the derived class
 // needs to flush the buffer and call up_extension before the next one.
@@ -87,6 +87,11 @@ public:
 
   PeerConnectionBase();
   virtual ~PeerConnectionBase();
+
+  // Allocated in the main thread from a pool per connection type
+  // size, the virtual destructor passes the size of the derived type.
+  static void*        operator new(size_t size);
+  static void         operator delete(void* ptr, size_t size);
   
   const char*         type_name() const { return "pcb"; }
 
@@ -158,6 +163,7 @@ protected:
   inline bool         write_remaining();
 
   void                load_up_chunk();
+  bool                up_chunk_prefetch();
 
   void                read_request_piece(const Piece& p);
   void                read_cancel_piece(const Piece& p);
@@ -167,6 +173,8 @@ protected:
 
   bool                down_chunk_start(const Piece& p);
   void                down_chunk_finished();
+  void                down_chunk_hash_prefix(BlockTransfer* transfer);
+  void                down_chunk_leaf_hash(BlockTransfer* transfer);
 
   bool                down_chunk();
   bool                down_chunk_from_buffer();
@@ -188,6 +196,7 @@ protected:
 
   bool                should_request();
   bool                try_request_pieces();
+  uint32_t            request_pipe_size();
 
   bool                send_pex_message();
   bool                send_ext_message();
@@ -229,6 +238,7 @@ protected:
   int                 m_sendPEXMask;
 
   rak::timer          m_timeLastRead;
+  rak::timer          m_timeLastRtt;
 
   DataBuffer          m_extensionMessage;
   uint32_t            m_extensionOffset;
@@ -51,6 +51,7 @@
 #include "torrent/peer/connection_list.h"
 #include "torrent/peer/peer_info.h"
 #include "torrent/utils/log.h"
+#include "utils/instrumentation.h"
 
 #include "extensions.h"
 #include "initial_seed.h"
@@ -524,6 +525,13 @@ PeerConnection<type>::fill_write_buffer() {
     m_sendInterested = false;
   }
 
+  // Cancel blocks that other peers have delivered before asking for
+  // more, so they leave the peer's queue as early as possible.
+  while (type == Download::CONNECTION_LEECH && !m_peerChunks.cancel_queue()->empty() && m_up->can_write_cancel()) {
+    m_up->write_cancel(m_peerChunks.cancel_queue()->front());
+    m_peerChunks.cancel_queue()->pop_front();
+  }
+
   if (type == Download::CONNECTION_LEECH && m_tryRequest) {
     if (!(m_tryRequest = !should_request()) &&
         !(m_tryRequest = try_request_pieces()) &&
@@ -538,30 +546,31 @@ PeerConnection<type>::fill_write_buffer() {
 
   DownloadMain::have_queue_type* haveQueue = m_download->have_queue();
 
-  if (type == Download::CONNECTION_LEECH && 
-      !haveQueue->empty() &&
-      m_peerChunks.have_timer() <= haveQueue->front().first &&
-      m_up->can_write_have()) {
+  if (type == Download::CONNECTION_LEECH &&
+      m_peerChunks.have_epoch() < haveQueue->end_epoch()) {
+    HaveQueue::epoch_type epoch = haveQueue->clamp_epoch(m_peerChunks.have_epoch());
+    bool lazy_have = m_download->info()->is_lazy_have();
 
-    auto last = std::find_if(haveQueue->begin(), haveQueue->end(), [this](auto v) {
-      return m_peerChunks.have_timer() > v.first;
-    });
+    while (epoch != haveQueue->end_epoch() && m_up->can_write_have()) {
+      uint32_t index = haveQueue->index_at_epoch(epoch++);
 
-    do {
-      m_up->write_have((--last)->second);
-    } while (last != haveQueue->begin() && m_up->can_write_have());
+      // Peers that already have the chunk do not need to know we
+      // have it too, unless they use it for availability statistics.
+      if (lazy_have && m_peerChunks.bitfield()->get(index)) {
+        instrumentation_update(INSTRUMENTATION_PROTOCOL_HAVE_SUPPRESSED, 1);
+        continue;
+      }
 
-    m_peerChunks.set_have_timer(last->first + 1);
+      m_up->write_have(index);
+      instrumentation_update(INSTRUMENTATION_PROTOCOL_HAVE_SENT, 1);
+    }
+
+    m_peerChunks.set_have_epoch(epoch);
   }
 
   if (type == Download::CONNECTION_INITIAL_SEED && m_up->can_write_have())
     offer_chunk();
 
-  while (type == Download::CONNECTION_LEECH && !m_peerChunks.cancel_queue()->empty() && m_up->can_write_cancel()) {
-    m_up->write_cancel(m_peerChunks.cancel_queue()->front());
-    m_peerChunks.cancel_queue()->pop_front();
-  }
-
   if (m_sendPEXMask && m_up->can_write_extension() &&
       send_pex_message()) {
     // Don't do anything else if send_pex_message() succeeded.
@@ -573,7 +582,8 @@ PeerConnection<type>::fill_write_buffer() {
   } else if (!m_upChoke.choked() &&
              !m_peerChunks.upload_queue()->empty() &&
              m_up->can_write_piece() &&
-             (type != Download::CONNECTION_INITIAL_SEED || should_upload())) {
+             (type != Download::CONNECTION_INITIAL_SEED || should_upload()) &&
+             up_chunk_prefetch()) {
     write_prepare_piece();
   }
 
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <functional>
+#include <limits>
 #include <cinttypes>
 
 #include "torrent/data/block.h"
@@ -83,7 +84,12 @@ RequestList::~RequestList() {
 
 std::vector<const Piece*>
 RequestList::delegate(uint32_t maxPieces) {
-  std::vector<BlockTransfer*> transfers = m_delegator->delegate(m_peerChunks, m_affinity, maxPieces);
+  uint32_t maxDuplicates = 0;
+
+  if (m_delegator->get_aggressive())
+    maxDuplicates = Delegator::endgame_peer_duplicates - std::min<uint32_t>(queued_duplicates(), Delegator::endgame_peer_duplicates);
+
+  std::vector<BlockTransfer*> transfers = m_delegator->delegate(m_peerChunks, m_affinity, maxPieces, maxDuplicates);
 
   std::vector<const Piece*> pieces;
 
@@ -92,6 +98,12 @@ RequestList::delegate(uint32_t maxPieces) {
 
   instrumentation_update(INSTRUMENTATION_TRANSFER_REQUESTS_DELEGATED, transfers.size());
 
+  if (!m_rtt_from_socket && m_transfer == NULL &&
+      queued_empty() && unordered_empty() && stalled_empty() && m_rtt_probe_piece.index() == Piece::invalid_index) {
+    m_rtt_probe_time = cachedTime;
+    m_rtt_probe_piece = transfers.front()->piece();
+  }
+
   for (auto transfer : transfers) {
     m_queues.push_back(bucket_queued, transfer);
     pieces.push_back(&transfer->piece());
@@ -130,6 +142,7 @@ RequestList::choked() {
   // updated within a short timespan?
 
   m_last_choke = cachedTime;
+  m_rtt_probe_piece = Piece();
 
   if (m_queues.queue_empty(bucket_queued) && m_queues.queue_empty(bucket_unordered))
     return;
@@ -206,6 +219,8 @@ RequestList::clear() {
   m_queues.clear(bucket_unordered);
   m_queues.clear(bucket_stalled);
   m_queues.clear(bucket_choked);
+
+  m_rtt_probe_piece = Piece();
 }
 
 bool
@@ -215,6 +230,13 @@ RequestList::downloading(const Piece& piece) {
 
   instrumentation_update(INSTRUMENTATION_TRANSFER_REQUESTS_DOWNLOADING, 1);
 
+  if (m_rtt_probe_piece.index() != Piece::invalid_index) {
+    if (piece.index() == m_rtt_probe_piece.index() && piece.offset() == m_rtt_probe_piece.offset())
+      rtt_sample(std::max<int64_t>((cachedTime - m_rtt_probe_time).usec(), 1), false);
+
+    m_rtt_probe_piece = Piece();
+  }
+
   std::pair<int, queues_type::iterator> itr =
     queue_bucket_find_if_in_any(m_queues, request_list_same_piece(piece));
 
@@ -296,6 +318,7 @@ RequestList::finished() {
   BlockTransfer* transfer = m_transfer;
   m_transfer = NULL;
 
+  delivered(transfer->position());
   m_delegator->transfer_list()->finished(transfer);
 
   instrumentation_update(INSTRUMENTATION_TRANSFER_REQUESTS_FINISHED, 1);
@@ -306,6 +329,7 @@ RequestList::skipped() {
   if (!is_downloading())
     throw internal_error("RequestList::skip() called but no transfer is in progress.");
 
+  delivered(m_transfer->position());
   Block::release(m_transfer);
   m_transfer = NULL;
 
@@ -328,14 +352,84 @@ RequestList::transfer_dissimilar() {
   m_transfer = dummy;
 }
 
+// Queued requests for blocks that have also been requested from
+// other peers.
+uint32_t
+RequestList::queued_duplicates() const {
+  return std::count_if(m_queues.begin(bucket_queued), m_queues.end(bucket_queued), [](BlockTransfer* transfer) {
+      return transfer->is_valid() && transfer->block()->size_all() > 1;
+    });
+}
+
 bool
 RequestList::is_interested_in_active() const {
   auto list = m_delegator->transfer_list();
   return std::any_of(list->begin(), list->end(), [this](auto transfer) { return m_peerChunks->bitfield()->get(transfer->index()); });
 }
 
+void
+RequestList::rtt_sample(uint32_t usec, bool from_socket) {
+  if (from_socket && !m_rtt_from_socket) {
+    m_rtt_from_socket = true;
+    m_rtt = 0;
+  }
+
+  if (from_socket != m_rtt_from_socket)
+    return;
+
+  m_rtt = m_rtt == 0 ? usec : (uint32_t)(((uint64_t)m_rtt * 7 + usec) / 8);
+}
+
+// The pipe is sized to keep the bandwidth-delay product of the peer
+// in flight. As the rate only reflects what the current pipe allows,
+// twice the product is requested so that a peer limited by the pipe
+// grows until the link is saturated, while end-game only asks for
+// the product itself to avoid duplicate requests. The target grows
+// immediately but shrinks gradually so a short dip in the rate
+// doesn't drain the pipe.
+//
+// The download rate is averaged over 30 seconds, so while the pipe
+// grows the rate of recently delivered blocks is used if higher.
 uint32_t
 RequestList::calculate_pipe_size(uint32_t rate) {
+  update_delivered_rate();
+  rate = std::max(rate, m_delivered_rate);
+
+  if (m_rtt == 0)
+    return m_target_pipe_size = calculate_pipe_size_rate(rate);
+
+  uint64_t bdp = ((uint64_t)rate * m_rtt + ((uint64_t)Delegator::block_size * 1000000 - 1)) / ((uint64_t)Delegator::block_size * 1000000);
+  uint64_t target;
+
+  if (!m_delegator->get_aggressive())
+    target = 2 * bdp + 4;
+  else
+    target = bdp + 1;
+
+  target = std::min<uint64_t>(target, uint64_t{pipe_size_max});
+
+  if (target < m_target_pipe_size)
+    target = (3 * (uint64_t)m_target_pipe_size + target) / 4;
+
+  return m_target_pipe_size = target;
+}
+
+// Samples cover at least a second, and at least two round trips so
+// that a full pipe is delivered within each.
+void
+RequestList::update_delivered_rate() {
+  int64_t elapsed = (cachedTime - m_delivered_time).usec();
+
+  if (elapsed < std::max<int64_t>(1000000, 2 * (int64_t)m_rtt))
+    return;
+
+  m_delivered_rate = std::min<uint64_t>(m_delivered * 1000000 / elapsed, std::numeric_limits<uint32_t>::max());
+  m_delivered = 0;
+  m_delivered_time = cachedTime;
+}
+
+uint32_t
+RequestList::calculate_pipe_size_rate(uint32_t rate) const {
   // Change into KB.
   rate /= 1024;
 
@@ -76,6 +76,8 @@ public:
   static const int timeout_choked_received = 60;
   static const int timeout_process_unordered = 60;
 
+  static const uint32_t pipe_size_max = 512;
+
   RequestList();
   ~RequestList();
 
@@ -114,9 +116,26 @@ public:
   bool                 choked_empty() const               { return m_queues.queue_empty(bucket_choked); }
   size_t               choked_size() const                { return m_queues.queue_size(bucket_choked); }
 
+  uint32_t             queued_duplicates() const;
+
   uint32_t             pipe_size() const;
   uint32_t             calculate_pipe_size(uint32_t rate);
 
+  // Smoothed round-trip time in microseconds, zero until measured,
+  // and the pipe size last returned by 'calculate_pipe_size'.
+  uint32_t             rtt() const                       { return m_rtt; }
+  uint32_t             target_pipe_size() const          { return m_target_pipe_size; }
+
+  // Samples taken from the socket replace the request timing
+  // estimate.
+  void                 rtt_sample(uint32_t usec, bool from_socket);
+
+  // Bytes of blocks received from the peer. The download rate lags
+  // far behind while the pipe grows, so the pipe is also sized from
+  // the rate recent blocks were delivered at.
+  void                 delivered(uint32_t bytes)         { m_delivered += bytes; }
+  uint32_t             delivered_rate() const            { return m_delivered_rate; }
+
   void                 set_delegator(Delegator* d)       { m_delegator = d; }
   void                 set_peer_chunks(PeerChunks* b)    { m_peerChunks = b; }
 
@@ -131,6 +150,9 @@ private:
   void                 prepare_process_unordered(queues_type::iterator itr);
   void                 delay_process_unordered();
 
+  uint32_t             calculate_pipe_size_rate(uint32_t rate) const;
+  void                 update_delivered_rate();
+
   Delegator*           m_delegator;
   PeerChunks*          m_peerChunks;
 
@@ -144,6 +166,19 @@ private:
   rak::timer           m_last_unchoke;
   size_t               m_last_unordered_position;
 
+  uint32_t             m_rtt;
+  uint32_t             m_target_pipe_size;
+  bool                 m_rtt_from_socket;
+
+  uint64_t             m_delivered;
+  uint32_t             m_delivered_rate;
+  rak::timer           m_delivered_time;
+
+  // Timing of a request sent while nothing else was outstanding, so
+  // that the response isn't delayed by earlier requests.
+  rak::timer           m_rtt_probe_time;
+  Piece                m_rtt_probe_piece;
+
   rak::priority_item   m_delay_remove_choked;
   rak::priority_item   m_delay_process_unordered;
 };
@@ -154,7 +189,12 @@ RequestList::RequestList() :
   m_peerChunks(NULL),
   m_transfer(NULL),
   m_affinity(-1),
-  m_last_unordered_position(0) {
+  m_last_unordered_position(0),
+  m_rtt(0),
+  m_target_pipe_size(0),
+  m_rtt_from_socket(false),
+  m_delivered(0),
+  m_delivered_rate(0) {
   m_delay_remove_choked.slot() = std::bind(&RequestList::delay_remove_choked, this);
   m_delay_process_unordered.slot() = std::bind(&RequestList::delay_process_unordered, this);
 }
@@ -20,7 +20,7 @@ thread_main::init_thread() {
     throw internal_error("thread_main::init_thread(): Poll::slot_create_poll() not valid.");
 
   m_poll = Poll::slot_create_poll()();
-  m_poll->set_flags(Poll::flag_waive_global_lock);
+  m_poll->set_flags(m_poll->flags() | Poll::flag_waive_global_lock);
 
   m_state = STATE_INITIALIZED;
   m_thread = pthread_self();
@@ -38,13 +38,7 @@ thread_main::call_events() {
   if (taskScheduler.empty() || taskScheduler.top()->time() > cachedTime)
     return;
 
-  while (!taskScheduler.empty() && taskScheduler.top()->time() <= cachedTime) {
-    rak::priority_item* v = taskScheduler.top();
-    taskScheduler.pop();
-
-    v->clear_time();
-    v->slot()();
-  }
+  rak::priority_queue_perform(&taskScheduler, cachedTime);
 
   // Update the timer again to ensure we get accurate triggering of
   // msec timers.
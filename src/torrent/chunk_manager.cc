@@ -36,11 +36,14 @@
 
 #include "config.h"
 
+#include <cstring>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 
 #include "data/chunk_list.h"
+#include "data/chunk_read_cache.h"
 #include "utils/instrumentation.h"
 
 #include "exceptions.h"
@@ -65,7 +68,12 @@ ChunkManager::ChunkManager() :
   m_statsNotPreloaded(0),
 
   m_timerStarved(0),
-  m_lastFreed(0) {
+  m_lastFreed(0),
+
+  m_writeCacheMaxMemory(0),
+  m_writeCacheUsage(0),
+
+  m_readCache(new ChunkReadCache) {
 
   // 1/5 of the available memory should be enough for the client. If
   // the client really requires alot more memory it should call this
@@ -76,6 +84,11 @@ ChunkManager::ChunkManager() :
 ChunkManager::~ChunkManager() {
   if (m_memoryUsage != 0 || m_memoryBlockCount != 0)
     throw internal_error("ChunkManager::~ChunkManager() m_memoryUsage != 0 || m_memoryBlockCount != 0.");
+
+  write_cache_trim(0);
+
+  if (m_writeCacheUsage != 0)
+    throw internal_error("ChunkManager::~ChunkManager() m_writeCacheUsage != 0.");
 }
 
 uint64_t
@@ -183,6 +196,94 @@ ChunkManager::deallocate(uint32_t size, int flags) {
   instrumentation_update(INSTRUMENTATION_MEMORY_CHUNK_USAGE, -(int64_t)size);
 }
 
+void
+ChunkManager::set_write_cache_max_memory(uint64_t bytes) {
+  m_writeCacheMaxMemory = bytes;
+
+  write_cache_trim(bytes);
+}
+
+// Reuses a pooled buffer of the same size if there is one, else maps
+// a new one after dropping pooled buffers to make room. Pooled buffers
+// are cleared so that the parts of a chunk not yet downloaded never
+// write another chunk's data to the files.
+char*
+ChunkManager::write_cache_allocate(uint32_t size) {
+  auto itr = std::find_if(m_writeCachePool.begin(), m_writeCachePool.end(), [size](auto& buffer) { return buffer.first == size; });
+
+  if (itr != m_writeCachePool.end()) {
+    char* buffer = itr->second;
+
+    *itr = m_writeCachePool.back();
+    m_writeCachePool.pop_back();
+
+    std::memset(buffer, 0, size);
+
+    instrumentation_update(INSTRUMENTATION_MEMORY_WRITE_CACHE_REUSED, 1);
+    return buffer;
+  }
+
+  if (size > m_writeCacheMaxMemory)
+    return NULL;
+
+  write_cache_trim(m_writeCacheMaxMemory - size);
+
+  if (m_writeCacheUsage + size > m_writeCacheMaxMemory) {
+    instrumentation_update(INSTRUMENTATION_MEMORY_WRITE_CACHE_FULL, 1);
+    return NULL;
+  }
+
+  char* buffer = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+
+  if (buffer == MAP_FAILED)
+    return NULL;
+
+  m_writeCacheUsage += size;
+  instrumentation_update(INSTRUMENTATION_MEMORY_WRITE_CACHE_USAGE, size);
+
+  return buffer;
+}
+
+void
+ChunkManager::write_cache_deallocate(char* buffer, uint32_t size) {
+  if (buffer == NULL || size > m_writeCacheUsage)
+    throw internal_error("ChunkManager::write_cache_deallocate(...) received an invalid buffer.");
+
+  m_writeCachePool.emplace_back(size, buffer);
+
+  uint64_t target = std::min(m_writeCacheUsage, m_writeCacheMaxMemory);
+
+  if (m_writeCachePool.size() > write_cache_pool_size)
+    target = std::min(target, m_writeCacheUsage - m_writeCachePool.front().first);
+
+  write_cache_trim(target);
+}
+
+// Unmaps pooled buffers, oldest first, until the usage is at most
+// 'target' or the pool is empty.
+void
+ChunkManager::write_cache_trim(uint64_t target) {
+  auto itr = m_writeCachePool.begin();
+
+  for (; itr != m_writeCachePool.end() && m_writeCacheUsage > target; ++itr) {
+    if (munmap(itr->second, itr->first) != 0)
+      throw internal_error("ChunkManager::write_cache_trim(...) munmap failed.");
+
+    m_writeCacheUsage -= itr->first;
+    instrumentation_update(INSTRUMENTATION_MEMORY_WRITE_CACHE_USAGE, -(int64_t)itr->first);
+  }
+
+  m_writeCachePool.erase(m_writeCachePool.begin(), itr);
+}
+
+uint64_t ChunkManager::read_cache_max_memory() const   { return m_readCache->max_memory(); }
+void     ChunkManager::set_read_cache_max_memory(uint64_t bytes) { m_readCache->set_max_memory(bytes); }
+
+uint64_t ChunkManager::read_cache_memory_usage() const { return m_readCache->memory_usage(); }
+uint64_t ChunkManager::read_cache_hits() const         { return m_readCache->stats_hits(); }
+uint64_t ChunkManager::read_cache_misses() const       { return m_readCache->stats_misses(); }
+uint64_t ChunkManager::read_cache_evictions() const    { return m_readCache->stats_evictions(); }
+
 void
 ChunkManager::try_free_memory(uint64_t size) {
   // Ensure that we don't call this function too often when futile as
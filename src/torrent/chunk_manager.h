@@ -39,11 +39,15 @@
 #ifndef LIBTORRENT_CHUNK_MANAGER_H
 #define LIBTORRENT_CHUNK_MANAGER_H
 
+#include <memory>
+#include <utility>
 #include <vector>
 #include <torrent/common.h>
 
 namespace torrent {
 
+class ChunkReadCache;
+
 // TODO: Currently all chunk lists are inserted, despite the download
 // not being open/active.
 
@@ -111,6 +115,30 @@ public:
   uint32_t            preload_required_rate() const             { return m_preloadRequiredRate; }
   void                set_preload_required_rate(uint32_t bytes) { m_preloadRequiredRate = bytes; }
 
+  // Incoming pieces are assembled in anonymous memory and written to
+  // the files once verified, as long as the write cache stays within
+  // this many bytes. Otherwise pieces are written directly to the
+  // mapped files. Set to 0 to disable.
+  uint64_t            write_cache_max_memory() const            { return m_writeCacheMaxMemory; }
+  void                set_write_cache_max_memory(uint64_t bytes);
+
+  // Includes buffers kept for reuse.
+  uint64_t            write_cache_memory_usage() const          { return m_writeCacheUsage; }
+
+  // Completed chunks requested by peers are read into memory on the
+  // disk thread and kept in a session wide cache with ARC eviction,
+  // as long as it stays within this many bytes. Set to 0 to disable,
+  // in which case uploads are served from mapped files.
+  uint64_t            read_cache_max_memory() const;
+  void                set_read_cache_max_memory(uint64_t bytes);
+
+  uint64_t            read_cache_memory_usage() const;
+  uint64_t            read_cache_hits() const;
+  uint64_t            read_cache_misses() const;
+  uint64_t            read_cache_evictions() const;
+
+  ChunkReadCache*     read_cache()                              { return m_readCache.get(); }
+
 
   void                insert(ChunkList* chunkList);
   void                erase(ChunkList* chunkList);
@@ -133,6 +161,12 @@ public:
   void                deallocate(uint32_t size, int flags = 0);
 
   void                try_free_memory(uint64_t size);
+
+  // Returns a page aligned buffer of 'size' bytes for the write
+  // cache, or NULL if it would exceed the budget. The contents are
+  // undefined.
+  char*               write_cache_allocate(uint32_t size) LIBTORRENT_NO_EXPORT;
+  void                write_cache_deallocate(char* buffer, uint32_t size) LIBTORRENT_NO_EXPORT;
   
   void                periodic_sync();
 
@@ -145,8 +179,14 @@ public:
   void                inc_stats_not_preloaded()                 { m_statsNotPreloaded++; }
 
 private:
+  typedef std::vector<std::pair<uint32_t, char*>> write_cache_pool;
+
+  static const uint32_t write_cache_pool_size = 4;
+
   void                sync_all(int flags, uint64_t target) LIBTORRENT_NO_EXPORT;
 
+  void                write_cache_trim(uint64_t target) LIBTORRENT_NO_EXPORT;
+
   uint64_t            m_memoryUsage;
   uint64_t            m_maxMemoryUsage;
 
@@ -165,6 +205,12 @@ private:
 
   int32_t             m_timerStarved;
   size_type           m_lastFreed;
+
+  uint64_t            m_writeCacheMaxMemory;
+  uint64_t            m_writeCacheUsage;
+  write_cache_pool    m_writeCachePool;
+
+  std::unique_ptr<ChunkReadCache> m_readCache;
 };
 
 }
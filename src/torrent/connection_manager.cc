@@ -42,6 +42,8 @@
 #include <rak/socket_address.h>
 
 #include "net/listen.h"
+#include "torrent/peer/peer_info.h"
+#include "torrent/peer/peer_list.h"
 
 #include "connection_manager.h"
 #include "error.h"
@@ -87,6 +89,9 @@ ConnectionManager::ConnectionManager() :
   m_receiveBufferSize(0),
   m_encryptionOptions(encryption_none),
 
+  m_max_handshakes(0),
+  m_max_handshakes_per_address(0),
+
   m_listen(new Listen),
   m_listen_port(0),
   m_listen_backlog(SOMAXCONN),
@@ -174,6 +179,9 @@ ConnectionManager::set_proxy_address(const sockaddr* sa) {
 
 uint32_t
 ConnectionManager::filter(const sockaddr* sa) {
+  if (PeerList::lookup_filter(sa) & PeerInfo::flag_unwanted)
+    return 0;
+
   if (!m_slot_filter)
     return 1;
   else
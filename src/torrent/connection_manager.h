@@ -133,6 +133,16 @@ public:
   void                set_receive_buffer_size(uint32_t s);
   void                set_encryption_options(uint32_t options); 
 
+  // Limits on concurrent handshakes, in total and per remote IP
+  // address, zero disables a limit and is the default. Outgoing
+  // connections beyond the total limit are queued fairly between
+  // downloads, incoming connections are closed.
+  size_type           max_handshakes() const                  { return m_max_handshakes; }
+  size_type           max_handshakes_per_address() const      { return m_max_handshakes_per_address; }
+
+  void                set_max_handshakes(size_type s)         { m_max_handshakes = s; }
+  void                set_max_handshakes_per_address(size_type s) { m_max_handshakes_per_address = s; }
+
   // Setting the addresses creates a copy of the address.
   const sockaddr*     bind_address() const                    { return m_bindAddress; }
   const sockaddr*     local_address() const                   { return m_localAddress; }
@@ -187,6 +197,9 @@ private:
   uint32_t            m_receiveBufferSize;
   int                 m_encryptionOptions;
 
+  size_type           m_max_handshakes;
+  size_type           m_max_handshakes_per_address;
+
   sockaddr*           m_bindAddress;
   sockaddr*           m_localAddress;
   sockaddr*           m_proxyAddress;
@@ -38,6 +38,7 @@
 
 #include <algorithm>
 #include <functional>
+#include <rak/slab_allocator.h>
 
 #include "peer/peer_info.h"
 #include "protocol/peer_connection_base.h"
@@ -47,9 +48,37 @@
 #include "block_list.h"
 #include "block_transfer.h"
 #include "exceptions.h"
+#include "utils/instrumentation.h"
 
 namespace torrent {
 
+// A BlockTransfer is created for every request and dummy transfer, so
+// keep them in a pool. The pool is never destroyed, as transfers may
+// still be released by other static destructors at exit.
+static rak::slab_allocator<BlockTransfer, 256>&
+block_transfer_pool() {
+  static auto pool = new rak::slab_allocator<BlockTransfer, 256>;
+  return *pool;
+}
+
+void*
+BlockTransfer::operator new(size_t size) {
+  if (size != sizeof(BlockTransfer))
+    throw internal_error("BlockTransfer::operator new(...) called with wrong size.");
+
+  instrumentation_update_peak(INSTRUMENTATION_POOL_BLOCK_TRANSFER, INSTRUMENTATION_POOL_BLOCK_TRANSFER_PEAK, 1);
+  return block_transfer_pool().allocate();
+}
+
+void
+BlockTransfer::operator delete(void* ptr) {
+  if (ptr == NULL)
+    return;
+
+  instrumentation_update_peak(INSTRUMENTATION_POOL_BLOCK_TRANSFER, INSTRUMENTATION_POOL_BLOCK_TRANSFER_PEAK, -1);
+  block_transfer_pool().deallocate(ptr);
+}
+
 Block::~Block() {
   if (m_state != STATE_INCOMPLETE && m_state != STATE_COMPLETED)
     throw internal_error("Block dtor with 'm_state != STATE_INCOMPLETE && m_state != STATE_COMPLETED'");
@@ -85,7 +114,7 @@ Block::insert(PeerInfo* peerInfo) {
   if (find_queued(peerInfo) || find_transfer(peerInfo))
     return NULL;
 
-  m_notStalled++;
+  inc_not_stalled();
 
   transfer_list_type::iterator itr = m_queued.insert(m_queued.end(), new BlockTransfer());
 
@@ -109,7 +138,8 @@ Block::erase(BlockTransfer* transfer) {
   if (transfer->peer_info() != NULL)
     throw internal_error("Block::erase(...) transfer has non-null peer info");
 
-  m_notStalled -= transfer->stall() == 0;
+  if (transfer->stall() == 0)
+    dec_not_stalled();
 
   if (transfer->is_queued()) {
     transfer_list_type::iterator itr = std::find(m_queued.begin(), m_queued.end(), transfer);
@@ -227,7 +257,8 @@ Block::completed(BlockTransfer* transfer) {
   if ((Block::size_type)std::count_if(m_parent->begin(), m_parent->end(), std::mem_fn(&Block::is_finished)) < m_parent->finished())
     throw internal_error("Block::completed(...) Finished blocks too large.");
 
-  m_notStalled -= transfer->stall() == 0;
+  if (transfer->stall() == 0)
+    dec_not_stalled();
 
   transfer->set_block(NULL);
   transfer->set_stall(~uint32_t());
@@ -251,6 +282,9 @@ Block::completed(BlockTransfer* transfer) {
   if (m_transfers.empty() || m_transfers.back() != transfer)
     throw internal_error("Block::completed(...) m_transfers.empty() || m_transfers.back() != transfer.");
 
+  if (m_notStalled == 0)
+    m_parent->dec_stalled();
+
   m_state = STATE_COMPLETED;
 
   return m_parent->is_all_finished();
@@ -258,6 +292,9 @@ Block::completed(BlockTransfer* transfer) {
 
 void
 Block::retry_transfer() {
+  if (m_state != STATE_INCOMPLETE && m_notStalled == 0)
+    m_parent->inc_stalled();
+
   m_state = STATE_INCOMPLETE;
 }
 
@@ -270,7 +307,8 @@ Block::transfer_dissimilar(BlockTransfer* transfer) {
   if (!transfer->is_not_leader() || m_leader == transfer)
     throw internal_error("Block::transfer_dissimilar(...) transfer is the leader.");
 
-  m_notStalled -= transfer->stall() == 0;
+  if (transfer->stall() == 0)
+    dec_not_stalled();
 
   // Why not just delete? Gets done by completed(), though when
   // erasing the leader we need to remove dissimilar unless we have
@@ -287,7 +325,7 @@ Block::stalled_transfer(BlockTransfer* transfer) {
     if (m_notStalled == 0)
       throw internal_error("Block::stalled(...) m_notStalled == 0.");
 
-    m_notStalled--;
+    dec_not_stalled();
 
     // Do magic here.
   }
@@ -363,13 +401,29 @@ Block::invalidate_transfer(BlockTransfer* transfer) {
     return; // Consider if this should be an exception.
   }
 
-  m_notStalled -= (transfer->stall() == 0);
+  if (transfer->stall() == 0)
+    dec_not_stalled();
 
   // Do the canceling magic here. 
   if (transfer->peer_info()->connection() != NULL)
     transfer->peer_info()->connection()->cancel_transfer(transfer);
 }
 
+// The parent keeps count of the incomplete blocks without any
+// transfers that aren't stalled, so that the delegator can skip block
+// lists with nothing left to hand out.
+void
+Block::inc_not_stalled() {
+  if (m_notStalled++ == 0 && m_state == STATE_INCOMPLETE)
+    m_parent->dec_stalled();
+}
+
+void
+Block::dec_not_stalled() {
+  if (--m_notStalled == 0 && m_state == STATE_INCOMPLETE)
+    m_parent->inc_stalled();
+}
+
 void
 Block::remove_erased_transfers() {
   auto split = std::stable_partition(m_transfers.begin(), m_transfers.end(), [](auto block) { return !block->is_erased(); });
@@ -99,6 +99,9 @@ private:
 
   void                      invalidate_transfer(BlockTransfer* transfer) LIBTORRENT_NO_EXPORT;
 
+  void                      inc_not_stalled() LIBTORRENT_NO_EXPORT;
+  void                      dec_not_stalled() LIBTORRENT_NO_EXPORT;
+
   void                      remove_erased_transfers() LIBTORRENT_NO_EXPORT;
   void                      remove_non_leader_transfers() LIBTORRENT_NO_EXPORT;
 
@@ -39,6 +39,8 @@
 #include <algorithm>
 #include <functional>
 
+#include "data/hash_chunk.h"
+
 #include "block_transfer.h"
 #include "block_list.h"
 #include "exceptions.h"
@@ -49,6 +51,7 @@ BlockList::BlockList(const Piece& piece, uint32_t blockLength) :
   m_piece(piece),
   m_priority(PRIORITY_OFF),
   m_finished(0),
+  m_stalled(0),
 
   m_failed(0),
   m_attempt(0),
@@ -60,6 +63,7 @@ BlockList::BlockList(const Piece& piece, uint32_t blockLength) :
 
   // Look into optimizing this by using input iterators in the ctor.
   base_type::resize((m_piece.length() + blockLength - 1) / blockLength);
+  m_stalled = size();
 
   // ATM assume offset of 0.
 //   uint32_t offset = m_piece.offset();
@@ -86,6 +90,49 @@ BlockList::do_all_failed() {
   // Clear leaders when we want to redownload the chunk.
   std::for_each(begin(), end(), std::mem_fn(&Block::failed_leader));
   std::for_each(begin(), end(), std::mem_fn(&Block::retry_transfer));
+
+  clear_hash_prefix();
+  clear_leaf_hashes();
+}
+
+HashPrefix*
+BlockList::make_hash_prefix() {
+  if (m_hashPrefix == nullptr)
+    m_hashPrefix = std::make_unique<HashPrefix>();
+
+  return m_hashPrefix.get();
+}
+
+void
+BlockList::clear_hash_prefix() {
+  m_hashPrefix.reset();
+}
+
+static const uint32_t block_list_leaf_hash_size = 32;
+
+const char*
+BlockList::leaf_hash(uint32_t leaf) const {
+  if (leaf >= m_leafHashed.size() || !m_leafHashed[leaf])
+    return NULL;
+
+  return m_leafHashes.c_str() + leaf * block_list_leaf_hash_size;
+}
+
+void
+BlockList::set_leaf_hash(uint32_t leaf, const char* hash) {
+  if (leaf >= m_leafHashed.size()) {
+    m_leafHashes.resize((leaf + 1) * block_list_leaf_hash_size);
+    m_leafHashed.resize(leaf + 1);
+  }
+
+  m_leafHashes.replace(leaf * block_list_leaf_hash_size, block_list_leaf_hash_size, hash, block_list_leaf_hash_size);
+  m_leafHashed[leaf] = true;
+}
+
+void
+BlockList::clear_leaf_hashes() {
+  m_leafHashes.clear();
+  m_leafHashed.clear();
 }
 
 }
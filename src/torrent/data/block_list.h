@@ -1,6 +1,8 @@
 #ifndef LIBTORRENT_BLOCK_LIST_H
 #define LIBTORRENT_BLOCK_LIST_H
 
+#include <memory>
+#include <string>
 #include <vector>
 #include <torrent/common.h>
 #include <torrent/data/block.h>
@@ -8,6 +10,8 @@
 
 namespace torrent {
 
+class HashPrefix;
+
 class LIBTORRENT_EXPORT BlockList : private std::vector<Block> {
 public:
   typedef uint32_t           size_type;
@@ -45,6 +49,12 @@ public:
   void                inc_finished()                { m_finished++; }
   void                clear_finished()              { m_finished = 0; }
 
+  // Incomplete blocks that have no transfers, or only stalled ones,
+  // and may thus be delegated.
+  size_type           stalled() const               { return m_stalled; }
+  void                inc_stalled()                 { m_stalled++; }
+  void                dec_stalled()                 { m_stalled--; }
+
   uint32_t            failed() const                { return m_failed; }
 
   // Temporary, just increment for now.
@@ -62,15 +72,34 @@ public:
 
   void                do_all_failed();
 
+  // Hash of the finished blocks at the start of the piece, created
+  // when the first block finishes and taken by the hash check.
+  HashPrefix*         hash_prefix()                 { return m_hashPrefix.get(); }
+  HashPrefix*         make_hash_prefix();
+  void                clear_hash_prefix();
+
+  // SHA-256 of the BitTorrent v2 leaves, the 16 KiB blocks of file
+  // data, hashed as the blocks arrived. Returns NULL for leaves not
+  // hashed.
+  const char*         leaf_hash(uint32_t leaf) const;
+  void                set_leaf_hash(uint32_t leaf, const char* hash);
+  void                clear_leaf_hashes();
+
 private:
   Piece               m_piece;
   priority_t          m_priority;
 
   size_type           m_finished;
+  size_type           m_stalled;
   uint32_t            m_failed;
   uint32_t            m_attempt;
 
   bool                m_bySeeder;
+
+  std::unique_ptr<HashPrefix> m_hashPrefix;
+
+  std::string         m_leafHashes;
+  std::vector<bool>   m_leafHashed;
 };
 
 }
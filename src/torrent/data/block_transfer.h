@@ -25,6 +25,10 @@ public:
 
   BlockTransfer();
   ~BlockTransfer();
+
+  // Allocated from a pool in the main thread, see block.cc.
+  static void*        operator new(size_t size) LIBTORRENT_NO_EXPORT;
+  static void         operator delete(void* ptr) LIBTORRENT_NO_EXPORT;
   BlockTransfer(const BlockTransfer&) = delete;
   BlockTransfer& operator=(const BlockTransfer&) = delete;
 
@@ -7,11 +7,13 @@
 #include <limits>
 #include <memory>
 #include <set>
+#include <unistd.h>
 #include <rak/error_number.h>
 #include <rak/file_stat.h>
 #include <rak/fs_stat.h>
 
 #include "data/chunk.h"
+#include "data/chunk_read_cache.h"
 #include "data/memory_chunk.h"
 #include "data/socket_file.h"
 
@@ -577,7 +579,7 @@ FileList::create_chunk(uint64_t offset, uint32_t length, int prot) {
 
   std::unique_ptr<Chunk> chunk(new Chunk);
 
-  auto itr = std::find_if(begin(), end(), [offset](File* file) { return file->is_valid_position(offset); });
+  auto itr = file_list_contains_position(this, offset);
 
   for (; length != 0; ++itr) {
     if (itr == end())
@@ -615,6 +617,100 @@ FileList::create_chunk_index(uint32_t index, int prot) {
   return create_chunk((uint64_t)index * chunk_size(), chunk_index_size(index), prot);
 }
 
+// The buffer spans the whole chunk, so each part maps a slice of it
+// with the page aligned start MemoryChunk requires.
+Chunk*
+FileList::create_cached_chunk(uint64_t offset, uint32_t length, char* buffer) {
+  if (offset + length > m_torrentSize)
+    throw internal_error("Tried to access chunk out of range in FileList", data()->hash());
+
+  std::unique_ptr<Chunk> chunk(new Chunk);
+
+  auto itr = file_list_contains_position(this, offset);
+  uint32_t position = 0;
+
+  for (; length != 0; ++itr) {
+    if (itr == end())
+      throw internal_error("FileList could not find a valid file for chunk", data()->hash());
+
+    if ((*itr)->size_bytes() == 0)
+      continue;
+
+    uint64_t file_offset = offset - (*itr)->offset();
+    uint32_t part_length = std::min<uint64_t>(length, (*itr)->size_bytes() - file_offset);
+    char* part_begin = buffer + position;
+
+    MemoryChunk mc(part_begin - position % MemoryChunk::page_size(), part_begin, part_begin + part_length,
+                   MemoryChunk::prot_read | MemoryChunk::prot_write, MemoryChunk::map_anon);
+
+    chunk->push_back(ChunkPart::MAPPED_CACHE, mc);
+    chunk->back().set_file(*itr, file_offset);
+
+    offset += part_length;
+    length -= part_length;
+    position += part_length;
+  }
+
+  if (chunk->empty())
+    return NULL;
+
+  return chunk.release();
+}
+
+Chunk*
+FileList::create_cached_chunk_index(uint32_t index, char* buffer) {
+  return create_cached_chunk((uint64_t)index * chunk_size(), chunk_index_size(index), buffer);
+}
+
+bool
+FileList::create_chunk_reads(uint32_t index, std::vector<chunk_read_part>* parts) {
+  return create_chunk_parts(index, MemoryChunk::prot_read, parts);
+}
+
+bool
+FileList::create_chunk_writes(uint32_t index, std::vector<chunk_read_part>* parts) {
+  return create_chunk_parts(index, MemoryChunk::prot_read | MemoryChunk::prot_write, parts);
+}
+
+bool
+FileList::create_chunk_parts(uint32_t index, int prot, std::vector<chunk_read_part>* parts) {
+  uint64_t offset = (uint64_t)index * chunk_size();
+  uint32_t length = chunk_index_size(index);
+  uint32_t position = 0;
+
+  auto itr = file_list_contains_position(this, offset);
+
+  for (; length != 0; ++itr) {
+    if (itr == end())
+      throw internal_error("FileList could not find a valid file for chunk", data()->hash());
+
+    if ((*itr)->size_bytes() == 0)
+      continue;
+
+    uint64_t file_offset = offset - (*itr)->offset();
+    uint32_t part_length = std::min<uint64_t>(length, (*itr)->size_bytes() - file_offset);
+    int fd = -1;
+
+    if (!(*itr)->is_padding() &&
+        (!(*itr)->prepare(prot) || (fd = ::dup((*itr)->file_descriptor())) == -1)) {
+      for (auto& part : *parts)
+        if (part.fd != -1)
+          ::close(part.fd);
+
+      parts->clear();
+      return false;
+    }
+
+    parts->push_back(chunk_read_part{ fd, file_offset, position, part_length });
+
+    offset += part_length;
+    length -= part_length;
+    position += part_length;
+  }
+
+  return !parts->empty();
+}
+
 void
 FileList::mark_completed(uint32_t index) {
   if (index >= size_chunks() || completed_chunks() >= size_chunks())
@@ -648,8 +744,10 @@ FileList::mark_completed(uint32_t index) {
 
 FileList::iterator
 FileList::inc_completed(iterator firstItr, uint32_t index) {
-  firstItr     = std::find_if(firstItr, end(), [index](File* file) { return index < file->range_second(); });
-  auto lastItr = std::find_if(firstItr, end(), [index](File* file) { return index+1 < file->range_second(); });
+  // The chunk ranges of the files are sorted, so search them instead
+  // of walking torrents with many small files.
+  firstItr     = std::upper_bound(firstItr, end(), index, [](uint32_t i, File* file) { return i < file->range_second(); });
+  auto lastItr = std::upper_bound(firstItr, end(), index + 1, [](uint32_t i, File* file) { return i < file->range_second(); });
 
   if (firstItr == end())
     throw internal_error("FileList::inc_completed() first == m_entryList->end().", data()->hash());
@@ -18,6 +18,8 @@ class DownloadMain;
 class DownloadWrapper;
 class Handshake;
 
+struct chunk_read_part;
+
 class LIBTORRENT_EXPORT FileList : private std::vector<File*> {
 public:
   friend class Content;
@@ -131,6 +133,17 @@ protected:
   Chunk*              create_chunk(uint64_t offset, uint32_t length, int prot) LIBTORRENT_NO_EXPORT;
   Chunk*              create_chunk_index(uint32_t index, int prot) LIBTORRENT_NO_EXPORT;
 
+  // Creates a read/write chunk backed by 'buffer' instead of the
+  // files, without reading their current contents. The chunk only
+  // reaches the files through 'create_chunk_writes'.
+  Chunk*              create_cached_chunk(uint64_t offset, uint32_t length, char* buffer) LIBTORRENT_NO_EXPORT;
+  Chunk*              create_cached_chunk_index(uint32_t index, char* buffer) LIBTORRENT_NO_EXPORT;
+
+  // Describes the file ranges of a chunk for reading or writing on
+  // another thread, each part holding a duplicated descriptor.
+  bool                create_chunk_reads(uint32_t index, std::vector<chunk_read_part>* parts) LIBTORRENT_NO_EXPORT;
+  bool                create_chunk_writes(uint32_t index, std::vector<chunk_read_part>* parts) LIBTORRENT_NO_EXPORT;
+
   void                mark_completed(uint32_t index) LIBTORRENT_NO_EXPORT;
   iterator            inc_completed(iterator firstItr, uint32_t index) LIBTORRENT_NO_EXPORT;
   void                update_completed() LIBTORRENT_NO_EXPORT;
@@ -143,6 +156,7 @@ private:
   bool                open_file(File* node, const Path& lastPath, int flags) LIBTORRENT_NO_EXPORT;
   void                make_directory(Path::const_iterator pathBegin, Path::const_iterator pathEnd, Path::const_iterator startItr) LIBTORRENT_NO_EXPORT;
   MemoryChunk         create_chunk_part(FileList::iterator itr, uint64_t offset, uint32_t length, int prot) LIBTORRENT_NO_EXPORT;
+  bool                create_chunk_parts(uint32_t index, int prot, std::vector<chunk_read_part>* parts) LIBTORRENT_NO_EXPORT;
 
   download_data       m_data;
 
@@ -161,11 +175,19 @@ private:
   std::string         m_frozenRootDir;
 };
 
+// Files are stored in order of their offset without gaps, so the file
+// containing a position is the first one ending after it. Zero length
+// files never contain a position.
 inline FileList::iterator
 file_list_contains_position(FileList* file_list, uint64_t pos) {
-  return std::find_if(file_list->begin(), file_list->end(), [pos] (File* file) {
-    return file->is_valid_position(pos);
+  auto itr = std::upper_bound(file_list->begin(), file_list->end(), pos, [] (uint64_t p, File* file) {
+    return p < file->offset() + file->size_bytes();
   });
+
+  if (itr == file_list->end() || !(*itr)->is_valid_position(pos))
+    return file_list->end();
+
+  return itr;
 }
 
 }
@@ -65,14 +65,19 @@ TransferList::~TransferList() {
     throw internal_error("TransferList::~TransferList() called on an non-empty object");
 }
 
+// Only scans the list when the chunk is in it.
 TransferList::iterator
 TransferList::find(uint32_t index) {
-  return std::find_if(begin(), end(), [index](BlockList* b) { return index == b->index(); });
+  BlockList* block_list = get(index);
+
+  return block_list != NULL ? std::find(begin(), end(), block_list) : end();
 }
 
 TransferList::const_iterator
 TransferList::find(uint32_t index) const {
-  return std::find_if(begin(), end(), [index](BlockList* b) { return index == b->index(); });
+  BlockList* block_list = get(index);
+
+  return block_list != NULL ? std::find(begin(), end(), block_list) : end();
 }
 
 void
@@ -85,15 +90,20 @@ TransferList::clear() {
   }
 
   base_type::clear();
+  m_index.clear();
 }
 
 TransferList::iterator
 TransferList::insert(const Piece& piece, uint32_t blockSize) {
-  if (find(piece.index()) != end())
+  if (get(piece.index()) != NULL)
     throw internal_error("Delegator::new_chunk(...) received an index that is already delegated.");
 
+  if (piece.index() >= m_index.size())
+    m_index.resize(piece.index() + 1, NULL);
+
   BlockList* blockList = new BlockList(piece, blockSize);
-  
+  m_index[piece.index()] = blockList;
+
   m_slot_queued(piece.index());
 
   return base_type::insert(end(), blockList);
@@ -106,6 +116,7 @@ TransferList::erase(iterator itr) {
   if (itr == end())
     throw internal_error("TransferList::erase(...) itr == m_chunks.end().");
 
+  m_index[(*itr)->index()] = NULL;
   delete *itr;
 
   return base_type::erase(itr);
@@ -273,6 +284,9 @@ TransferList::mark_failed_peers(BlockList* blockList, Chunk* chunk) {
 // largest reference counts.
 void
 TransferList::retry_most_popular(BlockList* blockList, Chunk* chunk) {
+  // The leaf hashes were of the data being replaced.
+  blockList->clear_leaf_hashes();
+
   for (auto& block : *blockList) {
 
     BlockFailed::reverse_iterator failedItr = block.failed_list()->reverse_max_element();
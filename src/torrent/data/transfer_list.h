@@ -57,6 +57,7 @@ public:
   using base_type::const_iterator;
   using base_type::reverse_iterator;
   using base_type::const_reverse_iterator;
+  using base_type::size_type;
   using base_type::size;
   using base_type::empty;
 
@@ -73,6 +74,9 @@ public:
   iterator            find(uint32_t index);
   const_iterator      find(uint32_t index) const;
 
+  // Returns NULL if the chunk is not in the list.
+  BlockList*          get(uint32_t index) const { return index < m_index.size() ? m_index[index] : NULL; }
+
   const completed_list_type& completed_list() const { return m_completedList; }
 
   uint32_t            succeeded_count() const { return m_succeededCount; }
@@ -106,11 +110,18 @@ private:
 
   void                retry_most_popular(BlockList* blockList, Chunk* chunk);
 
+  // Block list of each chunk index, grown to the highest index
+  // inserted, so that lookups don't need to walk every block list in
+  // flight.
+  typedef std::vector<BlockList*> index_map;
+
   slot_chunk_index    m_slot_canceled;
   slot_chunk_index    m_slot_completed;
   slot_chunk_index    m_slot_queued;
   slot_peer_info      m_slot_corrupt;
 
+  index_map           m_index;
+
   completed_list_type m_completedList;
 
   uint32_t            m_succeededCount;
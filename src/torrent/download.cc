@@ -42,6 +42,7 @@ const int DownloadInfo::flag_private;
 const int DownloadInfo::flag_meta_download;
 const int DownloadInfo::flag_pex_enabled;
 const int DownloadInfo::flag_pex_active;
+const int DownloadInfo::flag_lazy_have;
 
 const int DownloadInfo::public_flags;
 
@@ -561,6 +562,33 @@ Download::update_priorities() {
   m_ptr->receive_update_priorities();
 }
 
+uint32_t
+Download::stream_playhead() const {
+  return m_ptr->main()->chunk_selector()->stream_playhead();
+}
+
+void
+Download::set_stream_playhead(uint32_t index) {
+  // The selector is only sized while the download is open.
+  if (index >= m_ptr->main()->chunk_selector()->size())
+    throw input_error("Download::set_stream_playhead(...) invalid chunk index.");
+
+  m_ptr->main()->chunk_selector()->set_stream_playhead(index);
+}
+
+uint32_t
+Download::stream_window() const {
+  return m_ptr->main()->chunk_selector()->stream_window();
+}
+
+void
+Download::set_stream_window(uint32_t window, uint32_t rate) {
+  if (window != 0 && rate == 0)
+    throw input_error("Download::set_stream_window(...) playback rate must be non-zero.");
+
+  m_ptr->main()->set_stream_window(window, rate);
+}
+
 void
 Download::add_peer(const sockaddr* sa, int port) {
   if (m_ptr->info()->is_private())
@@ -161,6 +161,18 @@ public:
   // all the peer bitfields to see if we are still interested.
   void                update_priorities();
 
+  // Streaming mode requests the 'window' chunks from the playhead by
+  // deadlines derived from the playback rate in bytes per second,
+  // from the fastest peers and with duplicate requests for chunks
+  // about to be played. Other chunks are still picked rarest first.
+  // Move the playhead as playback progresses, a window of zero
+  // disables streaming.
+  uint32_t            stream_playhead() const;
+  void                set_stream_playhead(uint32_t index);
+
+  uint32_t            stream_window() const;
+  void                set_stream_window(uint32_t window, uint32_t rate);
+
   void                add_peer(const sockaddr* addr, int port);
 
   DownloadWrapper*    ptr() { return m_ptr; }
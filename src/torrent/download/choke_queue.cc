@@ -24,6 +24,19 @@ choke_manager_less(choke_queue::value_type v1, choke_queue::value_type v2) {
   return v1.weight < v2.weight;
 };
 
+// Moves the 'count' highest weighted connections to the back of the
+// range in ascending order, leaving the rest of the range unordered.
+//
+// The choke cycle only ever takes connections from the back of the
+// group containers, so there's no need to sort the whole range.
+static void
+choke_manager_select_back(choke_queue::iterator first, choke_queue::iterator last, uint32_t count) {
+  choke_queue::iterator middle = last - std::min<uint32_t>(count, std::distance(first, last));
+
+  std::nth_element(first, middle, last, choke_manager_less);
+  std::sort(middle, last, choke_manager_less);
+}
+
 static inline bool
 should_connection_unchoke(choke_queue* cq, PeerConnectionBase* pcb) {
   return pcb->should_connection_unchoke(cq);
@@ -70,11 +83,24 @@ choke_queue::prepare_weights(group_stats gs) {
   // also remember to clear the queue/unchoked thingies.
 
   for (auto group : m_group_container) {
-    m_heuristics_list[m_heuristics].slot_choke_weight(group->mutable_unchoked()->begin(), group->mutable_unchoked()->end());
-    std::sort(group->mutable_unchoked()->begin(), group->mutable_unchoked()->end(), choke_manager_less);
+    container_type* unchoked = group->mutable_unchoked();
+    container_type* queued = group->mutable_queued();
+
+    uint32_t min_slots = std::min(group->min_slots(), group->max_slots());
+
+    // Only unchoked connections above 'min_slots' are candidates for
+    // choking, and only as many queued connections as fit in
+    // 'max_slots' are candidates for unchoking. Groups with no
+    // candidates are not weighted at all.
+    if (unchoked->size() > min_slots) {
+      m_heuristics_list[m_heuristics].slot_choke_weight(unchoked->begin(), unchoked->end());
+      choke_manager_select_back(unchoked->begin(), unchoked->end(), unchoked->size() - min_slots);
+    }
 
-    m_heuristics_list[m_heuristics].slot_unchoke_weight(group->mutable_queued()->begin(), group->mutable_queued()->end());
-    std::sort(group->mutable_queued()->begin(), group->mutable_queued()->end(), choke_manager_less);
+    if (!queued->empty() && unchoked->size() < group->max_slots()) {
+      m_heuristics_list[m_heuristics].slot_unchoke_weight(queued->begin(), queued->end());
+      choke_manager_select_back(queued->begin(), queued->end(), group->max_slots() - unchoked->size());
+    }
 
     // Aggregate the statistics... Remember to update them after
     // optimistic/pessimistic unchokes.
@@ -126,7 +152,6 @@ choke_queue::retrieve_connections(group_stats gs, container_type* queued, contai
       gs.now_unchoked += entry->unchoked()->size();
 
     } else {
-      // TODO: This only handles a single weight group, fixme.
       group_entry::container_type::const_iterator first = entry->unchoked()->begin() + min_slots;
       group_entry::container_type::const_iterator last  = entry->unchoked()->end();
 
@@ -219,20 +244,27 @@ choke_queue::balance() {
 
 void
 choke_queue::balance_entry(group_entry* entry) {
-  m_heuristics_list[m_heuristics].slot_choke_weight(entry->mutable_unchoked()->begin(), entry->mutable_unchoked()->end());
-  std::sort(entry->mutable_unchoked()->begin(), entry->mutable_unchoked()->end(), choke_manager_less);
-
-  m_heuristics_list[m_heuristics].slot_unchoke_weight(entry->mutable_queued()->begin(), entry->mutable_queued()->end());
-  std::sort(entry->mutable_queued()->begin(), entry->mutable_queued()->end(), choke_manager_less);
+  container_type* unchoked = entry->mutable_unchoked();
+  container_type* queued = entry->mutable_queued();
 
   int count = 0;
   unsigned int min_slots = std::min(entry->min_slots(), entry->max_slots());
 
-  while (!entry->unchoked()->empty() && entry->unchoked()->size() > entry->max_slots())
-    count -= m_slotConnection(entry->unchoked()->back().connection, true);
+  if (unchoked->size() > entry->max_slots()) {
+    m_heuristics_list[m_heuristics].slot_choke_weight(unchoked->begin(), unchoked->end());
+    choke_manager_select_back(unchoked->begin(), unchoked->end(), unchoked->size() - entry->max_slots());
 
-  while (!entry->queued()->empty() && entry->unchoked()->size() < min_slots)
-    count += m_slotConnection(entry->queued()->back().connection, false);
+    while (!unchoked->empty() && unchoked->size() > entry->max_slots())
+      count -= m_slotConnection(unchoked->back().connection, true);
+  }
+
+  if (!queued->empty() && unchoked->size() < min_slots) {
+    m_heuristics_list[m_heuristics].slot_unchoke_weight(queued->begin(), queued->end());
+    choke_manager_select_back(queued->begin(), queued->end(), min_slots - unchoked->size());
+
+    while (!queued->empty() && unchoked->size() < min_slots)
+      count += m_slotConnection(queued->back().connection, false);
+  }
 
   m_slotUnchoke(count);
 }
@@ -423,11 +455,13 @@ choke_queue::move_connections(choke_queue* src, choke_queue* dest, DownloadMain*
 // Heuristics:
 //
 
-void
+static void
 choke_manager_allocate_slots(choke_queue::iterator first, choke_queue::iterator last,
                              uint32_t max, uint32_t* weights, choke_queue::target_type* target) {
-  // Sorting the connections from the lowest to highest value.
-  // TODO:  std::sort(first, last, choke_manager_less);
+  // Sorting the connections from the lowest to highest value. The
+  // range holds only the candidates selected from each group, which
+  // are individually sorted but not ordered relative to each other.
+  std::sort(first, last, choke_manager_less);
 
   // 'weightTotal' only contains the weight of targets that have
   // connections to unchoke. When all connections are in a group are
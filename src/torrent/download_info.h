@@ -39,8 +39,9 @@ public:
   static const int flag_meta_download       = (1 << 6);
   static const int flag_pex_enabled         = (1 << 7);
   static const int flag_pex_active          = (1 << 8);
+  static const int flag_lazy_have           = (1 << 9);  // Don't send HAVE for chunks the peer has.
 
-  static const int public_flags = flag_accepting_seeders;
+  static const int public_flags = flag_accepting_seeders | flag_lazy_have;
 
   static const uint32_t unlimited = ~uint32_t();
 
@@ -67,6 +68,7 @@ public:
   bool                is_meta_download() const                     { return m_flags & flag_meta_download; }
   bool                is_pex_enabled() const                       { return m_flags & flag_pex_enabled; }
   bool                is_pex_active() const                        { return m_flags & flag_pex_active; }
+  bool                is_lazy_have() const                         { return m_flags & flag_lazy_have; }
 
   int                 flags() const                                { return m_flags; }
 
@@ -0,0 +1,369 @@
+#include "config.h"
+
+#include "ip_filter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <queue>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "torrent/exceptions.h"
+
+namespace torrent {
+
+typedef ip_filter::ipv6_key ipv6_key;
+
+struct ip_filter_header {
+  char     magic[8];
+  uint32_t v4_size;
+  uint32_t v6_size;
+};
+
+static const char ip_filter_magic[8] = { 'l', 't', 'i', 'p', 'f', 'l', 't', '1' };
+
+// Header, then the IPv4 start, end and value arrays, then the IPv6
+// arrays aligned to 8 bytes.
+static size_t
+ip_filter_v6_offset(size_t v4_size) {
+  size_t offset = sizeof(ip_filter_header) + v4_size * (sizeof(uint32_t) * 2 + sizeof(int32_t));
+
+  return (offset + 7) & ~size_t(7);
+}
+
+static size_t
+ip_filter_data_size(size_t v4_size, size_t v6_size) {
+  return ip_filter_v6_offset(v4_size) + v6_size * (sizeof(ipv6_key) * 2 + sizeof(int32_t));
+}
+
+static bool     key_is_max(uint32_t key) { return key == std::numeric_limits<uint32_t>::max(); }
+static uint32_t key_next(uint32_t key)   { return key + 1; }
+static uint32_t key_prev(uint32_t key)   { return key - 1; }
+
+static bool
+key_is_max(const ipv6_key& key) {
+  return key.high == std::numeric_limits<uint64_t>::max() && key.low == std::numeric_limits<uint64_t>::max();
+}
+
+static ipv6_key
+key_next(const ipv6_key& key) {
+  return ipv6_key{ key.high + (key.low == std::numeric_limits<uint64_t>::max()), key.low + 1 };
+}
+
+static ipv6_key
+key_prev(const ipv6_key& key) {
+  return ipv6_key{ key.high - (key.low == 0), key.low - 1 };
+}
+
+// Sweeps the ranges in order of their start address, keeping the
+// ranges that cover the current position in a heap ordered by when
+// they were inserted.
+template <typename Key>
+static std::vector<ip_filter_builder::range_type<Key>>
+compile_ranges(const std::vector<ip_filter_builder::range_type<Key>>& ranges) {
+  std::vector<ip_filter_builder::range_type<Key>> result;
+  std::vector<uint32_t> order(ranges.size());
+
+  for (uint32_t i = 0; i < order.size(); i++)
+    order[i] = i;
+
+  std::stable_sort(order.begin(), order.end(), [&ranges](uint32_t a, uint32_t b) {
+      return ranges[a].first < ranges[b].first;
+    });
+
+  std::priority_queue<uint32_t> active;
+  auto next_itr = order.begin();
+  Key position{};
+
+  while (true) {
+    if (active.empty()) {
+      if (next_itr == order.end())
+        break;
+
+      position = ranges[*next_itr].first;
+    }
+
+    while (next_itr != order.end() && ranges[*next_itr].first <= position)
+      active.push(*next_itr++);
+
+    while (!active.empty() && ranges[active.top()].last < position)
+      active.pop();
+
+    if (active.empty())
+      continue;
+
+    const auto& top = ranges[active.top()];
+    Key last = top.last;
+
+    // A range starting inside this one may have precedence.
+    if (next_itr != order.end() && ranges[*next_itr].first <= last)
+      last = key_prev(ranges[*next_itr].first);
+
+    if (!result.empty() && result.back().value == top.value && key_next(result.back().last) == position)
+      result.back().last = last;
+    else
+      result.push_back({ position, last, top.value });
+
+    if (key_is_max(last))
+      break;
+
+    position = key_next(last);
+  }
+
+  return result;
+}
+
+// Lookups binary search the ranges, so data from disk must hold
+// ranges that are sorted and don't overlap.
+template <typename Key>
+static bool
+ranges_are_ordered(const Key* first, const Key* last, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    if (last[i] < first[i])
+      return false;
+
+    if (i != 0 && first[i] <= last[i - 1])
+      return false;
+  }
+
+  return true;
+}
+
+ip_filter::~ip_filter() {
+  if (m_data == nullptr)
+    return;
+
+  if (m_mapped)
+    ::munmap(m_data, m_data_size);
+  else
+    delete [] m_data;
+}
+
+void
+ip_filter::set_data(char* data, size_t size, bool mapped) {
+  m_data = data;
+  m_data_size = size;
+  m_mapped = mapped;
+
+  ip_filter_header header;
+
+  if (size < sizeof(ip_filter_header))
+    throw input_error("ip_filter: data too small");
+
+  std::memcpy(&header, data, sizeof(ip_filter_header));
+
+  if (std::memcmp(header.magic, ip_filter_magic, sizeof(ip_filter_magic)) != 0)
+    throw input_error("ip_filter: invalid magic");
+
+  if (ip_filter_data_size(header.v4_size, header.v6_size) != size)
+    throw input_error("ip_filter: invalid data size");
+
+  m_v4_size = header.v4_size;
+  m_v4_first = reinterpret_cast<const uint32_t*>(data + sizeof(ip_filter_header));
+  m_v4_last = m_v4_first + m_v4_size;
+  m_v4_value = reinterpret_cast<const int32_t*>(m_v4_last + m_v4_size);
+
+  m_v6_size = header.v6_size;
+  m_v6_first = reinterpret_cast<const ipv6_key*>(data + ip_filter_v6_offset(m_v4_size));
+  m_v6_last = m_v6_first + m_v6_size;
+  m_v6_value = reinterpret_cast<const int32_t*>(m_v6_last + m_v6_size);
+
+  if (!ranges_are_ordered(m_v4_first, m_v4_last, m_v4_size) ||
+      !ranges_are_ordered(m_v6_first, m_v6_last, m_v6_size))
+    throw input_error("ip_filter: ranges are not sorted or overlap");
+}
+
+ipv6_key
+ip_filter::to_key(const in6_addr& address) {
+  ipv6_key key{ 0, 0 };
+
+  for (int i = 0; i < 8; i++) {
+    key.high = (key.high << 8) | address.s6_addr[i];
+    key.low = (key.low << 8) | address.s6_addr[i + 8];
+  }
+
+  return key;
+}
+
+int
+ip_filter::lookup(const sockaddr* sa) const {
+  if (sa == nullptr)
+    return 0;
+
+  switch (sa->sa_family) {
+  case AF_INET:
+    return lookup_v4(ntohl(reinterpret_cast<const sockaddr_in*>(sa)->sin_addr.s_addr));
+
+  case AF_INET6: {
+    const in6_addr& address = reinterpret_cast<const sockaddr_in6*>(sa)->sin6_addr;
+
+    if (IN6_IS_ADDR_V4MAPPED(&address)) {
+      uint32_t address_n;
+      std::memcpy(&address_n, address.s6_addr + 12, sizeof(uint32_t));
+
+      return lookup_v4(ntohl(address_n));
+    }
+
+    return lookup_v6(address);
+  }
+  default:
+    return 0;
+  }
+}
+
+int
+ip_filter::lookup_v4(uint32_t address_h) const {
+  const uint32_t* itr = std::upper_bound(m_v4_first, m_v4_first + m_v4_size, address_h);
+
+  if (itr == m_v4_first)
+    return 0;
+
+  size_t index = std::distance(m_v4_first, itr) - 1;
+
+  return address_h <= m_v4_last[index] ? m_v4_value[index] : 0;
+}
+
+int
+ip_filter::lookup_v6(const in6_addr& address) const {
+  ipv6_key key = to_key(address);
+  const ipv6_key* itr = std::upper_bound(m_v6_first, m_v6_first + m_v6_size, key);
+
+  if (itr == m_v6_first)
+    return 0;
+
+  size_t index = std::distance(m_v6_first, itr) - 1;
+
+  return key <= m_v6_last[index] ? m_v6_value[index] : 0;
+}
+
+// Write to a temporary file and rename it so a running process that
+// has mapped the old file is not affected.
+void
+ip_filter::save_file(const std::string& path) const {
+  std::string tmp_path = path + ".new";
+  int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if (fd == -1)
+    throw input_error("ip_filter: could not open '" + tmp_path + "': " + std::strerror(errno));
+
+  const char* first = m_data;
+  const char* last = m_data + m_data_size;
+
+  while (first != last) {
+    ssize_t result = ::write(fd, first, std::distance(first, last));
+
+    if (result == -1 && errno == EINTR)
+      continue;
+
+    if (result == -1) {
+      int error = errno;
+      ::close(fd);
+      ::unlink(tmp_path.c_str());
+      throw input_error("ip_filter: could not write '" + tmp_path + "': " + std::strerror(error));
+    }
+
+    first += result;
+  }
+
+  ::close(fd);
+
+  if (::rename(tmp_path.c_str(), path.c_str()) == -1) {
+    int error = errno;
+    ::unlink(tmp_path.c_str());
+    throw input_error("ip_filter: could not rename '" + tmp_path + "': " + std::strerror(error));
+  }
+}
+
+ip_filter_ptr
+ip_filter::load_file(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+
+  if (fd == -1)
+    throw input_error("ip_filter: could not open '" + path + "': " + std::strerror(errno));
+
+  struct stat st;
+
+  if (::fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(ip_filter_header)) {
+    ::close(fd);
+    throw input_error("ip_filter: invalid file '" + path + "'");
+  }
+
+  void* data = ::mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  int error = errno;
+
+  ::close(fd);
+
+  if (data == MAP_FAILED)
+    throw input_error("ip_filter: could not map '" + path + "': " + std::strerror(error));
+
+  auto filter = std::make_shared<ip_filter>();
+  filter->set_data(static_cast<char*>(data), st.st_size, true);
+
+  return filter;
+}
+
+void
+ip_filter_builder::insert(uint32_t first_h, uint32_t last_h, int value) {
+  if (last_h < first_h)
+    throw input_error("ip_filter_builder: invalid range");
+
+  m_v4.push_back({ first_h, last_h, value });
+}
+
+void
+ip_filter_builder::insert(const in6_addr& first, const in6_addr& last, int value) {
+  ipv6_key first_key = ip_filter::to_key(first);
+  ipv6_key last_key = ip_filter::to_key(last);
+
+  if (last_key < first_key)
+    throw input_error("ip_filter_builder: invalid range");
+
+  m_v6.push_back({ first_key, last_key, value });
+}
+
+ip_filter_ptr
+ip_filter_builder::build() const {
+  v4_list v4 = compile_ranges(m_v4);
+  v6_list v6 = compile_ranges(m_v6);
+
+  size_t size = ip_filter_data_size(v4.size(), v6.size());
+  char* data = new char[size]();
+
+  ip_filter_header header;
+  std::memcpy(header.magic, ip_filter_magic, sizeof(ip_filter_magic));
+  header.v4_size = v4.size();
+  header.v6_size = v6.size();
+  std::memcpy(data, &header, sizeof(ip_filter_header));
+
+  uint32_t* v4_first = reinterpret_cast<uint32_t*>(data + sizeof(ip_filter_header));
+  uint32_t* v4_last = v4_first + v4.size();
+  int32_t*  v4_value = reinterpret_cast<int32_t*>(v4_last + v4.size());
+
+  for (size_t i = 0; i < v4.size(); i++) {
+    v4_first[i] = v4[i].first;
+    v4_last[i] = v4[i].last;
+    v4_value[i] = v4[i].value;
+  }
+
+  ipv6_key* v6_first = reinterpret_cast<ipv6_key*>(data + ip_filter_v6_offset(v4.size()));
+  ipv6_key* v6_last = v6_first + v6.size();
+  int32_t*  v6_value = reinterpret_cast<int32_t*>(v6_last + v6.size());
+
+  for (size_t i = 0; i < v6.size(); i++) {
+    v6_first[i] = v6[i].first;
+    v6_last[i] = v6[i].last;
+    v6_value[i] = v6[i].value;
+  }
+
+  auto filter = std::make_shared<ip_filter>();
+  filter->set_data(data, size, false);
+
+  return filter;
+}
+
+}
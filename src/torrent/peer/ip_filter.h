@@ -0,0 +1,116 @@
+#ifndef LIBTORRENT_PEER_IP_FILTER_H
+#define LIBTORRENT_PEER_IP_FILTER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include <torrent/common.h>
+
+// Compiled, immutable table of IPv4 and IPv6 address ranges mapped to
+// PeerInfo flags.
+//
+// The ranges are stored as sorted, non-overlapping flat arrays of
+// start, end and value so a lookup is a binary search over the start
+// addresses. A table is built once by ip_filter_builder and then
+// shared; reloading a blocklist builds a new table and swaps the
+// pointer, see PeerList::set_address_filter().
+//
+// The in-memory layout is the same as the file written by
+// 'save_file', so 'load_file' can map a compiled table directly
+// instead of parsing and sorting the blocklist again. The file is in
+// host byte order and is not portable between architectures.
+
+namespace torrent {
+
+class ip_filter;
+
+typedef std::shared_ptr<const ip_filter> ip_filter_ptr;
+
+class LIBTORRENT_EXPORT ip_filter {
+public:
+  // IPv6 addresses split in two host order integers, so they can be
+  // compared directly.
+  struct ipv6_key {
+    uint64_t high;
+    uint64_t low;
+
+    bool operator <  (const ipv6_key& k) const { return high < k.high || (high == k.high && low < k.low); }
+    bool operator <= (const ipv6_key& k) const { return !(k < *this); }
+    bool operator == (const ipv6_key& k) const { return high == k.high && low == k.low; }
+  };
+
+  ip_filter() = default;
+  ~ip_filter();
+  ip_filter(const ip_filter&) = delete;
+  ip_filter& operator=(const ip_filter&) = delete;
+
+  bool                empty() const             { return m_v4_size == 0 && m_v6_size == 0; }
+  size_t              size_v4() const           { return m_v4_size; }
+  size_t              size_v6() const           { return m_v6_size; }
+  size_t              sizeof_data() const       { return m_data_size; }
+
+  // Returns the value of the range containing the address, or zero
+  // if none does. V4-mapped IPv6 addresses use the IPv4 ranges.
+  int                 lookup(const sockaddr* sa) const;
+  int                 lookup_v4(uint32_t address_h) const;
+  int                 lookup_v6(const in6_addr& address) const;
+
+  // Throws input_error on failure.
+  void                save_file(const std::string& path) const;
+  static ip_filter_ptr load_file(const std::string& path);
+
+  static ipv6_key     to_key(const in6_addr& address);
+
+protected:
+  friend class ip_filter_builder;
+
+  void                set_data(char* data, size_t size, bool mapped);
+
+private:
+  char*               m_data{nullptr};
+  size_t              m_data_size{0};
+  bool                m_mapped{false};
+
+  size_t              m_v4_size{0};
+  const uint32_t*     m_v4_first{nullptr};
+  const uint32_t*     m_v4_last{nullptr};
+  const int32_t*      m_v4_value{nullptr};
+
+  size_t              m_v6_size{0};
+  const ipv6_key*     m_v6_first{nullptr};
+  const ipv6_key*     m_v6_last{nullptr};
+  const int32_t*      m_v6_value{nullptr};
+};
+
+// Collects ranges in any order and compiles them into an ip_filter.
+// Where ranges overlap the one inserted last takes precedence, and
+// adjacent ranges with the same value are merged.
+class LIBTORRENT_EXPORT ip_filter_builder {
+public:
+  template <typename Key>
+  struct range_type {
+    Key      first;
+    Key      last;
+    int      value;
+  };
+
+  typedef std::vector<range_type<uint32_t>>            v4_list;
+  typedef std::vector<range_type<ip_filter::ipv6_key>> v6_list;
+
+  size_t              size() const { return m_v4.size() + m_v6.size(); }
+
+  // Ranges are inclusive, IPv4 addresses are in host byte order.
+  void                insert(uint32_t first_h, uint32_t last_h, int value);
+  void                insert(const in6_addr& first, const in6_addr& last, int value);
+
+  ip_filter_ptr       build() const;
+
+private:
+  v4_list             m_v4;
+  v6_list             m_v6;
+};
+
+}
+
+#endif
@@ -76,6 +76,8 @@ const Bitfield*   Peer::bitfield() const   { return c_ptr()->c_peer_chunks()->bi
 
 uint32_t Peer::incoming_queue_size() const { return c_ptr()->request_list()->queued_size(); }
 uint32_t Peer::outgoing_queue_size() const { return c_ptr()->c_peer_chunks()->upload_queue()->size(); }  
+uint32_t Peer::incoming_rtt() const        { return c_ptr()->request_list()->rtt(); }
+uint32_t Peer::incoming_queue_target() const { return c_ptr()->request_list()->target_pipe_size(); }
 uint32_t Peer::chunks_done() const         { return c_ptr()->c_peer_chunks()->bitfield()->size_set(); }  
 
 const BlockTransfer*
@@ -91,6 +91,11 @@ public:
   uint32_t             incoming_queue_size() const;
   uint32_t             outgoing_queue_size() const;
 
+  // Smoothed round-trip time in microseconds, zero if not yet
+  // measured, and the request queue size it currently targets.
+  uint32_t             incoming_rtt() const;
+  uint32_t             incoming_queue_target() const;
+
   uint32_t             chunks_done() const;
 
   uint32_t             failed_counter() const             { return peer_info()->failed_counter(); }
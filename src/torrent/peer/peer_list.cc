@@ -1,12 +1,17 @@
 #include "config.h"
 
 #include <algorithm>
+#include <cstring>
 #include <functional>
+#include <new>
+#include <rak/position_index.h>
+#include <rak/slab_allocator.h>
 #include <rak/socket_address.h>
 
 #include "download/available_list.h"
 #include "torrent/peer/client_list.h"
 #include "torrent/utils/log.h"
+#include "utils/instrumentation.h"
 
 #include "download_info.h"
 #include "exceptions.h"
@@ -23,7 +28,8 @@
 
 namespace torrent {
 
-ipv4_table PeerList::m_ipv4_table;
+ip_filter_ptr PeerList::m_address_filter = std::make_shared<ip_filter>();
+ipv4_table    PeerList::m_ipv4_table;
 
 // TODO: Clean up...
 bool
@@ -54,23 +60,131 @@ socket_address_less(const sockaddr* s1, const sockaddr* s2) {
 // PeerList:
 //
 
+struct PeerList::storage_type {
+  rak::position_index             index;
+  rak::slab_allocator<PeerInfo>   slab;
+
+  // Seeded per list so addresses received from peers can't be
+  // chosen to collide.
+  uint64_t                        seed;
+};
+
 PeerList::PeerList() :
+  m_storage(new storage_type),
   m_available_list(new AvailableList) {
+
+  m_storage->seed = ((uint64_t)::random() << 32) ^ ::random();
 }
 
 PeerList::~PeerList() {
   LT_LOG_EVENTS("deleting list total:%" PRIuPTR " available:%" PRIuPTR,
                 size(), m_available_list->size());
 
-  for (const auto& v : *this) {
-    delete v.second;
-  }
-  base_type::clear();
+  for (const auto& v : m_entries)
+    v.second->~PeerInfo();
+
+  instrumentation_update(INSTRUMENTATION_POOL_PEER_INFO, -(int64_t)m_entries.size());
+
+  m_entries.clear();
+  delete m_storage;
 
   m_info = NULL;
   delete m_available_list;
 }
 
+uint32_t
+PeerList::hash_key(const socket_address_key& key) const {
+  uint64_t words[(sizeof(socket_address_key) + 7) / 8] = {};
+  std::memcpy(words, &key, sizeof(socket_address_key));
+
+  uint64_t value = m_storage->seed;
+
+  for (uint64_t word : words)
+    value = rak::position_index::mix(value ^ word);
+
+  return value >> 32;
+}
+
+size_t
+PeerList::find_key(const socket_address_key& key) const {
+  uint32_t slot = m_storage->index.find(hash_key(key), [this, &key](uint32_t position) { return m_entries[position].first == key; });
+
+  return slot != rak::position_index::npos ? m_storage->index.position(slot) : m_entries.size();
+}
+
+size_t
+PeerList::find_peer(PeerInfo* p) const {
+  socket_address_key sock_key = socket_address_key::from_sockaddr(p->socket_address());
+  uint32_t slot = m_storage->index.find(hash_key(sock_key), [this, p](uint32_t position) { return m_entries[position].second == p; });
+
+  return slot != rak::position_index::npos ? m_storage->index.position(slot) : m_entries.size();
+}
+
+PeerInfo*
+PeerList::insert_peer(const socket_address_key& key, const sockaddr* sa) {
+  PeerInfo* peerInfo = new (m_storage->slab.allocate()) PeerInfo(sa);
+  instrumentation_update_peak(INSTRUMENTATION_POOL_PEER_INFO, INSTRUMENTATION_POOL_PEER_INFO_PEAK, 1);
+
+  // Appending keeps the entries sorted as long as keys arrive in
+  // order, e.g. when loading resume data.
+  if (!m_entries.empty() && key < m_entries.back().first)
+    m_sorted = false;
+
+  m_storage->index.insert(hash_key(key), m_entries.size());
+  m_entries.emplace_back(key, peerInfo);
+
+  return peerInfo;
+}
+
+// Swaps the back entry into the hole, so only that entry's position
+// needs to be updated in the index.
+void
+PeerList::erase_peer(size_t position) {
+  rak::position_index& index = m_storage->index;
+  PeerInfo* peerInfo = m_entries[position].second;
+
+  uint32_t slot = index.find_position(hash_key(m_entries[position].first), position);
+
+  if (slot == rak::position_index::npos)
+    throw internal_error("PeerList::erase_peer(...) entry not found in index.");
+
+  index.erase(slot);
+
+  if (position != m_entries.size() - 1) {
+    uint32_t back_slot = index.find_position(hash_key(m_entries.back().first), m_entries.size() - 1);
+
+    if (back_slot == rak::position_index::npos)
+      throw internal_error("PeerList::erase_peer(...) back entry not found in index.");
+
+    index.set_position(back_slot, position);
+    m_entries[position] = m_entries.back();
+    m_sorted = false;
+  }
+
+  m_entries.pop_back();
+
+  peerInfo->~PeerInfo();
+  m_storage->slab.deallocate(peerInfo);
+
+  instrumentation_update(INSTRUMENTATION_POOL_PEER_INFO, -1);
+}
+
+void
+PeerList::sort_entries() const {
+  if (m_sorted)
+    return;
+
+  std::stable_sort(m_entries.begin(), m_entries.end(), [](const value_type& a, const value_type& b) { return a.first < b.first; });
+
+  m_storage->index.clear();
+  m_storage->index.reserve(m_entries.size());
+
+  for (size_t i = 0; i != m_entries.size(); i++)
+    m_storage->index.insert(hash_key(m_entries[i].first), i);
+
+  m_sorted = true;
+}
+
 void
 PeerList::set_info(DownloadInfo* info) {
   m_info = info;
@@ -78,6 +192,32 @@ PeerList::set_info(DownloadInfo* info) {
   LT_LOG_EVENTS("creating list", 0);
 }
 
+ip_filter_ptr
+PeerList::address_filter() {
+  return std::atomic_load(&m_address_filter);
+}
+
+void
+PeerList::set_address_filter(ip_filter_ptr filter) {
+  if (!filter)
+    filter = std::make_shared<ip_filter>();
+
+  std::atomic_store(&m_address_filter, filter);
+}
+
+int
+PeerList::lookup_filter(const sockaddr* sa) {
+  if (sa != NULL && sa->sa_family == AF_INET && !m_ipv4_table.range_map.empty()) {
+    // The legacy table stores addresses in host byte order.
+    uint32_t address_h = rak::socket_address::cast_from(sa)->sa_inet()->address_h();
+
+    if (m_ipv4_table.defined(address_h))
+      return m_ipv4_table.at(address_h);
+  }
+
+  return address_filter()->lookup(sa);
+}
+
 PeerInfo*
 PeerList::insert_address(const sockaddr* sa, int flags) {
   socket_address_key sock_key = socket_address_key::from_sockaddr(sa);
@@ -90,31 +230,23 @@ PeerList::insert_address(const sockaddr* sa, int flags) {
 
   const rak::socket_address* address = rak::socket_address::cast_from(sa);
 
-  range_type range = base_type::equal_range(sock_key);
-
   // Do some special handling if we got a new port number but the
   // address was present.
   //
   // What we do depends on the flags, but for now just allow one
   // PeerInfo per address key and do nothing.
-  if (range.first != range.second) {
+  if (find_key(sock_key) != m_entries.size()) {
     LT_LOG_EVENTS("address already exists " LT_LOG_SA_FMT,
                   address->address_str().c_str(), address->port());
     return NULL;
   }
 
-  PeerInfo* peerInfo = new PeerInfo(sa);
+  PeerInfo* peerInfo = insert_peer(sock_key, sa);
   peerInfo->set_listen_port(address->port());
-  uint32_t host_byte_order_ipv4_addr = address->sa_inet()->address_h();
+  peerInfo->set_flags(lookup_filter(sa) & PeerInfo::mask_ip_table);
 
-  // IPv4 addresses stored in host byte order in ipv4_table so they are comparable. ntohl has been called
-  if(m_ipv4_table.defined(host_byte_order_ipv4_addr))
-    peerInfo->set_flags(m_ipv4_table.at(host_byte_order_ipv4_addr) & PeerInfo::mask_ip_table);
-  
   manager->client_list()->retrieve_unknown(&peerInfo->mutable_client_info());
 
-  base_type::insert(range.second, value_type(sock_key, peerInfo));
-
   if ((flags & address_available) && peerInfo->listen_port() != 0) {
     m_available_list->push_back(address);
     LT_LOG_EVENTS("added available address " LT_LOG_SA_FMT,
@@ -127,11 +259,6 @@ PeerList::insert_address(const sockaddr* sa, int flags) {
   return peerInfo;
 }
 
-inline bool
-socket_address_less_rak(const rak::socket_address& s1, const rak::socket_address& s2) {
-  return socket_address_less(s1.c_sockaddr(), s2.c_sockaddr());
-}
-
 uint32_t
 PeerList::insert_available(const void* al) {
   const AddressList* addressList = static_cast<const AddressList*>(al);
@@ -144,12 +271,6 @@ PeerList::insert_available(const void* al) {
   if (m_available_list->size() + addressList->size() > m_available_list->capacity())
     m_available_list->reserve(m_available_list->size() + addressList->size() + 128);
 
-  // Optimize this so that we don't traverse the tree for every
-  // insert, since we know 'al' is sorted.
-
-  AvailableList::const_iterator availItr  = m_available_list->begin();
-  AvailableList::const_iterator availLast = m_available_list->end();
-
   for (const auto& addr : *addressList) {
     if (!socket_address_key::is_comparable_sockaddr(addr.c_sockaddr()) || addr.port() == 0) {
       invalid++;
@@ -157,11 +278,7 @@ PeerList::insert_available(const void* al) {
       continue;
     }
 
-    availItr = std::find_if(availItr, availLast, [&addr](const rak::socket_address& sa) {
-      return socket_address_less_rak(sa, addr);
-    });
-
-    if (availItr != availLast && !socket_address_less(availItr->c_sockaddr(), addr.c_sockaddr())) {
+    if (m_available_list->contains(addr)) {
       // The address is already in m_available_list, so don't bother
       // going further.
       unneeded++;
@@ -174,12 +291,12 @@ PeerList::insert_available(const void* al) {
     // ever want to connect. Just update the timer for the last
     // availability notice if the peer isn't really ideal, but might
     // be used in an emergency.
-    range_type range = base_type::equal_range(sock_key);
+    size_t position = find_key(sock_key);
 
-    if (range.first != range.second) {
+    if (position != m_entries.size()) {
       // Add some logic here to select the best PeerInfo, but for now
-      // just assume the first one is the only one that exists.
-      PeerInfo* peerInfo = range.first->second;
+      // just assume the first one found is the only one that exists.
+      PeerInfo* peerInfo = m_entries[position].second;
 
       if (peerInfo->listen_port() == 0)
         peerInfo->set_port(addr.port());
@@ -233,12 +350,7 @@ PeerList::connected(const sockaddr* sa, int flags) {
       !socket_address_key::is_comparable_sockaddr(sa))
     return NULL;
 
-  uint32_t host_byte_order_ipv4_addr = address->sa_inet()->address_h();
-  int filter_value = 0;
-
-  // IPv4 addresses stored in host byte order in ipv4_table so they are comparable. ntohl has been called
-  if(m_ipv4_table.defined(host_byte_order_ipv4_addr))
-    filter_value = m_ipv4_table.at(host_byte_order_ipv4_addr);
+  int filter_value = lookup_filter(sa);
 
   // We should also remove any PeerInfo objects already for this
   // address.
@@ -248,18 +360,16 @@ PeerList::connected(const sockaddr* sa, int flags) {
   }
 
   PeerInfo* peerInfo;
-  range_type range = base_type::equal_range(sock_key);
+  size_t position = find_key(sock_key);
 
-  if (range.first == range.second) {
+  if (position == m_entries.size()) {
     // Create a new entry.
-    peerInfo = new PeerInfo(sa);
+    peerInfo = insert_peer(sock_key, sa);
     peerInfo->set_flags(filter_value & PeerInfo::mask_ip_table);
 
-    base_type::insert(range.second, value_type(sock_key, peerInfo));
-
-  } else if (!range.first->second->is_connected()) {
+  } else if (!m_entries[position].second->is_connected()) {
     // Use an old entry.
-    peerInfo = range.first->second;
+    peerInfo = m_entries[position].second;
     peerInfo->set_port(address->port());
 
   } else {
@@ -282,10 +392,8 @@ PeerList::connected(const sockaddr* sa, int flags) {
 
     //return NULL;
 
-    peerInfo = new PeerInfo(sa);
+    peerInfo = insert_peer(sock_key, sa);
     peerInfo->set_flags(filter_value & PeerInfo::mask_ip_table);
-
-    base_type::insert(range.second, value_type(sock_key, peerInfo));
   }
 
   if (flags & connect_filter_recent &&
@@ -310,51 +418,34 @@ PeerList::connected(const sockaddr* sa, int flags) {
 
 void
 PeerList::disconnected(PeerInfo* p, int flags) {
-  socket_address_key sock_key = socket_address_key::from_sockaddr(p->socket_address());
-
-  range_type range = base_type::equal_range(sock_key);
-  
-  iterator itr = std::find_if(range.first, range.second, [p](auto& v) { return p == v.second; });
-
-  if (itr == range.second) {
-    if (std::none_of(base_type::begin(), base_type::end(), [p](auto& v){ return p == v.second; }))
-      throw internal_error("PeerList::disconnected(...) itr == range.second, doesn't exist.");
+  if (find_peer(p) == m_entries.size()) {
+    if (std::none_of(m_entries.begin(), m_entries.end(), [p](auto& v){ return p == v.second; }))
+      throw internal_error("PeerList::disconnected(...) peer doesn't exist.");
     else
-      throw internal_error("PeerList::disconnected(...) itr == range.second, not in the range.");
+      throw internal_error("PeerList::disconnected(...) peer not found in index.");
   }
-  
-  disconnected(itr, flags);
-}
-
-PeerList::iterator
-PeerList::disconnected(iterator itr, int flags) {
-  if (itr == base_type::end())
-    throw internal_error("PeerList::disconnected(...) itr == end().");
 
-  if (!itr->second->is_connected())
-    throw internal_error("PeerList::disconnected(...) !itr->is_connected().");
+  if (!p->is_connected())
+    throw internal_error("PeerList::disconnected(...) !p->is_connected().");
 
-  if (itr->second->transfer_counter() != 0) {
+  if (p->transfer_counter() != 0) {
     // Currently we only log these as it only affects the culling of
     // peers.
     LT_LOG_EVENTS("disconnected with non-zero transfer counter (%" PRIu32 ") for peer %40s",
-                  itr->second->transfer_counter(), itr->second->id_hex());
+                  p->transfer_counter(), p->id_hex());
   }
 
-  itr->second->unset_flags(PeerInfo::flag_connected);
+  p->unset_flags(PeerInfo::flag_connected);
 
   // Replace the socket address port with the listening port so that
   // future outgoing connections will connect to the right port.
-  itr->second->set_port(0);
+  p->set_port(0);
 
   if (flags & disconnect_set_time)
-    itr->second->set_last_connection(cachedTime.seconds());
+    p->set_last_connection(cachedTime.seconds());
 
-  if (flags & disconnect_available && itr->second->listen_port() != 0)
-    m_available_list->push_back(rak::socket_address::cast_from(itr->second->socket_address()));
-
-  // Do magic to get rid of unneeded entries.
-  return ++itr;
+  if (flags & disconnect_available && p->listen_port() != 0)
+    m_available_list->push_back(rak::socket_address::cast_from(p->socket_address()));
 }
 
 uint32_t
@@ -367,29 +458,25 @@ PeerList::cull_peers(int flags) {
   else
     timer = 0;
 
-  for (iterator itr = base_type::begin(); itr != base_type::end(); ) {
-    if (itr->second->is_connected() ||
-        itr->second->transfer_counter() != 0 || // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-        itr->second->last_connection() >= timer ||
+  // Erasing swaps the back entry into the current position, so only
+  // advance when the entry is kept.
+  for (size_t position = 0; position != m_entries.size(); ) {
+    PeerInfo* peerInfo = m_entries[position].second;
+
+    if (peerInfo->is_connected() ||
+        peerInfo->transfer_counter() != 0 || // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+        peerInfo->last_connection() >= timer ||
 
         (flags & cull_keep_interesting && 
-         (itr->second->failed_counter() != 0 || itr->second->is_blocked()))) {
-      itr++;
+         (peerInfo->failed_counter() != 0 || peerInfo->is_blocked()))) {
+      position++;
       continue;
     }
 
     // ##################### TODO: LOG CULLING OF PEERS ######################
     //   *** AND STATS OF DISCONNECTING PEERS (the peer info...)...
 
-    // The key is a pointer to a member in the value, although the key
-    // shouldn't actually be used in erase (I think), just ot be safe
-    // we delete it after erase.
-    iterator tmp = itr++;
-    PeerInfo* peerInfo = tmp->second;
-
-    base_type::erase(tmp);
-    delete peerInfo;
-
+    erase_peer(position);
     counter++;
   }
 
@@ -1,9 +1,10 @@
 #ifndef LIBTORRENT_PEER_LIST_H
 #define LIBTORRENT_PEER_LIST_H
 
-#include <map>
+#include <vector>
 #include <torrent/common.h>
 #include <torrent/net/socket_address_key.h>
+#include <torrent/peer/ip_filter.h>
 #include <torrent/utils/extents.h>
 
 namespace torrent {
@@ -12,27 +13,30 @@ class DownloadInfo;
 
 typedef extents<uint32_t, int> ipv4_table;
 
-class LIBTORRENT_EXPORT PeerList : private std::multimap<socket_address_key, PeerInfo*> {
+// Entries are kept in a dense vector indexed by a hash table on the
+// address key, several entries may share a key when a host connects
+// from different ports. The PeerInfo objects are allocated from a
+// per-download slab.
+//
+// Iteration is ordered by address key, the entries are sorted when
+// 'begin()' or 'end()' is called after a change. Inserting or culling
+// peers invalidates iterators.
+
+class LIBTORRENT_EXPORT PeerList {
 public:
   friend class DownloadWrapper;
   friend class Handshake;
   friend class HandshakeManager;
   friend class ConnectionList;
 
-  typedef std::multimap<socket_address_key, PeerInfo*>        base_type;
-  typedef std::pair<base_type::iterator, base_type::iterator> range_type;
-
-  using base_type::value_type;
-  using base_type::reference;
-  using base_type::difference_type;
+  typedef std::pair<socket_address_key, PeerInfo*> value_type;
+  typedef std::vector<value_type>                   base_type;
 
-  using base_type::iterator;
-  using base_type::reverse_iterator;
-  using base_type::const_iterator;
-  using base_type::const_reverse_iterator;
+  typedef base_type::const_reference        reference;
+  typedef base_type::difference_type        difference_type;
 
-  using base_type::size;
-  using base_type::empty;
+  typedef base_type::const_iterator         const_iterator;
+  typedef base_type::const_reverse_iterator const_reverse_iterator;
 
   static const int address_available       = (1 << 0);
 
@@ -59,17 +63,32 @@ public:
   // This will be used internally only for the moment.
   uint32_t            insert_available(const void* al) LIBTORRENT_NO_EXPORT;
 
-  static ipv4_table*  ipv4_filter() { return &m_ipv4_table; }
+  // The filter is shared by all downloads and may be replaced from
+  // any thread, lookups keep using the old table until they finish.
+  static ip_filter_ptr address_filter();
+  static void          set_address_filter(ip_filter_ptr filter);
+
+  // Deprecated IPv4 table kept for clients that have not moved to
+  // 'set_address_filter'. Addresses defined in it take precedence
+  // over the address filter. Not thread-safe.
+  [[deprecated("use set_address_filter()")]]
+  static ipv4_table*   ipv4_filter() { return &m_ipv4_table; }
+
+  // Returns the filter value of 'sa', consulting both tables.
+  static int           lookup_filter(const sockaddr* sa) LIBTORRENT_NO_EXPORT;
 
   AvailableList*      available_list()  { return m_available_list; }
   uint32_t            available_list_size() const;
 
   uint32_t            cull_peers(int flags);
 
-  const_iterator         begin() const  { return base_type::begin(); }
-  const_iterator         end() const    { return base_type::end(); }
-  const_reverse_iterator rbegin() const { return base_type::rbegin(); }
-  const_reverse_iterator rend() const   { return base_type::rend(); }
+  size_t                 size() const   { return m_entries.size(); }
+  bool                   empty() const  { return m_entries.empty(); }
+
+  const_iterator         begin() const  { sort_entries(); return m_entries.begin(); }
+  const_iterator         end() const    { sort_entries(); return m_entries.end(); }
+  const_reverse_iterator rbegin() const { sort_entries(); return m_entries.rbegin(); }
+  const_reverse_iterator rend() const   { sort_entries(); return m_entries.rend(); }
 
 protected:
   void                set_info(DownloadInfo* info) LIBTORRENT_NO_EXPORT;
@@ -79,10 +98,28 @@ protected:
   PeerInfo*           connected(const sockaddr* sa, int flags) LIBTORRENT_NO_EXPORT;
 
   void                disconnected(PeerInfo* p, int flags) LIBTORRENT_NO_EXPORT;
-  iterator            disconnected(iterator itr, int flags) LIBTORRENT_NO_EXPORT;
 
 private:
-  static ipv4_table   m_ipv4_table;
+  struct storage_type;
+
+  uint32_t            hash_key(const socket_address_key& key) const LIBTORRENT_NO_EXPORT;
+
+  // Returns the position of an entry with 'key', or size() if none.
+  size_t              find_key(const socket_address_key& key) const LIBTORRENT_NO_EXPORT;
+  size_t              find_peer(PeerInfo* p) const LIBTORRENT_NO_EXPORT;
+
+  PeerInfo*           insert_peer(const socket_address_key& key, const sockaddr* sa) LIBTORRENT_NO_EXPORT;
+  void                erase_peer(size_t position) LIBTORRENT_NO_EXPORT;
+
+  void                sort_entries() const LIBTORRENT_NO_EXPORT;
+
+  static ip_filter_ptr m_address_filter;
+  static ipv4_table    m_ipv4_table;
+
+  mutable base_type   m_entries;
+  mutable bool        m_sorted{true};
+
+  storage_type*       m_storage;
 
   DownloadInfo*       m_info;
   AvailableList*      m_available_list;
@@ -51,6 +51,9 @@ public:
   static const int      poll_worker_thread     = 0x1;
   static const uint32_t flag_waive_global_lock = 0x1;
 
+  // Register sockets edge-triggered where supported, see PollEPoll.
+  static const uint32_t flag_edge_triggered    = 0x2;
+
   Poll() : m_flags(0) {}
   virtual ~Poll() {}
 
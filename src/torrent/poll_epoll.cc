@@ -11,6 +11,7 @@
 
 #include "torrent.h"
 #include "poll_epoll.h"
+#include "utils/instrumentation.h"
 #include "utils/log.h"
 #include "utils/thread_base.h"
 #include "rak/error_number.h"
@@ -39,22 +40,17 @@ PollEPoll::set_event_mask(Event* e, uint32_t m) {
 }
 
 inline void
-PollEPoll::modify(Event* event, int op, uint32_t mask) {
-  if (event_mask(event) == mask)
-    return;
-
-  LT_LOG_EVENT(event, DEBUG, "Modify event: op:%hx mask:%hx.", op, mask);
-
+PollEPoll::control(Event* event, int op, uint32_t mask) {
   epoll_event e;
   e.data.u64 = 0; // Make valgrind happy? Remove please.
   e.data.fd = event->file_descriptor();
   e.events = mask;
 
-  set_event_mask(event, mask);
+  instrumentation_update(INSTRUMENTATION_POLLING_EPOLL_CTL, 1);
 
   if (epoll_ctl(m_fd, op, event->file_descriptor(), &e)) {
     // Socket was probably already closed. Ignore this.
-    if (op == EPOLL_CTL_DEL && errno == ENOENT)
+    if (op == EPOLL_CTL_DEL && (errno == ENOENT || errno == EBADF))
       return;
 
     // Handle some libcurl/c-ares bugs by retrying once.
@@ -68,6 +64,9 @@ PollEPoll::modify(Event* event, int op, uint32_t mask) {
       errno = 0;
     }
 
+    if (!errno)
+      instrumentation_update(INSTRUMENTATION_POLLING_EPOLL_CTL, 1);
+
     if (errno || epoll_ctl(m_fd, retry, event->file_descriptor(), &e)) {
       char errmsg[1024];
       snprintf(errmsg, sizeof(errmsg),
@@ -79,6 +78,96 @@ PollEPoll::modify(Event* event, int op, uint32_t mask) {
   }
 }
 
+inline void
+PollEPoll::modify(Event* event, int op, uint32_t mask) {
+  if (event_mask(event) == mask)
+    return;
+
+  LT_LOG_EVENT(event, DEBUG, "Modify event: op:%hx mask:%hx.", op, mask);
+
+  set_event_mask(event, mask);
+  control(event, op, mask);
+}
+
+void
+PollEPoll::insert_mask(Event* event, uint32_t flag) {
+  uint32_t mask = event_mask(event);
+
+  if (mask & flag)
+    return;
+
+  edge_state& state = m_edge[event->file_descriptor()];
+
+  if (state.registered == 0 && mask == 0 && (flags() & flag_edge_triggered)) {
+    LT_LOG_EVENT(event, DEBUG, "Register edge-triggered: mask:%hx.", flag);
+
+    state = edge_state{ EPOLLIN | EPOLLOUT | EPOLLERR | EPOLLET, 0, false };
+
+    set_event_mask(event, flag);
+    control(event, EPOLL_CTL_ADD, state.registered);
+    return;
+  }
+
+  if (state.registered == 0) {
+    modify(event, mask ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, mask | flag);
+    return;
+  }
+
+  set_event_mask(event, mask | flag);
+
+  if ((state.ready & flag) && !state.queued) {
+    state.queued = true;
+    m_pending.push_back(event->file_descriptor());
+  }
+}
+
+void
+PollEPoll::remove_mask(Event* event, uint32_t flag) {
+  uint32_t mask = event_mask(event);
+
+  if (!(mask & flag))
+    return;
+
+  if (!is_edge_triggered(event)) {
+    modify(event, (mask & ~flag) ? EPOLL_CTL_MOD : EPOLL_CTL_DEL, mask & ~flag);
+    return;
+  }
+
+  // The event may have stopped before the socket would block, so
+  // assume it is still ready.
+  set_event_mask(event, mask & ~flag);
+  m_edge[event->file_descriptor()].ready |= flag & (EPOLLIN | EPOLLOUT);
+}
+
+// Calls the event for readiness it wants, clearing each flag before
+// the call as the event may remove or insert itself again.
+unsigned int
+PollEPoll::dispatch_edge(int fd) {
+  edge_state& state = m_edge[fd];
+  Table::iterator evItr = m_table.begin() + fd;
+  unsigned int count = 0;
+
+  if (state.ready & EPOLLERR && evItr->second != NULL && evItr->first & EPOLLERR) {
+    state.ready &= ~EPOLLERR;
+    count++;
+    evItr->second->event_error();
+  }
+
+  if (state.ready & EPOLLIN && evItr->second != NULL && evItr->first & EPOLLIN) {
+    state.ready &= ~EPOLLIN;
+    count++;
+    evItr->second->event_read();
+  }
+
+  if (state.ready & EPOLLOUT && evItr->second != NULL && evItr->first & EPOLLOUT) {
+    state.ready &= ~EPOLLOUT;
+    count++;
+    evItr->second->event_write();
+  }
+
+  return count;
+}
+
 PollEPoll*
 PollEPoll::create(int maxOpenSockets) {
   int fd = epoll_create(maxOpenSockets);
@@ -97,6 +186,7 @@ PollEPoll::PollEPoll(int fd, int max_events, int max_open_sockets) :
 
   try {
     m_table.resize(max_open_sockets);
+    m_edge.resize(max_open_sockets);
   } catch (std::bad_alloc) {
     char errmsg[1024];
     snprintf(errmsg, sizeof(errmsg),
@@ -115,6 +205,10 @@ PollEPoll::~PollEPoll() {
 
 int
 PollEPoll::poll(int msec) {
+  // Edge-triggered sockets queued by insert_* are already ready.
+  if (!m_pending.empty())
+    msec = 0;
+
   int nfds = epoll_wait(m_fd, m_events, m_maxEvents, msec);
 
   if (nfds == -1)
@@ -128,10 +222,42 @@ PollEPoll::poll(int msec) {
 //
 // TODO: Do we want to guarantee if the Event has been removed from
 // some event but not closed, it won't call that event? Think so...
+//
+// Edge-triggered sockets have the readiness of the whole batch
+// recorded before any event is called, then those queued by insert_*
+// and those reported by the kernel are called once each.
 unsigned int
 PollEPoll::perform() {
   unsigned int count = 0;
 
+  for (epoll_event *itr = m_events, *last = m_events + m_waitingEvents; itr != last; ++itr) {
+    if (itr->data.fd < 0 || (size_t)itr->data.fd >= m_table.size() || m_edge[itr->data.fd].registered == 0)
+      continue;
+
+    m_edge[itr->data.fd].ready |= itr->events & (EPOLLIN | EPOLLOUT | EPOLLERR);
+
+    if (itr->events & EPOLLHUP)
+      m_edge[itr->data.fd].ready |= EPOLLIN;
+  }
+
+  // Events queued while dispatching are left for the next call.
+  size_t pending_size = m_pending.size();
+
+  for (size_t i = 0; i != pending_size; i++) {
+    int fd = m_pending[i];
+
+    if (!m_edge[fd].queued)
+      continue;
+
+    if ((flags() & flag_waive_global_lock) && thread_base::global_queue_size() != 0)
+      thread_base::waive_global_lock();
+
+    m_edge[fd].queued = false;
+    count += dispatch_edge(fd);
+  }
+
+  m_pending.erase(m_pending.begin(), m_pending.begin() + pending_size);
+
   for (epoll_event *itr = m_events, *last = m_events + m_waitingEvents; itr != last; ++itr) {
     if (itr->data.fd < 0 || (size_t)itr->data.fd >= m_table.size())
       continue;
@@ -139,6 +265,11 @@ PollEPoll::perform() {
     if ((flags() & flag_waive_global_lock) && thread_base::global_queue_size() != 0)
       thread_base::waive_global_lock();
 
+    if (m_edge[itr->data.fd].registered != 0) {
+      count += dispatch_edge(itr->data.fd);
+      continue;
+    }
+
     Table::iterator evItr = m_table.begin() + itr->data.fd;
 
     // Each branch must check for data.ptr != NULL to allow the socket
@@ -216,6 +347,13 @@ PollEPoll::close(Event* event) {
 
   m_table[event->file_descriptor()] = Table::value_type();
 
+  // Edge-triggered sockets stay registered until closed, remove it
+  // now in case the file descriptor is passed on to another event.
+  if (is_edge_triggered(event)) {
+    m_edge[event->file_descriptor()] = edge_state();
+    control(event, EPOLL_CTL_DEL, 0);
+  }
+
   // Clear the event list just in case we open a new socket with the
   // same fd while in the middle of calling PollEPoll::perform.
   for (epoll_event *itr = m_events, *last = m_events + m_waitingEvents; itr != last; ++itr)
@@ -229,8 +367,10 @@ PollEPoll::closed(Event* event) {
 
   // Kernel removes closed FDs automatically, so just clear the mask and remove it from pending calls.
   // Don't touch if the FD was re-used before we received the close notification.
-  if (m_table[event->file_descriptor()].second == event)
+  if (m_table[event->file_descriptor()].second == event) {
     m_table[event->file_descriptor()] = Table::value_type();
+    m_edge[event->file_descriptor()] = edge_state();
+  }
 
   // for (epoll_event *itr = m_events, *last = m_events + m_waitingEvents; itr != last; ++itr) {
   //   if (itr->data.fd == event->file_descriptor())
@@ -258,52 +398,37 @@ PollEPoll::in_error(Event* event) {
 void
 PollEPoll::insert_read(Event* event) {
   LT_LOG_EVENT(event, DEBUG, "Insert read.", 0);
-
-  modify(event,
-	 event_mask(event) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
-	 event_mask(event) | EPOLLIN);
+  insert_mask(event, EPOLLIN);
 }
 
 void
 PollEPoll::insert_write(Event* event) {
   LT_LOG_EVENT(event, DEBUG, "Insert write.", 0);
-
-  modify(event,
-	 event_mask(event) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
-	 event_mask(event) | EPOLLOUT);
+  insert_mask(event, EPOLLOUT);
 }
 
 void
 PollEPoll::insert_error(Event* event) {
   LT_LOG_EVENT(event, DEBUG, "Insert error.", 0);
-
-  modify(event,
-	 event_mask(event) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
-	 event_mask(event) | EPOLLERR);
+  insert_mask(event, EPOLLERR);
 }
 
 void
 PollEPoll::remove_read(Event* event) {
   LT_LOG_EVENT(event, DEBUG, "Remove read.", 0);
-
-  uint32_t mask = event_mask(event) & ~EPOLLIN;
-  modify(event, mask ? EPOLL_CTL_MOD : EPOLL_CTL_DEL, mask);
+  remove_mask(event, EPOLLIN);
 }
 
 void
 PollEPoll::remove_write(Event* event) {
   LT_LOG_EVENT(event, DEBUG, "Remove write.", 0);
-
-  uint32_t mask = event_mask(event) & ~EPOLLOUT;
-  modify(event, mask ? EPOLL_CTL_MOD : EPOLL_CTL_DEL, mask);
+  remove_mask(event, EPOLLOUT);
 }
 
 void
 PollEPoll::remove_error(Event* event) {
   LT_LOG_EVENT(event, DEBUG, "Remove error.", 0);
-
-  uint32_t mask = event_mask(event) & ~EPOLLERR;
-  modify(event, mask ? EPOLL_CTL_MOD : EPOLL_CTL_DEL, mask);
+  remove_mask(event, EPOLLERR);
 }
 
 #else // USE_EPOLL
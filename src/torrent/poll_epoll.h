@@ -44,6 +44,20 @@ struct epoll_event;
 
 namespace torrent {
 
+// With 'flag_edge_triggered' set, sockets are registered with
+// EPOLLET for reading and writing once, and only removed when closed.
+// Inserting and removing read/write interest then only changes the
+// mask kept here, with readiness reported by the kernel tracked until
+// the event wants it.
+//
+// As the kernel only reports changes in readiness, removing interest
+// marks the socket as possibly ready so that inserting it again calls
+// the event on the next perform(). Events must handle being called
+// when not ready, and must either read/write until the socket would
+// block or remove their interest.
+//
+// The flag applies to sockets registered after it is set.
+
 class LIBTORRENT_EXPORT PollEPoll : public torrent::Poll {
 public:
   typedef std::vector<std::pair<uint32_t, Event*> > Table;
@@ -84,19 +98,37 @@ public:
   virtual void        remove_error(torrent::Event* event);
 
 private:
+  struct edge_state {
+    uint32_t registered; // Non-zero if registered edge-triggered.
+    uint32_t ready;      // Readiness not yet passed to the event.
+    bool     queued;     // In 'm_pending'.
+  };
+
+  typedef std::vector<edge_state> EdgeTable;
+
   PollEPoll(int fd, int maxEvents, int maxOpenSockets);
 
   inline uint32_t     event_mask(Event* e);
   inline void         set_event_mask(Event* e, uint32_t m);
 
+  inline bool         is_edge_triggered(Event* e) { return m_edge[e->file_descriptor()].registered != 0; }
+
+  inline void         control(torrent::Event* event, int op, uint32_t mask);
   inline void         modify(torrent::Event* event, int op, uint32_t mask);
 
+  void                insert_mask(torrent::Event* event, uint32_t flag);
+  void                remove_mask(torrent::Event* event, uint32_t flag);
+
+  unsigned int        dispatch_edge(int fd);
+
   int                 m_fd;
 
   int                 m_maxEvents;
   int                 m_waitingEvents;
 
   Table               m_table;
+  EdgeTable           m_edge;
+  std::vector<int>    m_pending;
   epoll_event*        m_events;
 };
 
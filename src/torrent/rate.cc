@@ -36,22 +36,105 @@
 
 #include "config.h"
 
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
 #include "globals.h"
 #include "rate.h"
 #include "exceptions.h"
 
 namespace torrent {
 
+static inline int64_t
+floor_div(int64_t a, int64_t b) {
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static inline Rate::timer_type
+granularity_for_span(Rate::timer_type span) {
+  if (span <= 0)
+    throw internal_error("Rate::set_span(...) received a non-positive span.");
+
+  return (span + Rate::bucket_count - 3) / (Rate::bucket_count - 2);
+}
+
+Rate::Rate(timer_type span, mode_type mode) :
+  m_total(0),
+  m_span(span),
+  m_granularity(granularity_for_span(span)),
+  m_mode(mode) {
+
+  reset_rate();
+}
+
+void
+Rate::set_span(timer_type s) {
+  m_span = s;
+
+  if (m_granularity != granularity_for_span(s)) {
+    m_granularity = granularity_for_span(s);
+    reset_rate();
+  }
+}
+
+void
+Rate::reset_rate() {
+  std::fill(std::begin(m_buckets), std::end(m_buckets), rate_type());
+
+  m_first = 0;
+  m_last = -1;
+  m_current = 0;
+
+  m_ewma = 0.0;
+  m_ewmaTime = cachedTime.seconds();
+  m_ewmaPending = 0;
+}
+
+// A unit is only discarded once all its seconds are older than the
+// span, which for one-second units is the same as the old per-second
+// queue.
 inline void
 Rate::discard_old() const {
-  while (!m_container.empty() && m_container.back().first < cachedTime.seconds() - m_span) {
-    m_current -= m_container.back().second;
-    m_container.pop_back();
+  int64_t first_valid = floor_div((int64_t)cachedTime.seconds() - m_span, m_granularity);
+
+  while (m_first <= m_last && m_first < first_valid) {
+    rate_type& bucket = m_buckets[(uint64_t)m_first % bucket_count];
+
+    m_current -= bucket;
+    bucket = 0;
+    m_first++;
+  }
+
+  if (m_first > m_last) {
+    m_first = first_valid;
+    m_last = first_valid - 1;
   }
 }
 
+inline void
+Rate::update_ewma() const {
+  timer_type now = cachedTime.seconds();
+
+  if (now <= m_ewmaTime)
+    return;
+
+  double decay = std::exp(-1.0 / m_span);
+
+  m_ewma = m_ewma * decay + (double)m_ewmaPending * (1.0 - decay);
+  m_ewma *= std::pow(decay, now - m_ewmaTime - 1);
+
+  m_ewmaTime = now;
+  m_ewmaPending = 0;
+}
+
 Rate::rate_type
 Rate::rate() const {
+  if (m_mode == mode_ewma) {
+    update_ewma();
+    return (rate_type)m_ewma;
+  }
+
   discard_old();
 
   return m_current / m_span;
@@ -64,13 +147,23 @@ Rate::insert(rate_type bytes) {
   if (m_current > ((rate_type)1 << 40) || bytes > ((rate_type)1 << 28))
     throw internal_error("Rate::insert(bytes) received out-of-bounds values..");
 
-  if (m_container.empty() || m_container.front().first != cachedTime.seconds())
-    m_container.emplace_front(cachedTime.seconds(), bytes);
-  else
-    m_container.front().second += bytes;
+  // If the time went backwards past the buckets in use, add to the
+  // newest one.
+  int64_t unit = floor_div(cachedTime.seconds(), m_granularity);
+
+  if (unit < m_first)
+    unit = std::max(m_first, m_last);
+
+  m_buckets[(uint64_t)unit % bucket_count] += bytes;
+  m_last = std::max(m_last, unit);
 
   m_total += bytes;
   m_current += bytes;
+
+  if (m_mode == mode_ewma) {
+    update_ewma();
+    m_ewmaPending += bytes;
+  }
 }
 
 }
@@ -37,14 +37,24 @@
 #ifndef LIBTORRENT_UTILS_RATE_H
 #define LIBTORRENT_UTILS_RATE_H
 
-#include <deque>
+#include <utility>
 #include <torrent/common.h>
 
 namespace torrent {
 
 // Keep the current rate count up to date for each call to rate() and
 // insert(...). This requires a mutable since rate() can be const, but
-// is justified as we avoid iterating the deque for each call.
+// is justified as we avoid iterating the buckets for each call.
+//
+// The transfers are summed in a fixed ring of buckets, each covering
+// 'granularity()' seconds, so no allocations are done and both insert
+// and rate() are constant time. Spans up to 'bucket_count - 2'
+// seconds use one-second buckets; longer spans use coarser buckets
+// that only expire once all their seconds are outside the span.
+//
+// In EWMA mode rate() instead returns an exponentially weighted
+// moving average of the per-second rate, using the span as the time
+// constant.
 
 class LIBTORRENT_EXPORT Rate {
 public:
@@ -53,9 +63,15 @@ public:
   typedef uint64_t                         total_type;
 
   typedef std::pair<timer_type, rate_type> value_type;
-  typedef std::deque<value_type>           queue_type;
 
-  Rate(timer_type span) : m_current(0), m_total(0), m_span(span) {}
+  static constexpr unsigned int bucket_count = 32;
+
+  enum mode_type {
+    mode_window,
+    mode_ewma
+  };
+
+  Rate(timer_type span, mode_type mode = mode_window);
 
   // Bytes per second.
   rate_type           rate() const;
@@ -66,11 +82,17 @@ public:
 
   // Interval in seconds used to calculate the rate.
   timer_type          span() const                            { return m_span; }
-  void                set_span(timer_type s)                  { m_span = s; }
+  void                set_span(timer_type s);
+
+  // Seconds covered by each bucket.
+  timer_type          granularity() const                     { return m_granularity; }
+
+  mode_type           mode() const                            { return m_mode; }
+  void                set_mode(mode_type m)                   { m_mode = m; reset_rate(); }
 
   void                insert(rate_type bytes);
 
-  void                reset_rate()                            { m_current = 0; m_container.clear(); }
+  void                reset_rate();
   
   bool                operator <  (Rate& r) const             { return rate() < r.rate(); }
   bool                operator >  (Rate& r) const             { return rate() > r.rate(); }
@@ -84,12 +106,24 @@ public:
 
 private:
   inline void         discard_old() const;
+  inline void         update_ewma() const;
 
-  mutable queue_type  m_container;
+  mutable rate_type   m_buckets[bucket_count];
+
+  // Buckets in the unit range [m_first, m_last] are in use, the rest
+  // are zero. A unit is 'm_granularity' seconds.
+  mutable int64_t     m_first;
+  mutable int64_t     m_last;
 
   mutable rate_type   m_current;
   total_type          m_total;
   timer_type          m_span;
+  timer_type          m_granularity;
+  mode_type           m_mode;
+
+  mutable double      m_ewma;
+  mutable timer_type  m_ewmaTime;
+  mutable rate_type   m_ewmaPending;
 };
 
 }
@@ -13,6 +13,7 @@
 
 #include "manager.h"
 
+#include "protocol/handshake_key_pool.h"
 #include "protocol/handshake_manager.h"
 #include "protocol/peer_factory.h"
 #include "data/file_manager.h"
@@ -74,6 +75,8 @@ initialize() {
 
   manager->main_thread_disk()->init_thread();
   manager->main_thread_disk()->start_thread();
+
+  manager->handshake_key_pool()->start(HandshakeKeyPool::default_workers);
 }
 
 // Clean up and close stuff. Stopping all torrents and waiting for
@@ -134,33 +134,38 @@ directory_events::notify_on(const std::string& path, int flags, const slot_strin
 #endif
 }
 
+// Read until the descriptor would block, as an edge-triggered poll
+// doesn't report events already queued when we return.
 void
 directory_events::event_read() {
 #ifdef HAVE_INOTIFY
   char buffer[2048];
-  int result = ::read(m_fileDesc, buffer, 2048);
 
-  if (result < sizeof(struct inotify_event))
-    return;
-
-  struct inotify_event* event = (struct inotify_event*)buffer;
-  
-  while (event + 1 <= (struct inotify_event*)(buffer + result)) {
-    char* next_event = (char*)event + sizeof(struct inotify_event) + event->len;
+  while (m_fileDesc != -1) {
+    int result = ::read(m_fileDesc, buffer, 2048);
 
-    if (event->len == 0 || next_event > buffer + 2048)
+    if (result < (int)sizeof(struct inotify_event))
       return;
 
-    wd_list::const_iterator itr = std::find_if(m_wd_list.begin(), m_wd_list.end(),
-                                               std::bind(&watch_descriptor::compare_desc, std::placeholders::_1, event->wd));
+    struct inotify_event* event = (struct inotify_event*)buffer;
 
-    if (itr != m_wd_list.end()) {
-      std::string sname(event->name);
-      if((sname.substr(sname.find_last_of(".") ) == ".torrent"))
-        itr->slot(itr->path + event->name);
-    }
+    while (event + 1 <= (struct inotify_event*)(buffer + result)) {
+      char* next_event = (char*)event + sizeof(struct inotify_event) + event->len;
+
+      if (event->len == 0 || next_event > buffer + 2048)
+        break;
 
-    event = (struct inotify_event*)(next_event);
+      wd_list::const_iterator itr = std::find_if(m_wd_list.begin(), m_wd_list.end(),
+                                                 std::bind(&watch_descriptor::compare_desc, std::placeholders::_1, event->wd));
+
+      if (itr != m_wd_list.end()) {
+        std::string sname(event->name);
+        if((sname.substr(sname.find_last_of(".") ) == ".torrent"))
+          itr->slot(itr->path + event->name);
+      }
+
+      event = (struct inotify_event*)(next_event);
+    }
   }
 #endif
 }
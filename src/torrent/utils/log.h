@@ -115,6 +115,10 @@ enum {
 
   LOG_UI_EVENTS,
 
+  // New groups are appended to keep the values of the others.
+  LOG_INSTRUMENTATION_PROTOCOL,
+  LOG_INSTRUMENTATION_POOLS,
+
   LOG_GROUP_MAX_SIZE
 };
 
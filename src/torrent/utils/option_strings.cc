@@ -201,6 +201,9 @@ const char* option_list_log_group[] = {
 
   "ui_events",
 
+  "instrumentation_protocol",
+  "instrumentation_pools",
+
   NULL
 };
 
@@ -0,0 +1,154 @@
+// Lock-free multiple producer, single consumer queue of move-only
+// callables, based on Dmitry Vyukov's intrusive MPSC node queue.
+//
+// Any thread may push tasks, only the owning thread may process or
+// clear them. Each push is a single allocation and an atomic
+// exchange, tasks are run in the order they were pushed.
+//
+// A push that has swapped the head but not yet linked its node is
+// not seen by 'process()' until linked, so producers should wake the
+// consumer after pushing, as thread_base::post() does.
+
+#ifndef LIBTORRENT_UTILS_TASK_QUEUE_H
+#define LIBTORRENT_UTILS_TASK_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <torrent/common.h>
+
+namespace torrent {
+
+class LIBTORRENT_EXPORT task_queue {
+public:
+  task_queue() = default;
+  ~task_queue();
+  task_queue(const task_queue&) = delete;
+  task_queue& operator=(const task_queue&) = delete;
+
+  // Only reliable when called by the consumer.
+  bool                empty() const { return m_tail->next.load(std::memory_order_acquire) == nullptr; }
+
+  template <typename Func>
+  void                push(Func&& func);
+
+  // Runs queued tasks, including those pushed by the tasks, until the
+  // queue is empty or 'max_tasks' have run. Returns the number run.
+  unsigned int        process(unsigned int max_tasks = ~0u);
+
+  // Destroys queued tasks without running them.
+  void                clear();
+
+private:
+  struct node {
+    std::atomic<node*> next{nullptr};
+    void               (*call)(node*, bool run){nullptr};
+  };
+
+  template <typename Func>
+  struct task_node : public node {
+    template <typename Arg>
+    task_node(Arg&& arg) : func(std::forward<Arg>(arg)) {}
+
+    Func func;
+  };
+
+  template <typename Func>
+  static void         call_task(node* n, bool run);
+
+  node*               pop();
+
+  node                m_stub;
+
+  std::atomic<node*>  m_head{&m_stub};
+  node*               m_tail{&m_stub};
+};
+
+template <typename Func>
+inline void
+task_queue::push(Func&& func) {
+  typedef task_node<std::decay_t<Func>> node_type;
+
+  static_assert(alignof(node_type) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "task_queue does not support over-aligned tasks");
+
+  void* storage = ::operator new(sizeof(node_type));
+  node* n;
+
+  try {
+    n = new (storage) node_type(std::forward<Func>(func));
+  } catch (...) {
+    ::operator delete(storage);
+    throw;
+  }
+
+  n->call = &call_task<std::decay_t<Func>>;
+
+  node* prev = m_head.exchange(n, std::memory_order_acq_rel);
+  prev->next.store(n, std::memory_order_release);
+}
+
+// The task is destroyed after the call, but the node is kept as the
+// queue's stub until the next pop.
+template <typename Func>
+inline void
+task_queue::call_task(node* n, bool run) {
+  struct guard_type {
+    Func& func;
+    ~guard_type() { func.~Func(); }
+  } guard{static_cast<task_node<Func>*>(n)->func};
+
+  if (run)
+    guard.func();
+}
+
+inline task_queue::node*
+task_queue::pop() {
+  node* tail = m_tail;
+  node* next = tail->next.load(std::memory_order_acquire);
+
+  if (next == nullptr)
+    return nullptr;
+
+  m_tail = next;
+
+  if (tail != &m_stub)
+    ::operator delete(tail);
+
+  return next;
+}
+
+inline unsigned int
+task_queue::process(unsigned int max_tasks) {
+  unsigned int count = 0;
+  node* n;
+
+  while (count != max_tasks && (n = pop()) != nullptr) {
+    count++;
+    n->call(n, true);
+  }
+
+  return count;
+}
+
+inline void
+task_queue::clear() {
+  node* n;
+
+  while ((n = pop()) != nullptr)
+    n->call(n, false);
+}
+
+inline
+task_queue::~task_queue() {
+  clear();
+
+  if (m_tail != &m_stub)
+    ::operator delete(m_tail);
+}
+
+}
+
+#endif
@@ -35,6 +35,23 @@ thread_base::thread_base() :
 
 thread_base::~thread_base() = default;
 
+void
+thread_base::acquire_global_lock_contended() {
+  instrumentation_update(INSTRUMENTATION_POLLING_GLOBAL_LOCK_CONTENDED, 1);
+
+  m_global.waiting++;
+  m_global.mutex.lock();
+  m_global.waiting--;
+}
+
+void
+thread_base::waive_global_lock() {
+  instrumentation_update(INSTRUMENTATION_POLLING_GLOBAL_LOCK_WAIVED, 1);
+
+  release_global_lock();
+  acquire_global_lock();
+}
+
 void
 thread_base::start_thread() {
   if (m_poll == nullptr)
@@ -111,9 +128,14 @@ thread_base::event_loop(thread_base* thread) {
 
       thread->call_events();
       thread->signal_bitfield()->work();
+      thread->m_task_queue.process();
 
       thread->m_flags |= flag_polling;
 
+      // Pairs with the fence in post(), either we see the pushed task
+      // below or the poster sees flag_polling and pokes us.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
       // Call again after setting flag_polling to ensure we process
       // any events set while it was working.
       if (thread->m_slot_do_work)
@@ -121,6 +143,7 @@ thread_base::event_loop(thread_base* thread) {
 
       thread->call_events();
       thread->signal_bitfield()->work();
+      thread->m_task_queue.process();
 
       uint64_t next_timeout = 0;
 
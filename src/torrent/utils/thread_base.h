@@ -9,6 +9,7 @@
 
 #include <torrent/common.h>
 #include <torrent/utils/signal_bitfield.h>
+#include <torrent/utils/task_queue.h>
 
 namespace torrent {
 
@@ -21,6 +22,7 @@ public:
   typedef std::function<void ()>     slot_void;
   typedef std::function<uint64_t ()> slot_timer;
   typedef class signal_bitfield      signal_bitfield_t;
+  typedef class task_queue           task_queue_t;
 
   enum state_type {
     STATE_UNKNOWN,
@@ -57,6 +59,7 @@ public:
 
   Poll*               poll()            { return m_poll; }
   signal_bitfield_t*  signal_bitfield() { return &m_signal_bitfield; }
+  task_queue_t*       task_queue()      { return &m_task_queue; }
   pthread_t           pthread()         { return m_thread; }
 
   virtual void        init_thread() = 0;
@@ -68,15 +71,21 @@ public:
   void                interrupt();
   void                send_event_signal(unsigned int index, bool interrupt = true);
 
+  // Runs 'func' in this thread's event loop, may be called from any
+  // thread.
+  template <typename Func>
+  void                post(Func&& func);
+
   slot_void&          slot_do_work()      { return m_slot_do_work; }
   slot_timer&         slot_next_timeout() { return m_slot_next_timeout; }
 
+  // Number of threads blocked on the global lock.
   static inline int   global_queue_size() { return m_global.waiting; }
 
   static inline void  acquire_global_lock();
   static inline bool  trylock_global_lock();
   static inline void  release_global_lock();
-  static inline void  waive_global_lock();
+  static void         waive_global_lock();
 
   static bool         should_handle_sigusr1();
 
@@ -91,6 +100,8 @@ protected:
   virtual void        call_events() = 0;
   virtual int64_t     next_timeout_usec() = 0;
 
+  static void         acquire_global_lock_contended();
+
   static global_lock_type m_global;
 
   pthread_t               m_thread;
@@ -101,6 +112,7 @@ protected:
 
   Poll*               m_poll;
   signal_bitfield_t   m_signal_bitfield;
+  task_queue_t        m_task_queue;
 
   slot_void           m_slot_do_work;
   slot_timer          m_slot_next_timeout;
@@ -127,11 +139,22 @@ thread_base::send_event_signal(unsigned int index, bool do_interrupt) {
     interrupt();
 }
 
+template <typename Func>
+inline void
+thread_base::post(Func&& func) {
+  m_task_queue.push(std::forward<Func>(func));
+
+  // The push is a release store, which may otherwise be reordered
+  // after the load of flag_polling in interrupt().
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  interrupt();
+}
+
+// Only touch the waiting count when the lock is contended.
 inline void
 thread_base::acquire_global_lock() {
-  thread_base::m_global.waiting++;
-  thread_base::m_global.mutex.lock();
-  thread_base::m_global.waiting--;
+  if (!thread_base::m_global.mutex.try_lock())
+    acquire_global_lock_contended();
 }
 
 inline bool
@@ -144,12 +167,6 @@ thread_base::release_global_lock() {
   thread_base::m_global.mutex.unlock();
 }
 
-inline void
-thread_base::waive_global_lock() {
-  release_global_lock();
-  acquire_global_lock();
-}
-
 }
 
 #endif
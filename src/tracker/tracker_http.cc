@@ -15,6 +15,7 @@
 #include "torrent/http.h"
 #include "torrent/net/utils.h"
 #include "torrent/net/socket_address.h"
+#include "torrent/object_raw_bencode.h"
 #include "torrent/object_stream.h"
 #include "torrent/tracker_list.h"
 #include "torrent/utils/log.h"
@@ -22,6 +23,8 @@
 
 #include "globals.h"
 #include "manager.h"
+#include "tracker/tracker_http_buffer.h"
+#include "tracker/tracker_scrape_queue.h"
 
 // TODO: Update this to use the new logging system, dump the full request url.
 
@@ -58,13 +61,16 @@ TrackerHttp::TrackerHttp(TrackerList* parent, const std::string& url, int flags)
 }
 
 TrackerHttp::~TrackerHttp() {
+  if (m_scrape_queued)
+    manager->tracker_scrape_queue()->erase(this);
+
   delete m_get;
   delete m_data;
 }
 
 bool
 TrackerHttp::is_busy() const {
-  return m_data != NULL;
+  return m_data != NULL || m_scrape_queued;
 }
 
 void
@@ -152,7 +158,7 @@ TrackerHttp::send_event(TrackerState::event_enum new_state) {
     break;
   }
 
-  m_data = new std::stringstream();
+  m_data = new TrackerHttpBuffer();
 
   std::string request_url = s.str();
 
@@ -168,34 +174,30 @@ TrackerHttp::send_event(TrackerState::event_enum new_state) {
   m_get->start();
 }
 
+// Scrapes are sent through the session's scrape queue, which combines
+// the info hashes of all downloads using the same scrape url.
 void
 TrackerHttp::send_scrape() {
-  if (m_data != NULL)
+  if (is_busy())
     return;
 
   set_latest_event(TrackerState::EVENT_SCRAPE);
 
-  std::stringstream s;
-  s.imbue(std::locale::classic());
-
-  request_prefix(&s, scrape_url_from(m_url));
-
-  m_data = new std::stringstream();
-
-  std::string request_url = s.str();
+  std::string scrape_url = scrape_url_from(m_url);
+  scrape_url += m_dropDeliminator ? '&' : '?';
 
-  LT_LOG_TRACKER_DUMP(DEBUG, request_url.c_str(), request_url.size(), "Tracker HTTP scrape.", 0);
+  LT_LOG_TRACKER(DEBUG, "Tracker HTTP scrape queued: url:%s.", scrape_url.c_str());
 
-  m_get->set_url(request_url);
-  m_get->set_stream(m_data);
-  m_get->set_timeout(2 * 60);
-
-  m_get->start();
+  m_scrape_queued = true;
+  manager->tracker_scrape_queue()->insert(TrackerScrapeQueue::request_type{
+      this, scrape_url, m_parent->info()->hash(),
+      std::bind(&TrackerHttp::receive_scrape_success, this, std::placeholders::_1),
+      std::bind(&TrackerHttp::receive_scrape_failed, this, std::placeholders::_1) });
 }
 
 void
 TrackerHttp::close() {
-  if (m_data == NULL)
+  if (!is_busy())
     return;
 
   LT_LOG_TRACKER(DEBUG, "Tracker HTTP request cancelled: state:%s url:%s.",
@@ -206,6 +208,12 @@ TrackerHttp::close() {
 
 void
 TrackerHttp::disown() {
+  // Nothing depends on the reply to a scrape, so just drop it.
+  if (m_scrape_queued) {
+    manager->tracker_scrape_queue()->erase(this);
+    m_scrape_queued = false;
+  }
+
   if (m_data == NULL)
     return;
 
@@ -229,6 +237,11 @@ TrackerHttp::type() const {
 
 void
 TrackerHttp::close_directly() {
+  if (m_scrape_queued) {
+    manager->tracker_scrape_queue()->erase(this);
+    m_scrape_queued = false;
+  }
+
   if (m_data == NULL)
     return;
 
@@ -239,35 +252,71 @@ TrackerHttp::close_directly() {
   m_data = NULL;
 }
 
+// Reads the top level of the reply directly from the buffer. The peer
+// lists are left as raw bencode pointing into the buffer, so large
+// replies don't build an Object for each peer or copy the compact
+// strings.
+static void
+read_reply(const char* first, const char* last, Object* object, raw_bencode* peers, raw_bencode* peers6) {
+  if (first == last || *first++ != 'd')
+    throw bencode_error("Invalid bencode data.");
+
+  while (first != last && *first != 'e') {
+    raw_string key = object_read_bencode_c_string(first, last);
+    first = key.end();
+
+    if (raw_bencode_equal_c_str(key, "peers") || raw_bencode_equal_c_str(key, "peers6")) {
+      const char* value = first;
+      first = object_read_bencode_skip_c(first, last);
+
+      *(key.size() == 5 ? peers : peers6) = raw_bencode(value, std::distance(value, first));
+      continue;
+    }
+
+    first = object_read_bencode_c(first, last, &object->insert_key(key.as_string(), Object()));
+  }
+
+  if (first == last)
+    throw bencode_error("Invalid bencode data.");
+}
+
 void
 TrackerHttp::receive_done() {
   if (m_data == NULL)
     throw internal_error("TrackerHttp::receive_done() called on an invalid object");
 
-  if (lt_log_is_valid(LOG_TRACKER_DEBUG)) {
-    std::string dump = m_data->str();
-    LT_LOG_TRACKER_DUMP(DEBUG, dump.c_str(), dump.size(), "Tracker HTTP reply.", 0);
-  }
-
-  Object b;
-  *m_data >> b;
+  if (lt_log_is_valid(LOG_TRACKER_DEBUG))
+    LT_LOG_TRACKER_DUMP(DEBUG, m_data->data(), m_data->size(), "Tracker HTTP reply.", 0);
 
   // Temporarily reset the interval
   //
   // TODO: This might be causing an issue with too frequent tracker requests.
   clear_intervals();
 
-  if (m_data->fail()) {
-    std::string dump = m_data->str();
-    return receive_failed("Could not parse bencoded data: " + rak::sanitize(rak::striptags(dump)).substr(0,99));
-  }
+  Object b = Object::create_map();
+  raw_bencode peers;
+  raw_bencode peers6;
 
-  if (!b.is_map())
-    return receive_failed("Root not a bencoded map");
+  try {
+    read_reply(m_data->data(), m_data->end(), &b, &peers, &peers6);
+
+  } catch (bencode_error& e) {
+    bool is_bencode = m_data->size() != 0;
+
+    try {
+      is_bencode = is_bencode && object_read_bencode_skip_c(m_data->data(), m_data->end()) != NULL;
+    } catch (bencode_error& e) {
+      is_bencode = false;
+    }
+
+    if (is_bencode)
+      return receive_failed("Root not a bencoded map");
+
+    return receive_failed("Could not parse bencoded data: " + rak::sanitize(rak::striptags(m_data->str())).substr(0,99));
+  }
 
   if (b.has_key("failure reason")) {
-    if (state().latest_event() != TrackerState::EVENT_SCRAPE)
-      process_failure(b);
+    process_failure(b);
 
     return receive_failed("Failure reason \"" +
                          (b.get_key("failure reason").is_string() ?
@@ -277,11 +326,7 @@ TrackerHttp::receive_done() {
   }
 
   // If no failures, set intervals to defaults prior to processing
-
-  if (state().latest_event() == TrackerState::EVENT_SCRAPE)
-    process_scrape(b);
-  else
-    process_success(b);
+  process_success(b, peers, peers6);
 }
 
 void
@@ -292,17 +337,11 @@ TrackerHttp::receive_signal_failed(std::string msg) {
 
 void
 TrackerHttp::receive_failed(std::string msg) {
-  if (lt_log_is_valid(LOG_TRACKER_DEBUG)) {
-    std::string dump = m_data->str();
-    LT_LOG_TRACKER_DUMP(DEBUG, dump.c_str(), dump.size(), "Tracker HTTP failed.", 0);
-  }
+  if (lt_log_is_valid(LOG_TRACKER_DEBUG))
+    LT_LOG_TRACKER_DUMP(DEBUG, m_data->data(), m_data->size(), "Tracker HTTP failed.", 0);
 
   close_directly();
-
-  if (state().latest_event() == TrackerState::EVENT_SCRAPE)
-    m_parent->receive_scrape_failed(this, msg);
-  else
-    m_parent->receive_failed(this, msg);
+  m_parent->receive_failed(this, msg);
 }
 
 void
@@ -331,7 +370,7 @@ TrackerHttp::process_failure(const Object& object) {
 }
 
 void
-TrackerHttp::process_success(const Object& object) {
+TrackerHttp::process_success(const Object& object, raw_bencode peers, raw_bencode peers6) {
   if (object.has_key_string("tracker id"))
     update_tracker_id(object.get_key_string("tracker id"));
 
@@ -358,45 +397,35 @@ TrackerHttp::process_success(const Object& object) {
 
   set_state(tracker_state);
 
-  if (!object.has_key("peers") && !object.has_key("peers6"))
+  if (peers.is_empty() && peers6.is_empty())
     return receive_failed("No peers returned");
 
   AddressList l;
 
-  if (object.has_key("peers")) {
-    try {
-      // Due to some trackers sending the wrong type when no peers are
-      // available, don't bork on it.
-      if (object.get_key("peers").is_string())
-        l.parse_address_compact(object.get_key_string("peers"));
-
-      else if (object.get_key("peers").is_list())
-        l.parse_address_normal(object.get_key_list("peers"));
+  try {
+    // Due to some trackers sending the wrong type when no peers are
+    // available, don't bork on it.
+    if (!peers.is_empty() && peers.data()[0] >= '0' && peers.data()[0] <= '9') {
+      l.parse_address_compact(peers.as_raw_string());
 
-    } catch (bencode_error& e) {
-      return receive_failed(e.what());
+    } else if (!peers.is_empty() && peers.data()[0] == 'l') {
+      l.parse_address_normal(peers.as_raw_list());
     }
+
+  } catch (bencode_error& e) {
+    return receive_failed(e.what());
   }
 
-  if (object.has_key_string("peers6"))
-    l.parse_address_compact_ipv6(object.get_key_string("peers6"));
+  if (!peers6.is_empty() && peers6.data()[0] >= '0' && peers6.data()[0] <= '9')
+    l.parse_address_compact_ipv6(peers6.as_raw_string());
 
   close_directly();
   m_parent->receive_success(this, &l);
 }
 
 void
-TrackerHttp::process_scrape(const Object& object) {
-  if (!object.has_key_map("files"))
-    return receive_failed("Tracker scrape does not have files entry.");
-
-  // Add better validation here...
-  const Object& files = object.get_key("files");
-
-  if (!files.has_key_map(m_parent->info()->hash().str()))
-    return receive_failed("Tracker scrape replay did not contain infohash.");
-
-  const Object& stats = files.get_key(m_parent->info()->hash().str());
+TrackerHttp::receive_scrape_success(const Object& stats) {
+  m_scrape_queued = false;
 
   auto tracker_state = state();
 
@@ -411,11 +440,19 @@ TrackerHttp::process_scrape(const Object& object) {
 
   set_state(tracker_state);
 
-  LT_LOG_TRACKER(INFO, "Tracker scrape for %u torrents: complete:%u incomplete:%u downloaded:%u.",
-                 files.as_map().size(), tracker_state.m_scrape_complete, tracker_state.m_scrape_incomplete, tracker_state.m_scrape_downloaded);
+  LT_LOG_TRACKER(INFO, "Tracker scrape: complete:%u incomplete:%u downloaded:%u.",
+                 tracker_state.m_scrape_complete, tracker_state.m_scrape_incomplete, tracker_state.m_scrape_downloaded);
 
-  close_directly();
   m_parent->receive_scrape_success(this);
 }
 
+void
+TrackerHttp::receive_scrape_failed(const std::string& msg) {
+  m_scrape_queued = false;
+
+  LT_LOG_TRACKER(DEBUG, "Tracker HTTP scrape failed: %s", msg.c_str());
+
+  m_parent->receive_scrape_failed(this, msg);
+}
+
 }
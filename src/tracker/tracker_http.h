@@ -9,6 +9,7 @@
 namespace torrent {
 
 class Http;
+class TrackerHttpBuffer;
 
 class TrackerHttp : public Tracker {
 public:
@@ -34,13 +35,15 @@ private:
   void                receive_failed(std::string msg);
 
   void                process_failure(const Object& object);
-  void                process_success(const Object& object);
-  void                process_scrape(const Object& object);
+  void                process_success(const Object& object, raw_bencode peers, raw_bencode peers6);
+  void                receive_scrape_success(const Object& stats);
+  void                receive_scrape_failed(const std::string& msg);
 
   Http*               m_get;
-  std::stringstream*  m_data;
+  TrackerHttpBuffer*  m_data;
 
   bool                m_dropDeliminator;
+  bool                m_scrape_queued{false};
 };
 
 }
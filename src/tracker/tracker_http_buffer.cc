@@ -0,0 +1,59 @@
+#include "config.h"
+
+#include "tracker_http_buffer.h"
+
+namespace torrent {
+
+static std::vector<TrackerHttpBuffer::storage_type> tracker_http_buffer_pool;
+
+TrackerHttpBuffer::TrackerHttpBuffer() :
+  std::iostream(nullptr) {
+
+  if (!tracker_http_buffer_pool.empty()) {
+    m_buffer.storage.swap(tracker_http_buffer_pool.back());
+    tracker_http_buffer_pool.pop_back();
+  } else {
+    m_buffer.storage.reserve(initial_capacity);
+  }
+
+  rdbuf(&m_buffer);
+}
+
+TrackerHttpBuffer::~TrackerHttpBuffer() {
+  // Drop buffers grown by unusually large replies rather than keeping
+  // them around.
+  if (tracker_http_buffer_pool.size() >= max_pooled || m_buffer.storage.capacity() > max_pooled_capacity)
+    return;
+
+  m_buffer.storage.clear();
+
+  tracker_http_buffer_pool.emplace_back();
+  tracker_http_buffer_pool.back().swap(m_buffer.storage);
+}
+
+size_t
+TrackerHttpBuffer::size_pool() {
+  return tracker_http_buffer_pool.size();
+}
+
+void
+TrackerHttpBuffer::clear_pool() {
+  tracker_http_buffer_pool.clear();
+}
+
+TrackerHttpBuffer::buffer_type::int_type
+TrackerHttpBuffer::buffer_type::overflow(int_type c) {
+  if (traits_type::eq_int_type(c, traits_type::eof()))
+    return traits_type::not_eof(c);
+
+  storage.push_back(traits_type::to_char_type(c));
+  return c;
+}
+
+std::streamsize
+TrackerHttpBuffer::buffer_type::xsputn(const char* s, std::streamsize n) {
+  storage.insert(storage.end(), s, s + n);
+  return n;
+}
+
+}
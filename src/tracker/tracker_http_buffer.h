@@ -0,0 +1,56 @@
+#ifndef LIBTORRENT_TRACKER_TRACKER_HTTP_BUFFER_H
+#define LIBTORRENT_TRACKER_TRACKER_HTTP_BUFFER_H
+
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace torrent {
+
+// Output stream for tracker HTTP replies that keeps the body in one
+// contiguous buffer, so it can be parsed in place by the C-buffer
+// bencode readers.
+//
+// The storage is taken from a small pool shared by all trackers and
+// returned to it on destruction, so announces don't grow a new buffer
+// for every reply. Only used from the main thread.
+
+class TrackerHttpBuffer : public std::iostream {
+public:
+  typedef std::vector<char> storage_type;
+
+  static const size_t initial_capacity = 16 << 10;
+  static const size_t max_pooled_capacity = 1 << 20;
+  static const size_t max_pooled = 32;
+
+  TrackerHttpBuffer();
+  ~TrackerHttpBuffer();
+  TrackerHttpBuffer(const TrackerHttpBuffer&) = delete;
+  TrackerHttpBuffer& operator=(const TrackerHttpBuffer&) = delete;
+
+  const char*         data() const              { return m_buffer.storage.data(); }
+  const char*         end() const               { return m_buffer.storage.data() + m_buffer.storage.size(); }
+  size_t              size() const              { return m_buffer.storage.size(); }
+
+  std::string         str() const               { return std::string(data(), size()); }
+
+  static size_t       size_pool();
+  static void         clear_pool();
+
+private:
+  class buffer_type : public std::streambuf {
+  public:
+    storage_type storage;
+
+  protected:
+    int_type        overflow(int_type c);
+    std::streamsize xsputn(const char* s, std::streamsize n);
+  };
+
+  buffer_type         m_buffer;
+};
+
+}
+
+#endif
@@ -0,0 +1,214 @@
+#include "config.h"
+
+#include "tracker_scrape_queue.h"
+
+#include <algorithm>
+#include <rak/string_manip.h>
+
+#include "globals.h"
+#include "torrent/exceptions.h"
+#include "torrent/http.h"
+#include "torrent/object.h"
+#include "torrent/object_stream.h"
+#include "torrent/utils/log.h"
+#include "tracker/tracker_http_buffer.h"
+
+#define LT_LOG(log_fmt, ...)                                            \
+  lt_log_print_subsystem(LOG_TRACKER_DEBUG, "tracker_scrape_queue", log_fmt, __VA_ARGS__);
+
+namespace torrent {
+
+TrackerScrapeQueue::TrackerScrapeQueue() {
+  m_task_flush.slot() = std::bind(&TrackerScrapeQueue::flush, this);
+}
+
+TrackerScrapeQueue::~TrackerScrapeQueue() {
+  clear();
+}
+
+void
+TrackerScrapeQueue::insert(request_type request) {
+  if (request.owner == NULL || m_owners.find(request.owner) != m_owners.end())
+    throw internal_error("TrackerScrapeQueue::insert(...) owner is invalid or already queued.");
+
+  auto pending_itr = m_pending.find(request.url);
+
+  if (pending_itr == m_pending.end()) {
+    m_batches.push_back(batch_type{ request.url, {}, NULL, NULL });
+    pending_itr = m_pending.emplace(request.url, std::prev(m_batches.end())).first;
+  }
+
+  auto batch_itr = pending_itr->second;
+
+  m_owners.emplace(request.owner, batch_itr);
+  batch_itr->requests.push_back(std::move(request));
+
+  // Full batches stay queued, new requests start another batch.
+  if (batch_itr->requests.size() >= max_hashes)
+    m_pending.erase(pending_itr);
+
+  if (!m_task_flush.is_queued())
+    priority_queue_insert(&taskScheduler, &m_task_flush, (cachedTime + rak::timer::from_seconds(batch_delay)).round_seconds());
+}
+
+void
+TrackerScrapeQueue::erase(const void* owner) {
+  auto owner_itr = m_owners.find(owner);
+
+  if (owner_itr == m_owners.end())
+    return;
+
+  auto batch_itr = owner_itr->second;
+  auto& requests = batch_itr->requests;
+
+  m_owners.erase(owner_itr);
+  requests.erase(std::find_if(requests.begin(), requests.end(), [owner](const request_type& r) { return r.owner == owner; }));
+
+  if (!requests.empty())
+    return;
+
+  auto pending_itr = m_pending.find(batch_itr->url);
+
+  if (pending_itr != m_pending.end() && pending_itr->second == batch_itr)
+    m_pending.erase(pending_itr);
+
+  close_batch(batch_itr);
+  m_batches.erase(batch_itr);
+}
+
+// Starting a request may fail synchronously, and the slots of the
+// failed batch may erase or insert other requests. Look up the next
+// unsent batch again after each start rather than holding on to an
+// iterator.
+void
+TrackerScrapeQueue::flush() {
+  priority_queue_erase(&taskScheduler, &m_task_flush);
+
+  auto unsent = [](const batch_type& batch) { return batch.http == NULL; };
+
+  for (auto itr = std::find_if(m_batches.begin(), m_batches.end(), unsent);
+       itr != m_batches.end();
+       itr = std::find_if(m_batches.begin(), m_batches.end(), unsent)) {
+    auto pending_itr = m_pending.find(itr->url);
+
+    if (pending_itr != m_pending.end() && pending_itr->second == itr)
+      m_pending.erase(pending_itr);
+
+    std::string url = itr->url;
+
+    for (const auto& request : itr->requests) {
+      char hash[61];
+      *rak::copy_escape_html(request.hash.begin(), request.hash.end(), hash) = '\0';
+
+      url += (&request == &itr->requests.front() ? "info_hash=" : "&info_hash=");
+      url += hash;
+    }
+
+    LT_LOG("sending scrape (hashes:%u url:%s)", (unsigned int)itr->requests.size(), itr->url.c_str());
+
+    itr->data = new TrackerHttpBuffer();
+    itr->http = Http::slot_factory()();
+
+    itr->http->set_url(url);
+    itr->http->set_stream(itr->data);
+    itr->http->set_timeout(2 * 60);
+
+    // The Http object deletes itself and the stream once the reply
+    // has been processed by the slots below.
+    itr->http->set_delete_self();
+    itr->http->set_delete_stream();
+
+    itr->http->signal_done().emplace_back(std::bind(&TrackerScrapeQueue::receive_done, this, itr));
+    itr->http->signal_failed().emplace_back(std::bind(&TrackerScrapeQueue::receive_failed, this, itr, std::placeholders::_1));
+
+    itr->http->start();
+  }
+}
+
+void
+TrackerScrapeQueue::clear() {
+  priority_queue_erase(&taskScheduler, &m_task_flush);
+
+  for (auto itr = m_batches.begin(); itr != m_batches.end(); itr++)
+    close_batch(itr);
+
+  m_batches.clear();
+  m_pending.clear();
+  m_owners.clear();
+}
+
+// Only called for batches that are not currently calling their
+// signals, as those are removed from 'm_batches' first.
+void
+TrackerScrapeQueue::close_batch(batch_list::iterator itr) {
+  if (itr->http == NULL)
+    return;
+
+  itr->http->close();
+  delete itr->http;
+  delete itr->data;
+
+  itr->http = NULL;
+  itr->data = NULL;
+}
+
+TrackerScrapeQueue::batch_type
+TrackerScrapeQueue::take_batch(batch_list::iterator itr) {
+  batch_type batch = std::move(*itr);
+
+  for (const auto& request : batch.requests)
+    m_owners.erase(request.owner);
+
+  m_batches.erase(itr);
+  return batch;
+}
+
+void
+TrackerScrapeQueue::receive_done(batch_list::iterator itr) {
+  batch_type batch = take_batch(itr);
+
+  Object root;
+  std::string failure;
+
+  try {
+    object_read_bencode_c(batch.data->data(), batch.data->end(), &root);
+  } catch (bencode_error& e) {
+    root.clear();
+  }
+
+  if (root.is_empty())
+    failure = "Could not parse bencoded data: " + rak::sanitize(rak::striptags(batch.data->str())).substr(0,99);
+  else if (!root.is_map())
+    failure = "Root not a bencoded map";
+  else if (root.has_key("failure reason"))
+    failure = "Failure reason \"" + (root.get_key("failure reason").is_string() ?
+                                      root.get_key_string("failure reason") :
+                                      std::string("failure reason not a string")) + "\"";
+  else if (!root.has_key_map("files"))
+    failure = "Tracker scrape does not have files entry.";
+
+  LT_LOG("received scrape (hashes:%u url:%s failure:'%s')",
+         (unsigned int)batch.requests.size(), batch.url.c_str(), failure.c_str());
+
+  for (auto& request : batch.requests) {
+    if (!failure.empty())
+      request.failed(failure);
+    else if (!root.get_key("files").has_key_map(request.hash.str()))
+      request.failed("Tracker scrape reply did not contain infohash.");
+    else
+      request.success(root.get_key("files").get_key(request.hash.str()));
+  }
+}
+
+void
+TrackerScrapeQueue::receive_failed(batch_list::iterator itr, const std::string& msg) {
+  batch_type batch = take_batch(itr);
+
+  LT_LOG("scrape failed (hashes:%u url:%s msg:'%s')",
+         (unsigned int)batch.requests.size(), batch.url.c_str(), msg.c_str());
+
+  for (auto& request : batch.requests)
+    request.failed(msg);
+}
+
+}
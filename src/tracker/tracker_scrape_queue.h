@@ -0,0 +1,95 @@
+#ifndef LIBTORRENT_TRACKER_TRACKER_SCRAPE_QUEUE_H
+#define LIBTORRENT_TRACKER_TRACKER_SCRAPE_QUEUE_H
+
+#include <functional>
+#include <list>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <rak/priority_queue_default.h>
+
+#include "torrent/hash_string.h"
+
+namespace torrent {
+
+class Http;
+class Object;
+class TrackerHttpBuffer;
+
+// Collects HTTP scrape requests from the trackers of all downloads and
+// sends them as multi-hash scrapes, one request for up to
+// 'max_hashes' info hashes per scrape url. Requests are held for
+// 'batch_delay' seconds so scrapes from downloads started together
+// end up in the same request.
+//
+// Each request is answered by exactly one call to either its
+// 'slot_success', with the stats entry of its info hash, or its
+// 'slot_failed'. Requests are removed before the slot is called, so
+// the slot may insert a new request for the same owner.
+
+class TrackerScrapeQueue {
+public:
+  typedef std::function<void (const Object&)>       slot_success;
+  typedef std::function<void (const std::string&)>  slot_failed;
+
+  // Keeps the request url well below the length most servers accept.
+  static const unsigned int max_hashes = 64;
+  static const int32_t      batch_delay = 5;
+
+  struct request_type {
+    const void*  owner;
+    std::string  url;
+    HashString   hash;
+    slot_success success;
+    slot_failed  failed;
+  };
+
+  TrackerScrapeQueue();
+  ~TrackerScrapeQueue();
+  TrackerScrapeQueue(const TrackerScrapeQueue&) = delete;
+  TrackerScrapeQueue& operator=(const TrackerScrapeQueue&) = delete;
+
+  bool                empty() const                     { return m_owners.empty(); }
+  size_t              size() const                      { return m_owners.size(); }
+  size_t              size_batches() const              { return m_batches.size(); }
+
+  bool                is_queued(const void* owner) const { return m_owners.find(owner) != m_owners.end(); }
+
+  // The url is the scrape url, the info_hash parameters are appended
+  // to it as is.
+  void                insert(request_type request);
+  void                erase(const void* owner);
+
+  // Sends all batches that are still waiting.
+  void                flush();
+  void                clear();
+
+private:
+  struct batch_type {
+    std::string               url;
+    std::vector<request_type> requests;
+    Http*                     http;
+    TrackerHttpBuffer*        data;
+  };
+
+  typedef std::list<batch_type>                                   batch_list;
+  typedef std::map<std::string, batch_list::iterator>             pending_map;
+  typedef std::unordered_map<const void*, batch_list::iterator>   owner_map;
+
+  void                close_batch(batch_list::iterator itr);
+  batch_type          take_batch(batch_list::iterator itr);
+
+  void                receive_done(batch_list::iterator itr);
+  void                receive_failed(batch_list::iterator itr, const std::string& msg);
+
+  batch_list          m_batches;
+  pending_map         m_pending;
+  owner_map           m_owners;
+
+  rak::priority_item  m_task_flush;
+};
+
+}
+
+#endif
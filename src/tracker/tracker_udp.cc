@@ -4,7 +4,9 @@
 
 #include <sys/types.h>
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 
 #include "rak/error_number.h"
 
@@ -12,13 +14,13 @@
 #include "torrent/exceptions.h"
 #include "torrent/connection_manager.h"
 #include "torrent/download_info.h"
-#include "torrent/poll.h"
 #include "torrent/tracker_list.h"
 #include "torrent/utils/log.h"
 #include "torrent/utils/option_strings.h"
 #include "torrent/utils/uri_parser.h"
 
 #include "tracker_udp.h"
+#include "tracker_udp_router.h"
 #include "manager.h"
 
 #define LT_LOG_TRACKER(log_level, log_fmt, ...)                         \
@@ -46,7 +48,7 @@ TrackerUdp::~TrackerUdp() {
 
 bool
 TrackerUdp::is_busy() const {
-  return get_fd().is_valid();
+  return m_endpoint != NULL;
 }
 
 void
@@ -114,32 +116,57 @@ TrackerUdp::start_announce(const sockaddr* sa, [[maybe_unused]] int err) {
   if (!m_connectAddress.is_valid())
     return receive_failed("invalid tracker address");
 
-  // TODO: Make each of these a separate error... at the very least separate open and bind.
-  if (!get_fd().open_datagram() || !get_fd().set_nonblock())
-    return receive_failed("could not open UDP socket");
-
   auto bind_address = rak::socket_address::cast_from(manager->connection_manager()->bind_address());
+  auto router = manager->tracker_udp_router();
+
+  m_endpoint = router->acquire(*bind_address);
 
-  if (bind_address->is_bindable() && !get_fd().bind(*bind_address))
-    return receive_failed("failed to bind socket to udp address '" + bind_address->pretty_address_str() + "' with error '" + rak::error_number::current().c_str() + "'");
+  if (m_endpoint == NULL) {
+    if (bind_address->is_bindable())
+      return receive_failed("failed to bind socket to udp address '" + bind_address->pretty_address_str() + "' with error '" + rak::error_number::current().c_str() + "'");
+    else
+      return receive_failed("could not open UDP socket");
+  }
 
   m_readBuffer = new ReadBuffer;
   m_writeBuffer = new WriteBuffer;
 
-  prepare_connect_input();
+  m_cached_connection_id = router->find_connection_id(m_connectAddress, &m_connectionId);
+
+  if (m_cached_connection_id)
+    prepare_announce_input();
+  else
+    prepare_connect_input();
 
-  manager->poll()->open(this);
-  manager->poll()->insert_read(this);
-  manager->poll()->insert_write(this);
-  manager->poll()->insert_error(this);
+  send_request();
 
   m_tries = m_parent->info()->udp_tries();
   priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(m_parent->info()->udp_timeout())).round_seconds());
 }
 
+uint32_t
+TrackerUdp::next_transaction() {
+  if (m_transactionId != 0)
+    m_endpoint->erase_transaction(m_transactionId);
+
+  return m_transactionId = m_endpoint->insert_transaction(m_connectAddress,
+                                                          std::bind(&TrackerUdp::receive_datagram,
+                                                                    this,
+                                                                    std::placeholders::_1,
+                                                                    std::placeholders::_2));
+}
+
+void
+TrackerUdp::send_request() {
+  if (m_writeBuffer->size_end() == 0)
+    throw internal_error("TrackerUdp::send_request() called but the write buffer is empty.");
+
+  m_endpoint->send(m_transactionId, reinterpret_cast<const char*>(m_writeBuffer->begin()), m_writeBuffer->size_end());
+}
+
 void
 TrackerUdp::close() {
-  if (!get_fd().is_valid())
+  if (m_endpoint == NULL)
     return;
 
   LT_LOG_TRACKER(DEBUG, "request cancelled (state:%s url:%s)",
@@ -150,7 +177,7 @@ TrackerUdp::close() {
 
 void
 TrackerUdp::disown() {
-  if (!get_fd().is_valid())
+  if (m_endpoint == NULL)
     return;
 
   LT_LOG_TRACKER(DEBUG, "request disowned (state:%s url:%s)",
@@ -161,7 +188,7 @@ TrackerUdp::disown() {
 
 void
 TrackerUdp::close_directly() {
-  if (!get_fd().is_valid())
+  if (m_endpoint == NULL)
     return;
 
   delete m_readBuffer;
@@ -172,13 +199,13 @@ TrackerUdp::close_directly() {
 
   priority_queue_erase(&taskScheduler, &m_taskTimeout);
 
-  manager->poll()->remove_read(this);
-  manager->poll()->remove_write(this);
-  manager->poll()->remove_error(this);
-  manager->poll()->close(this);
+  if (m_transactionId != 0)
+    m_endpoint->erase_transaction(m_transactionId);
+
+  manager->tracker_udp_router()->release(m_endpoint);
 
-  get_fd().close();
-  get_fd().clear();
+  m_endpoint = NULL;
+  m_transactionId = 0;
 }
 
 tracker_enum
@@ -197,35 +224,35 @@ TrackerUdp::receive_timeout() {
   if (m_taskTimeout.is_queued())
     throw internal_error("TrackerUdp::receive_timeout() called but m_taskTimeout is still scheduled.");
 
-  if (--m_tries == 0) {
-    receive_failed("unable to connect to UDP tracker");
-  } else {
-    priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(m_parent->info()->udp_timeout())).round_seconds());
+  // A cached connection id may have expired on the tracker's side,
+  // which then silently drops the announce, so retry with a connect.
+  if (m_cached_connection_id) {
+    manager->tracker_udp_router()->erase_connection_id(m_connectAddress);
+    m_cached_connection_id = false;
 
-    manager->poll()->insert_write(this);
+    prepare_connect_input();
+
+  } else if (--m_tries == 0) {
+    return receive_failed("unable to connect to UDP tracker");
   }
+
+  priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(m_parent->info()->udp_timeout())).round_seconds());
+  send_request();
 }
 
 void
-TrackerUdp::event_read() {
-  rak::socket_address sa;
-
-  int s = read_datagram(m_readBuffer->begin(), m_readBuffer->reserved(), &sa);
-
-  if (s < 0)
-    return;
+TrackerUdp::receive_datagram(const char* data, unsigned int length) {
+  length = std::min<unsigned int>(length, m_readBuffer->reserved());
 
+  std::memcpy(m_readBuffer->begin(), data, length);
   m_readBuffer->reset_position();
-  m_readBuffer->set_end(s);
+  m_readBuffer->set_end(length);
 
-  LT_LOG_TRACKER_DUMP(DEBUG, (const char*)m_readBuffer->begin(), s, "received reply", 0);
+  LT_LOG_TRACKER_DUMP(DEBUG, (const char*)m_readBuffer->begin(), length, "received reply", 0);
 
-  if (s < 4)
+  if (length < 4)
     return;
 
-  // Make sure sa is from the source we expected?
-
-  // Do something with the content here.
   switch (m_readBuffer->read_32()) {
   case 0:
     if (m_action != 0 || !process_connect_output())
@@ -236,7 +263,7 @@ TrackerUdp::event_read() {
     priority_queue_update(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(m_parent->info()->udp_timeout())).round_seconds());
 
     m_tries = m_parent->info()->udp_tries();
-    manager->poll()->insert_write(this);
+    send_request();
     return;
 
   case 1:
@@ -256,26 +283,12 @@ TrackerUdp::event_read() {
   };
 }
 
-void
-TrackerUdp::event_write() {
-  if (m_writeBuffer->size_end() == 0)
-    throw internal_error("TrackerUdp::write() called but the write buffer is empty.");
-
-  [[maybe_unused]] int s = write_datagram(m_writeBuffer->begin(), m_writeBuffer->size_end(), &m_connectAddress);
-
-  manager->poll()->remove_write(this);
-}
-
-void
-TrackerUdp::event_error() {
-}
-
 void
 TrackerUdp::prepare_connect_input() {
   m_writeBuffer->reset();
   m_writeBuffer->write_64(m_connectionId = magic_connection_id);
   m_writeBuffer->write_32(m_action = 0);
-  m_writeBuffer->write_32(m_transactionId = random());
+  m_writeBuffer->write_32(next_transaction());
 
   LT_LOG_TRACKER_DUMP(DEBUG, m_writeBuffer->begin(), m_writeBuffer->size_end(),
                       "prepare connect (id:%" PRIx32 ")", m_transactionId);
@@ -289,7 +302,7 @@ TrackerUdp::prepare_announce_input() {
 
   m_writeBuffer->write_64(m_connectionId);
   m_writeBuffer->write_32(m_action = 1);
-  m_writeBuffer->write_32(m_transactionId = random());
+  m_writeBuffer->write_32(next_transaction());
 
   m_writeBuffer->write_range(info->hash().begin(), info->hash().end());
   m_writeBuffer->write_range(info->local_id().begin(), info->local_id().end());
@@ -331,6 +344,7 @@ TrackerUdp::process_connect_output() {
     return false;
 
   m_connectionId = m_readBuffer->read_64();
+  manager->tracker_udp_router()->insert_connection_id(m_connectAddress, m_connectionId);
 
   return true;
 }
@@ -372,6 +386,10 @@ TrackerUdp::process_error_output() {
       m_readBuffer->read_32() != m_transactionId)
     return false;
 
+  // The tracker may have rejected our connection id, make sure the
+  // next request connects again.
+  manager->tracker_udp_router()->erase_connection_id(m_connectAddress);
+
   receive_failed("received error message: " + std::string(m_readBuffer->position(), m_readBuffer->end()));
   return true;
 }
@@ -5,7 +5,6 @@
 #include <rak/socket_address.h>
 
 #include "net/protocol_buffer.h"
-#include "net/socket_datagram.h"
 #include "torrent/connection_manager.h"
 #include "torrent/tracker.h"
 
@@ -13,11 +12,13 @@
 
 namespace torrent {
 
-class TrackerUdp : public SocketDatagram, public Tracker {
+class TrackerUdpEndpoint;
+
+class TrackerUdp : public Tracker {
 public:
   typedef std::array<char, 1024> hostname_type;
 
-  typedef ProtocolBuffer<512> ReadBuffer;
+  typedef ProtocolBuffer<2048> ReadBuffer;
   typedef ProtocolBuffer<512> WriteBuffer;
 
   typedef ConnectionManager::slot_resolver_result_type resolver_type;
@@ -38,18 +39,18 @@ public:
 
   virtual tracker_enum type() const;
 
-  virtual void        event_read();
-  virtual void        event_write();
-  virtual void        event_error();
-
 private:
   void                close_directly();
 
+  void                receive_datagram(const char* data, unsigned int length);
   void                receive_failed(const std::string& msg);
   void                receive_timeout();
 
   void                start_announce(const sockaddr* sa, int err);
 
+  uint32_t            next_transaction();
+  void                send_request();
+
   void                prepare_connect_input();
   void                prepare_announce_input();
 
@@ -67,9 +68,15 @@ private:
 
   resolver_type*      m_slot_resolver{nullptr};
 
+  TrackerUdpEndpoint* m_endpoint{nullptr};
+
   uint32_t            m_action;
   uint64_t            m_connectionId;
-  uint32_t            m_transactionId;
+  uint32_t            m_transactionId{0};
+
+  // The connection id came from the router's cache rather than a
+  // connect reply during this request.
+  bool                m_cached_connection_id{false};
 
   ReadBuffer*         m_readBuffer{nullptr};
   WriteBuffer*        m_writeBuffer{nullptr};
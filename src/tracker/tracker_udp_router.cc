@@ -0,0 +1,349 @@
+#include "config.h"
+
+#include "tracker_udp_router.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <arpa/inet.h>
+
+#include "globals.h"
+#include "manager.h"
+#include "torrent/exceptions.h"
+#include "torrent/poll.h"
+#include "torrent/utils/log.h"
+
+#define LT_LOG(log_fmt, ...)                                            \
+  lt_log_print_subsystem(LOG_TRACKER_DEBUG, "tracker_udp_router", log_fmt, __VA_ARGS__);
+
+namespace torrent {
+
+// Replies from IPv4 trackers arrive as v4-mapped addresses on dual
+// stack sockets.
+static rak::socket_address
+normalize_address(const rak::socket_address& address) {
+  if (address.family() == rak::socket_address::af_inet6)
+    return address.sa_inet6()->normalize_address();
+
+  return address;
+}
+
+static uint32_t
+read_32_n(const char* data) {
+  uint32_t value;
+  std::memcpy(&value, data, sizeof(uint32_t));
+  return ntohl(value);
+}
+
+TrackerUdpEndpoint::TrackerUdpEndpoint(Poll* poll) :
+  m_poll(poll) {
+
+  m_task_send.slot() = std::bind(&TrackerUdpEndpoint::receive_send_budget, this);
+}
+
+TrackerUdpEndpoint::~TrackerUdpEndpoint() {
+  close();
+}
+
+bool
+TrackerUdpEndpoint::open(const rak::socket_address& bind_address) {
+  if (get_fd().is_valid())
+    throw internal_error("TrackerUdpEndpoint::open() called on an open endpoint.");
+
+  if (!get_fd().open_datagram())
+    return false;
+
+  if (!get_fd().set_nonblock() ||
+      (bind_address.is_bindable() && !get_fd().bind(bind_address))) {
+    int error = errno;
+    get_fd().close();
+    get_fd().clear();
+    errno = error;
+    return false;
+  }
+
+  if (m_poll != NULL) {
+    m_poll->open(this);
+    m_poll->insert_read(this);
+    m_poll->insert_error(this);
+  }
+
+  return true;
+}
+
+void
+TrackerUdpEndpoint::close() {
+  priority_queue_erase(&taskScheduler, &m_task_send);
+
+  m_transactions.clear();
+  m_queue.clear();
+
+  if (!get_fd().is_valid())
+    return;
+
+  if (m_poll != NULL) {
+    m_poll->remove_read(this);
+    m_poll->remove_write(this);
+    m_poll->remove_error(this);
+    m_poll->close(this);
+  }
+
+  get_fd().close();
+  get_fd().clear();
+}
+
+uint32_t
+TrackerUdpEndpoint::insert_transaction(const rak::socket_address& address, slot_receive slot) {
+  uint32_t id;
+
+  do {
+    id = ::random();
+  } while (id == 0 || m_transactions.find(id) != m_transactions.end());
+
+  m_transactions.emplace(id, transaction_type{ normalize_address(address), std::move(slot) });
+  return id;
+}
+
+void
+TrackerUdpEndpoint::erase_transaction(uint32_t id) {
+  m_transactions.erase(id);
+  erase_queued(id);
+}
+
+void
+TrackerUdpEndpoint::erase_queued(uint32_t id) {
+  m_queue.erase(std::remove_if(m_queue.begin(), m_queue.end(), [id](const packet_type& p) { return p.id == id; }),
+                m_queue.end());
+}
+
+void
+TrackerUdpEndpoint::send(uint32_t id, const char* data, unsigned int length) {
+  auto itr = m_transactions.find(id);
+
+  if (itr == m_transactions.end())
+    throw internal_error("TrackerUdpEndpoint::send(...) transaction not found.");
+
+  if (length == 0 || length > max_datagram_size)
+    throw internal_error("TrackerUdpEndpoint::send(...) invalid datagram length.");
+
+  erase_queued(id);
+  m_queue.push_back(packet_type{ id, itr->second.address, std::string(data, length) });
+
+  if (m_poll != NULL && !m_task_send.is_queued())
+    m_poll->insert_write(this);
+}
+
+void
+TrackerUdpEndpoint::receive_datagram(const char* data, unsigned int length, const rak::socket_address& address) {
+  // Both replies and errors start with the action and transaction id.
+  if (length < 8)
+    return;
+
+  auto itr = m_transactions.find(read_32_n(data + 4));
+
+  if (itr == m_transactions.end()) {
+    LT_LOG("dropped reply with unknown transaction (address:%s)", address.pretty_address_str().c_str());
+    return;
+  }
+
+  if (!(normalize_address(address) == itr->second.address)) {
+    LT_LOG("dropped reply from unexpected address (address:%s)", address.pretty_address_str().c_str());
+    return;
+  }
+
+  // The slot may erase the transaction, so don't use 'itr' after
+  // the call.
+  slot_receive slot = itr->second.slot;
+  slot(data, length);
+}
+
+// Stops after 'max_reads_per_event' datagrams so other sockets get
+// their turn, then inserts read interest again so that the event is
+// called on the next poll even when the socket is edge-triggered.
+void
+TrackerUdpEndpoint::event_read() {
+  char buffer[max_datagram_size];
+
+  for (unsigned int i = 0; i < max_reads_per_event; i++) {
+    if (!get_fd().is_valid())
+      return;
+
+    rak::socket_address address;
+    int length = read_datagram(buffer, max_datagram_size, &address);
+
+    if (length < 0)
+      return;
+
+    receive_datagram(buffer, length, address);
+  }
+
+  if (m_poll != NULL && get_fd().is_valid()) {
+    m_poll->remove_read(this);
+    m_poll->insert_read(this);
+  }
+}
+
+void
+TrackerUdpEndpoint::event_write() {
+  if (m_send_second != cachedTime.seconds()) {
+    m_send_second = cachedTime.seconds();
+    m_send_remaining = m_send_budget;
+  }
+
+  while (!m_queue.empty() && (m_send_budget == 0 || m_send_remaining != 0)) {
+    packet_type& packet = m_queue.front();
+
+    if (write_datagram(packet.data.data(), packet.data.size(), &packet.address) == -1 &&
+        (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+      return;
+
+    // Datagrams that fail for other reasons are dropped, the tracker
+    // will resend on timeout.
+    m_queue.pop_front();
+    m_send_remaining -= (m_send_remaining != 0);
+  }
+
+  if (m_poll != NULL)
+    m_poll->remove_write(this);
+
+  if (!m_queue.empty() && !m_task_send.is_queued())
+    priority_queue_insert(&taskScheduler, &m_task_send, (cachedTime + rak::timer::from_seconds(1)).round_seconds());
+}
+
+void
+TrackerUdpEndpoint::event_error() {
+}
+
+void
+TrackerUdpEndpoint::receive_send_budget() {
+  if (!m_queue.empty() && m_poll != NULL)
+    m_poll->insert_write(this);
+}
+
+TrackerUdpRouter::TrackerUdpRouter() {
+  m_task_idle.slot() = std::bind(&TrackerUdpRouter::receive_idle, this);
+}
+
+TrackerUdpRouter::~TrackerUdpRouter() {
+  clear();
+}
+
+void
+TrackerUdpRouter::set_send_budget(uint32_t budget) {
+  m_send_budget = budget;
+
+  for (auto& entry : m_endpoints)
+    entry.second.endpoint->set_send_budget(budget);
+}
+
+TrackerUdpEndpoint*
+TrackerUdpRouter::acquire(const rak::socket_address& bind_address) {
+  std::string key = bind_address.is_bindable() ? bind_address.pretty_address_str() : std::string();
+  auto itr = m_endpoints.find(key);
+
+  if (itr == m_endpoints.end()) {
+    std::unique_ptr<TrackerUdpEndpoint> endpoint(new TrackerUdpEndpoint(manager->poll()));
+
+    if (!endpoint->open(bind_address))
+      return NULL;
+
+    endpoint->set_send_budget(m_send_budget);
+
+    LT_LOG("opened endpoint (bind_address:%s)", key.empty() ? "any" : key.c_str());
+
+    itr = m_endpoints.emplace(key, endpoint_entry{ std::move(endpoint), 0, rak::timer() }).first;
+  }
+
+  itr->second.references++;
+  return itr->second.endpoint.get();
+}
+
+void
+TrackerUdpRouter::release(TrackerUdpEndpoint* endpoint) {
+  auto itr = std::find_if(m_endpoints.begin(), m_endpoints.end(), [endpoint](const endpoint_map::value_type& v) {
+      return v.second.endpoint.get() == endpoint;
+    });
+
+  if (itr == m_endpoints.end() || itr->second.references == 0)
+    throw internal_error("TrackerUdpRouter::release(...) endpoint not found.");
+
+  if (--itr->second.references != 0)
+    return;
+
+  itr->second.released = cachedTime;
+
+  if (!m_task_idle.is_queued())
+    priority_queue_insert(&taskScheduler, &m_task_idle, (cachedTime + rak::timer::from_seconds(idle_timeout)).round_seconds_ceiling());
+}
+
+bool
+TrackerUdpRouter::find_connection_id(const rak::socket_address& address, uint64_t* id) {
+  auto itr = m_connection_ids.find(normalize_address(address));
+
+  if (itr == m_connection_ids.end())
+    return false;
+
+  if (itr->second.second <= cachedTime) {
+    m_connection_ids.erase(itr);
+    return false;
+  }
+
+  *id = itr->second.first;
+  return true;
+}
+
+void
+TrackerUdpRouter::insert_connection_id(const rak::socket_address& address, uint64_t id) {
+  m_connection_ids[normalize_address(address)] = std::make_pair(id, cachedTime + rak::timer::from_seconds(connection_id_lifetime));
+}
+
+void
+TrackerUdpRouter::erase_connection_id(const rak::socket_address& address) {
+  m_connection_ids.erase(normalize_address(address));
+}
+
+void
+TrackerUdpRouter::clear() {
+  priority_queue_erase(&taskScheduler, &m_task_idle);
+
+  m_endpoints.clear();
+  m_connection_ids.clear();
+}
+
+void
+TrackerUdpRouter::receive_idle() {
+  rak::timer next_idle = cachedTime + rak::timer::from_seconds(idle_timeout);
+  bool has_idle = false;
+
+  for (auto itr = m_endpoints.begin(); itr != m_endpoints.end(); ) {
+    rak::timer expires = itr->second.released + rak::timer::from_seconds(idle_timeout);
+
+    if (itr->second.references != 0) {
+      itr++;
+
+    } else if (expires <= cachedTime) {
+      LT_LOG("closing idle endpoint (bind_address:%s)", itr->first.empty() ? "any" : itr->first.c_str());
+      itr = m_endpoints.erase(itr);
+
+    } else {
+      // Released after the task was queued, check again when it
+      // has been idle long enough.
+      next_idle = std::min(next_idle, expires);
+      has_idle = true;
+      itr++;
+    }
+  }
+
+  for (auto itr = m_connection_ids.begin(); itr != m_connection_ids.end(); ) {
+    if (itr->second.second <= cachedTime)
+      itr = m_connection_ids.erase(itr);
+    else
+      itr++;
+  }
+
+  if (has_idle || !m_connection_ids.empty())
+    priority_queue_insert(&taskScheduler, &m_task_idle, next_idle.round_seconds_ceiling());
+}
+
+}
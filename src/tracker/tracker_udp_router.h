@@ -0,0 +1,153 @@
+#ifndef LIBTORRENT_TRACKER_TRACKER_UDP_ROUTER_H
+#define LIBTORRENT_TRACKER_TRACKER_UDP_ROUTER_H
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <rak/priority_queue_default.h>
+#include <rak/socket_address.h>
+
+#include "net/socket_datagram.h"
+
+namespace torrent {
+
+class Poll;
+
+// A UDP socket shared by all UDP trackers using the same bind
+// address. Requests register a transaction and replies are routed
+// back to them by the transaction id, after checking that the reply
+// came from the address the request was sent to.
+//
+// Outgoing datagrams are queued and at most 'send_budget()' are sent
+// each second, zero meaning unlimited.
+
+class TrackerUdpEndpoint : public SocketDatagram {
+public:
+  typedef std::function<void (const char*, unsigned int)> slot_receive;
+
+  static const unsigned int max_datagram_size = 2048;
+  static const unsigned int max_reads_per_event = 32;
+
+  TrackerUdpEndpoint(Poll* poll);
+  ~TrackerUdpEndpoint();
+
+  const char*         type_name() const { return "tracker_udp_endpoint"; }
+
+  bool                open(const rak::socket_address& bind_address);
+  void                close();
+
+  bool                is_idle() const                   { return m_transactions.empty(); }
+
+  size_t              size_transactions() const         { return m_transactions.size(); }
+  size_t              size_queued() const               { return m_queue.size(); }
+
+  uint32_t            send_budget() const               { return m_send_budget; }
+  void                set_send_budget(uint32_t budget)  { m_send_budget = budget; }
+
+  // Returns a non-zero transaction id unique to this endpoint.
+  uint32_t            insert_transaction(const rak::socket_address& address, slot_receive slot);
+  void                erase_transaction(uint32_t id);
+
+  // Replaces any datagram of the transaction that is still queued.
+  void                send(uint32_t id, const char* data, unsigned int length);
+
+  void                receive_datagram(const char* data, unsigned int length, const rak::socket_address& address);
+
+  virtual void        event_read();
+  virtual void        event_write();
+  virtual void        event_error();
+
+private:
+  struct transaction_type {
+    rak::socket_address address;
+    slot_receive        slot;
+  };
+
+  struct packet_type {
+    uint32_t            id;
+    rak::socket_address address;
+    std::string         data;
+  };
+
+  typedef std::unordered_map<uint32_t, transaction_type> transaction_map;
+  typedef std::deque<packet_type>                        packet_queue;
+
+  void                erase_queued(uint32_t id);
+  void                receive_send_budget();
+
+  Poll*               m_poll;
+
+  transaction_map     m_transactions;
+  packet_queue        m_queue;
+
+  uint32_t            m_send_budget{0};
+  uint32_t            m_send_remaining{0};
+  int32_t             m_send_second{-1};
+
+  rak::priority_item  m_task_send;
+};
+
+// Owns the shared endpoints and caches the connection id of each
+// tracker address for the time BEP 15 allows clients to reuse it, so
+// announces to a tracker we recently talked to skip the connect round
+// trip.
+//
+// Endpoints no longer used by any tracker are closed once they have
+// been unused for 'idle_timeout' seconds, rather than when released,
+// as the last transaction is usually released from within the
+// endpoint's own read event.
+
+class TrackerUdpRouter {
+public:
+  static const int32_t  connection_id_lifetime = 60;
+  static const int32_t  idle_timeout = 60;
+  static const uint32_t default_send_budget = 100;
+
+  TrackerUdpRouter();
+  ~TrackerUdpRouter();
+  TrackerUdpRouter(const TrackerUdpRouter&) = delete;
+  TrackerUdpRouter& operator=(const TrackerUdpRouter&) = delete;
+
+  size_t              size_endpoints() const            { return m_endpoints.size(); }
+  size_t              size_connection_ids() const       { return m_connection_ids.size(); }
+
+  uint32_t            send_budget() const               { return m_send_budget; }
+  void                set_send_budget(uint32_t budget);
+
+  // Returns NULL and leaves errno set if the socket could not be
+  // opened or bound.
+  TrackerUdpEndpoint* acquire(const rak::socket_address& bind_address);
+  void                release(TrackerUdpEndpoint* endpoint);
+
+  bool                find_connection_id(const rak::socket_address& address, uint64_t* id);
+  void                insert_connection_id(const rak::socket_address& address, uint64_t id);
+  void                erase_connection_id(const rak::socket_address& address);
+
+  void                clear();
+
+private:
+  struct endpoint_entry {
+    std::unique_ptr<TrackerUdpEndpoint> endpoint;
+    uint32_t                            references{0};
+    rak::timer                          released{};
+  };
+
+  typedef std::map<std::string, endpoint_entry>                              endpoint_map;
+  typedef std::map<rak::socket_address, std::pair<uint64_t, rak::timer>>     connection_id_map;
+
+  void                receive_idle();
+
+  endpoint_map        m_endpoints;
+  connection_id_map   m_connection_ids;
+
+  uint32_t            m_send_budget{default_send_budget};
+
+  rak::priority_item  m_task_idle;
+};
+
+}
+
+#endif
@@ -18,12 +18,20 @@ instrumentation_fetch_and_clear(instrumentation_enum type) {
 void
 instrumentation_tick() {
   lt_log_print(LOG_INSTRUMENTATION_MEMORY,
-               "%" PRIi64 " %" PRIi64 " %" PRIi64  " %" PRIi64 " %" PRIi64,
+               "%" PRIi64 " %" PRIi64 " %" PRIi64  " %" PRIi64 " %" PRIi64
+               " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64,
                instrumentation_values[INSTRUMENTATION_MEMORY_CHUNK_USAGE].load(),
                instrumentation_values[INSTRUMENTATION_MEMORY_CHUNK_COUNT].load(),
                instrumentation_values[INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE].load(),
                instrumentation_values[INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT].load(),
-               instrumentation_values[INSTRUMENTATION_MEMORY_BITFIELDS].load());
+               instrumentation_values[INSTRUMENTATION_MEMORY_BITFIELDS].load(),
+
+               instrumentation_values[INSTRUMENTATION_MEMORY_WRITE_CACHE_USAGE].load(),
+               instrumentation_fetch_and_clear(INSTRUMENTATION_MEMORY_WRITE_CACHE_REUSED),
+               instrumentation_fetch_and_clear(INSTRUMENTATION_MEMORY_WRITE_CACHE_FULL),
+
+               instrumentation_fetch_and_clear(INSTRUMENTATION_MEMORY_HASHING_INLINE_BYTES),
+               instrumentation_fetch_and_clear(INSTRUMENTATION_MEMORY_HASHING_QUEUED_BYTES));
 
   lt_log_print(LOG_INSTRUMENTATION_MINCORE,
                "%"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
@@ -47,7 +55,8 @@ instrumentation_tick() {
   lt_log_print(LOG_INSTRUMENTATION_POLLING,
                "%"  PRIi64 " %" PRIi64
                " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
-               " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64,
+               " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
+               " %"  PRIi64 " %" PRIi64 " %" PRIi64,
                instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_INTERRUPT_POKE),
                instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_INTERRUPT_READ_EVENT),
 
@@ -59,7 +68,24 @@ instrumentation_tick() {
                instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS),
                instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_MAIN),
                instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_DISK),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_OTHERS));
+               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_OTHERS),
+
+               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EPOLL_CTL),
+
+               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_GLOBAL_LOCK_CONTENDED),
+               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_GLOBAL_LOCK_WAIVED));
+
+  lt_log_print(LOG_INSTRUMENTATION_POOLS,
+               "%"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
+               " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64,
+               instrumentation_values[INSTRUMENTATION_POOL_BLOCK_TRANSFER].load(),
+               instrumentation_values[INSTRUMENTATION_POOL_BLOCK_TRANSFER_PEAK].load(),
+               instrumentation_values[INSTRUMENTATION_POOL_HANDSHAKE].load(),
+               instrumentation_values[INSTRUMENTATION_POOL_HANDSHAKE_PEAK].load(),
+               instrumentation_values[INSTRUMENTATION_POOL_PEER_CONNECTION].load(),
+               instrumentation_values[INSTRUMENTATION_POOL_PEER_CONNECTION_PEAK].load(),
+               instrumentation_values[INSTRUMENTATION_POOL_PEER_INFO].load(),
+               instrumentation_values[INSTRUMENTATION_POOL_PEER_INFO_PEAK].load());
 
   lt_log_print(LOG_INSTRUMENTATION_TRANSFERS,
                "%"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
@@ -67,7 +93,8 @@ instrumentation_tick() {
                " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
                " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
                " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
-               " %" PRIi64,
+               " %" PRIi64
+               " %"  PRIi64 " %" PRIi64 " %" PRIi64,
 
                instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_DELEGATED),
                instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_DOWNLOADING),
@@ -96,11 +123,25 @@ instrumentation_tick() {
                instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_REMOVED),
                instrumentation_values[INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_TOTAL].load(),
 
-               instrumentation_values[INSTRUMENTATION_TRANSFER_PEER_INFO_UNACCOUNTED].load());
+               instrumentation_values[INSTRUMENTATION_TRANSFER_PEER_INFO_UNACCOUNTED].load(),
+
+               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_DUPLICATED),
+               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_CANCELED),
+               instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_DUPLICATE_BYTES_WASTED));
+
+  lt_log_print(LOG_INSTRUMENTATION_PROTOCOL,
+               "%" PRIi64 " %" PRIi64,
+               instrumentation_fetch_and_clear(INSTRUMENTATION_PROTOCOL_HAVE_SENT),
+               instrumentation_fetch_and_clear(INSTRUMENTATION_PROTOCOL_HAVE_SUPPRESSED));
 }
 
 void
 instrumentation_reset() {
+  instrumentation_fetch_and_clear(INSTRUMENTATION_MEMORY_HASHING_INLINE_BYTES);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_MEMORY_HASHING_QUEUED_BYTES);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_MEMORY_WRITE_CACHE_REUSED);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_MEMORY_WRITE_CACHE_FULL);
+
   instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_INCORE_TOUCHED);
   instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_INCORE_NEW);
   instrumentation_fetch_and_clear(INSTRUMENTATION_MINCORE_NOT_INCORE_TOUCHED);
@@ -129,6 +170,11 @@ instrumentation_reset() {
   instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_DISK);
   instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_OTHERS);
 
+  instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EPOLL_CTL);
+
+  instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_GLOBAL_LOCK_CONTENDED);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_GLOBAL_LOCK_WAIVED);
+
   instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_DELEGATED);
   instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_DOWNLOADING);
   instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_FINISHED);
@@ -148,6 +194,13 @@ instrumentation_reset() {
   instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_ADDED);
   instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_MOVED);
   instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_REMOVED);
+
+  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_DUPLICATED);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_CANCELED);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_DUPLICATE_BYTES_WASTED);
+
+  instrumentation_fetch_and_clear(INSTRUMENTATION_PROTOCOL_HAVE_SENT);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_PROTOCOL_HAVE_SUPPRESSED);
 }
 
 }
@@ -16,6 +16,11 @@ enum instrumentation_enum {
   INSTRUMENTATION_MEMORY_CHUNK_COUNT,
   INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE,
   INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT,
+  INSTRUMENTATION_MEMORY_HASHING_INLINE_BYTES,
+  INSTRUMENTATION_MEMORY_HASHING_QUEUED_BYTES,
+  INSTRUMENTATION_MEMORY_WRITE_CACHE_USAGE,
+  INSTRUMENTATION_MEMORY_WRITE_CACHE_REUSED,
+  INSTRUMENTATION_MEMORY_WRITE_CACHE_FULL,
 
   INSTRUMENTATION_MINCORE_INCORE_TOUCHED,
   INSTRUMENTATION_MINCORE_INCORE_NEW,
@@ -43,6 +48,20 @@ enum instrumentation_enum {
   INSTRUMENTATION_POLLING_EVENTS_DISK,
   INSTRUMENTATION_POLLING_EVENTS_OTHERS,
 
+  INSTRUMENTATION_POLLING_EPOLL_CTL,
+
+  INSTRUMENTATION_POLLING_GLOBAL_LOCK_CONTENDED,
+  INSTRUMENTATION_POLLING_GLOBAL_LOCK_WAIVED,
+
+  INSTRUMENTATION_POOL_BLOCK_TRANSFER,
+  INSTRUMENTATION_POOL_BLOCK_TRANSFER_PEAK,
+  INSTRUMENTATION_POOL_HANDSHAKE,
+  INSTRUMENTATION_POOL_HANDSHAKE_PEAK,
+  INSTRUMENTATION_POOL_PEER_CONNECTION,
+  INSTRUMENTATION_POOL_PEER_CONNECTION_PEAK,
+  INSTRUMENTATION_POOL_PEER_INFO,
+  INSTRUMENTATION_POOL_PEER_INFO_PEAK,
+
   INSTRUMENTATION_TRANSFER_REQUESTS_DELEGATED,
   INSTRUMENTATION_TRANSFER_REQUESTS_DOWNLOADING,
   INSTRUMENTATION_TRANSFER_REQUESTS_FINISHED,
@@ -68,6 +87,13 @@ enum instrumentation_enum {
 
   INSTRUMENTATION_TRANSFER_PEER_INFO_UNACCOUNTED,
 
+  INSTRUMENTATION_TRANSFER_REQUESTS_DUPLICATED,
+  INSTRUMENTATION_TRANSFER_REQUESTS_CANCELED,
+  INSTRUMENTATION_TRANSFER_DUPLICATE_BYTES_WASTED,
+
+  INSTRUMENTATION_PROTOCOL_HAVE_SENT,
+  INSTRUMENTATION_PROTOCOL_HAVE_SUPPRESSED,
+
   INSTRUMENTATION_MAX_SIZE
 };
 
@@ -75,6 +101,7 @@ extern std::array<std::atomic_int64_t, INSTRUMENTATION_MAX_SIZE> instrumentation
 
 void instrumentation_initialize();
 void instrumentation_update(instrumentation_enum type, int64_t change);
+void instrumentation_update_peak(instrumentation_enum type, instrumentation_enum peak, int64_t change);
 void instrumentation_tick();
 void instrumentation_reset();
 
@@ -94,6 +121,18 @@ instrumentation_update(instrumentation_enum type, int64_t change) {
 #endif
 }
 
+// Adjusts a live count and raises 'peak' to the new value if higher.
+inline void
+instrumentation_update_peak(instrumentation_enum type, instrumentation_enum peak, int64_t change) {
+#ifdef LT_INSTRUMENTATION
+  int64_t value = instrumentation_values[type] += change;
+  int64_t current = instrumentation_values[peak].load();
+
+  while (value > current && !instrumentation_values[peak].compare_exchange_weak(current, value))
+    ;
+#endif
+}
+
 }
 
 #endif
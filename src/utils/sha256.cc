@@ -0,0 +1,196 @@
+#include "config.h"
+
+#include <algorithm>
+
+#include "sha256.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define LT_SHA256_X86_SHA 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace torrent {
+
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t
+sha256_rotr(uint32_t x, unsigned int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+static void
+sha256_transform_generic(uint32_t* state, const uint8_t* data, unsigned int blocks) {
+  for (; blocks != 0; blocks--, data += 64) {
+    uint32_t w[64];
+
+    for (int i = 0; i < 16; i++)
+      w[i] = (uint32_t)data[4 * i] << 24 | (uint32_t)data[4 * i + 1] << 16 | (uint32_t)data[4 * i + 2] << 8 | data[4 * i + 3];
+
+    for (int i = 16; i < 64; i++) {
+      uint32_t s0 = sha256_rotr(w[i - 15], 7) ^ sha256_rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = sha256_rotr(w[i - 2], 17) ^ sha256_rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i = 0; i < 64; i++) {
+      uint32_t s1 = sha256_rotr(e, 6) ^ sha256_rotr(e, 11) ^ sha256_rotr(e, 25);
+      uint32_t t1 = h + s1 + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+      uint32_t s0 = sha256_rotr(a, 2) ^ sha256_rotr(a, 13) ^ sha256_rotr(a, 22);
+      uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+  }
+}
+
+#ifdef LT_SHA256_X86_SHA
+
+// Each group of four rounds extends the message schedule from the
+// previous four groups using the SHA extension instructions.
+__attribute__((target("sha,sse4.1")))
+static void
+sha256_transform_x86_sha(uint32_t* state, const uint8_t* data, unsigned int blocks) {
+  const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+  __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xb1);
+  __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1b);
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+
+  state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+  for (; blocks != 0; blocks--, data += 64) {
+    __m128i abef_save = state0;
+    __m128i cdgh_save = state1;
+    __m128i msgs[4];
+
+    for (int i = 0; i < 16; i++) {
+      if (i < 4) {
+        msgs[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16 * i)), mask);
+      } else {
+        __m128i next = _mm_sha256msg1_epu32(msgs[i % 4], msgs[(i + 1) % 4]);
+
+        next = _mm_add_epi32(next, _mm_alignr_epi8(msgs[(i + 3) % 4], msgs[(i + 2) % 4], 4));
+        msgs[i % 4] = _mm_sha256msg2_epu32(next, msgs[(i + 3) % 4]);
+      }
+
+      __m128i msg = _mm_add_epi32(msgs[i % 4], _mm_loadu_si128((const __m128i*)&sha256_k[4 * i]));
+
+      state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+      state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+    }
+
+    state0 = _mm_add_epi32(state0, abef_save);
+    state1 = _mm_add_epi32(state1, cdgh_save);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1b);
+  state1 = _mm_shuffle_epi32(state1, 0xb1);
+  state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+  state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+  _mm_storeu_si128((__m128i*)&state[0], state0);
+  _mm_storeu_si128((__m128i*)&state[4], state1);
+}
+
+static bool
+sha256_has_x86_sha() {
+  unsigned int eax, ebx, ecx, edx;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3))
+    return false;
+
+  return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1 << 29));
+}
+
+#endif
+
+void
+Sha256Bundled::transform(const uint8_t* data, unsigned int blocks) {
+#ifdef LT_SHA256_X86_SHA
+  static const bool has_x86_sha = sha256_has_x86_sha();
+
+  if (has_x86_sha)
+    return sha256_transform_x86_sha(m_state, data, blocks);
+#endif
+
+  sha256_transform_generic(m_state, data, blocks);
+}
+
+void
+Sha256Bundled::init() {
+  static const uint32_t initial[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+
+  std::memcpy(m_state, initial, sizeof(m_state));
+  m_length = 0;
+}
+
+void
+Sha256Bundled::update(const void* data, unsigned int length) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  unsigned int used = m_length % 64;
+
+  m_length += length;
+
+  if (used != 0) {
+    unsigned int fill = std::min(length, 64 - used);
+
+    std::memcpy(m_buffer + used, bytes, fill);
+    bytes  += fill;
+    length -= fill;
+
+    if (used + fill < 64)
+      return;
+
+    transform(m_buffer, 1);
+  }
+
+  if (length >= 64) {
+    transform(bytes, length / 64);
+
+    bytes  += length & ~63u;
+    length &= 63;
+  }
+
+  std::memcpy(m_buffer, bytes, length);
+}
+
+void
+Sha256Bundled::final_c(char* buffer) {
+  uint64_t bits = m_length * 8;
+  uint8_t padding[72] = { 0x80 };
+  unsigned int pad_length = (m_length % 64 < 56 ? 56 : 120) - m_length % 64;
+
+  for (int i = 0; i < 8; i++)
+    padding[pad_length + i] = bits >> (56 - 8 * i);
+
+  update(padding, pad_length + 8);
+
+  for (int i = 0; i < 8; i++) {
+    buffer[4 * i]     = m_state[i] >> 24;
+    buffer[4 * i + 1] = m_state[i] >> 16;
+    buffer[4 * i + 2] = m_state[i] >> 8;
+    buffer[4 * i + 3] = m_state[i];
+  }
+}
+
+}
@@ -0,0 +1,91 @@
+// SHA-256 as used by BitTorrent v2 merkle trees.
+//
+// With OpenSSL the hashing is done by libcrypto, which already picks
+// the SHA extensions of the CPU when available. Otherwise the bundled
+// implementation in sha256.cc is used, which also uses the SHA
+// extensions on x86 CPUs that support them. The bundled one is built
+// in either case so the tests can check it against OpenSSL's.
+
+#ifndef LIBTORRENT_UTILS_SHA256_H
+#define LIBTORRENT_UTILS_SHA256_H
+
+#include <cinttypes>
+#include <cstring>
+
+#if defined USE_NSS_SHA
+#elif defined USE_OPENSSL_SHA
+#include <openssl/sha.h>
+#else
+#error "No SHA256 implementation selected, choose between the bundled one and OpenSSL."
+#endif
+
+namespace torrent {
+
+class Sha256Bundled {
+public:
+  static const unsigned int size_data = 32;
+
+  void                init();
+  void                update(const void* data, unsigned int length);
+
+  void                final_c(char* buffer);
+
+private:
+  void                transform(const uint8_t* data, unsigned int blocks);
+
+  uint32_t            m_state[8];
+  uint64_t            m_length;
+  uint8_t             m_buffer[64];
+};
+
+#if defined USE_NSS_SHA
+
+typedef Sha256Bundled Sha256;
+
+#elif defined USE_OPENSSL_SHA
+
+class Sha256 {
+public:
+  static const unsigned int size_data = 32;
+
+  void                init();
+  void                update(const void* data, unsigned int length);
+
+  void                final_c(char* buffer);
+
+private:
+  SHA256_CTX m_ctx;
+};
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+inline void
+Sha256::init() {
+  SHA256_Init(&m_ctx);
+}
+
+inline void
+Sha256::update(const void* data, unsigned int length) {
+  SHA256_Update(&m_ctx, data, length);
+}
+
+inline void
+Sha256::final_c(char* buffer) {
+  SHA256_Final((unsigned char*)buffer, &m_ctx);
+}
+#pragma GCC diagnostic pop
+
+#endif
+
+inline void
+sha256_hash(const void* data, unsigned int length, char* out) {
+  Sha256 sha256;
+
+  sha256.init();
+  sha256.update(data, length);
+  sha256.final_c(out);
+}
+
+}
+
+#endif
@@ -2,6 +2,10 @@
 
 #import "test_chunk_list.h"
 
+#import <fcntl.h>
+#import <unistd.h>
+
+#import "helpers/test_thread.h"
 #import "torrent/chunk_manager.h"
 #import "torrent/exceptions.h"
 
@@ -26,6 +30,34 @@ func_create_chunk(uint32_t index, int prot_flags) {
   return chunk;
 }
 
+static int      write_fd = -1;
+static uint32_t write_fail_index = ~uint32_t();
+
+torrent::Chunk*
+func_create_cached_chunk(uint32_t index, char* buffer) {
+  torrent::Chunk* chunk = new torrent::Chunk();
+  chunk->push_back(torrent::ChunkPart::MAPPED_CACHE,
+                   torrent::MemoryChunk(buffer, buffer, buffer + (1 << 16), torrent::MemoryChunk::prot_read | torrent::MemoryChunk::prot_write, torrent::MemoryChunk::map_anon));
+
+  return chunk;
+}
+
+// Writing to a directory fails with EBADF.
+bool
+func_create_chunk_writes(uint32_t index, torrent::chunk_read_list* parts) {
+  int fd = index == write_fail_index ? open("/", O_RDONLY) : dup(write_fd);
+
+  parts->push_back(torrent::chunk_read_part{ fd, (uint64_t)index << 16, 0, 1 << 16 });
+  return true;
+}
+
+static std::string
+read_file(uint64_t offset, uint32_t length) {
+  std::string result(length, '\0');
+  result.resize(std::max<ssize_t>(pread(write_fd, &result[0], length, offset), 0));
+  return result;
+}
+
 uint64_t
 func_free_diskspace(torrent::ChunkList* chunk_list) {
   return 0;
@@ -135,3 +167,179 @@ test_chunk_list::test_blocking() {
 
   CLEANUP_CHUNK_LIST();
 }
+
+// The threads are never started, their task queues are processed
+// manually to step through writes.
+#define SETUP_WRITE_CACHE()                                             \
+  test_thread thread_disk;                                              \
+  test_thread thread_owner;                                             \
+  std::vector<std::string> storage_errors;                              \
+  char path[] = "/tmp/test_chunk_list.XXXXXX";                          \
+  write_fd = mkstemp(path);                                             \
+  write_fail_index = ~uint32_t();                                       \
+  CPPUNIT_ASSERT(write_fd != -1);                                       \
+  unlink(path);                                                         \
+  chunk_list->slot_create_cached_chunk() = std::bind(&func_create_cached_chunk, std::placeholders::_1, std::placeholders::_2); \
+  chunk_list->slot_create_chunk_writes() = std::bind(&func_create_chunk_writes, std::placeholders::_1, std::placeholders::_2); \
+  chunk_list->slot_storage_error() = [&storage_errors](const std::string& msg) { storage_errors.push_back(msg); };
+
+#define CLEANUP_WRITE_CACHE()                   \
+  close(write_fd);                              \
+  write_fd = -1;
+
+static void
+process_writes(test_thread& thread_disk, test_thread& thread_owner) {
+  thread_disk.task_queue()->process();
+  thread_owner.task_queue()->process();
+}
+
+void
+test_chunk_list::test_write_cache() {
+  SETUP_CHUNK_LIST();
+  SETUP_WRITE_CACHE();
+
+  // Disabled by default.
+  torrent::ChunkHandle handle_0 = chunk_list->get(4, torrent::ChunkList::get_writable);
+  CPPUNIT_ASSERT(handle_0.is_valid() && !handle_0.object()->is_cached());
+  chunk_list->release(&handle_0);
+  chunk_list->sync_chunks(torrent::ChunkList::sync_all | torrent::ChunkList::sync_force);
+
+  chunk_list->set_threads(&thread_disk, &thread_owner);
+  chunk_manager->set_write_cache_max_memory(2 << 16);
+
+  // Chunks written through a mapping stay mapped, as a new buffer
+  // would not hold those writes.
+  handle_0 = chunk_list->get(4, torrent::ChunkList::get_writable);
+  CPPUNIT_ASSERT(handle_0.is_valid() && !handle_0.object()->is_cached());
+  chunk_list->release(&handle_0);
+  chunk_list->sync_chunks(torrent::ChunkList::sync_all | torrent::ChunkList::sync_force);
+
+  // Read-only chunks are never cached.
+  handle_0 = chunk_list->get(0);
+  CPPUNIT_ASSERT(handle_0.is_valid() && !handle_0.object()->is_cached());
+  chunk_list->release(&handle_0);
+
+  handle_0 = chunk_list->get(0, torrent::ChunkList::get_writable);
+  torrent::ChunkHandle handle_1 = chunk_list->get(1, torrent::ChunkList::get_writable);
+  torrent::ChunkHandle handle_2 = chunk_list->get(2, torrent::ChunkList::get_writable);
+
+  CPPUNIT_ASSERT(handle_0.is_valid() && handle_0.object()->is_cached());
+  CPPUNIT_ASSERT(handle_1.is_valid() && handle_1.object()->is_cached());
+  CPPUNIT_ASSERT(handle_2.is_valid() && !handle_2.object()->is_cached());
+  CPPUNIT_ASSERT(chunk_manager->write_cache_memory_usage() == (2 << 16));
+
+  CPPUNIT_ASSERT(handle_0.chunk()->from_buffer("xyz", 1, 3));
+  CPPUNIT_ASSERT(handle_1.chunk()->from_buffer("bbbb", 0, 4));
+
+  chunk_list->release(&handle_0);
+  chunk_list->release(&handle_1);
+  chunk_list->release(&handle_2);
+
+  CPPUNIT_ASSERT(chunk_list->sync_chunks(0) == 0);
+
+  // The writes hold the chunks until the disk thread is done.
+  CPPUNIT_ASSERT(chunk_list->writes_size() == 2);
+  CPPUNIT_ASSERT((*chunk_list)[0].is_valid() && (*chunk_list)[0].is_writing());
+  CPPUNIT_ASSERT(read_file(0, 4).empty());
+
+  process_writes(thread_disk, thread_owner);
+
+  CPPUNIT_ASSERT(chunk_list->writes_size() == 0);
+  CPPUNIT_ASSERT(read_file(0, 4) == std::string("\0xyz", 4));
+  CPPUNIT_ASSERT(read_file(1 << 16, 4) == "bbbb");
+  CPPUNIT_ASSERT(storage_errors.empty());
+
+  // The mapped chunk is only released after a second, safe sync.
+  CPPUNIT_ASSERT(chunk_list->queue_size() == 1);
+  CPPUNIT_ASSERT(!(*chunk_list)[0].is_valid() && !(*chunk_list)[0].is_cached());
+  CPPUNIT_ASSERT(!(*chunk_list)[1].is_valid() && !(*chunk_list)[1].is_cached());
+
+  // Released buffers are kept for reuse within the budget, and are
+  // cleared before being reused.
+  CPPUNIT_ASSERT(chunk_manager->write_cache_memory_usage() == (2 << 16));
+
+  handle_0 = chunk_list->get(3, torrent::ChunkList::get_writable);
+  CPPUNIT_ASSERT(handle_0.is_valid() && handle_0.object()->is_cached());
+  CPPUNIT_ASSERT(handle_0.chunk()->compare_buffer(std::string(1 << 16, '\0').c_str(), 0, 1 << 16));
+  CPPUNIT_ASSERT(chunk_manager->write_cache_memory_usage() == (2 << 16));
+
+  chunk_list->release(&handle_0);
+  chunk_list->sync_chunks(torrent::ChunkList::sync_all | torrent::ChunkList::sync_force);
+  process_writes(thread_disk, thread_owner);
+
+  CPPUNIT_ASSERT(chunk_list->queue_size() == 0 && chunk_list->writes_size() == 0);
+
+  // Written chunks are mapped when acquired again.
+  handle_0 = chunk_list->get(0, torrent::ChunkList::get_writable);
+  CPPUNIT_ASSERT(handle_0.is_valid() && !handle_0.object()->is_cached());
+  chunk_list->release(&handle_0);
+  chunk_list->sync_chunks(torrent::ChunkList::sync_all | torrent::ChunkList::sync_force);
+
+  chunk_manager->set_write_cache_max_memory(0);
+  CPPUNIT_ASSERT(chunk_manager->write_cache_memory_usage() == 0);
+
+  CLEANUP_WRITE_CACHE();
+  CLEANUP_CHUNK_LIST();
+}
+
+void
+test_chunk_list::test_write_cache_flush() {
+  SETUP_CHUNK_LIST();
+  SETUP_WRITE_CACHE();
+
+  chunk_list->set_threads(&thread_disk, &thread_owner);
+  chunk_manager->set_write_cache_max_memory(2 << 16);
+
+  // Changes made during a write queue the chunk again.
+  torrent::ChunkHandle handle_0 = chunk_list->get(0, torrent::ChunkList::get_writable);
+  CPPUNIT_ASSERT(handle_0.is_valid() && handle_0.object()->is_cached());
+  CPPUNIT_ASSERT(handle_0.chunk()->from_buffer("old", 0, 3));
+  chunk_list->release(&handle_0);
+  chunk_list->sync_chunks(torrent::ChunkList::sync_all | torrent::ChunkList::sync_force);
+
+  handle_0 = chunk_list->get(0, torrent::ChunkList::get_writable);
+  CPPUNIT_ASSERT(handle_0.is_valid() && handle_0.object()->is_writing());
+  CPPUNIT_ASSERT(handle_0.chunk()->from_buffer("new", 0, 3));
+  chunk_list->release(&handle_0);
+
+  process_writes(thread_disk, thread_owner);
+
+  CPPUNIT_ASSERT(chunk_list->queue_size() == 1 && chunk_list->writes_size() == 0);
+  CPPUNIT_ASSERT((*chunk_list)[0].is_valid() && (*chunk_list)[0].is_cached());
+
+  // Failed writes keep the chunk queued and are reported.
+  write_fail_index = 0;
+  chunk_list->sync_chunks(torrent::ChunkList::sync_all | torrent::ChunkList::sync_force);
+  process_writes(thread_disk, thread_owner);
+
+  CPPUNIT_ASSERT(storage_errors.size() == 1);
+  CPPUNIT_ASSERT(chunk_list->queue_size() == 1 && (*chunk_list)[0].is_valid());
+
+  // Cached chunks must be flushed before clearing.
+  CPPUNIT_ASSERT_THROW(chunk_list->clear(), torrent::internal_error);
+
+  // Flushing runs the writes the disk thread has not started, and
+  // returns the chunks that could not be written.
+  torrent::ChunkHandle handle_1 = chunk_list->get(1, torrent::ChunkList::get_writable);
+  CPPUNIT_ASSERT(handle_1.is_valid() && handle_1.object()->is_cached());
+  CPPUNIT_ASSERT(handle_1.chunk()->from_buffer("one", 0, 3));
+  chunk_list->release(&handle_1);
+  chunk_list->sync_chunks(torrent::ChunkList::sync_all | torrent::ChunkList::sync_force);
+
+  CPPUNIT_ASSERT(chunk_list->writes_size() == 2 && chunk_list->queue_size() == 0);
+  CPPUNIT_ASSERT(chunk_list->flush() == std::vector<uint32_t>{ 0 });
+
+  CPPUNIT_ASSERT(chunk_list->queue_size() == 0 && chunk_list->writes_size() == 0);
+  CPPUNIT_ASSERT(!(*chunk_list)[0].is_valid() && !(*chunk_list)[1].is_valid());
+  CPPUNIT_ASSERT(read_file(1 << 16, 3) == "one");
+  CPPUNIT_ASSERT(read_file(0, 3) == "new");
+
+  // The disk thread skips the write taken over by the flush.
+  process_writes(thread_disk, thread_owner);
+  CPPUNIT_ASSERT(storage_errors.size() == 1);
+
+  chunk_manager->set_write_cache_max_memory(0);
+
+  CLEANUP_WRITE_CACHE();
+  CLEANUP_CHUNK_LIST();
+}
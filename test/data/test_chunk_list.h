@@ -6,6 +6,8 @@ class test_chunk_list : public test_fixture {
   CPPUNIT_TEST(test_basic);
   CPPUNIT_TEST(test_get_release);
   CPPUNIT_TEST(test_blocking);
+  CPPUNIT_TEST(test_write_cache);
+  CPPUNIT_TEST(test_write_cache_flush);
 
   CPPUNIT_TEST_SUITE_END();
 
@@ -13,6 +15,8 @@ public:
   void test_basic();
   void test_get_release();
   void test_blocking();
+  void test_write_cache();
+  void test_write_cache_flush();
 };
 
 #include "data/chunk_list.h"
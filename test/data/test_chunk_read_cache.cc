@@ -0,0 +1,221 @@
+#import "config.h"
+
+#import "test_chunk_read_cache.h"
+
+#import <fcntl.h>
+#import <unistd.h>
+
+#import "data/chunk.h"
+#import "data/chunk_list.h"
+#import "data/chunk_read_cache.h"
+#import "helpers/test_thread.h"
+#import "torrent/exceptions.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_chunk_read_cache, "data");
+
+// The threads are never started, their task queues are processed
+// manually to step through loads.
+#define SETUP_READ_CACHE()                                              \
+  test_thread thread_disk;                                              \
+  test_thread thread_owner;                                             \
+  std::vector<uint32_t> loaded;                                         \
+  torrent::ChunkList chunk_list;                                        \
+  chunk_list.slot_chunk_loaded() = [&loaded](uint32_t index) { loaded.push_back(index); }; \
+  torrent::ChunkReadCache cache;                                        \
+  cache.set_threads(&thread_disk, &thread_owner);
+
+static const uint32_t chunk_size = 1 << 12;
+
+static torrent::chunk_read_list
+padding_parts(uint32_t size) {
+  return torrent::chunk_read_list{ torrent::chunk_read_part{ -1, 0, 0, size } };
+}
+
+static void
+process_loads(test_thread& thread_disk, test_thread& thread_owner) {
+  thread_disk.task_queue()->process();
+  thread_owner.task_queue()->process();
+}
+
+void
+test_chunk_read_cache::test_basic() {
+  SETUP_READ_CACHE();
+
+  CPPUNIT_ASSERT(!cache.is_enabled());
+  CPPUNIT_ASSERT(!cache.load(&chunk_list, 0, chunk_size, padding_parts(chunk_size)));
+
+  cache.set_max_memory(2 * chunk_size);
+
+  CPPUNIT_ASSERT(cache.is_enabled());
+  CPPUNIT_ASSERT(cache.state(&chunk_list, 0) == torrent::ChunkReadCache::state_none);
+  CPPUNIT_ASSERT(cache.load(&chunk_list, 0, chunk_size, padding_parts(chunk_size)));
+
+  CPPUNIT_ASSERT(cache.state(&chunk_list, 0) == torrent::ChunkReadCache::state_loading);
+  CPPUNIT_ASSERT(cache.acquire(&chunk_list, 0) == NULL);
+  CPPUNIT_ASSERT(cache.memory_usage() == chunk_size);
+
+  process_loads(thread_disk, thread_owner);
+
+  CPPUNIT_ASSERT(cache.state(&chunk_list, 0) == torrent::ChunkReadCache::state_resident);
+  CPPUNIT_ASSERT(loaded.size() == 1 && loaded[0] == 0);
+
+  torrent::Chunk* chunk = cache.acquire(&chunk_list, 0);
+  char zeros[chunk_size] = {};
+
+  CPPUNIT_ASSERT(chunk != NULL && chunk->chunk_size() == chunk_size);
+  CPPUNIT_ASSERT(chunk->compare_buffer(zeros, 0, chunk_size));
+  CPPUNIT_ASSERT(cache.stats_hits() == 1 && cache.stats_misses() == 1);
+
+  cache.release(&chunk_list, 0);
+  CPPUNIT_ASSERT_THROW(cache.release(&chunk_list, 0), torrent::internal_error);
+
+  cache.set_max_memory(0);
+
+  CPPUNIT_ASSERT(cache.memory_usage() == 0);
+  CPPUNIT_ASSERT(cache.state(&chunk_list, 0) == torrent::ChunkReadCache::state_none);
+}
+
+void
+test_chunk_read_cache::test_read_file() {
+  SETUP_READ_CACHE();
+
+  char path[] = "/tmp/test_chunk_read_cache.XXXXXX";
+  int fd = mkstemp(path);
+
+  CPPUNIT_ASSERT(fd != -1);
+  CPPUNIT_ASSERT(write(fd, "0123456789", 10) == 10);
+  unlink(path);
+
+  // The second part starts past the end of the file and the padding
+  // between them reads as zeros.
+  torrent::chunk_read_list parts{
+    torrent::chunk_read_part{ dup(fd), 2, 0, 6 },
+    torrent::chunk_read_part{ -1, 0, 6, 2 },
+    torrent::chunk_read_part{ dup(fd), 8, 8, chunk_size - 8 }
+  };
+
+  close(fd);
+
+  cache.set_max_memory(chunk_size);
+
+  CPPUNIT_ASSERT(cache.load(&chunk_list, 3, chunk_size, parts));
+  process_loads(thread_disk, thread_owner);
+
+  torrent::Chunk* chunk = cache.acquire(&chunk_list, 3);
+  char expected[chunk_size] = "234567\0\089";
+
+  CPPUNIT_ASSERT(chunk != NULL && chunk->chunk_size() == chunk_size);
+  CPPUNIT_ASSERT(chunk->compare_buffer(expected, 0, chunk_size));
+
+  cache.release(&chunk_list, 3);
+}
+
+void
+test_chunk_read_cache::test_eviction() {
+  SETUP_READ_CACHE();
+
+  cache.set_max_memory(2 * chunk_size);
+
+  CPPUNIT_ASSERT(cache.load(&chunk_list, 0, chunk_size, padding_parts(chunk_size)));
+  CPPUNIT_ASSERT(cache.load(&chunk_list, 1, chunk_size, padding_parts(chunk_size)));
+  process_loads(thread_disk, thread_owner);
+
+  // A second use moves chunk 1 to the frequent list.
+  CPPUNIT_ASSERT(cache.acquire(&chunk_list, 1) != NULL);
+  cache.release(&chunk_list, 1);
+
+  CPPUNIT_ASSERT(cache.load(&chunk_list, 2, chunk_size, padding_parts(chunk_size)));
+  process_loads(thread_disk, thread_owner);
+
+  CPPUNIT_ASSERT(cache.stats_evictions() == 1);
+  CPPUNIT_ASSERT(cache.memory_usage() == 2 * chunk_size);
+  CPPUNIT_ASSERT(cache.state(&chunk_list, 0) == torrent::ChunkReadCache::state_none);
+  CPPUNIT_ASSERT(cache.state(&chunk_list, 1) == torrent::ChunkReadCache::state_resident);
+  CPPUNIT_ASSERT(cache.state(&chunk_list, 2) == torrent::ChunkReadCache::state_resident);
+
+  // Reloading an evicted recent chunk grows the recent target, so
+  // the frequent list gives up its least recently used chunk.
+  CPPUNIT_ASSERT(cache.target_recent() == 0);
+  CPPUNIT_ASSERT(cache.load(&chunk_list, 0, chunk_size, padding_parts(chunk_size)));
+  process_loads(thread_disk, thread_owner);
+
+  CPPUNIT_ASSERT(cache.stats_ghost_hits() == 1 && cache.stats_evictions() == 2);
+  CPPUNIT_ASSERT(cache.target_recent() == chunk_size);
+  CPPUNIT_ASSERT(cache.state(&chunk_list, 0) == torrent::ChunkReadCache::state_resident);
+  CPPUNIT_ASSERT(cache.state(&chunk_list, 1) == torrent::ChunkReadCache::state_none);
+  CPPUNIT_ASSERT(cache.state(&chunk_list, 2) == torrent::ChunkReadCache::state_resident);
+
+  // Loading a resident chunk is a bug in the caller.
+  CPPUNIT_ASSERT_THROW(cache.load(&chunk_list, 2, chunk_size, padding_parts(chunk_size)), torrent::internal_error);
+}
+
+void
+test_chunk_read_cache::test_pinned() {
+  SETUP_READ_CACHE();
+
+  cache.set_max_memory(chunk_size);
+
+  CPPUNIT_ASSERT(!cache.load(&chunk_list, 0, 2 * chunk_size, padding_parts(2 * chunk_size)));
+  CPPUNIT_ASSERT(cache.load(&chunk_list, 0, chunk_size, padding_parts(chunk_size)));
+  process_loads(thread_disk, thread_owner);
+
+  CPPUNIT_ASSERT(cache.acquire(&chunk_list, 0) != NULL);
+  CPPUNIT_ASSERT(!cache.load(&chunk_list, 1, chunk_size, padding_parts(chunk_size)));
+  CPPUNIT_ASSERT_THROW(cache.erase(&chunk_list, 0), torrent::internal_error);
+
+  // Shrinking the budget leaves pinned chunks until released.
+  cache.set_max_memory(chunk_size / 2);
+  CPPUNIT_ASSERT(cache.memory_usage() == chunk_size);
+
+  cache.release(&chunk_list, 0);
+  CPPUNIT_ASSERT(cache.memory_usage() == 0);
+
+  cache.set_max_memory(chunk_size);
+  CPPUNIT_ASSERT(cache.load(&chunk_list, 1, chunk_size, padding_parts(chunk_size)));
+  process_loads(thread_disk, thread_owner);
+}
+
+void
+test_chunk_read_cache::test_erase_loading() {
+  SETUP_READ_CACHE();
+
+  cache.set_max_memory(2 * chunk_size);
+
+  CPPUNIT_ASSERT(cache.load(&chunk_list, 0, chunk_size, padding_parts(chunk_size)));
+  CPPUNIT_ASSERT(cache.load(&chunk_list, 1, chunk_size, padding_parts(chunk_size)));
+
+  cache.erase(&chunk_list, 0);
+
+  // The buffer is owned by the load until it completes.
+  CPPUNIT_ASSERT(cache.state(&chunk_list, 0) == torrent::ChunkReadCache::state_none);
+  CPPUNIT_ASSERT(cache.memory_usage() == 2 * chunk_size);
+
+  process_loads(thread_disk, thread_owner);
+
+  CPPUNIT_ASSERT(loaded.size() == 1 && loaded[0] == 1);
+  CPPUNIT_ASSERT(cache.memory_usage() == chunk_size);
+
+  cache.erase(&chunk_list);
+
+  CPPUNIT_ASSERT(cache.state(&chunk_list, 1) == torrent::ChunkReadCache::state_none);
+  CPPUNIT_ASSERT(cache.memory_usage() == 0);
+}
+
+void
+test_chunk_read_cache::test_failed_load() {
+  SETUP_READ_CACHE();
+
+  cache.set_max_memory(chunk_size);
+
+  // Reading a directory fails with EISDIR.
+  torrent::chunk_read_list parts{ torrent::chunk_read_part{ open("/", O_RDONLY), 0, 0, chunk_size } };
+
+  CPPUNIT_ASSERT(parts.front().fd != -1);
+  CPPUNIT_ASSERT(cache.load(&chunk_list, 0, chunk_size, parts));
+  process_loads(thread_disk, thread_owner);
+
+  CPPUNIT_ASSERT(loaded.size() == 1 && loaded[0] == 0);
+  CPPUNIT_ASSERT(cache.state(&chunk_list, 0) == torrent::ChunkReadCache::state_failed);
+  CPPUNIT_ASSERT(cache.acquire(&chunk_list, 0) == NULL);
+  CPPUNIT_ASSERT(cache.memory_usage() == 0);
+}
@@ -0,0 +1,22 @@
+#import "helpers/test_fixture.h"
+
+class test_chunk_read_cache : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_chunk_read_cache);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_read_file);
+  CPPUNIT_TEST(test_eviction);
+  CPPUNIT_TEST(test_pinned);
+  CPPUNIT_TEST(test_erase_loading);
+  CPPUNIT_TEST(test_failed_load);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_read_file();
+  void test_eviction();
+  void test_pinned();
+  void test_erase_loading();
+  void test_failed_load();
+};
@@ -106,6 +106,40 @@ test_hash_check_queue::test_single() {
   CLEANUP_CHUNK_LIST();
 }
 
+void
+test_hash_check_queue::test_prefix() {
+  SETUP_CHUNK_LIST();
+  torrent::HashCheckQueue hash_queue;
+
+  done_chunks_type done_chunks;
+  hash_queue.slot_chunk_done() = std::bind(&chunk_done, &done_chunks, std::placeholders::_1, std::placeholders::_2);
+
+  torrent::ChunkHandle handle_0 = chunk_list->get(0, torrent::ChunkList::get_blocking);
+  torrent::HashPrefix prefix;
+
+  prefix.update(handle_0.chunk(), 3);
+  prefix.update(handle_0.chunk(), 4);
+
+  CPPUNIT_ASSERT(prefix.length() == 7);
+  CPPUNIT_ASSERT_THROW(prefix.update(handle_0.chunk(), 4), torrent::internal_error);
+
+  torrent::HashChunk* hash_chunk = new torrent::HashChunk(handle_0);
+  hash_chunk->set_prefix(prefix);
+
+  CPPUNIT_ASSERT(hash_chunk->remaining() == 3);
+
+  hash_queue.push_back(hash_chunk);
+  hash_queue.perform();
+
+  CPPUNIT_ASSERT(done_chunks.find(0) != done_chunks.end());
+  CPPUNIT_ASSERT(done_chunks[0] == hash_for_index(0));
+
+  delete hash_chunk;
+  chunk_list->release(&handle_0);
+
+  CLEANUP_CHUNK_LIST();
+}
+
 void
 test_hash_check_queue::test_multiple() {
   SETUP_CHUNK_LIST();
@@ -4,6 +4,7 @@ class test_hash_check_queue : public test_fixture {
   CPPUNIT_TEST_SUITE(test_hash_check_queue);
 
   CPPUNIT_TEST(test_single);
+  CPPUNIT_TEST(test_prefix);
   CPPUNIT_TEST(test_multiple);
   CPPUNIT_TEST(test_erase);
 
@@ -15,6 +16,7 @@ public:
   void setUp();
 
   void test_single();
+  void test_prefix();
   void test_multiple();
   void test_erase();
 
@@ -33,8 +33,8 @@ chunk_done(torrent::ChunkList* chunk_list, done_chunks_type* done_chunks, torren
 }
 
 bool
-check_for_chunk_done(torrent::HashQueue* hash_queue, done_chunks_type* done_chunks, int index) {
-  hash_queue->work();
+check_for_chunk_done(torrent::thread_base* thread_main, done_chunks_type* done_chunks, int index) {
+  thread_main->task_queue()->process();
   return done_chunks->find(index) != done_chunks->end();
 }
 
@@ -58,10 +58,6 @@ test_hash_queue::tearDown() {
   test_fixture::tearDown();
 }
 
-static void
-fill_queue() {
-}
-
 void
 test_hash_queue::test_single() {
   SETUP_CHUNK_LIST();
@@ -69,8 +65,8 @@ test_hash_queue::test_single() {
   thread_disk->start_thread();
 
   done_chunks_type done_chunks;
-  torrent::HashQueue* hash_queue = new torrent::HashQueue(thread_disk);
-  hash_queue->slot_has_work() = std::bind(&fill_queue);
+  test_thread thread_main;
+  torrent::HashQueue* hash_queue = new torrent::HashQueue(thread_disk, &thread_main);
 
   torrent::ChunkHandle handle_0 = chunk_list->get(0, torrent::ChunkList::get_blocking);
   hash_queue->push_back(handle_0, NULL, std::bind(&chunk_done, chunk_list, &done_chunks, std::placeholders::_1, std::placeholders::_2));
@@ -79,9 +75,9 @@ test_hash_queue::test_single() {
   CPPUNIT_ASSERT(hash_queue->front().handle().is_blocking());
   CPPUNIT_ASSERT(hash_queue->front().handle().object() == &((*chunk_list)[0]));
 
-  hash_queue->work();
+  thread_main.task_queue()->process();
 
-  CPPUNIT_ASSERT(wait_for_true(std::bind(&check_for_chunk_done, hash_queue, &done_chunks, 0)));
+  CPPUNIT_ASSERT(wait_for_true(std::bind(&check_for_chunk_done, &thread_main, &done_chunks, 0)));
   CPPUNIT_ASSERT(done_chunks[0] == hash_for_index(0));
 
   // chunk_list->release(&handle_0);
@@ -101,8 +97,8 @@ test_hash_queue::test_multiple() {
   thread_disk->start_thread();
 
   done_chunks_type done_chunks;
-  torrent::HashQueue* hash_queue = new torrent::HashQueue(thread_disk);
-  hash_queue->slot_has_work() = std::bind(&fill_queue);
+  test_thread thread_main;
+  torrent::HashQueue* hash_queue = new torrent::HashQueue(thread_disk, &thread_main);
 
   for (unsigned int i = 0; i < 20; i++) {
     hash_queue->push_back(chunk_list->get(i, torrent::ChunkList::get_blocking),
@@ -114,7 +110,7 @@ test_hash_queue::test_multiple() {
   }
 
   for (unsigned int i = 0; i < 20; i++) {
-    CPPUNIT_ASSERT(wait_for_true(std::bind(&check_for_chunk_done, hash_queue, &done_chunks, i)));
+    CPPUNIT_ASSERT(wait_for_true(std::bind(&check_for_chunk_done, &thread_main, &done_chunks, i)));
     CPPUNIT_ASSERT(done_chunks[i] == hash_for_index(i));
   }
   
@@ -131,8 +127,8 @@ test_hash_queue::test_erase() {
   SETUP_CHUNK_LIST();
   SETUP_THREAD();
 
-  torrent::HashQueue* hash_queue = new torrent::HashQueue(thread_disk);
-  hash_queue->slot_has_work() = std::bind(&fill_queue);
+  test_thread thread_main;
+  torrent::HashQueue* hash_queue = new torrent::HashQueue(thread_disk, &thread_main);
 
   done_chunks_type done_chunks;
 
@@ -159,8 +155,8 @@ test_hash_queue::test_erase_stress() {
   SETUP_THREAD();
   thread_disk->start_thread();
 
-  torrent::HashQueue* hash_queue = new torrent::HashQueue(thread_disk);
-  hash_queue->slot_has_work() = std::bind(&fill_queue);
+  test_thread thread_main;
+  torrent::HashQueue* hash_queue = new torrent::HashQueue(thread_disk, &thread_main);
 
   done_chunks_type done_chunks;
 
@@ -0,0 +1,164 @@
+#import "config.h"
+
+#import "test_merkle_tree.h"
+
+#import "data/merkle_tree.h"
+#import "torrent/exceptions.h"
+#import "utils/sha256.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_merkle_tree, "data");
+
+static std::string
+hash_pair(const std::string& left, const std::string& right) {
+  std::string data = left + right;
+  std::string result(torrent::merkle_hash_size, '\0');
+
+  torrent::sha256_hash(data.c_str(), data.size(), &result[0]);
+  return result;
+}
+
+static std::string
+to_hex(const char* data, unsigned int length) {
+  static const char hex[] = "0123456789abcdef";
+  std::string result;
+
+  for (unsigned int i = 0; i < length; i++) {
+    result += hex[(unsigned char)data[i] >> 4];
+    result += hex[(unsigned char)data[i] & 0xf];
+  }
+
+  return result;
+}
+
+static std::string
+leaf(char c) {
+  std::string block(torrent::merkle_block_size, c);
+  std::string result(torrent::merkle_hash_size, '\0');
+
+  torrent::sha256_hash(block.c_str(), block.size(), &result[0]);
+  return result;
+}
+
+void
+test_merkle_tree::test_sha256() {
+  char result[torrent::Sha256::size_data];
+
+  torrent::sha256_hash("abc", 3, result);
+  CPPUNIT_ASSERT(to_hex(result, sizeof(result)) == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+  // Split updates crossing the 64 byte block boundary.
+  std::string data(1000, 'x');
+  char split_result[torrent::Sha256::size_data];
+
+  torrent::sha256_hash(data.c_str(), data.size(), result);
+
+  torrent::Sha256 sha256;
+  sha256.init();
+  sha256.update(data.c_str(), 63);
+  sha256.update(data.c_str() + 63, 2);
+  sha256.update(data.c_str() + 65, 935);
+  sha256.final_c(split_result);
+
+  CPPUNIT_ASSERT(std::memcmp(result, split_result, torrent::Sha256::size_data) == 0);
+}
+
+static std::string
+bundled_hex(const std::string& data) {
+  char result[torrent::Sha256Bundled::size_data];
+
+  torrent::Sha256Bundled sha256;
+  sha256.init();
+  sha256.update(data.c_str(), data.size());
+  sha256.final_c(result);
+
+  return to_hex(result, sizeof(result));
+}
+
+void
+test_merkle_tree::test_sha256_bundled() {
+  CPPUNIT_ASSERT(bundled_hex("") == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  CPPUNIT_ASSERT(bundled_hex("abc") == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+  CPPUNIT_ASSERT(bundled_hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq") ==
+                 "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+  CPPUNIT_ASSERT(bundled_hex(std::string(1000000, 'a')) == "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+  // Every length around the padding and block boundaries, in split
+  // updates, must agree with the implementation in use.
+  std::string data;
+
+  for (unsigned int i = 0; i < 300; i++)
+    data += (char)(i * 7 + 3);
+
+  for (unsigned int length = 0; length <= data.size(); length++) {
+    char expected[torrent::Sha256::size_data];
+    char result[torrent::Sha256Bundled::size_data];
+
+    torrent::sha256_hash(data.c_str(), length, expected);
+
+    torrent::Sha256Bundled sha256;
+    sha256.init();
+    sha256.update(data.c_str(), length / 3);
+    sha256.update(data.c_str() + length / 3, length - length / 3);
+    sha256.final_c(result);
+
+    CPPUNIT_ASSERT(std::memcmp(result, expected, sizeof(result)) == 0);
+  }
+}
+
+void
+test_merkle_tree::test_height() {
+  CPPUNIT_ASSERT(torrent::merkle_height(16 << 10) == 0);
+  CPPUNIT_ASSERT(torrent::merkle_height(64 << 10) == 2);
+  CPPUNIT_ASSERT(torrent::merkle_height(16 << 20) == 10);
+
+  CPPUNIT_ASSERT_THROW(torrent::merkle_height(8 << 10), torrent::internal_error);
+  CPPUNIT_ASSERT_THROW(torrent::merkle_height(48 << 10), torrent::internal_error);
+}
+
+void
+test_merkle_tree::test_pad_hash() {
+  std::string zero(torrent::merkle_hash_size, '\0');
+
+  CPPUNIT_ASSERT(torrent::merkle_pad_hash(0) == zero);
+  CPPUNIT_ASSERT(torrent::merkle_pad_hash(1) == hash_pair(zero, zero));
+  CPPUNIT_ASSERT(torrent::merkle_pad_hash(2) == hash_pair(hash_pair(zero, zero), hash_pair(zero, zero)));
+}
+
+void
+test_merkle_tree::test_root() {
+  std::string l0 = leaf('a');
+  std::string l1 = leaf('b');
+  std::string l2 = leaf('c');
+
+  CPPUNIT_ASSERT(torrent::merkle_root("", 0).empty());
+  CPPUNIT_ASSERT(torrent::merkle_root(l0.substr(1), 0).empty());
+
+  CPPUNIT_ASSERT(torrent::merkle_root(l0, 0) == l0);
+  CPPUNIT_ASSERT(torrent::merkle_root(l0 + l1, 0) == hash_pair(l0, l1));
+
+  // Odd layers are padded with all-zero subtrees of the same height.
+  std::string zero(torrent::merkle_hash_size, '\0');
+
+  CPPUNIT_ASSERT(torrent::merkle_root(l0 + l1 + l2, 0) == hash_pair(hash_pair(l0, l1), hash_pair(l2, zero)));
+  CPPUNIT_ASSERT(torrent::merkle_root(l0 + l1 + l2, 1) ==
+                 hash_pair(hash_pair(l0, l1), hash_pair(l2, torrent::merkle_pad_hash(1))));
+}
+
+void
+test_merkle_tree::test_subtree_root() {
+  std::string l0 = leaf('a');
+  std::string l1 = leaf('b');
+  std::string l2 = leaf('c');
+  std::string zero(torrent::merkle_hash_size, '\0');
+
+  CPPUNIT_ASSERT(torrent::merkle_subtree_root("", 2).empty());
+  CPPUNIT_ASSERT(torrent::merkle_subtree_root(l0 + l1 + l2, 1).empty());
+
+  CPPUNIT_ASSERT(torrent::merkle_subtree_root(l0, 0) == l0);
+  CPPUNIT_ASSERT(torrent::merkle_subtree_root(l0 + l1 + l2, 2) == torrent::merkle_root(l0 + l1 + l2, 0));
+
+  // The missing leaves of a short last piece are all zero.
+  CPPUNIT_ASSERT(torrent::merkle_subtree_root(l0, 2) == hash_pair(hash_pair(l0, zero), torrent::merkle_pad_hash(1)));
+  CPPUNIT_ASSERT(torrent::merkle_subtree_root(l0 + l1 + l2, 3) ==
+                 hash_pair(torrent::merkle_root(l0 + l1 + l2, 0), torrent::merkle_pad_hash(2)));
+}
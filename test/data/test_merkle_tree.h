@@ -0,0 +1,22 @@
+#import "helpers/test_fixture.h"
+
+class test_merkle_tree : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_merkle_tree);
+
+  CPPUNIT_TEST(test_sha256);
+  CPPUNIT_TEST(test_sha256_bundled);
+  CPPUNIT_TEST(test_height);
+  CPPUNIT_TEST(test_pad_hash);
+  CPPUNIT_TEST(test_root);
+  CPPUNIT_TEST(test_subtree_root);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_sha256();
+  void test_sha256_bundled();
+  void test_height();
+  void test_pad_hash();
+  void test_root();
+  void test_subtree_root();
+};
@@ -0,0 +1,97 @@
+#import "config.h"
+
+#import "test_piece_layers.h"
+
+#import "data/merkle_tree.h"
+#import "data/piece_layers.h"
+#import "torrent/exceptions.h"
+#import "torrent/data/block_list.h"
+#import "utils/sha256.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_piece_layers, "data");
+
+static std::string
+leaf(char c, uint32_t length = torrent::merkle_block_size) {
+  std::string block(length, c);
+  std::string result(torrent::merkle_hash_size, '\0');
+
+  torrent::sha256_hash(block.c_str(), block.size(), &result[0]);
+  return result;
+}
+
+void
+test_piece_layers::test_basic() {
+  torrent::PieceLayers piece_layers;
+  std::string root = leaf('a');
+
+  CPPUNIT_ASSERT(piece_layers.empty());
+  CPPUNIT_ASSERT(!piece_layers.has_piece(0));
+
+  piece_layers.set_piece(2, root.c_str(), 3 * torrent::merkle_block_size + 1, 2);
+
+  CPPUNIT_ASSERT(!piece_layers.empty());
+  CPPUNIT_ASSERT(!piece_layers.has_piece(0));
+  CPPUNIT_ASSERT(!piece_layers.has_piece(1));
+  CPPUNIT_ASSERT(piece_layers.has_piece(2));
+  CPPUNIT_ASSERT(!piece_layers.has_piece(3));
+
+  CPPUNIT_ASSERT(piece_layers.file_length(2) == 3 * torrent::merkle_block_size + 1);
+  CPPUNIT_ASSERT(piece_layers.leaf_count(2) == 4);
+  CPPUNIT_ASSERT(piece_layers.leaf_count(1) == 0);
+
+  CPPUNIT_ASSERT_THROW(piece_layers.set_piece(3, root.c_str(), 4 * torrent::merkle_block_size + 1, 2), torrent::internal_error);
+  CPPUNIT_ASSERT_THROW(piece_layers.set_piece(3, root.c_str(), 0, 2), torrent::internal_error);
+  CPPUNIT_ASSERT_THROW(piece_layers.verify(1, root), torrent::internal_error);
+
+  piece_layers.clear();
+  CPPUNIT_ASSERT(piece_layers.empty());
+}
+
+void
+test_piece_layers::test_verify() {
+  torrent::PieceLayers piece_layers;
+  std::string l0 = leaf('a');
+  std::string l1 = leaf('b', 100);
+
+  // A file ending within a 64 KiB piece, and a file of a single
+  // short block whose pieces root is the leaf itself.
+  std::string root = torrent::merkle_subtree_root(l0 + l1, 2);
+
+  piece_layers.set_piece(0, root.c_str(), torrent::merkle_block_size + 100, 2);
+  piece_layers.set_piece(1, l1.c_str(), 100, 0);
+
+  CPPUNIT_ASSERT(piece_layers.verify(0, l0 + l1));
+  CPPUNIT_ASSERT(!piece_layers.verify(0, l1 + l0));
+  CPPUNIT_ASSERT(!piece_layers.verify(0, l0));
+  CPPUNIT_ASSERT(!piece_layers.verify(0, l0 + l1 + l1));
+
+  CPPUNIT_ASSERT(piece_layers.verify(1, l1));
+  CPPUNIT_ASSERT(!piece_layers.verify(1, l0));
+}
+
+void
+test_piece_layers::test_block_list_leaves() {
+  torrent::PieceLayers piece_layers;
+  torrent::BlockList block_list(torrent::Piece(0, 0, 2 * torrent::merkle_block_size), torrent::merkle_block_size);
+
+  std::string l0 = leaf('a');
+  std::string l1 = leaf('b');
+  std::string root = torrent::merkle_subtree_root(l0 + l1, 1);
+
+  piece_layers.set_piece(0, root.c_str(), 2 * torrent::merkle_block_size, 1);
+
+  CPPUNIT_ASSERT(block_list.leaf_hash(0) == NULL);
+
+  block_list.set_leaf_hash(1, l1.c_str());
+  block_list.set_leaf_hash(0, l0.c_str());
+
+  CPPUNIT_ASSERT(std::memcmp(block_list.leaf_hash(0), l0.c_str(), torrent::merkle_hash_size) == 0);
+  CPPUNIT_ASSERT(std::memcmp(block_list.leaf_hash(1), l1.c_str(), torrent::merkle_hash_size) == 0);
+
+  // With every leaf kept the chunk is not read.
+  CPPUNIT_ASSERT(piece_layers.verify(0, piece_layers.leaves(0, NULL, &block_list)));
+
+  block_list.clear_leaf_hashes();
+  CPPUNIT_ASSERT(block_list.leaf_hash(0) == NULL);
+  CPPUNIT_ASSERT(block_list.leaf_hash(1) == NULL);
+}
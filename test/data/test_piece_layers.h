@@ -0,0 +1,16 @@
+#import "helpers/test_fixture.h"
+
+class test_piece_layers : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_piece_layers);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_verify);
+  CPPUNIT_TEST(test_block_list_leaves);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_verify();
+  void test_block_list_leaves();
+};
@@ -0,0 +1,147 @@
+#include "config.h"
+
+#include "test_available_list.h"
+
+#include <set>
+#include <stdlib.h>
+
+#include "download/available_list.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_available_list);
+
+static rak::socket_address
+make_inet(uint32_t address, uint16_t port) {
+  rak::socket_address sa;
+  sa.sa_inet()->clear();
+  sa.sa_inet()->set_address_h(address);
+  sa.sa_inet()->set_port(port);
+  return sa;
+}
+
+static rak::socket_address
+make_inet6(const char* address, uint16_t port) {
+  rak::socket_address sa;
+  sa.sa_inet6()->clear();
+  sa.sa_inet6()->set_address_str(address);
+  sa.sa_inet6()->set_port(port);
+  return sa;
+}
+
+void
+test_available_list::test_basic() {
+  torrent::AvailableList list;
+  rak::socket_address sa1 = make_inet(0x7f000001, 6881);
+  rak::socket_address sa2 = make_inet(0x7f000001, 6882);
+
+  list.push_back(&sa1);
+  list.push_back(&sa2);
+  list.push_back(&sa1);
+
+  CPPUNIT_ASSERT(list.size() == 2);
+  CPPUNIT_ASSERT(list.contains(sa1) && list.contains(sa2));
+  CPPUNIT_ASSERT(!list.contains(make_inet(0x7f000002, 6881)));
+
+  rak::socket_address unspec;
+  unspec.clear();
+  list.push_back(&unspec);
+  CPPUNIT_ASSERT(list.size() == 2);
+
+  torrent::AddressList addresses;
+  addresses.push_back(sa2);
+  addresses.push_back(make_inet(0x0a000001, 1));
+  addresses.push_back(make_inet(0x0a000001, 1));
+
+  list.insert(&addresses);
+  CPPUNIT_ASSERT(list.size() == 3);
+
+  list.set_max_size(2);
+  addresses.push_back(make_inet(0x0a000002, 1));
+  list.insert(&addresses);
+  CPPUNIT_ASSERT(list.size() == 3);
+
+  list.clear();
+  CPPUNIT_ASSERT(list.empty() && !list.contains(sa1));
+}
+
+void
+test_available_list::test_inet6() {
+  torrent::AvailableList list;
+  rak::socket_address sa1 = make_inet6("2001:db8::1", 6881);
+  rak::socket_address sa2 = make_inet6("2001:db8::2", 6881);
+  rak::socket_address sa3 = make_inet(0x7f000001, 6881);
+
+  list.push_back(&sa1);
+  list.push_back(&sa2);
+  list.push_back(&sa3);
+  list.push_back(&sa1);
+
+  CPPUNIT_ASSERT(list.size() == 3);
+  CPPUNIT_ASSERT(list.contains(sa1) && list.contains(sa2) && list.contains(sa3));
+  CPPUNIT_ASSERT(!list.contains(make_inet6("2001:db8::1", 6882)));
+}
+
+void
+test_available_list::test_erase() {
+  torrent::AvailableList list;
+
+  for (uint32_t i = 0; i < 100; i++) {
+    rak::socket_address sa = make_inet(0x0a000000 + i, 6881);
+    list.push_back(&sa);
+  }
+
+  list.erase(make_inet(0x0a000000, 6881));
+  list.erase(make_inet(0x0a000000, 6881));
+  list.erase(make_inet(0x0a000000 + 99, 6881));
+
+  CPPUNIT_ASSERT(list.size() == 98);
+  CPPUNIT_ASSERT(!list.contains(make_inet(0x0a000000, 6881)));
+
+  for (uint32_t i = 1; i < 99; i++)
+    CPPUNIT_ASSERT(list.contains(make_inet(0x0a000000 + i, 6881)));
+
+  std::set<rak::socket_address> popped;
+
+  while (!list.empty()) {
+    rak::socket_address sa = list.pop_random();
+
+    CPPUNIT_ASSERT(!list.contains(sa));
+    CPPUNIT_ASSERT(popped.insert(sa).second);
+  }
+
+  CPPUNIT_ASSERT(popped.size() == 98);
+}
+
+void
+test_available_list::test_random_operations() {
+  torrent::AvailableList list;
+  std::set<rak::socket_address> reference;
+
+  list.reserve(64);
+
+  for (int i = 0; i < 20000; i++) {
+    // Small address range so inserts, duplicates and erases collide.
+    rak::socket_address sa = make_inet(0x0a000000 + ::random() % 512, 1 + ::random() % 4);
+
+    switch (::random() % 4) {
+    case 0:
+      list.erase(sa);
+      reference.erase(sa);
+      break;
+    case 1:
+      if (!list.empty())
+        CPPUNIT_ASSERT(reference.erase(list.pop_random()) == 1);
+      break;
+    default:
+      list.push_back(&sa);
+      reference.insert(sa);
+      break;
+    }
+
+    CPPUNIT_ASSERT(list.size() == reference.size());
+  }
+
+  for (const auto& sa : reference)
+    CPPUNIT_ASSERT(list.contains(sa));
+
+  CPPUNIT_ASSERT(std::set<rak::socket_address>(list.begin(), list.end()) == reference);
+}
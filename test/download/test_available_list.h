@@ -0,0 +1,18 @@
+#include "helpers/test_fixture.h"
+
+class test_available_list : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_available_list);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_inet6);
+  CPPUNIT_TEST(test_erase);
+  CPPUNIT_TEST(test_random_operations);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_inet6();
+  void test_erase();
+  void test_random_operations();
+};
@@ -0,0 +1,285 @@
+#include "config.h"
+
+#include "test_chunk_selector.h"
+
+#include <memory>
+#include <vector>
+
+#include "download/chunk_selector.h"
+#include "download/chunk_statistics.h"
+#include "download/delegator.h"
+#include "protocol/peer_chunks.h"
+#include "protocol/request_list.h"
+#include "rak/socket_address.h"
+#include "torrent/exceptions.h"
+#include "torrent/data/block.h"
+#include "torrent/peer/peer_info.h"
+#include "torrent/rate.h"
+
+#include "globals.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_chunk_selector);
+
+static const uint32_t chunk_count = 200;
+static const uint32_t chunk_size = 256 << 10;
+
+// Half a second of playback per chunk.
+static const uint32_t stream_rate = 512 << 10;
+static const uint32_t stream_window = 20;
+
+static const int64_t tick_usec = 10000;
+
+class stream_data : public torrent::download_data {
+public:
+  stream_data() {
+    mutable_completed_bitfield()->set_size_bits(chunk_count);
+    mutable_completed_bitfield()->allocate();
+    mutable_completed_bitfield()->unset_all();
+
+    mutable_normal_priority()->insert(0, chunk_count);
+  }
+};
+
+struct stream_peer {
+  stream_peer(torrent::Delegator* delegator, uint32_t r, uint32_t m) :
+    rate(r),
+    measured(m),
+    info(new torrent::PeerInfo(address.c_sockaddr())) {
+
+    chunks.set_peer_info(info.get());
+    chunks.bitfield()->set_size_bits(chunk_count);
+    chunks.bitfield()->allocate();
+    chunks.bitfield()->set_all();
+
+    requests.set_delegator(delegator);
+    requests.set_peer_chunks(&chunks);
+  }
+
+  uint32_t                           rate;
+  uint32_t                           measured;
+  rak::socket_address                address;
+  std::unique_ptr<torrent::PeerInfo> info;
+  torrent::PeerChunks                chunks;
+  torrent::RequestList               requests;
+};
+
+struct stream_result {
+  int64_t      first_chunk;
+  unsigned int stalls;
+  uint32_t     played;
+};
+
+static void
+set_time(int64_t usec) {
+  torrent::cachedTime = rak::timer::from_seconds(1000) + rak::timer(usec);
+}
+
+// Each tick a peer receives what its bandwidth allows of the requests
+// it has queued, keeping about a chunk worth of requests in flight.
+static void
+stream_peer_tick(stream_peer* peer) {
+  uint64_t budget = (uint64_t)peer->rate * tick_usec / 1000000;
+
+  peer->chunks.download_throttle()->rate()->insert(budget);
+
+  while (budget != 0) {
+    if (!peer->requests.is_downloading()) {
+      uint32_t queued = peer->requests.queued_size();
+
+      if (queued < chunk_size / torrent::Delegator::block_size)
+        peer->requests.delegate(chunk_size / torrent::Delegator::block_size - queued);
+
+      if (peer->requests.queued_empty())
+        return;
+
+      torrent::Piece piece = peer->requests.next_queued_piece();
+      peer->requests.downloading(piece);
+    }
+
+    torrent::BlockTransfer* transfer = peer->requests.transfer();
+    uint32_t length = std::min<uint64_t>(budget, transfer->piece().length() - transfer->position());
+
+    // A duplicate that overtakes the leader becomes the new leader.
+    if (transfer->is_valid() && !transfer->is_leader()) {
+      uint32_t behind = std::min(length, transfer->block()->leader()->position() - transfer->position());
+
+      transfer->adjust_position(behind);
+
+      if (behind != length) {
+        transfer->block()->change_leader(transfer);
+        transfer->adjust_position(length - behind);
+      }
+
+    } else {
+      transfer->adjust_position(length);
+    }
+
+    budget -= length;
+
+    if (!transfer->is_finished())
+      continue;
+
+    if (transfer->is_valid() && transfer->is_leader())
+      peer->requests.finished();
+    else
+      peer->requests.skipped();
+  }
+}
+
+// A fast seeder, six slow ones and one whose measured rate is far
+// above what it now delivers serve a player that starts at chunk zero
+// and stalls whenever the next chunk is missing.
+static stream_result
+stream_simulate(bool streaming) {
+  set_time(0);
+
+  stream_data data;
+  torrent::ChunkStatistics statistics;
+  torrent::ChunkSelector selector(&data);
+
+  statistics.initialize(chunk_count);
+  selector.initialize(&statistics);
+  selector.update_priorities();
+
+  std::vector<int64_t> completed(chunk_count, -1);
+  int64_t now = 0;
+
+  torrent::Delegator delegator;
+  delegator.slot_chunk_find() = std::bind(&torrent::ChunkSelector::find, &selector, std::placeholders::_1, std::placeholders::_2);
+  delegator.slot_chunk_size() = [](uint32_t) { return chunk_size; };
+  delegator.slot_chunk_urgent() = std::bind(&torrent::ChunkSelector::is_stream_urgent, &selector, std::placeholders::_1, std::placeholders::_2);
+  delegator.slot_chunk_in_time() = std::bind(&torrent::ChunkSelector::is_stream_in_time, &selector, std::placeholders::_1, std::placeholders::_2);
+  delegator.transfer_list()->slot_canceled() = std::bind(&torrent::ChunkSelector::not_using_index, &selector, std::placeholders::_1);
+  delegator.transfer_list()->slot_queued() = std::bind(&torrent::ChunkSelector::using_index, &selector, std::placeholders::_1);
+  delegator.transfer_list()->slot_corrupt() = [](torrent::PeerInfo*) {};
+  delegator.transfer_list()->slot_completed() = [&](uint32_t index) {
+      completed[index] = now;
+      delegator.transfer_list()->erase(delegator.transfer_list()->find(index));
+    };
+
+  std::vector<std::unique_ptr<stream_peer>> peers;
+  uint32_t rates[] = { 768 << 10, 24 << 10, 32 << 10, 32 << 10, 32 << 10, 32 << 10, 32 << 10, 32 << 10 };
+
+  for (int i = 0; i < 8; i++)
+    peers.emplace_back(new stream_peer(&delegator, rates[i], i == 1 ? (512 << 10) : rates[i]));
+
+  for (int64_t second = -30; second < 0; second++) {
+    set_time(second * 1000000);
+
+    for (auto& peer : peers)
+      peer->chunks.download_throttle()->rate()->insert(peer->measured);
+  }
+
+  set_time(0);
+
+  if (streaming) {
+    selector.set_stream_window(stream_window, chunk_size, stream_rate);
+    selector.set_stream_playhead(0);
+  }
+
+  stream_result result = { -1, 0, 0 };
+  int64_t chunk_time = (int64_t)chunk_size * 1000000 / stream_rate;
+  int64_t play_until = -1;
+
+  for (; now < 120 * 1000000 && result.played < 60; now += tick_usec) {
+    set_time(now);
+
+    for (auto& peer : peers)
+      stream_peer_tick(peer.get());
+
+    if (play_until == -1) {
+      if (completed[result.played] == -1)
+        continue;
+
+      if (result.first_chunk == -1)
+        result.first_chunk = now;
+
+      play_until = now + chunk_time;
+
+    } else if (now >= play_until) {
+      if (++result.played < chunk_count && streaming)
+        selector.set_stream_playhead(result.played);
+
+      if (completed[result.played] != -1) {
+        play_until = now + chunk_time;
+      } else {
+        result.stalls++;
+        play_until = -1;
+      }
+    }
+  }
+
+  for (auto& peer : peers)
+    peer->requests.clear();
+
+  delegator.transfer_list()->clear();
+  peers.clear();
+
+  return result;
+}
+
+void
+test_chunk_selector::test_stream_deadlines() {
+  set_time(0);
+
+  stream_data data;
+  torrent::ChunkStatistics statistics;
+  torrent::ChunkSelector selector(&data);
+
+  statistics.initialize(chunk_count);
+  selector.initialize(&statistics);
+  selector.update_priorities();
+
+  torrent::Delegator delegator;
+  stream_peer slow(&delegator, 0, 0);
+  stream_peer fast(&delegator, 0, 0);
+
+  fast.chunks.download_throttle()->rate()->insert(30 * stream_rate);
+
+  selector.set_stream_window(stream_window, chunk_size, stream_rate);
+  selector.set_stream_playhead(10);
+
+  CPPUNIT_ASSERT(selector.is_streaming());
+  CPPUNIT_ASSERT(selector.stream_playhead() == 10);
+
+  // A peer without a measured rate gets the first chunk it can
+  // deliver in time, the playhead chunk being due already.
+  CPPUNIT_ASSERT(selector.find(&slow.chunks, true) == 10);
+
+  selector.using_index(10);
+  CPPUNIT_ASSERT(selector.find(&slow.chunks, true) == 11);
+  CPPUNIT_ASSERT(selector.find(&fast.chunks, true) == 11);
+
+  // Only chunks due within a chunk's playback time are urgent, and
+  // only for peers that keep up with playback.
+  CPPUNIT_ASSERT(selector.is_stream_urgent(&fast.chunks, 10));
+  CPPUNIT_ASSERT(!selector.is_stream_urgent(&fast.chunks, 11));
+  CPPUNIT_ASSERT(!selector.is_stream_urgent(&slow.chunks, 10));
+  CPPUNIT_ASSERT(!selector.is_stream_urgent(&fast.chunks, 9));
+
+  set_time(600000);
+  CPPUNIT_ASSERT(selector.is_stream_urgent(&fast.chunks, 11));
+  CPPUNIT_ASSERT(!selector.is_stream_urgent(&fast.chunks, 10 + stream_window));
+
+  selector.set_stream_window(0, 0, 0);
+  CPPUNIT_ASSERT(!selector.is_streaming());
+  CPPUNIT_ASSERT(!selector.is_stream_urgent(&fast.chunks, 11));
+
+  CPPUNIT_ASSERT_THROW(selector.set_stream_window(stream_window, chunk_size, 0), torrent::internal_error);
+  CPPUNIT_ASSERT_THROW(selector.set_stream_playhead(chunk_count), torrent::internal_error);
+}
+
+void
+test_chunk_selector::test_stream_swarm() {
+  stream_result linear = stream_simulate(false);
+  stream_result stream = stream_simulate(true);
+
+  CPPUNIT_ASSERT(linear.first_chunk != -1);
+  CPPUNIT_ASSERT(stream.first_chunk != -1 && stream.first_chunk <= 1000000);
+  CPPUNIT_ASSERT(stream.first_chunk * 10 < linear.first_chunk);
+
+  // The chunk first given to the peer that slowed down is late once,
+  // until other peers duplicate its requests.
+  CPPUNIT_ASSERT(stream.played == 60);
+  CPPUNIT_ASSERT(stream.stalls <= 1);
+}
@@ -0,0 +1,14 @@
+#include "helpers/test_fixture.h"
+
+class test_chunk_selector : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_chunk_selector);
+
+  CPPUNIT_TEST(test_stream_deadlines);
+  CPPUNIT_TEST(test_stream_swarm);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_stream_deadlines();
+  void test_stream_swarm();
+};
@@ -0,0 +1,90 @@
+#include "config.h"
+
+#include "test_have_queue.h"
+
+#include "download/have_queue.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_have_queue);
+
+static rak::timer
+seconds(int32_t s) {
+  return rak::timer::from_seconds(s);
+}
+
+void
+test_have_queue::test_basic() {
+  torrent::HaveQueue queue;
+
+  CPPUNIT_ASSERT(queue.empty());
+  CPPUNIT_ASSERT(queue.begin_epoch() == 0 && queue.end_epoch() == 0);
+
+  queue.push_back(seconds(1), 5);
+  queue.push_back(seconds(2), 7);
+  queue.push_back(seconds(2), 3);
+
+  CPPUNIT_ASSERT(queue.size() == 3);
+  CPPUNIT_ASSERT(queue.begin_epoch() == 0 && queue.end_epoch() == 3);
+  CPPUNIT_ASSERT(queue.index_at_epoch(0) == 5);
+  CPPUNIT_ASSERT(queue.index_at_epoch(1) == 7);
+  CPPUNIT_ASSERT(queue.index_at_epoch(2) == 3);
+
+  queue.clear();
+
+  CPPUNIT_ASSERT(queue.empty());
+  CPPUNIT_ASSERT(queue.begin_epoch() == 3 && queue.end_epoch() == 3);
+}
+
+void
+test_have_queue::test_epoch_at_time() {
+  torrent::HaveQueue queue;
+
+  CPPUNIT_ASSERT(queue.epoch_at_time(seconds(10)) == 0);
+
+  queue.push_back(seconds(1), 0);
+  queue.push_back(seconds(3), 1);
+  queue.push_back(seconds(3), 2);
+  queue.push_back(seconds(5), 3);
+
+  CPPUNIT_ASSERT(queue.epoch_at_time(seconds(0)) == 0);
+  CPPUNIT_ASSERT(queue.epoch_at_time(seconds(1)) == 0);
+  CPPUNIT_ASSERT(queue.epoch_at_time(seconds(2)) == 1);
+  CPPUNIT_ASSERT(queue.epoch_at_time(seconds(3)) == 1);
+  CPPUNIT_ASSERT(queue.epoch_at_time(seconds(4)) == 3);
+  CPPUNIT_ASSERT(queue.epoch_at_time(seconds(6)) == 4);
+
+  // Timestamps going backwards are clamped to keep the queue sorted.
+  queue.push_back(seconds(4), 4);
+
+  CPPUNIT_ASSERT(queue.at_epoch(4).first == seconds(5));
+  CPPUNIT_ASSERT(queue.epoch_at_time(seconds(5)) == 3);
+}
+
+void
+test_have_queue::test_erase() {
+  torrent::HaveQueue queue;
+
+  for (int i = 0; i < 10; i++)
+    queue.push_back(seconds(i), i);
+
+  queue.erase_older_than(seconds(4));
+
+  CPPUNIT_ASSERT(queue.size() == 6);
+  CPPUNIT_ASSERT(queue.begin_epoch() == 4 && queue.end_epoch() == 10);
+  CPPUNIT_ASSERT(queue.index_at_epoch(4) == 4);
+
+  CPPUNIT_ASSERT(queue.clamp_epoch(2) == 4);
+  CPPUNIT_ASSERT(queue.clamp_epoch(7) == 7);
+
+  CPPUNIT_ASSERT(queue.epoch_at_time(seconds(0)) == 4);
+  CPPUNIT_ASSERT(queue.epoch_at_time(seconds(8)) == 8);
+
+  queue.push_back(seconds(10), 10);
+
+  CPPUNIT_ASSERT(queue.end_epoch() == 11);
+  CPPUNIT_ASSERT(queue.index_at_epoch(10) == 10);
+
+  queue.erase_older_than(seconds(20));
+
+  CPPUNIT_ASSERT(queue.empty());
+  CPPUNIT_ASSERT(queue.begin_epoch() == 11 && queue.end_epoch() == 11);
+}
@@ -0,0 +1,16 @@
+#include "helpers/test_fixture.h"
+
+class test_have_queue : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_have_queue);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_epoch_at_time);
+  CPPUNIT_TEST(test_erase);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_epoch_at_time();
+  void test_erase();
+};
@@ -0,0 +1,184 @@
+#include "config.h"
+
+#include "test_handshake_key_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <rak/socket_address.h>
+
+#include "manager.h"
+#include "net/socket_fd.h"
+#include "net/throttle_list.h"
+#include "torrent/net/socket_address.h"
+#include "protocol/handshake.h"
+#include "protocol/handshake_key_pool.h"
+#include "protocol/handshake_manager.h"
+#include "torrent/connection_manager.h"
+#include "torrent/poll_select.h"
+#include "torrent/torrent.h"
+#include "torrent/utils/thread_base.h"
+#include "utils/diffie_hellman.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_handshake_key_pool);
+
+typedef torrent::HandshakeKeyPool pool_type;
+
+template <typename Func>
+static bool
+wait_for(Func func) {
+  for (int i = 0; i < 1000; i++) {
+    if (func())
+      return true;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+
+  return false;
+}
+
+void
+test_handshake_key_pool::test_not_running() {
+  pool_type pool;
+
+  CPPUNIT_ASSERT(!pool.is_running());
+  CPPUNIT_ASSERT(pool.size_ready() == 0);
+
+#ifdef USE_OPENSSL
+  pool_type::key_ptr key = pool.acquire();
+
+  CPPUNIT_ASSERT(key && key->is_valid());
+#endif
+}
+
+void
+test_handshake_key_pool::test_ready_keys() {
+#ifdef USE_OPENSSL
+  pool_type pool;
+  pool.start(2);
+
+  CPPUNIT_ASSERT(pool.is_running());
+  CPPUNIT_ASSERT(wait_for([&pool] { return pool.size_ready() == pool_type::max_ready; }));
+
+  pool_type::key_ptr key = pool.acquire();
+
+  CPPUNIT_ASSERT(key && key->is_valid());
+  CPPUNIT_ASSERT(wait_for([&pool] { return pool.size_ready() == pool_type::max_ready; }));
+
+  pool.stop();
+
+  CPPUNIT_ASSERT(!pool.is_running());
+  CPPUNIT_ASSERT(pool.size_ready() == 0);
+#endif
+}
+
+void
+test_handshake_key_pool::test_compute_secret() {
+#ifdef USE_OPENSSL
+  pool_type pool;
+  std::atomic<int> signals{0};
+
+  pool.slot_has_work() = [&signals] { signals++; };
+  pool.start(2);
+
+  pool_type::key_ptr local = pool.acquire();
+  pool_type::key_ptr remote = pool.acquire();
+
+  unsigned char local_pubkey[pool_type::pubkey_length];
+  unsigned char remote_pubkey[pool_type::pubkey_length];
+
+  local->store_pub_key(local_pubkey, pool_type::pubkey_length);
+  remote->store_pub_key(remote_pubkey, pool_type::pubkey_length);
+
+  CPPUNIT_ASSERT(remote->compute_secret(local_pubkey, pool_type::pubkey_length));
+
+  int results = 0;
+  bool success = false;
+
+  pool.compute_secret(&results, local.get(), remote_pubkey, [&](bool s) { results++; success = s; });
+
+  CPPUNIT_ASSERT(wait_for([&signals] { return signals != 0; }));
+  CPPUNIT_ASSERT(results == 0);
+
+  pool.work();
+
+  CPPUNIT_ASSERT(results == 1 && success);
+  CPPUNIT_ASSERT(local->secret_str() == remote->secret_str());
+#endif
+}
+
+void
+test_handshake_key_pool::test_cancel() {
+#ifdef USE_OPENSSL
+  pool_type pool;
+  std::atomic<int> signals{0};
+
+  pool.slot_has_work() = [&signals] { signals++; };
+  pool.start(1);
+
+  pool_type::key_ptr local = pool.acquire();
+  pool_type::key_ptr remote = pool.acquire();
+
+  unsigned char remote_pubkey[pool_type::pubkey_length];
+  remote->store_pub_key(remote_pubkey, pool_type::pubkey_length);
+
+  int results = 0;
+
+  pool.compute_secret(&results, local.get(), remote_pubkey, [&](bool) { results++; });
+
+  // The pool takes the key, a worker computing the secret destroys it
+  // once done.
+  pool.cancel(&results, std::move(local));
+
+  CPPUNIT_ASSERT(wait_for([&pool] { return pool.size_ready() == pool_type::max_ready; }));
+  pool.work();
+
+  CPPUNIT_ASSERT(results == 0);
+#endif
+}
+
+// A read may be delivered while the handshake waits for a worker, and
+// destroying the handshake then must not wait for the secret.
+void
+test_handshake_key_pool::test_handshake_pending() {
+#ifdef USE_OPENSSL
+  torrent::Poll::slot_create_poll() = [] { return torrent::PollSelect::create(256); };
+  torrent::initialize();
+
+  int sockets[2];
+  CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sockets) == 0);
+
+  rak::socket_address sa;
+  sa.set_address_c_str("127.0.0.1");
+  sa.set_port(6881);
+
+  torrent::manager->connection_manager()->inc_socket_count();
+
+  auto handshake = new torrent::Handshake(torrent::SocketFd(sockets[0]), torrent::manager->handshake_manager(),
+                                          torrent::ConnectionManager::encryption_allow_incoming);
+  handshake->initialize_incoming(sa.c_sockaddr());
+
+  pool_type::key_ptr remote = torrent::manager->handshake_key_pool()->acquire();
+  unsigned char remote_pubkey[pool_type::pubkey_length];
+
+  remote->store_pub_key(remote_pubkey, pool_type::pubkey_length);
+  CPPUNIT_ASSERT(::write(sockets[1], remote_pubkey, pool_type::pubkey_length) == pool_type::pubkey_length);
+
+  handshake->event_read();
+  CPPUNIT_ASSERT(handshake->state() == torrent::Handshake::READ_ENC_SECRET);
+
+  handshake->event_read();
+  CPPUNIT_ASSERT(handshake->state() == torrent::Handshake::READ_ENC_SECRET);
+
+  handshake->deactivate_connection();
+  handshake->destroy_connection();
+  delete handshake;
+
+  ::close(sockets[1]);
+  torrent::cleanup();
+  torrent::thread_base::release_global_lock();
+#endif
+}
@@ -0,0 +1,20 @@
+#include "helpers/test_fixture.h"
+
+class test_handshake_key_pool : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_handshake_key_pool);
+
+  CPPUNIT_TEST(test_not_running);
+  CPPUNIT_TEST(test_ready_keys);
+  CPPUNIT_TEST(test_compute_secret);
+  CPPUNIT_TEST(test_cancel);
+  CPPUNIT_TEST(test_handshake_pending);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_not_running();
+  void test_ready_keys();
+  void test_compute_secret();
+  void test_cancel();
+  void test_handshake_pending();
+};
@@ -0,0 +1,272 @@
+#include "config.h"
+
+#include "test_handshake_manager.h"
+
+#include <functional>
+#include <vector>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <rak/socket_address.h>
+
+#include "manager.h"
+#include "download/download_main.h"
+#include "net/socket_fd.h"
+#include "protocol/handshake_manager.h"
+#include "torrent/connection_manager.h"
+#include "torrent/poll_select.h"
+#include "torrent/torrent.h"
+#include "torrent/utils/thread_base.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_handshake_manager);
+
+static rak::socket_address
+make_address(const char* address, uint16_t port) {
+  rak::socket_address sa;
+  sa.set_address_c_str(address);
+  sa.set_port(port);
+  return sa;
+}
+
+// Hands the manager one end of a socket pair as an incoming connection
+// from 'address', returning the other end.
+static int
+add_incoming(torrent::HandshakeManager* handshake_manager, const char* address, uint16_t port) {
+  int sockets[2];
+  CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sockets) == 0);
+
+  handshake_manager->add_incoming(torrent::SocketFd(sockets[0]), make_address(address, port));
+  return sockets[1];
+}
+
+static bool
+is_closed(int fd) {
+  char buffer;
+  return ::read(fd, &buffer, 1) == 0;
+}
+
+static bool
+poll_until(std::function<bool ()> func) {
+  for (int i = 0; i < 100 && !func(); i++)
+    torrent::manager->poll()->do_poll(10000, torrent::Poll::poll_worker_thread);
+
+  return func();
+}
+
+static int
+open_listen(uint16_t* port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  CPPUNIT_ASSERT(fd != -1);
+
+  sockaddr_in sa{};
+  sa.sin_family = AF_INET;
+  socklen_t length = sizeof(sa);
+
+  CPPUNIT_ASSERT(::bind(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) == 0);
+  CPPUNIT_ASSERT(::listen(fd, 16) == 0);
+  CPPUNIT_ASSERT(::getsockname(fd, reinterpret_cast<sockaddr*>(&sa), &length) == 0);
+
+  *port = ntohs(sa.sin_port);
+  return fd;
+}
+
+void
+test_handshake_manager::setUp() {
+  test_fixture::setUp();
+
+  torrent::Poll::slot_create_poll() = [] { return torrent::PollSelect::create(256); };
+  torrent::initialize();
+
+  torrent::manager->connection_manager()->set_priority(torrent::ConnectionManager::iptos_default);
+}
+
+void
+test_handshake_manager::tearDown() {
+  torrent::cleanup();
+
+  // Taken by initialize() for the main thread.
+  torrent::thread_base::release_global_lock();
+
+  test_fixture::tearDown();
+}
+
+void
+test_handshake_manager::test_incoming_limits() {
+  torrent::ConnectionManager* connection_manager = torrent::manager->connection_manager();
+  torrent::HandshakeManager handshake_manager;
+  std::vector<int> peers;
+
+  connection_manager->set_max_handshakes_per_address(2);
+
+  peers.push_back(add_incoming(&handshake_manager, "10.0.0.1", 1000));
+  peers.push_back(add_incoming(&handshake_manager, "10.0.0.1", 1001));
+  peers.push_back(add_incoming(&handshake_manager, "10.0.0.1", 1002));
+  peers.push_back(add_incoming(&handshake_manager, "10.0.0.2", 1000));
+
+  CPPUNIT_ASSERT(handshake_manager.size() == 3);
+  CPPUNIT_ASSERT(!is_closed(peers[0]) && !is_closed(peers[1]));
+  CPPUNIT_ASSERT(is_closed(peers[2]));
+  CPPUNIT_ASSERT(!is_closed(peers[3]));
+
+  connection_manager->set_max_handshakes(3);
+
+  peers.push_back(add_incoming(&handshake_manager, "10.0.0.3", 1000));
+
+  CPPUNIT_ASSERT(handshake_manager.size() == 3);
+  CPPUNIT_ASSERT(is_closed(peers[4]));
+
+  handshake_manager.clear();
+  CPPUNIT_ASSERT(handshake_manager.empty());
+
+  for (auto fd : peers)
+    ::close(fd);
+}
+
+// Handshakes fail when the peer closes, and are removed out of order
+// from the list and the address index.
+void
+test_handshake_manager::test_incoming_erase() {
+  torrent::HandshakeManager handshake_manager;
+  std::vector<int> peers;
+
+  torrent::manager->connection_manager()->set_max_handshakes_per_address(1);
+
+  peers.push_back(add_incoming(&handshake_manager, "10.0.0.1", 1000));
+  peers.push_back(add_incoming(&handshake_manager, "10.0.0.2", 1000));
+  peers.push_back(add_incoming(&handshake_manager, "10.0.0.3", 1000));
+  peers.push_back(add_incoming(&handshake_manager, "10.0.0.4", 1000));
+  peers.push_back(add_incoming(&handshake_manager, "10.0.0.5", 1000));
+
+  CPPUNIT_ASSERT(handshake_manager.size() == 5);
+
+  ::close(peers[1]);
+  ::close(peers[3]);
+
+  CPPUNIT_ASSERT(poll_until([&] { return handshake_manager.size() == 3; }));
+
+  // The address is free again once its handshake is gone.
+  int peer = add_incoming(&handshake_manager, "10.0.0.2", 1001);
+  CPPUNIT_ASSERT(handshake_manager.size() == 4);
+
+  int rejected = add_incoming(&handshake_manager, "10.0.0.3", 1001);
+  CPPUNIT_ASSERT(handshake_manager.size() == 4);
+  CPPUNIT_ASSERT(is_closed(rejected));
+
+  ::close(peers[0]);
+  ::close(peers[2]);
+  ::close(peers[4]);
+  ::close(peer);
+  ::close(rejected);
+
+  CPPUNIT_ASSERT(poll_until([&] { return handshake_manager.empty(); }));
+}
+
+// Outgoing handshakes also index by download, which must stay in sync
+// when the peers close in a different order than they were added.
+void
+test_handshake_manager::test_outgoing_erase() {
+  uint16_t port;
+  int listen_fd = open_listen(&port);
+
+  torrent::DownloadMain download;
+  torrent::HandshakeManager handshake_manager;
+
+  const char* addresses[] = { "127.0.0.1", "127.0.0.2", "127.0.0.3", "127.0.0.4" };
+
+  for (auto address : addresses)
+    handshake_manager.add_outgoing(make_address(address, port), &download);
+
+  CPPUNIT_ASSERT(handshake_manager.size() == 4);
+  CPPUNIT_ASSERT(handshake_manager.size_info(&download) == 4);
+
+  std::vector<int> accepted;
+
+  for (int i = 0; i < 4; i++) {
+    accepted.push_back(::accept(listen_fd, NULL, NULL));
+    CPPUNIT_ASSERT(accepted.back() != -1);
+  }
+
+  // Close the connections to the second and third address.
+  for (auto fd : accepted) {
+    sockaddr_in sa;
+    socklen_t length = sizeof(sa);
+
+    CPPUNIT_ASSERT(::getsockname(fd, reinterpret_cast<sockaddr*>(&sa), &length) == 0);
+
+    uint32_t host = ntohl(sa.sin_addr.s_addr) & 0xff;
+
+    if (host == 2 || host == 3)
+      ::close(fd);
+  }
+
+  CPPUNIT_ASSERT(poll_until([&] { return handshake_manager.size_info(&download) == 2; }));
+  CPPUNIT_ASSERT(handshake_manager.size() == 2);
+
+  CPPUNIT_ASSERT(handshake_manager.find(make_address("127.0.0.1", port)));
+  CPPUNIT_ASSERT(!handshake_manager.find(make_address("127.0.0.2", port)));
+  CPPUNIT_ASSERT(!handshake_manager.find(make_address("127.0.0.3", port)));
+  CPPUNIT_ASSERT(handshake_manager.find(make_address("127.0.0.4", port)));
+
+  handshake_manager.erase_download(&download);
+  CPPUNIT_ASSERT(handshake_manager.empty());
+
+  for (auto fd : accepted)
+    ::close(fd);
+
+  ::close(listen_fd);
+}
+
+// Connections over the total limit are queued per download, without
+// duplicates, and started one download at a time as room is made.
+void
+test_handshake_manager::test_outgoing_queue() {
+  uint16_t port;
+  int listen_fd = open_listen(&port);
+
+  torrent::DownloadMain download_a;
+  torrent::DownloadMain download_b;
+  torrent::DownloadMain download_c;
+  torrent::HandshakeManager handshake_manager;
+
+  torrent::manager->connection_manager()->set_max_handshakes(1);
+
+  handshake_manager.add_outgoing(make_address("127.0.0.1", port), &download_c);
+
+  handshake_manager.add_outgoing(make_address("127.0.0.2", port), &download_a);
+  handshake_manager.add_outgoing(make_address("127.0.0.3", port), &download_a);
+  handshake_manager.add_outgoing(make_address("127.0.0.2", port), &download_a);
+  handshake_manager.add_outgoing(make_address("127.0.0.4", port), &download_b);
+
+  CPPUNIT_ASSERT(handshake_manager.size() == 1);
+  CPPUNIT_ASSERT(handshake_manager.size_queued() == 3);
+  CPPUNIT_ASSERT(handshake_manager.size_info(&download_a) == 2);
+  CPPUNIT_ASSERT(handshake_manager.size_info(&download_b) == 1);
+  CPPUNIT_ASSERT(handshake_manager.size_info(&download_c) == 1);
+
+  // Two slots free up, the second goes to the next download rather
+  // than the first download's next address.
+  torrent::manager->connection_manager()->set_max_handshakes(2);
+  handshake_manager.erase_download(&download_c);
+
+  CPPUNIT_ASSERT(handshake_manager.size() == 2);
+  CPPUNIT_ASSERT(handshake_manager.size_queued() == 1);
+
+  CPPUNIT_ASSERT(handshake_manager.find(make_address("127.0.0.2", port)));
+  CPPUNIT_ASSERT(!handshake_manager.find(make_address("127.0.0.3", port)));
+  CPPUNIT_ASSERT(handshake_manager.find(make_address("127.0.0.4", port)));
+
+  // The address may be queued again once it left the queue.
+  handshake_manager.add_outgoing(make_address("127.0.0.2", port), &download_a);
+  CPPUNIT_ASSERT(handshake_manager.size_queued() == 2);
+
+  handshake_manager.erase_download(&download_a);
+
+  CPPUNIT_ASSERT(handshake_manager.size() == 1);
+  CPPUNIT_ASSERT(handshake_manager.size_queued() == 0);
+  CPPUNIT_ASSERT(handshake_manager.size_info(&download_a) == 0);
+
+  handshake_manager.erase_download(&download_b);
+  CPPUNIT_ASSERT(handshake_manager.empty());
+
+  ::close(listen_fd);
+}
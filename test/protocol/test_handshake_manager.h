@@ -0,0 +1,21 @@
+#include "helpers/test_fixture.h"
+
+class test_handshake_manager : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_handshake_manager);
+
+  CPPUNIT_TEST(test_incoming_limits);
+  CPPUNIT_TEST(test_incoming_erase);
+  CPPUNIT_TEST(test_outgoing_erase);
+  CPPUNIT_TEST(test_outgoing_queue);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void test_incoming_limits();
+  void test_incoming_erase();
+  void test_outgoing_erase();
+  void test_outgoing_queue();
+};
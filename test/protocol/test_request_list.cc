@@ -3,6 +3,10 @@
 #include "test_request_list.h"
 
 #include "torrent/exceptions.h"
+#include "torrent/rate.h"
+#include "torrent/data/block.h"
+#include "torrent/data/block_list.h"
+#include "torrent/data/block_transfer.h"
 #include "torrent/peer/peer_info.h"
 #include "download/delegator.h"
 #include "protocol/peer_chunks.h"
@@ -258,3 +262,278 @@ TestRequestList::test_choke_unchoke_transfer() {
   CLEAR_TRANSFERS();
   CLEANUP_ALL();
 }
+
+void
+TestRequestList::test_pipe_size_rtt() {
+  SETUP_ALL(basic);
+
+  request_list->rtt_sample(100000, true);
+  CPPUNIT_ASSERT(request_list->rtt() == 100000);
+
+  // 1 MiB/s at 100 ms is 7 blocks in flight, doubled plus headroom.
+  CPPUNIT_ASSERT(request_list->calculate_pipe_size(1 << 20) == 2 * 7 + 4);
+  CPPUNIT_ASSERT(request_list->target_pipe_size() == 18);
+
+  // Shrinks gradually towards the new target.
+  CPPUNIT_ASSERT(request_list->calculate_pipe_size(0) == (3 * 18 + 4) / 4);
+  CPPUNIT_ASSERT(request_list->calculate_pipe_size(1 << 30) == torrent::RequestList::pipe_size_max);
+
+  request_list->rtt_sample(200000, true);
+  CPPUNIT_ASSERT(request_list->rtt() == (7 * 100000 + 200000) / 8);
+
+  // Request timing is ignored once the socket provides samples.
+  request_list->rtt_sample(1000, false);
+  CPPUNIT_ASSERT(request_list->rtt() == (7 * 100000 + 200000) / 8);
+
+  CLEANUP_ALL();
+}
+
+void
+TestRequestList::test_rtt_probe() {
+  SETUP_ALL(basic);
+
+  auto pieces = request_list->delegate(2);
+  CPPUNIT_ASSERT(pieces.size() == 2);
+
+  torrent::cachedTime += rak::timer::from_milliseconds(150);
+
+  CPPUNIT_ASSERT(request_list->downloading(*pieces[0]));
+  request_list->transfer()->adjust_position(pieces[0]->length());
+  request_list->finished();
+
+  CPPUNIT_ASSERT(request_list->rtt() == 150000);
+
+  // Requests queued behind others don't give samples.
+  auto more = request_list->delegate(1);
+  torrent::cachedTime += rak::timer::from_milliseconds(500);
+
+  CPPUNIT_ASSERT(request_list->downloading(*pieces[1]));
+  request_list->transfer()->adjust_position(pieces[1]->length());
+  request_list->finished();
+
+  CPPUNIT_ASSERT(request_list->downloading(*more[0]));
+  request_list->transfer()->adjust_position(more[0]->length());
+  request_list->finished();
+
+  CPPUNIT_ASSERT(request_list->rtt() == 150000);
+
+  CLEANUP_ALL();
+}
+
+// Simulates a peer on a 4 MiB/s link with 200 ms RTT, where each
+// second delivers what the pipe allows in flight, up to the link
+// capacity. The pipe should saturate the link within a few seconds
+// even though the 30 second download rate lags behind.
+void
+TestRequestList::test_pipe_size_latency() {
+  SETUP_ALL(basic);
+
+  const uint64_t link_rate = 4 << 20;
+  const uint32_t rtt = 200000;
+  const uint64_t link_bdp = (link_rate * rtt + (1 << 14) * 1000000ull - 1) / ((1 << 14) * 1000000ull);
+
+  torrent::Rate rate(30);
+  uint64_t throughput = 0;
+  uint32_t pipe_size = 0;
+  int saturated = 0;
+
+  request_list->rtt_sample(rtt, true);
+
+  for (int i = 1; i <= 60; i++) {
+    SET_CACHED_TIME(i);
+
+    pipe_size = request_list->calculate_pipe_size(rate.rate());
+    throughput = std::min<uint64_t>(link_rate, (uint64_t)pipe_size * (1 << 14) * 1000000 / rtt);
+
+    rate.insert(throughput);
+    request_list->delivered(throughput);
+
+    if (throughput == link_rate && saturated == 0)
+      saturated = i;
+
+    // Once saturated the link stays saturated.
+    CPPUNIT_ASSERT(saturated == 0 || throughput == link_rate);
+  }
+
+  CPPUNIT_ASSERT(saturated != 0 && saturated <= 5);
+  CPPUNIT_ASSERT(pipe_size >= link_bdp && pipe_size <= 2 * link_bdp + 4);
+
+  CLEANUP_ALL();
+}
+
+void
+TestRequestList::test_transfer_list_index() {
+  torrent::TransferList transfer_list;
+  transfer_list.slot_canceled() = [](uint32_t) {};
+  transfer_list.slot_queued() = [](uint32_t) {};
+
+  const uint32_t block_size = torrent::Delegator::block_size;
+
+  for (uint32_t index : { 5, 3, 9, 7 })
+    transfer_list.insert(torrent::Piece(index, 0, 4 * block_size), block_size);
+
+  CPPUNIT_ASSERT(transfer_list.find(3) == transfer_list.begin() + 1);
+  CPPUNIT_ASSERT(transfer_list.find(7) == transfer_list.begin() + 3);
+  CPPUNIT_ASSERT(transfer_list.find(4) == transfer_list.end());
+  CPPUNIT_ASSERT((*transfer_list.find(9))->stalled() == 4);
+
+  CPPUNIT_ASSERT(transfer_list.get(9) == *transfer_list.find(9));
+  CPPUNIT_ASSERT(transfer_list.get(4) == NULL);
+  CPPUNIT_ASSERT(transfer_list.get(10) == NULL);
+  CPPUNIT_ASSERT(transfer_list.get(~uint32_t()) == NULL);
+
+  CPPUNIT_ASSERT_THROW(transfer_list.insert(torrent::Piece(9, 0, block_size), block_size), torrent::internal_error);
+
+  transfer_list.erase(transfer_list.find(3));
+
+  CPPUNIT_ASSERT(transfer_list.size() == 3);
+  CPPUNIT_ASSERT(transfer_list.find(3) == transfer_list.end());
+  CPPUNIT_ASSERT(transfer_list.get(3) == NULL);
+  CPPUNIT_ASSERT(transfer_list.find(5) == transfer_list.begin());
+  CPPUNIT_ASSERT(transfer_list.find(9) == transfer_list.begin() + 1);
+  CPPUNIT_ASSERT(transfer_list.find(7) == transfer_list.begin() + 2);
+
+  transfer_list.insert(torrent::Piece(3, 0, block_size), block_size);
+
+  CPPUNIT_ASSERT(transfer_list.find(3) == transfer_list.begin() + 3);
+  CPPUNIT_ASSERT((*transfer_list.find(3))->index() == 3);
+
+  transfer_list.clear();
+
+  CPPUNIT_ASSERT(transfer_list.find(5) == transfer_list.end());
+  CPPUNIT_ASSERT(transfer_list.get(5) == NULL);
+}
+
+static uint32_t
+stalled_find_peer_chunk(torrent::PeerChunks* peerChunk, bool highPriority) {
+  static bool found = false;
+
+  if (found)
+    return ~uint32_t();
+
+  found = true;
+  return 0;
+}
+
+void
+TestRequestList::test_delegate_stalled() {
+  SET_CACHED_TIME(0);
+  SETUP_DELEGATOR(stalled);
+  delegator->slot_chunk_size() = [](uint32_t) { return 4 * torrent::Delegator::block_size; };
+
+  SETUP_PEER_CHUNKS();
+  peer_chunks->bitfield()->set_size_bits(1);
+  peer_chunks->bitfield()->allocate();
+  peer_chunks->bitfield()->set_all();
+
+  torrent::PeerInfo* other_info = new torrent::PeerInfo(peer_info_address.c_sockaddr());
+  torrent::PeerChunks* other_chunks = new torrent::PeerChunks;
+  other_chunks->set_peer_info(other_info);
+  other_chunks->bitfield()->set_size_bits(1);
+  other_chunks->bitfield()->allocate();
+  other_chunks->bitfield()->set_all();
+
+  auto transfers = delegator->delegate(peer_chunks, ~uint32_t(), 3, 0);
+  torrent::BlockList* block_list = *delegator->transfer_list()->find(0);
+
+  CPPUNIT_ASSERT(transfers.size() == 3);
+  CPPUNIT_ASSERT(block_list->stalled() == 1);
+
+  auto other_transfers = delegator->delegate(other_chunks, 0, 3, 0);
+
+  CPPUNIT_ASSERT(other_transfers.size() == 1);
+  CPPUNIT_ASSERT(other_transfers[0]->piece().offset() == 3 * torrent::Delegator::block_size);
+  CPPUNIT_ASSERT(block_list->stalled() == 0);
+  CPPUNIT_ASSERT(delegator->delegate(other_chunks, 0, 3, 0).empty());
+
+  // A stalled transfer opens its block for other peers again.
+  torrent::Block::stalled(transfers[0]);
+
+  CPPUNIT_ASSERT(block_list->stalled() == 1);
+
+  other_transfers = delegator->delegate(other_chunks, 0, 3, 0);
+
+  CPPUNIT_ASSERT(other_transfers.size() == 1);
+  CPPUNIT_ASSERT(other_transfers[0]->piece().offset() == 0);
+  CPPUNIT_ASSERT(block_list->stalled() == 0);
+
+  // Released transfers are erased from their blocks.
+  for (auto transfer : transfers)
+    torrent::Block::release(transfer);
+
+  CPPUNIT_ASSERT(block_list->stalled() == 2);
+
+  CLEAR_TRANSFERS();
+  delete other_chunks;
+  delete other_info;
+  CLEANUP_PEER_CHUNKS();
+  delete delegator;
+}
+
+static uint32_t
+endgame_find_peer_chunk(torrent::PeerChunks* peerChunk, bool highPriority) {
+  static bool found = false;
+
+  if (found)
+    return ~uint32_t();
+
+  found = true;
+  return 0;
+}
+
+#define SETUP_ENDGAME_PEER(name)                                        \
+  torrent::PeerInfo* name ## _info = new torrent::PeerInfo(peer_info_address.c_sockaddr()); \
+  torrent::PeerChunks* name ## _chunks = new torrent::PeerChunks;       \
+  name ## _chunks->set_peer_info(name ## _info);                        \
+  name ## _chunks->bitfield()->set_size_bits(1);                        \
+  name ## _chunks->bitfield()->allocate();                              \
+  name ## _chunks->bitfield()->set_all();
+
+void
+TestRequestList::test_endgame_duplicates() {
+  SET_CACHED_TIME(0);
+  SETUP_DELEGATOR(endgame);
+  delegator->slot_chunk_size() = [](uint32_t) { return 4 * torrent::Delegator::block_size; };
+
+  rak::socket_address peer_info_address;
+  SETUP_ENDGAME_PEER(first);
+  SETUP_ENDGAME_PEER(second);
+  SETUP_ENDGAME_PEER(third);
+  SETUP_ENDGAME_PEER(fourth);
+
+  auto transfers = delegator->delegate(first_chunks, ~uint32_t(), 4, 0);
+  CPPUNIT_ASSERT(transfers.size() == 4);
+
+  // Duplicates are only handed out in end-game.
+  CPPUNIT_ASSERT(delegator->delegate(second_chunks, ~uint32_t(), 4, 4).empty());
+
+  delegator->set_aggressive(true);
+
+  // The peer's duplicate budget bounds the requests.
+  CPPUNIT_ASSERT(delegator->delegate(second_chunks, ~uint32_t(), 4, 0).empty());
+  CPPUNIT_ASSERT(delegator->delegate(second_chunks, ~uint32_t(), 4, 3).size() == 3);
+
+  // Blocks already requested twice are left alone.
+  auto third_transfers = delegator->delegate(third_chunks, ~uint32_t(), 4, 4);
+
+  CPPUNIT_ASSERT(third_transfers.size() == 1);
+  CPPUNIT_ASSERT(third_transfers[0]->piece().offset() == 3 * torrent::Delegator::block_size);
+  CPPUNIT_ASSERT(delegator->delegate(fourth_chunks, ~uint32_t(), 4, 4).empty());
+
+  // Stalled requests don't count against the block.
+  torrent::Block::stalled(transfers[0]);
+
+  auto fourth_transfers = delegator->delegate(fourth_chunks, ~uint32_t(), 4, 4);
+
+  CPPUNIT_ASSERT(fourth_transfers.size() == 1);
+  CPPUNIT_ASSERT(fourth_transfers[0]->piece().offset() == 0);
+
+  CLEAR_TRANSFERS();
+
+  for (auto info : { first_info, second_info, third_info, fourth_info })
+    delete info;
+  for (auto chunks : { first_chunks, second_chunks, third_chunks, fourth_chunks })
+    delete chunks;
+
+  delete delegator;
+}
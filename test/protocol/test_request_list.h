@@ -12,6 +12,14 @@ class TestRequestList : public CppUnit::TestFixture {
   CPPUNIT_TEST(test_choke_unchoke_discard);
   CPPUNIT_TEST(test_choke_unchoke_transfer);
 
+  CPPUNIT_TEST(test_pipe_size_rtt);
+  CPPUNIT_TEST(test_rtt_probe);
+  CPPUNIT_TEST(test_pipe_size_latency);
+
+  CPPUNIT_TEST(test_transfer_list_index);
+  CPPUNIT_TEST(test_delegate_stalled);
+  CPPUNIT_TEST(test_endgame_duplicates);
+
   CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -26,4 +34,12 @@ public:
   void test_choke_normal();
   void test_choke_unchoke_discard();
   void test_choke_unchoke_transfer();
+
+  void test_pipe_size_rtt();
+  void test_rtt_probe();
+  void test_pipe_size_latency();
+
+  void test_transfer_list_index();
+  void test_delegate_stalled();
+  void test_endgame_duplicates();
 };
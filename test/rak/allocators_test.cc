@@ -3,6 +3,7 @@
 #include <stdint.h>
 
 #include "allocators_test.h"
+#include "rak/slab_allocator.h"
 
 CPPUNIT_TEST_SUITE_REGISTRATION(AllocatorsTest);
 
@@ -25,3 +26,26 @@ AllocatorsTest::testAlignment() {
   CPPUNIT_ASSERT(is_aligned(v4));
   CPPUNIT_ASSERT(is_aligned(v5));
 }
+
+void
+AllocatorsTest::testSlabAlignment() {
+  struct object_type { char data[LT_SMP_CACHE_BYTES + 1]; };
+
+  rak::slab_allocator<object_type, 4> slab;
+  std::vector<void*> ptrs;
+
+  CPPUNIT_ASSERT(slab.slot_size() == 2 * LT_SMP_CACHE_BYTES);
+
+  for (int i = 0; i < 6; i++) {
+    ptrs.push_back(slab.allocate());
+    CPPUNIT_ASSERT((reinterpret_cast<intptr_t>(ptrs.back()) & (LT_SMP_CACHE_BYTES - 1)) == 0x0);
+  }
+
+  CPPUNIT_ASSERT(slab.chunks() == 2);
+
+  for (auto ptr : ptrs)
+    slab.deallocate(ptr);
+
+  CPPUNIT_ASSERT(slab.size() == 0);
+  CPPUNIT_ASSERT(slab.peak() == 6);
+}
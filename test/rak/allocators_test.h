@@ -7,6 +7,7 @@
 class AllocatorsTest : public CppUnit::TestFixture {
   CPPUNIT_TEST_SUITE(AllocatorsTest);
   CPPUNIT_TEST(testAlignment);
+  CPPUNIT_TEST(testSlabAlignment);
   CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -16,4 +17,5 @@ public:
   void tearDown() {}
 
   void testAlignment();
+  void testSlabAlignment();
 };
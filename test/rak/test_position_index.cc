@@ -0,0 +1,148 @@
+#include "config.h"
+
+#include "test_position_index.h"
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "rak/position_index.h"
+#include "rak/slab_allocator.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_position_index);
+
+typedef std::vector<uint32_t> key_list;
+
+// Use a weak hash so keys collide and probe sequences wrap around.
+static uint32_t
+weak_hash(uint32_t key) {
+  return key % 7;
+}
+
+static uint32_t
+find_key(const rak::position_index& index, const key_list& keys, uint32_t key) {
+  uint32_t slot = index.find(weak_hash(key), [&](uint32_t position) { return keys[position] == key; });
+
+  return slot == rak::position_index::npos ? rak::position_index::npos : index.position(slot);
+}
+
+// Erases by swapping the back into the hole, like the containers
+// using the index.
+static void
+erase_key(rak::position_index& index, key_list& keys, uint32_t position) {
+  index.erase(index.find_position(weak_hash(keys[position]), position));
+
+  if (position != keys.size() - 1) {
+    index.set_position(index.find_position(weak_hash(keys.back()), keys.size() - 1), position);
+    keys[position] = keys.back();
+  }
+
+  keys.pop_back();
+}
+
+void
+test_position_index::test_basic() {
+  rak::position_index index;
+  key_list keys;
+
+  CPPUNIT_ASSERT(find_key(index, keys, 1) == rak::position_index::npos);
+
+  for (uint32_t key = 0; key < 100; key++) {
+    index.insert(weak_hash(key), keys.size());
+    keys.push_back(key);
+  }
+
+  CPPUNIT_ASSERT(index.size() == 100);
+  CPPUNIT_ASSERT(index.table_size() >= 200);
+
+  for (uint32_t key = 0; key < 100; key++)
+    CPPUNIT_ASSERT(find_key(index, keys, key) == key);
+
+  CPPUNIT_ASSERT(find_key(index, keys, 100) == rak::position_index::npos);
+
+  erase_key(index, keys, 10);
+
+  CPPUNIT_ASSERT(index.size() == 99);
+  CPPUNIT_ASSERT(find_key(index, keys, 10) == rak::position_index::npos);
+  CPPUNIT_ASSERT(find_key(index, keys, 99) == 10);
+
+  index.clear();
+
+  CPPUNIT_ASSERT(index.size() == 0);
+  CPPUNIT_ASSERT(find_key(index, keys, 1) == rak::position_index::npos);
+}
+
+void
+test_position_index::test_shared_key() {
+  rak::position_index index;
+  key_list keys{ 5, 3, 5, 5 };
+
+  for (uint32_t position = 0; position < keys.size(); position++)
+    index.insert(weak_hash(keys[position]), position);
+
+  auto equal = [&](uint32_t position) { return keys[position] == 5; };
+  std::set<uint32_t> found;
+
+  for (uint32_t slot = index.find(weak_hash(5), equal); slot != rak::position_index::npos; slot = index.find_next(slot, weak_hash(5), equal))
+    found.insert(index.position(slot));
+
+  CPPUNIT_ASSERT((found == std::set<uint32_t>{ 0, 2, 3 }));
+}
+
+void
+test_position_index::test_compare_vector() {
+  std::mt19937 rng(4711);
+  rak::position_index index;
+  key_list keys;
+
+  for (unsigned int i = 0; i < 10000; i++) {
+    uint32_t key = rng() % 500;
+
+    if (keys.empty() || rng() % 3 != 0) {
+      if (find_key(index, keys, key) == rak::position_index::npos) {
+        index.insert(weak_hash(key), keys.size());
+        keys.push_back(key);
+      }
+    } else {
+      erase_key(index, keys, rng() % keys.size());
+    }
+
+    CPPUNIT_ASSERT(index.size() == keys.size());
+  }
+
+  for (uint32_t key = 0; key < 500; key++) {
+    uint32_t position = find_key(index, keys, key);
+
+    if (position == rak::position_index::npos)
+      CPPUNIT_ASSERT(std::find(keys.begin(), keys.end(), key) == keys.end());
+    else
+      CPPUNIT_ASSERT(keys[position] == key);
+  }
+}
+
+void
+test_position_index::test_slab() {
+  typedef rak::slab_allocator<uint64_t, 4> slab_type;
+
+  slab_type slab;
+  std::vector<void*> ptrs;
+
+  for (unsigned int i = 0; i < 6; i++)
+    ptrs.push_back(slab.allocate());
+
+  CPPUNIT_ASSERT(slab.size() == 6);
+  CPPUNIT_ASSERT(slab.capacity() == 8);
+  CPPUNIT_ASSERT(std::set<void*>(ptrs.begin(), ptrs.end()).size() == 6);
+
+  slab.deallocate(ptrs[2]);
+
+  CPPUNIT_ASSERT(slab.size() == 5);
+  CPPUNIT_ASSERT(slab.allocate() == ptrs[2]);
+
+  for (unsigned int i = 0; i < 3; i++)
+    slab.allocate();
+
+  CPPUNIT_ASSERT(slab.size() == 9);
+  CPPUNIT_ASSERT(slab.capacity() == 12);
+}
@@ -0,0 +1,18 @@
+#include "helpers/test_fixture.h"
+
+class test_position_index : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_position_index);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_shared_key);
+  CPPUNIT_TEST(test_compare_vector);
+  CPPUNIT_TEST(test_slab);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_shared_key();
+  void test_compare_vector();
+  void test_slab();
+};
@@ -0,0 +1,262 @@
+#include "config.h"
+
+#include "test_timer_wheel.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "rak/priority_queue_default.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(test_timer_wheel);
+
+typedef rak::priority_queue_default wheel_type;
+typedef std::vector<std::unique_ptr<rak::priority_item>> item_list;
+
+static item_list
+create_items(unsigned int count, std::vector<unsigned int>* fired) {
+  item_list items;
+
+  for (unsigned int i = 0; i < count; i++) {
+    items.emplace_back(new rak::priority_item);
+    items.back()->slot() = [fired, i]() { fired->push_back(i); };
+  }
+
+  return items;
+}
+
+static void
+clear_items(wheel_type* wheel, item_list& items) {
+  for (auto& item : items)
+    rak::priority_queue_erase(wheel, item.get());
+}
+
+static rak::timer
+base_time() {
+  return rak::timer::from_seconds(1000000);
+}
+
+// Current times are well past the 2^32 ticks the levels cover.
+static rak::timer
+epoch_time() {
+  return rak::timer::from_seconds(1700000000);
+}
+
+static void
+insert_far_items(wheel_type* wheel, item_list& items, rak::timer base) {
+  rak::priority_queue_insert(wheel, items[0].get(), base + rak::timer::from_seconds(10));
+  rak::priority_queue_insert(wheel, items[1].get(), base + rak::timer::from_minutes(60 * 24 * 50));
+  rak::priority_queue_insert(wheel, items[2].get(), base + rak::timer::from_minutes(60 * 24 * 60));
+  rak::priority_queue_insert(wheel, items[3].get(), base + rak::timer::from_minutes(60 * 24 * 120));
+  rak::priority_queue_insert(wheel, items[4].get(), base + rak::timer::from_minutes(60 * 24 * 400));
+}
+
+static void
+verify_far_items(wheel_type* wheel, item_list& items, std::vector<unsigned int>& fired) {
+  for (unsigned int i = 0; i < items.size(); i++) {
+    CPPUNIT_ASSERT(wheel->top() == items[i].get());
+
+    rak::priority_queue_perform(wheel, items[i]->time() - 1);
+    CPPUNIT_ASSERT(fired.size() == i);
+
+    rak::priority_queue_perform(wheel, items[i]->time());
+    CPPUNIT_ASSERT(fired.size() == i + 1 && fired.back() == i);
+  }
+
+  CPPUNIT_ASSERT(wheel->empty());
+}
+
+void
+test_timer_wheel::test_basic() {
+  auto wheel = std::make_unique<wheel_type>();
+  std::vector<unsigned int> fired;
+  item_list items = create_items(4, &fired);
+
+  CPPUNIT_ASSERT(wheel->empty());
+
+  rak::priority_queue_perform(wheel.get(), base_time());
+
+  rak::priority_queue_insert(wheel.get(), items[0].get(), base_time() + 3000);
+  rak::priority_queue_insert(wheel.get(), items[1].get(), base_time() + 1000);
+  rak::priority_queue_insert(wheel.get(), items[2].get(), base_time() + 2000);
+  rak::priority_queue_insert(wheel.get(), items[3].get(), base_time() + 1500);
+
+  CPPUNIT_ASSERT(wheel->size() == 4);
+  CPPUNIT_ASSERT(wheel->top() == items[1].get());
+
+  rak::priority_queue_perform(wheel.get(), base_time() + 1999);
+
+  CPPUNIT_ASSERT((fired == std::vector<unsigned int>{1, 3}));
+  CPPUNIT_ASSERT(wheel->size() == 2);
+  CPPUNIT_ASSERT(!items[1]->is_queued() && !items[3]->is_queued());
+
+  rak::priority_queue_perform(wheel.get(), base_time() + 3000);
+
+  CPPUNIT_ASSERT((fired == std::vector<unsigned int>{1, 3, 2, 0}));
+  CPPUNIT_ASSERT(wheel->empty());
+}
+
+void
+test_timer_wheel::test_erase() {
+  auto wheel = std::make_unique<wheel_type>();
+  std::vector<unsigned int> fired;
+  item_list items = create_items(3, &fired);
+
+  rak::priority_queue_perform(wheel.get(), base_time());
+
+  rak::priority_queue_insert(wheel.get(), items[0].get(), base_time() + rak::timer::from_seconds(1));
+  rak::priority_queue_insert(wheel.get(), items[1].get(), base_time() + rak::timer::from_seconds(600));
+  rak::priority_queue_insert(wheel.get(), items[2].get(), base_time() + rak::timer::from_seconds(2));
+
+  CPPUNIT_ASSERT(wheel->top() == items[0].get());
+
+  rak::priority_queue_erase(wheel.get(), items[0].get());
+
+  CPPUNIT_ASSERT(!items[0]->is_queued() && !wheel->contains(items[0].get()));
+  CPPUNIT_ASSERT(wheel->top() == items[2].get());
+
+  rak::priority_queue_erase(wheel.get(), items[2].get());
+
+  CPPUNIT_ASSERT(wheel->top() == items[1].get());
+
+  rak::priority_queue_perform(wheel.get(), base_time() + rak::timer::from_seconds(601));
+
+  CPPUNIT_ASSERT((fired == std::vector<unsigned int>{1}));
+  CPPUNIT_ASSERT(wheel->empty());
+}
+
+void
+test_timer_wheel::test_update() {
+  auto wheel = std::make_unique<wheel_type>();
+  std::vector<unsigned int> fired;
+  item_list items = create_items(2, &fired);
+
+  rak::priority_queue_perform(wheel.get(), base_time());
+
+  rak::priority_queue_update(wheel.get(), items[0].get(), base_time() + rak::timer::from_seconds(10));
+  rak::priority_queue_update(wheel.get(), items[1].get(), base_time() + rak::timer::from_seconds(20));
+  rak::priority_queue_update(wheel.get(), items[0].get(), base_time() + rak::timer::from_seconds(30));
+
+  CPPUNIT_ASSERT(wheel->size() == 2);
+  CPPUNIT_ASSERT(wheel->top() == items[1].get());
+
+  // Items in the past are placed in the current slot.
+  rak::priority_queue_update(wheel.get(), items[0].get(), base_time() - rak::timer::from_seconds(5));
+
+  CPPUNIT_ASSERT(wheel->top() == items[0].get());
+
+  rak::priority_queue_perform(wheel.get(), base_time());
+
+  CPPUNIT_ASSERT((fired == std::vector<unsigned int>{0}));
+  clear_items(wheel.get(), items);
+}
+
+void
+test_timer_wheel::test_cascade() {
+  auto wheel = std::make_unique<wheel_type>();
+  std::vector<unsigned int> fired;
+  item_list items = create_items(5, &fired);
+
+  rak::priority_queue_perform(wheel.get(), base_time());
+
+  // Spread the items over the levels and the overflow list.
+  rak::priority_queue_insert(wheel.get(), items[0].get(), base_time() + rak::timer::from_milliseconds(100));
+  rak::priority_queue_insert(wheel.get(), items[1].get(), base_time() + rak::timer::from_seconds(5));
+  rak::priority_queue_insert(wheel.get(), items[2].get(), base_time() + rak::timer::from_minutes(30));
+  rak::priority_queue_insert(wheel.get(), items[3].get(), base_time() + rak::timer::from_minutes(60 * 24 * 3));
+  rak::priority_queue_insert(wheel.get(), items[4].get(), base_time() + rak::timer::from_minutes(60 * 24 * 100));
+
+  for (unsigned int i = 0; i < items.size(); i++) {
+    CPPUNIT_ASSERT(wheel->top() == items[i].get());
+
+    rak::priority_queue_perform(wheel.get(), items[i]->time() - 1);
+    CPPUNIT_ASSERT(fired.size() == i);
+
+    rak::priority_queue_perform(wheel.get(), items[i]->time());
+    CPPUNIT_ASSERT(fired.size() == i + 1 && fired.back() == i);
+  }
+
+  CPPUNIT_ASSERT(wheel->empty());
+}
+
+void
+test_timer_wheel::test_compare_heap() {
+  auto wheel = std::make_unique<wheel_type>();
+  std::vector<unsigned int> fired;
+  item_list items = create_items(1000, &fired);
+
+  rak::priority_queue_heap heap;
+  std::mt19937 rng(1);
+
+  rak::timer current = base_time();
+  rak::priority_queue_perform(wheel.get(), current);
+
+  // Insert, reschedule and cancel items at random, and check that the
+  // wheel always agrees with the heap on the earliest item.
+  for (unsigned int step = 0; step < 20000; step++) {
+    rak::priority_item* item = items[rng() % items.size()].get();
+
+    switch (rng() % 4) {
+    case 0:
+    case 1:
+      if (wheel->contains(item))
+        heap.erase(item);
+
+      rak::priority_queue_update(wheel.get(), item, current + (int64_t)(rng() % (1 << (rng() % 32))) + 1);
+      heap.push(item);
+      break;
+
+    case 2:
+      rak::priority_queue_erase(wheel.get(), item);
+      heap.erase(item);
+      break;
+
+    default:
+      current += (int64_t)(rng() % (1 << (rng() % 24)));
+
+      while (!heap.empty() && heap.top()->time() <= current)
+        heap.pop();
+
+      rak::priority_queue_perform(wheel.get(), current);
+      break;
+    }
+
+    CPPUNIT_ASSERT(wheel->size() == heap.size());
+    CPPUNIT_ASSERT(wheel->empty() || wheel->top()->time() == heap.top()->time());
+  }
+
+  clear_items(wheel.get(), items);
+}
+
+void
+test_timer_wheel::test_real_epoch() {
+  auto wheel = std::make_unique<wheel_type>();
+  std::vector<unsigned int> fired;
+  item_list items = create_items(5, &fired);
+
+  rak::priority_queue_perform(wheel.get(), epoch_time());
+
+  insert_far_items(wheel.get(), items, epoch_time());
+  verify_far_items(wheel.get(), items, fired);
+}
+
+void
+test_timer_wheel::test_insert_before_perform() {
+  auto wheel = std::make_unique<wheel_type>();
+  std::vector<unsigned int> fired;
+  item_list items = create_items(5, &fired);
+
+  // The wheel takes the current time from the first item, the latest
+  // one here, and must place the items again when the first perform
+  // is earlier.
+  rak::priority_queue_insert(wheel.get(), items[4].get(), epoch_time() + rak::timer::from_minutes(60 * 24 * 400));
+  rak::priority_queue_insert(wheel.get(), items[2].get(), epoch_time() + rak::timer::from_minutes(60 * 24 * 60));
+  rak::priority_queue_insert(wheel.get(), items[0].get(), epoch_time() + rak::timer::from_seconds(10));
+  rak::priority_queue_insert(wheel.get(), items[3].get(), epoch_time() + rak::timer::from_minutes(60 * 24 * 120));
+  rak::priority_queue_insert(wheel.get(), items[1].get(), epoch_time() + rak::timer::from_minutes(60 * 24 * 50));
+
+  CPPUNIT_ASSERT(wheel->top() == items[0].get());
+
+  rak::priority_queue_perform(wheel.get(), epoch_time());
+  verify_far_items(wheel.get(), items, fired);
+}
@@ -0,0 +1,24 @@
+#include "helpers/test_fixture.h"
+
+class test_timer_wheel : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_timer_wheel);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_erase);
+  CPPUNIT_TEST(test_update);
+  CPPUNIT_TEST(test_cascade);
+  CPPUNIT_TEST(test_compare_heap);
+  CPPUNIT_TEST(test_real_epoch);
+  CPPUNIT_TEST(test_insert_before_perform);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_erase();
+  void test_update();
+  void test_cascade();
+  void test_compare_heap();
+  void test_real_epoch();
+  void test_insert_before_perform();
+};
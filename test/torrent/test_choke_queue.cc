@@ -0,0 +1,199 @@
+#include "config.h"
+
+#include "test_choke_queue.h"
+
+#include <memory>
+#include <vector>
+#include <netinet/in.h>
+
+#include "manager.h"
+#include "download/download_main.h"
+#include "protocol/peer_connection_base.h"
+#include "torrent/download/choke_group.h"
+#include "torrent/download/choke_queue.h"
+#include "torrent/download/group_entry.h"
+#include "torrent/peer/peer_info.h"
+#include "torrent/poll_select.h"
+#include "torrent/torrent.h"
+#include "torrent/utils/thread_base.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_choke_queue, "torrent");
+
+// A connection without a socket, only the download rate the
+// HEURISTICS_DOWNLOAD_LEECH weights look at is set.
+class test_connection : public torrent::PeerConnectionBase {
+public:
+  test_connection(torrent::DownloadMain* download, torrent::PeerInfo* peer_info, uint32_t rate) {
+    m_download = download;
+    m_peerInfo = peer_info;
+
+    // Keeps the choke messages from inserting the invalid fd into the
+    // poll.
+    m_up->set_state(ProtocolWrite::MSG);
+
+    peer_chunks()->download_throttle()->rate()->insert(rate);
+  }
+
+  void initialize_custom() override {}
+  void update_interested() override {}
+  bool receive_keepalive() override { return true; }
+
+  void event_read() override {}
+  void event_write() override {}
+};
+
+class test_swarm {
+public:
+  test_swarm() {
+    m_download.set_choke_group(&m_group);
+
+    // The download heuristics weigh connections by their download
+    // rate alone, which keeps the upload queue's choices predictable.
+    queue()->set_heuristics(torrent::choke_queue::HEURISTICS_DOWNLOAD_LEECH);
+    queue()->set_slot_connection(&torrent::PeerConnectionBase::receive_upload_choke);
+    queue()->set_slot_unchoke([](int) {});
+    queue()->set_slot_can_unchoke([] { return 0; });
+  }
+
+  ~test_swarm() {
+    for (auto& connection : m_connections)
+      queue()->disconnected(connection.get(), connection->up_choke());
+  }
+
+  torrent::choke_queue* queue() { return m_group.up_queue(); }
+
+  torrent::group_entry*
+  add_entry() {
+    m_entries.emplace_back(new torrent::group_entry);
+    queue()->group_container().push_back(m_entries.back().get());
+    return m_entries.back().get();
+  }
+
+  test_connection*
+  add_connection(torrent::group_entry* entry, uint32_t rate) {
+    sockaddr_in sa{};
+    sa.sin_family = AF_INET;
+
+    m_peer_infos.emplace_back(new torrent::PeerInfo(reinterpret_cast<sockaddr*>(&sa)));
+    m_connections.emplace_back(new test_connection(&m_download, m_peer_infos.back().get(), rate));
+
+    test_connection* connection = m_connections.back().get();
+    connection->up_choke()->set_entry(entry);
+    queue()->set_queued(connection, connection->up_choke());
+
+    return connection;
+  }
+
+private:
+  torrent::DownloadMain m_download;
+  torrent::choke_group  m_group;
+
+  std::vector<std::unique_ptr<torrent::group_entry>> m_entries;
+  std::vector<std::unique_ptr<torrent::PeerInfo>>    m_peer_infos;
+  std::vector<std::unique_ptr<test_connection>>      m_connections;
+};
+
+void
+test_choke_queue::setUp() {
+  test_fixture::setUp();
+
+  torrent::Poll::slot_create_poll() = [] { return torrent::PollSelect::create(256); };
+  torrent::initialize();
+}
+
+void
+test_choke_queue::tearDown() {
+  torrent::cleanup();
+  torrent::thread_base::release_global_lock();
+
+  test_fixture::tearDown();
+}
+
+void
+test_choke_queue::test_cycle_unchoke() {
+  test_swarm swarm;
+  torrent::group_entry* entry = swarm.add_entry();
+  std::vector<test_connection*> connections;
+
+  for (uint32_t rate : { 5, 1, 8, 3, 7, 2, 6, 4 })
+    connections.push_back(swarm.add_connection(entry, rate << 20));
+
+  swarm.queue()->set_max_unchoked(3);
+  CPPUNIT_ASSERT(swarm.queue()->cycle(3) == 3);
+
+  CPPUNIT_ASSERT(swarm.queue()->size_unchoked() == 3);
+  CPPUNIT_ASSERT(swarm.queue()->size_queued() == 5);
+
+  // Only the three fastest connections get unchoked.
+  CPPUNIT_ASSERT(connections[2]->up_choke()->unchoked());
+  CPPUNIT_ASSERT(connections[4]->up_choke()->unchoked());
+  CPPUNIT_ASSERT(connections[6]->up_choke()->unchoked());
+}
+
+// Candidates from several groups are concatenated, so the fastest
+// connections must be found regardless of which group they are in.
+void
+test_choke_queue::test_cycle_groups() {
+  test_swarm swarm;
+  torrent::group_entry* first = swarm.add_entry();
+  torrent::group_entry* second = swarm.add_entry();
+
+  test_connection* first_3 = swarm.add_connection(first, 3 << 20);
+  test_connection* first_1 = swarm.add_connection(first, 1 << 20);
+  test_connection* second_7 = swarm.add_connection(second, 7 << 20);
+  test_connection* second_2 = swarm.add_connection(second, 2 << 20);
+  test_connection* second_4 = swarm.add_connection(second, 4 << 20);
+
+  swarm.queue()->set_max_unchoked(3);
+  CPPUNIT_ASSERT(swarm.queue()->cycle(3) == 3);
+
+  CPPUNIT_ASSERT(first_3->up_choke()->unchoked() && !first_1->up_choke()->unchoked());
+  CPPUNIT_ASSERT(second_7->up_choke()->unchoked() && second_4->up_choke()->unchoked());
+  CPPUNIT_ASSERT(!second_2->up_choke()->unchoked());
+
+  CPPUNIT_ASSERT(first->unchoked()->size() == 1 && first->queued()->size() == 1);
+  CPPUNIT_ASSERT(second->unchoked()->size() == 2 && second->queued()->size() == 1);
+}
+
+// A full queue still alternates, the fastest queued connection
+// replaces the slowest unchoked one.
+void
+test_choke_queue::test_cycle_alternate() {
+  test_swarm swarm;
+  torrent::group_entry* entry = swarm.add_entry();
+
+  test_connection* slow = swarm.add_connection(entry, 1 << 20);
+  test_connection* medium = swarm.add_connection(entry, 2 << 20);
+
+  swarm.queue()->set_max_unchoked(2);
+  CPPUNIT_ASSERT(swarm.queue()->cycle(2) == 2);
+
+  test_connection* fast = swarm.add_connection(entry, 3 << 20);
+  CPPUNIT_ASSERT(swarm.queue()->cycle(2) == 0);
+
+  CPPUNIT_ASSERT(!slow->up_choke()->unchoked());
+  CPPUNIT_ASSERT(medium->up_choke()->unchoked());
+  CPPUNIT_ASSERT(fast->up_choke()->unchoked());
+}
+
+// A group never gets more than 'max_slots' unchoked, even when its
+// queued connections are faster than those of other groups.
+void
+test_choke_queue::test_cycle_slots() {
+  test_swarm swarm;
+  torrent::group_entry* limited = swarm.add_entry();
+  torrent::group_entry* other = swarm.add_entry();
+
+  limited->set_max_slots(1);
+
+  test_connection* limited_8 = swarm.add_connection(limited, 8 << 20);
+  test_connection* limited_7 = swarm.add_connection(limited, 7 << 20);
+  test_connection* other_1 = swarm.add_connection(other, 1 << 20);
+  test_connection* other_2 = swarm.add_connection(other, 2 << 20);
+
+  swarm.queue()->set_max_unchoked(3);
+  CPPUNIT_ASSERT(swarm.queue()->cycle(3) == 3);
+
+  CPPUNIT_ASSERT(limited_8->up_choke()->unchoked() && !limited_7->up_choke()->unchoked());
+  CPPUNIT_ASSERT(other_1->up_choke()->unchoked() && other_2->up_choke()->unchoked());
+}
@@ -0,0 +1,21 @@
+#include "helpers/test_fixture.h"
+
+class test_choke_queue : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_choke_queue);
+
+  CPPUNIT_TEST(test_cycle_unchoke);
+  CPPUNIT_TEST(test_cycle_groups);
+  CPPUNIT_TEST(test_cycle_alternate);
+  CPPUNIT_TEST(test_cycle_slots);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void test_cycle_unchoke();
+  void test_cycle_groups();
+  void test_cycle_alternate();
+  void test_cycle_slots();
+};
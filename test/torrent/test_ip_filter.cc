@@ -0,0 +1,214 @@
+#include "config.h"
+
+#include "test_ip_filter.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "helpers/network.h"
+
+#include "torrent/exceptions.h"
+#include "torrent/peer/ip_filter.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_ip_filter, "torrent");
+
+static uint32_t
+ipv4(const char* str) {
+  in_addr address;
+  inet_pton(AF_INET, str, &address);
+  return ntohl(address.s_addr);
+}
+
+static in6_addr
+ipv6(const char* str) {
+  in6_addr address;
+  inet_pton(AF_INET6, str, &address);
+  return address;
+}
+
+void
+test_ip_filter::test_empty() {
+  torrent::ip_filter filter;
+
+  CPPUNIT_ASSERT(filter.empty());
+  CPPUNIT_ASSERT(filter.lookup_v4(ipv4("1.2.3.4")) == 0);
+  CPPUNIT_ASSERT(filter.lookup_v6(ipv6("ff01::1")) == 0);
+  CPPUNIT_ASSERT(filter.lookup(nullptr) == 0);
+
+  auto built = torrent::ip_filter_builder().build();
+
+  CPPUNIT_ASSERT(built->empty());
+  CPPUNIT_ASSERT(built->lookup_v4(0) == 0);
+}
+
+void
+test_ip_filter::test_v4() {
+  torrent::ip_filter_builder builder;
+  builder.insert(ipv4("10.0.0.0"), ipv4("10.255.255.255"), 1);
+  builder.insert(ipv4("1.2.3.4"), ipv4("1.2.3.4"), 2);
+  builder.insert(ipv4("192.168.0.0"), ipv4("192.168.255.255"), 4);
+
+  auto filter = builder.build();
+
+  CPPUNIT_ASSERT(filter->size_v4() == 3 && filter->size_v6() == 0);
+  CPPUNIT_ASSERT(filter->lookup_v4(ipv4("1.2.3.3")) == 0);
+  CPPUNIT_ASSERT(filter->lookup_v4(ipv4("1.2.3.4")) == 2);
+  CPPUNIT_ASSERT(filter->lookup_v4(ipv4("1.2.3.5")) == 0);
+  CPPUNIT_ASSERT(filter->lookup_v4(ipv4("9.255.255.255")) == 0);
+  CPPUNIT_ASSERT(filter->lookup_v4(ipv4("10.0.0.0")) == 1);
+  CPPUNIT_ASSERT(filter->lookup_v4(ipv4("10.128.0.1")) == 1);
+  CPPUNIT_ASSERT(filter->lookup_v4(ipv4("10.255.255.255")) == 1);
+  CPPUNIT_ASSERT(filter->lookup_v4(ipv4("11.0.0.0")) == 0);
+  CPPUNIT_ASSERT(filter->lookup_v4(ipv4("192.168.1.1")) == 4);
+  CPPUNIT_ASSERT(filter->lookup_v4(ipv4("255.255.255.255")) == 0);
+
+  CPPUNIT_ASSERT_THROW(builder.insert(2, 1, 1), torrent::input_error);
+}
+
+void
+test_ip_filter::test_v4_overlap() {
+  torrent::ip_filter_builder builder;
+  builder.insert(100, 200, 1);
+  builder.insert(150, 160, 2);
+  builder.insert(50, 120, 1);
+  builder.insert(190, 300, 4);
+  builder.insert(155, 155, 1);
+
+  auto filter = builder.build();
+
+  // [50,149]:1 [150,154]:2 [155,155]:1 [156,160]:2 [161,189]:1 [190,300]:4
+  CPPUNIT_ASSERT(filter->size_v4() == 6);
+  CPPUNIT_ASSERT(filter->lookup_v4(49) == 0);
+  CPPUNIT_ASSERT(filter->lookup_v4(50) == 1);
+  CPPUNIT_ASSERT(filter->lookup_v4(149) == 1);
+  CPPUNIT_ASSERT(filter->lookup_v4(150) == 2);
+  CPPUNIT_ASSERT(filter->lookup_v4(155) == 1);
+  CPPUNIT_ASSERT(filter->lookup_v4(156) == 2);
+  CPPUNIT_ASSERT(filter->lookup_v4(161) == 1);
+  CPPUNIT_ASSERT(filter->lookup_v4(189) == 1);
+  CPPUNIT_ASSERT(filter->lookup_v4(190) == 4);
+  CPPUNIT_ASSERT(filter->lookup_v4(300) == 4);
+  CPPUNIT_ASSERT(filter->lookup_v4(301) == 0);
+}
+
+void
+test_ip_filter::test_v4_bounds() {
+  torrent::ip_filter_builder builder;
+  builder.insert(0, 0xffffffff, 1);
+  builder.insert(0xffffff00, 0xffffffff, 2);
+  builder.insert(0, 0, 2);
+
+  auto filter = builder.build();
+
+  CPPUNIT_ASSERT(filter->size_v4() == 3);
+  CPPUNIT_ASSERT(filter->lookup_v4(0) == 2);
+  CPPUNIT_ASSERT(filter->lookup_v4(1) == 1);
+  CPPUNIT_ASSERT(filter->lookup_v4(0xfffffeff) == 1);
+  CPPUNIT_ASSERT(filter->lookup_v4(0xffffff00) == 2);
+  CPPUNIT_ASSERT(filter->lookup_v4(0xffffffff) == 2);
+}
+
+void
+test_ip_filter::test_v6() {
+  torrent::ip_filter_builder builder;
+  builder.insert(ipv6("2001:db8::"), ipv6("2001:db8:ffff:ffff:ffff:ffff:ffff:ffff"), 1);
+  builder.insert(ipv6("2001:db8:0:0:ffff:ffff:ffff:ffff"), ipv6("2001:db8:0:1::"), 2);
+
+  auto filter = builder.build();
+
+  CPPUNIT_ASSERT(filter->size_v4() == 0 && filter->size_v6() == 3);
+  CPPUNIT_ASSERT(filter->lookup_v6(ipv6("2001:db7:ffff:ffff:ffff:ffff:ffff:ffff")) == 0);
+  CPPUNIT_ASSERT(filter->lookup_v6(ipv6("2001:db8::1")) == 1);
+  CPPUNIT_ASSERT(filter->lookup_v6(ipv6("2001:db8:0:0:ffff:ffff:ffff:fffe")) == 1);
+  CPPUNIT_ASSERT(filter->lookup_v6(ipv6("2001:db8:0:0:ffff:ffff:ffff:ffff")) == 2);
+  CPPUNIT_ASSERT(filter->lookup_v6(ipv6("2001:db8:0:1::")) == 2);
+  CPPUNIT_ASSERT(filter->lookup_v6(ipv6("2001:db8:0:1::1")) == 1);
+  CPPUNIT_ASSERT(filter->lookup_v6(ipv6("2001:db9::")) == 0);
+}
+
+void
+test_ip_filter::test_sockaddr() {
+  torrent::ip_filter_builder builder;
+  builder.insert(ipv4("1.2.3.4"), ipv4("1.2.3.4"), 1);
+  builder.insert(ipv6("ff01::1"), ipv6("ff01::1"), 2);
+
+  auto filter = builder.build();
+
+  CPPUNIT_ASSERT(filter->lookup(wrap_ai_get_first_sa("1.2.3.4", "5000").get()) == 1);
+  CPPUNIT_ASSERT(filter->lookup(wrap_ai_get_first_sa("4.3.2.1").get()) == 0);
+  CPPUNIT_ASSERT(filter->lookup(wrap_ai_get_first_sa("::ffff:1.2.3.4").get()) == 1);
+  CPPUNIT_ASSERT(filter->lookup(wrap_ai_get_first_sa("ff01::1").get()) == 2);
+  CPPUNIT_ASSERT(filter->lookup(wrap_ai_get_first_sa("ff01::2").get()) == 0);
+}
+
+void
+test_ip_filter::test_file() {
+  torrent::ip_filter_builder builder;
+  builder.insert(ipv4("10.0.0.0"), ipv4("10.255.255.255"), 1);
+  builder.insert(ipv6("ff01::1"), ipv6("ff01::1"), 2);
+
+  char path[] = "/tmp/test_ip_filter.XXXXXX";
+  int fd = mkstemp(path);
+  CPPUNIT_ASSERT(fd != -1);
+  close(fd);
+
+  builder.build()->save_file(path);
+  auto filter = torrent::ip_filter::load_file(path);
+
+  std::remove(path);
+
+  CPPUNIT_ASSERT(filter->size_v4() == 1 && filter->size_v6() == 1);
+  CPPUNIT_ASSERT(filter->lookup_v4(ipv4("10.1.2.3")) == 1);
+  CPPUNIT_ASSERT(filter->lookup_v4(ipv4("11.0.0.0")) == 0);
+  CPPUNIT_ASSERT(filter->lookup_v6(ipv6("ff01::1")) == 2);
+
+  CPPUNIT_ASSERT_THROW(torrent::ip_filter::load_file("/nonexistent/ip_filter"), torrent::input_error);
+}
+
+// Writes a header and IPv4 arrays by hand, the builder never produces
+// unsorted ranges.
+static void
+write_raw_filter(const char* path, const std::vector<uint32_t>& first, const std::vector<uint32_t>& last) {
+  uint32_t size = first.size();
+  std::vector<int32_t> values(size, 1);
+
+  FILE* file = std::fopen(path, "wb");
+  CPPUNIT_ASSERT(file != NULL);
+
+  uint32_t header[2] = { size, 0 };
+  std::fwrite("ltipflt1", 1, 8, file);
+  std::fwrite(header, sizeof(header), 1, file);
+  std::fwrite(first.data(), sizeof(uint32_t), size, file);
+  std::fwrite(last.data(), sizeof(uint32_t), size, file);
+  std::fwrite(values.data(), sizeof(int32_t), size, file);
+
+  // Pad to the 8 byte aligned IPv6 offset.
+  long padding = (8 - std::ftell(file) % 8) % 8;
+  std::fwrite("\0\0\0\0\0\0\0", 1, padding, file);
+  std::fclose(file);
+}
+
+void
+test_ip_filter::test_file_invalid() {
+  char path[] = "/tmp/test_ip_filter.XXXXXX";
+  int fd = mkstemp(path);
+  CPPUNIT_ASSERT(fd != -1);
+  close(fd);
+
+  write_raw_filter(path, { ipv4("1.0.0.0"), ipv4("2.0.0.0") }, { ipv4("1.0.0.255"), ipv4("2.0.0.255") });
+  CPPUNIT_ASSERT(torrent::ip_filter::load_file(path)->lookup_v4(ipv4("2.0.0.1")) == 1);
+
+  write_raw_filter(path, { ipv4("2.0.0.0"), ipv4("1.0.0.0") }, { ipv4("2.0.0.255"), ipv4("1.0.0.255") });
+  CPPUNIT_ASSERT_THROW(torrent::ip_filter::load_file(path), torrent::input_error);
+
+  write_raw_filter(path, { ipv4("1.0.0.0"), ipv4("1.0.0.128") }, { ipv4("1.0.0.255"), ipv4("1.0.1.0") });
+  CPPUNIT_ASSERT_THROW(torrent::ip_filter::load_file(path), torrent::input_error);
+
+  write_raw_filter(path, { ipv4("1.0.0.255") }, { ipv4("1.0.0.0") });
+  CPPUNIT_ASSERT_THROW(torrent::ip_filter::load_file(path), torrent::input_error);
+
+  std::remove(path);
+}
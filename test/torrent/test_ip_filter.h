@@ -0,0 +1,26 @@
+#include "helpers/test_fixture.h"
+
+class test_ip_filter : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_ip_filter);
+
+  CPPUNIT_TEST(test_empty);
+  CPPUNIT_TEST(test_v4);
+  CPPUNIT_TEST(test_v4_overlap);
+  CPPUNIT_TEST(test_v4_bounds);
+  CPPUNIT_TEST(test_v6);
+  CPPUNIT_TEST(test_sockaddr);
+  CPPUNIT_TEST(test_file);
+  CPPUNIT_TEST(test_file_invalid);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_empty();
+  void test_v4();
+  void test_v4_overlap();
+  void test_v4_bounds();
+  void test_v6();
+  void test_sockaddr();
+  void test_file();
+  void test_file_invalid();
+};
@@ -0,0 +1,135 @@
+#include "config.h"
+
+#include "test_poll_epoll.h"
+
+#include <memory>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "torrent/event.h"
+#include "torrent/poll_epoll.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_poll_epoll, "torrent");
+
+// Counts reads without consuming any data, like a throttled peer
+// connection.
+class counting_event : public torrent::Event {
+public:
+  counting_event(int fd) { set_file_descriptor(fd); }
+
+  void event_read() override  { m_reads++; }
+  void event_write() override { m_writes++; }
+  void event_error() override {}
+
+  unsigned int m_reads{0};
+  unsigned int m_writes{0};
+};
+
+static unsigned int
+poll_perform(torrent::PollEPoll* poll, int msec = 0) {
+  if (poll->poll(msec) == -1)
+    return 0;
+
+  return poll->perform();
+}
+
+void
+test_poll_epoll::setUp() {
+  test_fixture::setUp();
+
+  CPPUNIT_ASSERT(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, m_sockets) == 0);
+}
+
+void
+test_poll_epoll::tearDown() {
+  ::close(m_sockets[0]);
+  ::close(m_sockets[1]);
+
+  test_fixture::tearDown();
+}
+
+void
+test_poll_epoll::test_level_triggered() {
+  std::unique_ptr<torrent::PollEPoll> poll(torrent::PollEPoll::create(256));
+  counting_event event(m_sockets[0]);
+
+  if (poll == nullptr)
+    return;
+
+  poll->open(&event);
+  poll->insert_read(&event);
+
+  CPPUNIT_ASSERT(::write(m_sockets[1], "a", 1) == 1);
+  CPPUNIT_ASSERT(poll_perform(poll.get()) == 1 && event.m_reads == 1);
+
+  // Unread data is reported again.
+  CPPUNIT_ASSERT(poll_perform(poll.get()) == 1 && event.m_reads == 2);
+
+  poll->remove_read(&event);
+  CPPUNIT_ASSERT(poll_perform(poll.get()) == 0 && event.m_reads == 2);
+
+  poll->close(&event);
+}
+
+void
+test_poll_epoll::test_edge_triggered() {
+  std::unique_ptr<torrent::PollEPoll> poll(torrent::PollEPoll::create(256));
+  counting_event event(m_sockets[0]);
+
+  if (poll == nullptr)
+    return;
+
+  poll->set_flags(torrent::Poll::flag_edge_triggered);
+  poll->open(&event);
+  poll->insert_read(&event);
+
+  CPPUNIT_ASSERT(poll->in_read(&event) && !poll->in_write(&event));
+
+  CPPUNIT_ASSERT(::write(m_sockets[1], "a", 1) == 1);
+  CPPUNIT_ASSERT(poll_perform(poll.get()) == 1 && event.m_reads == 1);
+
+  // Only new data is reported, and writability is not passed on as
+  // write was not inserted.
+  CPPUNIT_ASSERT(poll_perform(poll.get()) == 0 && event.m_reads == 1);
+  CPPUNIT_ASSERT(event.m_writes == 0);
+
+  CPPUNIT_ASSERT(::write(m_sockets[1], "b", 1) == 1);
+  CPPUNIT_ASSERT(poll_perform(poll.get()) == 1 && event.m_reads == 2);
+
+  // Writability was recorded when registered.
+  poll->insert_write(&event);
+  CPPUNIT_ASSERT(poll_perform(poll.get()) == 1 && event.m_writes == 1);
+
+  poll->remove_write(&event);
+  poll->remove_read(&event);
+  poll->close(&event);
+}
+
+void
+test_poll_epoll::test_edge_triggered_reinsert() {
+  std::unique_ptr<torrent::PollEPoll> poll(torrent::PollEPoll::create(256));
+  counting_event event(m_sockets[0]);
+
+  if (poll == nullptr)
+    return;
+
+  poll->set_flags(torrent::Poll::flag_edge_triggered);
+  poll->open(&event);
+  poll->insert_read(&event);
+
+  CPPUNIT_ASSERT(::write(m_sockets[1], "a", 1) == 1);
+  CPPUNIT_ASSERT(poll_perform(poll.get()) == 1 && event.m_reads == 1);
+
+  // Removing read leaves the socket marked as possibly readable, so
+  // inserting it again calls the event without waiting for new data.
+  poll->remove_read(&event);
+  CPPUNIT_ASSERT(!poll->in_read(&event));
+  CPPUNIT_ASSERT(poll_perform(poll.get()) == 0 && event.m_reads == 1);
+
+  poll->insert_read(&event);
+  CPPUNIT_ASSERT(poll_perform(poll.get(), 10000) == 1 && event.m_reads == 2);
+  CPPUNIT_ASSERT(poll_perform(poll.get()) == 0 && event.m_reads == 2);
+
+  poll->remove_read(&event);
+  poll->close(&event);
+}
@@ -0,0 +1,22 @@
+#include "helpers/test_fixture.h"
+
+class test_poll_epoll : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_poll_epoll);
+
+  CPPUNIT_TEST(test_level_triggered);
+  CPPUNIT_TEST(test_edge_triggered);
+  CPPUNIT_TEST(test_edge_triggered_reinsert);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void test_level_triggered();
+  void test_edge_triggered();
+  void test_edge_triggered_reinsert();
+
+private:
+  int m_sockets[2];
+};
@@ -0,0 +1,137 @@
+#include "config.h"
+
+#include "test_rate.h"
+
+#include "globals.h"
+#include "torrent/rate.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_rate, "torrent");
+
+static void
+set_time(int32_t seconds) {
+  torrent::cachedTime = rak::timer::from_seconds(1000000 + seconds);
+}
+
+void
+test_rate::tearDown() {
+  torrent::cachedTime = rak::timer::current();
+  test_fixture::tearDown();
+}
+
+void
+test_rate::test_basic() {
+  set_time(0);
+  torrent::Rate rate(10);
+
+  CPPUNIT_ASSERT(rate.rate() == 0 && rate.total() == 0);
+  CPPUNIT_ASSERT(rate.granularity() == 1);
+
+  rate.insert(500);
+  rate.insert(500);
+
+  CPPUNIT_ASSERT(rate.rate() == 100 && rate.total() == 1000);
+
+  set_time(5);
+  rate.insert(1000);
+
+  CPPUNIT_ASSERT(rate.rate() == 200 && rate.total() == 2000);
+
+  rate.reset_rate();
+
+  CPPUNIT_ASSERT(rate.rate() == 0 && rate.total() == 2000);
+}
+
+void
+test_rate::test_discard() {
+  set_time(0);
+  torrent::Rate rate(10);
+
+  rate.insert(1000);
+  set_time(4);
+  rate.insert(2000);
+
+  set_time(10);
+  CPPUNIT_ASSERT(rate.rate() == 300);
+
+  set_time(11);
+  CPPUNIT_ASSERT(rate.rate() == 200);
+
+  set_time(14);
+  CPPUNIT_ASSERT(rate.rate() == 200);
+
+  set_time(15);
+  CPPUNIT_ASSERT(rate.rate() == 0);
+
+  // Idle for longer than the ring, then reuse it.
+  set_time(1000);
+  rate.insert(100);
+  set_time(1001);
+  rate.insert(200);
+
+  CPPUNIT_ASSERT(rate.rate() == 30 && rate.total() == 3300);
+}
+
+void
+test_rate::test_coarse_span() {
+  set_time(0);
+  torrent::Rate rate(600);
+
+  CPPUNIT_ASSERT(rate.granularity() == 20);
+
+  for (int i = 0; i < 600; i++) {
+    set_time(i);
+    rate.insert(600);
+  }
+
+  CPPUNIT_ASSERT(rate.rate() == 600);
+
+  // The first bucket covers seconds [0, 20) and is dropped once all
+  // of them are older than the span.
+  set_time(619);
+  CPPUNIT_ASSERT(rate.rate() == 600);
+  set_time(620);
+  CPPUNIT_ASSERT(rate.rate() == 580);
+
+  set_time(1219);
+  CPPUNIT_ASSERT(rate.rate() == 0);
+}
+
+void
+test_rate::test_time_backwards() {
+  set_time(100);
+  torrent::Rate rate(10);
+
+  rate.insert(100);
+  set_time(50);
+  rate.insert(100);
+
+  CPPUNIT_ASSERT(rate.rate() == 20);
+
+  set_time(110);
+  CPPUNIT_ASSERT(rate.rate() == 20);
+
+  set_time(111);
+  CPPUNIT_ASSERT(rate.rate() == 0);
+}
+
+void
+test_rate::test_ewma() {
+  set_time(0);
+  torrent::Rate rate(10, torrent::Rate::mode_ewma);
+
+  for (int i = 0; i < 100; i++) {
+    set_time(i);
+    rate.insert(1000);
+  }
+
+  set_time(100);
+  CPPUNIT_ASSERT(rate.rate() > 990 && rate.rate() <= 1000);
+  CPPUNIT_ASSERT(rate.total() == 100000);
+
+  // Decays by e^-1 per span when idle.
+  set_time(110);
+  CPPUNIT_ASSERT(rate.rate() > 360 && rate.rate() < 380);
+
+  set_time(1000);
+  CPPUNIT_ASSERT(rate.rate() == 0);
+}
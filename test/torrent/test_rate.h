@@ -0,0 +1,22 @@
+#include "helpers/test_fixture.h"
+
+class test_rate : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_rate);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_discard);
+  CPPUNIT_TEST(test_coarse_span);
+  CPPUNIT_TEST(test_time_backwards);
+  CPPUNIT_TEST(test_ewma);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void tearDown();
+
+  void test_basic();
+  void test_discard();
+  void test_coarse_span();
+  void test_time_backwards();
+  void test_ewma();
+};
@@ -0,0 +1,152 @@
+#include "config.h"
+
+#include "test_task_queue.h"
+
+#include "helpers/test_thread.h"
+#include "helpers/test_utils.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <torrent/utils/task_queue.h>
+#include <torrent/utils/thread_base.h>
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_task_queue, "torrent/utils");
+
+struct count_destroyed {
+  count_destroyed(int* counter) : m_counter(counter) {}
+  count_destroyed(count_destroyed&& other) : m_counter(other.m_counter) { other.m_counter = nullptr; }
+  ~count_destroyed() { if (m_counter != nullptr) (*m_counter)++; }
+
+  int* m_counter;
+};
+
+void
+test_task_queue::test_basic() {
+  torrent::task_queue queue;
+  std::vector<int> result;
+
+  CPPUNIT_ASSERT(queue.empty());
+  CPPUNIT_ASSERT(queue.process() == 0);
+
+  for (int i = 0; i < 5; i++)
+    queue.push([&result, i] { result.push_back(i); });
+
+  CPPUNIT_ASSERT(!queue.empty());
+  CPPUNIT_ASSERT(queue.process(2) == 2);
+  CPPUNIT_ASSERT(result == std::vector<int>({ 0, 1 }));
+
+  CPPUNIT_ASSERT(queue.process() == 3);
+  CPPUNIT_ASSERT(result == std::vector<int>({ 0, 1, 2, 3, 4 }));
+  CPPUNIT_ASSERT(queue.empty());
+}
+
+void
+test_task_queue::test_move_only() {
+  torrent::task_queue queue;
+  int value = 0;
+  int destroyed = 0;
+
+  queue.push([&value, ptr = std::make_unique<int>(42)] { value = *ptr; });
+  queue.push([&value, counter = count_destroyed(&destroyed)] { value++; });
+
+  CPPUNIT_ASSERT(queue.process() == 2);
+  CPPUNIT_ASSERT(value == 43);
+  CPPUNIT_ASSERT(destroyed == 1);
+}
+
+void
+test_task_queue::test_clear() {
+  int value = 0;
+  int destroyed = 0;
+
+  {
+    torrent::task_queue queue;
+
+    queue.push([&value, counter = count_destroyed(&destroyed)] { value++; });
+    queue.push([&value, counter = count_destroyed(&destroyed)] { value++; });
+    queue.clear();
+
+    CPPUNIT_ASSERT(queue.empty());
+    CPPUNIT_ASSERT(destroyed == 2);
+
+    queue.push([&value, counter = count_destroyed(&destroyed)] { value++; });
+  }
+
+  CPPUNIT_ASSERT(value == 0);
+  CPPUNIT_ASSERT(destroyed == 3);
+}
+
+void
+test_task_queue::test_reentrant() {
+  torrent::task_queue queue;
+  std::vector<int> result;
+
+  queue.push([&] {
+      result.push_back(0);
+      queue.push([&result] { result.push_back(2); });
+    });
+  queue.push([&result] { result.push_back(1); });
+
+  CPPUNIT_ASSERT(queue.process() == 3);
+  CPPUNIT_ASSERT(result == std::vector<int>({ 0, 1, 2 }));
+}
+
+void
+test_task_queue::test_threaded() {
+  static const int producers = 4;
+  static const int tasks = 20000;
+
+  torrent::task_queue queue;
+  std::vector<int> last(producers, -1);
+  std::atomic_int out_of_order{0};
+  std::vector<std::thread> threads;
+  int processed = 0;
+
+  for (int p = 0; p < producers; p++)
+    threads.emplace_back([&, p] {
+        for (int i = 0; i < tasks; i++)
+          queue.push([&, p, i] {
+              if (last[p] + 1 != i)
+                out_of_order++;
+
+              last[p] = i;
+            });
+      });
+
+  while (processed != producers * tasks)
+    processed += queue.process();
+
+  for (auto& thread : threads)
+    thread.join();
+
+  CPPUNIT_ASSERT(queue.empty());
+  CPPUNIT_ASSERT(out_of_order == 0);
+
+  for (int p = 0; p < producers; p++)
+    CPPUNIT_ASSERT(last[p] == tasks - 1);
+}
+
+void
+test_task_queue::test_thread_post() {
+  test_thread* thread = new test_thread;
+  thread->set_test_flag(test_thread::test_flag_long_timeout);
+
+  thread->init_thread();
+  thread->start_thread();
+
+  // Posting interrupts the poll, so this doesn't wait for the timeout.
+  std::atomic_int value{0};
+
+  for (int i = 1; i <= 10; i++) {
+    thread->post([&value] { value++; });
+    CPPUNIT_ASSERT(wait_for_true([&value, i] { return value == i; }));
+  }
+
+  thread->stop_thread();
+  CPPUNIT_ASSERT(wait_for_true(std::bind(&test_thread::is_state, thread, test_thread::STATE_INACTIVE)));
+
+  delete thread;
+}
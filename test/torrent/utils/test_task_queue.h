@@ -0,0 +1,24 @@
+#include "helpers/test_fixture.h"
+
+class test_task_queue : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_task_queue);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_move_only);
+  CPPUNIT_TEST(test_clear);
+  CPPUNIT_TEST(test_reentrant);
+
+  CPPUNIT_TEST(test_threaded);
+  CPPUNIT_TEST(test_thread_post);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_move_only();
+  void test_clear();
+  void test_reentrant();
+
+  void test_threaded();
+  void test_thread_post();
+};
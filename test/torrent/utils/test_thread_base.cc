@@ -5,7 +5,10 @@
 #include "helpers/test_thread.h"
 #include "helpers/test_utils.h"
 
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <sched.h>
 #include <unistd.h>
 
 #include "torrent/exceptions.h"
@@ -90,9 +93,11 @@ test_thread_base::test_global_lock_basic() {
 
   thread->set_acquire_global();
   CPPUNIT_ASSERT(!wait_for_true(std::bind(&test_thread::is_test_flags, thread, test_thread::test_flag_has_global)));
+  CPPUNIT_ASSERT(torrent::thread_base::global_queue_size() == 1);
   
   torrent::thread_base::release_global_lock();
   CPPUNIT_ASSERT(wait_for_true(std::bind(&test_thread::is_test_flags, thread, test_thread::test_flag_has_global)));
+  CPPUNIT_ASSERT(torrent::thread_base::global_queue_size() == 0);
 
   CPPUNIT_ASSERT(!torrent::thread_base::trylock_global_lock());
   torrent::thread_base::release_global_lock();
@@ -166,3 +171,34 @@ test_thread_base::test_stop() {
     torrent::thread_base::release_global_lock();
   };
 }
+
+// Posts while the thread is going between processing its queue and
+// polling. A lost wakeup leaves the task until the 10 second timeout.
+void
+test_thread_base::test_post_wakeup() {
+  test_thread* thread = new test_thread;
+  thread->set_test_flag(test_thread::test_flag_long_timeout);
+
+  thread->init_thread();
+  thread->start_thread();
+
+  CPPUNIT_ASSERT(wait_for_true(std::bind(&test_thread::is_state, thread, test_thread::STATE_ACTIVE)));
+
+  std::atomic_int count{0};
+
+  for (int i = 0; i < 2000; i++) {
+    thread->post([&count]() { count++; });
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+
+    while (count != i + 1 && std::chrono::steady_clock::now() < deadline)
+      sched_yield();
+
+    CPPUNIT_ASSERT(count == i + 1);
+  }
+
+  thread->stop_thread();
+  CPPUNIT_ASSERT(wait_for_true(std::bind(&test_thread::is_state, thread, test_thread::STATE_INACTIVE)));
+
+  delete thread;
+}
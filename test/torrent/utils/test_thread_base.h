@@ -9,6 +9,7 @@ class test_thread_base : public test_fixture {
   CPPUNIT_TEST(test_global_lock_basic);
   CPPUNIT_TEST(test_interrupt);
   CPPUNIT_TEST(test_stop);
+  CPPUNIT_TEST(test_post_wakeup);
 
   CPPUNIT_TEST_SUITE_END();
 
@@ -22,4 +23,5 @@ public:
   void test_interrupt();
   void test_interrupt_legacy();
   void test_stop();
+  void test_post_wakeup();
 };
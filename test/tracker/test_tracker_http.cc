@@ -2,10 +2,81 @@
 
 #include "test_tracker_http.h"
 
+#include "net/address_list.h"
+#include "torrent/object_raw_bencode.h"
 #include "tracker/tracker_http.h"
+#include "tracker/tracker_http_buffer.h"
 
 CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_tracker_http, "tracker");
 
 void
 test_tracker_http::test_basic() {
 }
+
+void
+test_tracker_http::test_buffer() {
+  torrent::TrackerHttpBuffer buffer;
+  std::iostream* stream = &buffer;
+
+  CPPUNIT_ASSERT(buffer.size() == 0);
+  CPPUNIT_ASSERT(stream->good());
+
+  stream->write("d8:intervali", 12);
+  *stream << 1800 << 'e' << 'e';
+
+  CPPUNIT_ASSERT(stream->good());
+  CPPUNIT_ASSERT(buffer.str() == "d8:intervali1800ee");
+  CPPUNIT_ASSERT(buffer.end() - buffer.data() == 18);
+}
+
+void
+test_tracker_http::test_buffer_pool() {
+  torrent::TrackerHttpBuffer::clear_pool();
+
+  const char* storage;
+
+  {
+    torrent::TrackerHttpBuffer buffer;
+    buffer.write("abc", 3);
+    storage = buffer.data();
+  }
+
+  CPPUNIT_ASSERT(torrent::TrackerHttpBuffer::size_pool() == 1);
+
+  {
+    torrent::TrackerHttpBuffer buffer;
+
+    CPPUNIT_ASSERT(torrent::TrackerHttpBuffer::size_pool() == 0);
+    CPPUNIT_ASSERT(buffer.size() == 0);
+
+    buffer.write("de", 2);
+    CPPUNIT_ASSERT(buffer.data() == storage);
+
+    // Buffers grown past the limit are not returned to the pool.
+    std::string large(torrent::TrackerHttpBuffer::max_pooled_capacity + 1, 'x');
+    buffer.write(large.data(), large.size());
+  }
+
+  CPPUNIT_ASSERT(torrent::TrackerHttpBuffer::size_pool() == 0);
+}
+
+void
+test_tracker_http::test_address_normal() {
+  torrent::AddressList list;
+  auto peers = torrent::raw_bencode::from_c_str("l"
+                                                "d2:ip9:127.0.0.17:peer id20:aaaaaaaaaaaaaaaaaaaa4:porti6881ee"
+                                                "d2:ip8:10.0.0.14:porti0ee"
+                                                "d2:ip7:invalid4:porti1ee"
+                                                "i5e"
+                                                "d4:porti51413e2:ip8:10.0.0.2e"
+                                                "e");
+
+  list.parse_address_normal(peers.as_raw_list());
+
+  CPPUNIT_ASSERT(list.size() == 2);
+  CPPUNIT_ASSERT(list.front().address_str() == "127.0.0.1" && list.front().port() == 6881);
+  CPPUNIT_ASSERT(list.back().address_str() == "10.0.0.2" && list.back().port() == 51413);
+
+  CPPUNIT_ASSERT_THROW(list.parse_address_normal(torrent::raw_bencode::from_c_str("ld2:ip8:10.0.0.1e").as_raw_list()),
+                       torrent::bencode_error);
+}
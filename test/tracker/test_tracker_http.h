@@ -5,8 +5,14 @@
 class test_tracker_http : public test_fixture {
   CPPUNIT_TEST_SUITE(test_tracker_http);
   CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_buffer);
+  CPPUNIT_TEST(test_buffer_pool);
+  CPPUNIT_TEST(test_address_normal);
   CPPUNIT_TEST_SUITE_END();
 
 public:
   void test_basic();
+  void test_buffer();
+  void test_buffer_pool();
+  void test_address_normal();
 };
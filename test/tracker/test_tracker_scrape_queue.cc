@@ -0,0 +1,242 @@
+#include "config.h"
+
+#include "test_tracker_scrape_queue.h"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "torrent/http.h"
+#include "torrent/object.h"
+#include "tracker/tracker_scrape_queue.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_tracker_scrape_queue, "tracker");
+
+class scrape_http : public torrent::Http {
+public:
+  static std::vector<scrape_http*> created;
+  static std::string               start_failure;
+
+  ~scrape_http() { created.erase(std::find(created.begin(), created.end(), this)); }
+
+  void start() {
+    if (start_failure.empty())
+      m_active = true;
+    else
+      trigger_failed(start_failure);
+  }
+  void close() { m_active = false; }
+
+  bool is_active() const { return m_active; }
+
+  void reply(const std::string& data) { *m_stream << data; trigger_done(); }
+  void fail(const std::string& msg)   { trigger_failed(msg); }
+
+private:
+  bool m_active{false};
+};
+
+std::vector<scrape_http*> scrape_http::created;
+std::string               scrape_http::start_failure;
+
+static torrent::Http*
+create_scrape_http() {
+  scrape_http::created.push_back(new scrape_http);
+  return scrape_http::created.back();
+}
+
+struct scrape_result {
+  int64_t     complete{-1};
+  std::string failed;
+};
+
+static torrent::HashString
+make_hash(char c) {
+  torrent::HashString hash;
+  std::fill(hash.begin(), hash.end(), c);
+  return hash;
+}
+
+static torrent::TrackerScrapeQueue::request_type
+make_request(scrape_result* result, const std::string& url, char c) {
+  return torrent::TrackerScrapeQueue::request_type{
+    result, url, make_hash(c),
+    [result](const torrent::Object& stats) { result->complete = stats.get_key_value("complete"); },
+    [result](const std::string& msg) { result->failed = msg; } };
+}
+
+static size_t
+count_hashes(const std::string& url) {
+  size_t count = 0;
+
+  for (size_t pos = url.find("info_hash="); pos != std::string::npos; pos = url.find("info_hash=", pos + 1))
+    count++;
+
+  return count;
+}
+
+void
+test_tracker_scrape_queue::setUp() {
+  test_fixture::setUp();
+  torrent::Http::slot_factory() = std::bind(&create_scrape_http);
+}
+
+void
+test_tracker_scrape_queue::tearDown() {
+  torrent::Http::slot_factory() = torrent::Http::slot_http();
+  scrape_http::start_failure.clear();
+  test_fixture::tearDown();
+}
+
+void
+test_tracker_scrape_queue::test_batching() {
+  torrent::TrackerScrapeQueue queue;
+  scrape_result results[4];
+
+  queue.insert(make_request(&results[0], "http://a/scrape?", 'a'));
+  queue.insert(make_request(&results[1], "http://a/scrape?", 'b'));
+  queue.insert(make_request(&results[2], "http://b/scrape?key=1&", 'c'));
+  queue.insert(make_request(&results[3], "http://a/scrape?", 'd'));
+
+  CPPUNIT_ASSERT(queue.size() == 4);
+  CPPUNIT_ASSERT(queue.size_batches() == 2);
+  CPPUNIT_ASSERT(scrape_http::created.empty());
+  CPPUNIT_ASSERT_THROW(queue.insert(make_request(&results[0], "http://a/scrape?", 'a')), torrent::internal_error);
+
+  queue.flush();
+
+  CPPUNIT_ASSERT(scrape_http::created.size() == 2);
+  CPPUNIT_ASSERT(scrape_http::created[0]->is_active());
+  CPPUNIT_ASSERT(scrape_http::created[0]->url() == "http://a/scrape?info_hash=aaaaaaaaaaaaaaaaaaaa"
+                 "&info_hash=bbbbbbbbbbbbbbbbbbbb&info_hash=dddddddddddddddddddd");
+  CPPUNIT_ASSERT(scrape_http::created[1]->url() == "http://b/scrape?key=1&info_hash=cccccccccccccccccccc");
+
+  // Batches already sent don't take new requests.
+  scrape_result late;
+  queue.insert(make_request(&late, "http://a/scrape?", 'e'));
+  CPPUNIT_ASSERT(queue.size_batches() == 3);
+
+  queue.clear();
+  CPPUNIT_ASSERT(queue.empty());
+  CPPUNIT_ASSERT(scrape_http::created.empty());
+}
+
+void
+test_tracker_scrape_queue::test_max_hashes() {
+  torrent::TrackerScrapeQueue queue;
+  std::vector<scrape_result> results(torrent::TrackerScrapeQueue::max_hashes + 1);
+
+  for (unsigned int i = 0; i < results.size(); i++)
+    queue.insert(make_request(&results[i], "http://a/scrape?", 'a' + i % 26));
+
+  CPPUNIT_ASSERT(queue.size_batches() == 2);
+
+  queue.flush();
+
+  CPPUNIT_ASSERT(scrape_http::created.size() == 2);
+  CPPUNIT_ASSERT(count_hashes(scrape_http::created[0]->url()) == torrent::TrackerScrapeQueue::max_hashes);
+  CPPUNIT_ASSERT(count_hashes(scrape_http::created[1]->url()) == 1);
+}
+
+void
+test_tracker_scrape_queue::test_reply() {
+  torrent::TrackerScrapeQueue queue;
+  scrape_result results[3];
+
+  queue.insert(make_request(&results[0], "http://a/scrape?", 'a'));
+  queue.insert(make_request(&results[1], "http://a/scrape?", 'b'));
+  queue.insert(make_request(&results[2], "http://a/scrape?", 'c'));
+  queue.flush();
+
+  scrape_http::created[0]->reply("d5:filesd"
+                                 "20:aaaaaaaaaaaaaaaaaaaad8:completei5e10:incompletei1ee"
+                                 "20:bbbbbbbbbbbbbbbbbbbbd8:completei7e10:incompletei2ee"
+                                 "ee");
+
+  CPPUNIT_ASSERT(queue.empty() && queue.size_batches() == 0);
+  CPPUNIT_ASSERT(scrape_http::created.empty());
+
+  CPPUNIT_ASSERT(results[0].complete == 5 && results[0].failed.empty());
+  CPPUNIT_ASSERT(results[1].complete == 7 && results[1].failed.empty());
+  CPPUNIT_ASSERT(results[2].complete == -1 && !results[2].failed.empty());
+}
+
+void
+test_tracker_scrape_queue::test_failed() {
+  torrent::TrackerScrapeQueue queue;
+  scrape_result results[3];
+
+  queue.insert(make_request(&results[0], "http://a/scrape?", 'a'));
+  queue.insert(make_request(&results[1], "http://a/scrape?", 'b'));
+  queue.insert(make_request(&results[2], "http://b/scrape?", 'c'));
+  queue.flush();
+
+  scrape_http::created[0]->fail("timeout");
+
+  CPPUNIT_ASSERT(results[0].failed == "timeout");
+  CPPUNIT_ASSERT(results[1].failed == "timeout");
+  CPPUNIT_ASSERT(results[2].failed.empty());
+  CPPUNIT_ASSERT(queue.size() == 1);
+
+  scrape_http::created[0]->reply("d14:failure reason4:nopee");
+
+  CPPUNIT_ASSERT(results[2].failed == "Failure reason \"nope\"");
+  CPPUNIT_ASSERT(queue.empty());
+}
+
+void
+test_tracker_scrape_queue::test_erase() {
+  torrent::TrackerScrapeQueue queue;
+  scrape_result results[3];
+
+  queue.insert(make_request(&results[0], "http://a/scrape?", 'a'));
+  queue.insert(make_request(&results[1], "http://a/scrape?", 'b'));
+
+  queue.erase(&results[0]);
+  queue.erase(&results[0]);
+  CPPUNIT_ASSERT(queue.size() == 1);
+  CPPUNIT_ASSERT(!queue.is_queued(&results[0]));
+
+  queue.flush();
+  CPPUNIT_ASSERT(count_hashes(scrape_http::created[0]->url()) == 1);
+
+  // Erasing the last request of a sent batch cancels the request.
+  queue.insert(make_request(&results[2], "http://a/scrape?", 'c'));
+  queue.erase(&results[1]);
+
+  CPPUNIT_ASSERT(scrape_http::created.empty());
+  CPPUNIT_ASSERT(queue.size() == 1 && queue.size_batches() == 1);
+
+  queue.flush();
+  scrape_http::created[0]->reply("d5:filesd20:ccccccccccccccccccccd8:completei3eeee");
+
+  CPPUNIT_ASSERT(results[0].complete == -1 && results[0].failed.empty());
+  CPPUNIT_ASSERT(results[1].complete == -1 && results[1].failed.empty());
+  CPPUNIT_ASSERT(results[2].complete == 3);
+}
+
+// A batch failing from within 'start()' is removed during flush, and
+// its slots may erase other batches.
+void
+test_tracker_scrape_queue::test_failed_start() {
+  torrent::TrackerScrapeQueue queue;
+  scrape_result results[3];
+
+  auto request = make_request(&results[0], "http://a/scrape?", 'a');
+  request.failed = [&](const std::string& msg) { results[0].failed = msg; queue.erase(&results[1]); };
+
+  queue.insert(request);
+  queue.insert(make_request(&results[1], "http://b/scrape?", 'b'));
+  queue.insert(make_request(&results[2], "http://c/scrape?", 'c'));
+  CPPUNIT_ASSERT(queue.size_batches() == 3);
+
+  scrape_http::start_failure = "refused";
+  queue.flush();
+
+  CPPUNIT_ASSERT(results[0].failed == "refused");
+  CPPUNIT_ASSERT(results[1].failed.empty());
+  CPPUNIT_ASSERT(results[2].failed == "refused");
+  CPPUNIT_ASSERT(queue.empty() && queue.size_batches() == 0);
+  CPPUNIT_ASSERT(scrape_http::created.empty());
+}
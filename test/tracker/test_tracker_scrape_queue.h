@@ -0,0 +1,25 @@
+#include "helpers/test_fixture.h"
+
+class test_tracker_scrape_queue : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_tracker_scrape_queue);
+
+  CPPUNIT_TEST(test_batching);
+  CPPUNIT_TEST(test_max_hashes);
+  CPPUNIT_TEST(test_reply);
+  CPPUNIT_TEST(test_failed);
+  CPPUNIT_TEST(test_erase);
+  CPPUNIT_TEST(test_failed_start);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void test_batching();
+  void test_max_hashes();
+  void test_reply();
+  void test_failed();
+  void test_erase();
+  void test_failed_start();
+};
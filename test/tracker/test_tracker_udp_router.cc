@@ -0,0 +1,302 @@
+#include "config.h"
+
+#include "test_tracker_udp_router.h"
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "globals.h"
+#include "torrent/event.h"
+#include "torrent/poll_epoll.h"
+#include "tracker/tracker_udp_router.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_tracker_udp_router, "tracker");
+
+static rak::socket_address
+make_address(const char* str, uint16_t port) {
+  rak::socket_address sa;
+  sa.set_address_c_str(str);
+  sa.set_port(port);
+  return sa;
+}
+
+static std::string
+make_header(uint32_t action, uint32_t id) {
+  uint32_t values[2] = { htonl(action), htonl(id) };
+  return std::string(reinterpret_cast<const char*>(values), sizeof(values));
+}
+
+static uint32_t
+read_32(const std::string& data, size_t offset) {
+  uint32_t value;
+  std::memcpy(&value, data.data() + offset, sizeof(uint32_t));
+  return ntohl(value);
+}
+
+static bool
+wait_readable(int fd) {
+  pollfd pfd = { fd, POLLIN, 0 };
+  return ::poll(&pfd, 1, 1000) == 1;
+}
+
+// Minimal stand-in for a UDP tracker on the loopback interface.
+struct stand_in_tracker {
+  stand_in_tracker() {
+    fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+
+    sockaddr_in sin;
+    std::memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t length = sizeof(sin);
+
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&sin), sizeof(sin)) != 0 ||
+        ::getsockname(fd, reinterpret_cast<sockaddr*>(&sin), &length) != 0)
+      CPPUNIT_FAIL("could not bind stand-in tracker");
+
+    port = ntohs(sin.sin_port);
+  }
+
+  ~stand_in_tracker() { ::close(fd); }
+
+  bool receive(std::string* data) {
+    if (!wait_readable(fd))
+      return false;
+
+    char buffer[2048];
+    socklen_t length = sizeof(from);
+    ssize_t s = ::recvfrom(fd, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&from), &length);
+
+    if (s < 0)
+      return false;
+
+    data->assign(buffer, s);
+    return true;
+  }
+
+  void reply(const std::string& data) {
+    ::sendto(fd, data.data(), data.size(), 0, reinterpret_cast<sockaddr*>(&from), sizeof(from));
+  }
+
+  int         fd;
+  uint16_t    port;
+  sockaddr_in from;
+};
+
+void
+test_tracker_udp_router::tearDown() {
+  torrent::cachedTime = rak::timer::current();
+  test_fixture::tearDown();
+}
+
+void
+test_tracker_udp_router::test_connection_id_cache() {
+  torrent::cachedTime = rak::timer::from_seconds(1000000);
+
+  torrent::TrackerUdpRouter router;
+  rak::socket_address tracker_1 = make_address("1.2.3.4", 6969);
+  rak::socket_address tracker_2 = make_address("1.2.3.4", 6970);
+  uint64_t id = 0;
+
+  CPPUNIT_ASSERT(!router.find_connection_id(tracker_1, &id));
+
+  router.insert_connection_id(tracker_1, 0x1234);
+  CPPUNIT_ASSERT(router.find_connection_id(tracker_1, &id) && id == 0x1234);
+  CPPUNIT_ASSERT(!router.find_connection_id(tracker_2, &id));
+
+  // IPv4 trackers seen through dual stack sockets share the entry.
+  rak::socket_address mapped;
+  *mapped.sa_inet6() = tracker_1.sa_inet()->to_mapped_address();
+  CPPUNIT_ASSERT(router.find_connection_id(mapped, &id) && id == 0x1234);
+
+  torrent::cachedTime += rak::timer::from_seconds(torrent::TrackerUdpRouter::connection_id_lifetime - 1);
+  CPPUNIT_ASSERT(router.find_connection_id(tracker_1, &id));
+
+  torrent::cachedTime += rak::timer::from_seconds(1);
+  CPPUNIT_ASSERT(!router.find_connection_id(tracker_1, &id));
+  CPPUNIT_ASSERT(router.size_connection_ids() == 0);
+
+  router.insert_connection_id(tracker_2, 0x5678);
+  router.erase_connection_id(tracker_2);
+  CPPUNIT_ASSERT(!router.find_connection_id(tracker_2, &id));
+}
+
+void
+test_tracker_udp_router::test_transactions() {
+  torrent::TrackerUdpEndpoint endpoint(NULL);
+  rak::socket_address tracker = make_address("1.2.3.4", 6969);
+  std::vector<std::string> received_1;
+  std::vector<std::string> received_2;
+
+  uint32_t id_1 = endpoint.insert_transaction(tracker, [&](const char* data, unsigned int length) {
+      received_1.emplace_back(data, length);
+    });
+  uint32_t id_2 = endpoint.insert_transaction(tracker, [&](const char* data, unsigned int length) {
+      received_2.emplace_back(data, length);
+    });
+
+  CPPUNIT_ASSERT(id_1 != 0 && id_2 != 0 && id_1 != id_2);
+  CPPUNIT_ASSERT(endpoint.size_transactions() == 2);
+
+  std::string reply_2 = make_header(0, id_2) + std::string(8, 'x');
+  endpoint.receive_datagram(reply_2.data(), reply_2.size(), tracker);
+
+  CPPUNIT_ASSERT(received_1.empty() && received_2.size() == 1 && received_2[0] == reply_2);
+
+  // Too short, unknown id and wrong source are dropped.
+  endpoint.receive_datagram(reply_2.data(), 7, tracker);
+  std::string unknown = make_header(0, id_1 ^ id_2 ^ 1);
+  endpoint.receive_datagram(unknown.data(), unknown.size(), tracker);
+  std::string reply_1 = make_header(1, id_1);
+  endpoint.receive_datagram(reply_1.data(), reply_1.size(), make_address("1.2.3.4", 6970));
+  endpoint.receive_datagram(reply_1.data(), reply_1.size(), make_address("4.3.2.1", 6969));
+
+  CPPUNIT_ASSERT(received_1.empty() && received_2.size() == 1);
+
+  endpoint.receive_datagram(reply_1.data(), reply_1.size(), tracker);
+  CPPUNIT_ASSERT(received_1.size() == 1);
+
+  endpoint.erase_transaction(id_1);
+  endpoint.receive_datagram(reply_1.data(), reply_1.size(), tracker);
+  CPPUNIT_ASSERT(received_1.size() == 1 && endpoint.size_transactions() == 1);
+
+  endpoint.send(id_2, reply_2.data(), reply_2.size());
+  endpoint.send(id_2, reply_2.data(), reply_2.size());
+  CPPUNIT_ASSERT(endpoint.size_queued() == 1);
+
+  endpoint.erase_transaction(id_2);
+  CPPUNIT_ASSERT(endpoint.size_queued() == 0 && endpoint.is_idle());
+}
+
+// Two transactions to the same tracker share the endpoint's socket
+// and get their own replies.
+void
+test_tracker_udp_router::test_exchange() {
+  stand_in_tracker stand_in;
+
+  torrent::TrackerUdpEndpoint endpoint(NULL);
+  CPPUNIT_ASSERT(endpoint.open(make_address("127.0.0.1", 0)));
+
+  rak::socket_address tracker = make_address("127.0.0.1", stand_in.port);
+  std::string received_1;
+  std::string received_2;
+
+  uint32_t id_1 = endpoint.insert_transaction(tracker, [&](const char* data, unsigned int length) { received_1.assign(data, length); });
+  uint32_t id_2 = endpoint.insert_transaction(tracker, [&](const char* data, unsigned int length) { received_2.assign(data, length); });
+
+  std::string request_1 = std::string(8, '\0') + make_header(0, id_1);
+  std::string request_2 = std::string(8, '\0') + make_header(0, id_2);
+
+  endpoint.send(id_1, request_1.data(), request_1.size());
+  endpoint.send(id_2, request_2.data(), request_2.size());
+  endpoint.event_write();
+
+  CPPUNIT_ASSERT(endpoint.size_queued() == 0);
+
+  std::string request;
+
+  for (int i = 0; i < 2; i++) {
+    CPPUNIT_ASSERT(stand_in.receive(&request));
+    CPPUNIT_ASSERT(request.size() == 16 && read_32(request, 8) == 0);
+
+    // Reply with the transaction id as the connection id.
+    stand_in.reply(make_header(0, read_32(request, 12)) + make_header(0, read_32(request, 12)));
+  }
+
+  for (int i = 0; i < 2 && (received_1.empty() || received_2.empty()); i++) {
+    CPPUNIT_ASSERT(wait_readable(endpoint.file_descriptor()));
+    endpoint.event_read();
+  }
+
+  CPPUNIT_ASSERT(received_1.size() == 16 && read_32(received_1, 4) == id_1 && read_32(received_1, 12) == id_1);
+  CPPUNIT_ASSERT(received_2.size() == 16 && read_32(received_2, 4) == id_2 && read_32(received_2, 12) == id_2);
+
+  endpoint.close();
+  CPPUNIT_ASSERT(!endpoint.get_fd().is_valid() && endpoint.is_idle());
+}
+
+void
+test_tracker_udp_router::test_send_budget() {
+  torrent::cachedTime = rak::timer::from_seconds(1000000);
+
+  stand_in_tracker stand_in;
+
+  torrent::TrackerUdpEndpoint endpoint(NULL);
+  CPPUNIT_ASSERT(endpoint.open(make_address("127.0.0.1", 0)));
+
+  endpoint.set_send_budget(2);
+
+  rak::socket_address tracker = make_address("127.0.0.1", stand_in.port);
+  auto ignore = [](const char*, unsigned int) {};
+
+  for (int i = 0; i < 3; i++) {
+    uint32_t id = endpoint.insert_transaction(tracker, ignore);
+    std::string request = std::string(8, '\0') + make_header(0, id);
+
+    endpoint.send(id, request.data(), request.size());
+  }
+
+  endpoint.event_write();
+  CPPUNIT_ASSERT(endpoint.size_queued() == 1);
+
+  endpoint.event_write();
+  CPPUNIT_ASSERT(endpoint.size_queued() == 1);
+
+  std::string request;
+  CPPUNIT_ASSERT(stand_in.receive(&request));
+  CPPUNIT_ASSERT(stand_in.receive(&request));
+
+  torrent::cachedTime += rak::timer::from_seconds(1);
+
+  endpoint.event_write();
+  CPPUNIT_ASSERT(endpoint.size_queued() == 0);
+  CPPUNIT_ASSERT(stand_in.receive(&request));
+}
+
+// Replies left after the per-event limit must still be read when the
+// socket is edge-triggered and nothing new arrives.
+void
+test_tracker_udp_router::test_read_limit() {
+  std::unique_ptr<torrent::PollEPoll> poll(torrent::PollEPoll::create(256));
+
+  if (poll == nullptr)
+    return;
+
+  poll->set_flags(torrent::Poll::flag_edge_triggered);
+
+  stand_in_tracker stand_in;
+  torrent::TrackerUdpEndpoint endpoint(poll.get());
+  CPPUNIT_ASSERT(endpoint.open(make_address("127.0.0.1", 0)));
+
+  rak::socket_address tracker = make_address("127.0.0.1", stand_in.port);
+  unsigned int received = 0;
+
+  uint32_t id = endpoint.insert_transaction(tracker, [&](const char*, unsigned int) { received++; });
+  std::string request = std::string(8, '\0') + make_header(0, id);
+
+  endpoint.send(id, request.data(), request.size());
+  endpoint.event_write();
+  CPPUNIT_ASSERT(stand_in.receive(&request));
+
+  const unsigned int replies = torrent::TrackerUdpEndpoint::max_reads_per_event + 8;
+
+  for (unsigned int i = 0; i < replies; i++)
+    stand_in.reply(make_header(0, id));
+
+  CPPUNIT_ASSERT(poll->poll(1000) > 0);
+  poll->perform();
+  CPPUNIT_ASSERT(received == torrent::TrackerUdpEndpoint::max_reads_per_event);
+
+  poll->poll(0);
+  poll->perform();
+  CPPUNIT_ASSERT(received == replies);
+
+  endpoint.close();
+}
@@ -0,0 +1,22 @@
+#include "helpers/test_fixture.h"
+
+class test_tracker_udp_router : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_tracker_udp_router);
+
+  CPPUNIT_TEST(test_connection_id_cache);
+  CPPUNIT_TEST(test_transactions);
+  CPPUNIT_TEST(test_exchange);
+  CPPUNIT_TEST(test_send_budget);
+  CPPUNIT_TEST(test_read_limit);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void tearDown();
+
+  void test_connection_id_cache();
+  void test_transactions();
+  void test_exchange();
+  void test_send_budget();
+  void test_read_limit();
+};